@@ -96,6 +96,7 @@ var EvoEditor = {
 	inheritThemeColors : false,
 	checkInheritFontsOnChange : false,
 	forceFormatStateUpdate : false,
+	batchFormattingChanges : null, // collects formatting changes while in RunBatch()
 	formattingState : {
 		mode : -1,
 		anchorElement : null, // to avoid often notifications when just moving within the same node
@@ -158,6 +159,40 @@ EvoEditor.setupPlugins = function(doc)
 	}
 }
 
+// Runs the 'commands' (an array of functions) queued by the editor in one call,
+// reporting the formatting changes they cause as one "formattingChanged" message
+EvoEditor.RunBatch = function(commands)
+{
+	var ii, firstError = null;
+
+	EvoEditor.batchFormattingChanges = {};
+
+	try {
+		for (ii = 0; ii < commands.length; ii++) {
+			try {
+				commands[ii]();
+			} catch (err) {
+				if (firstError === null)
+					firstError = err;
+			}
+		}
+	} finally {
+		var changes = EvoEditor.batchFormattingChanges, key, nchanges = 0;
+
+		EvoEditor.batchFormattingChanges = null;
+
+		for (key in changes) {
+			nchanges++;
+		}
+
+		if (nchanges > 0)
+			window.webkit.messageHandlers.formattingChanged.postMessage(changes);
+	}
+
+	if (firstError !== null)
+		throw firstError;
+}
+
 EvoEditor.maybeUpdateFormattingState = function(force)
 {
 	var anchorElem = null;
@@ -463,8 +498,17 @@ EvoEditor.maybeUpdateFormattingState = function(force)
 		nchanges++;
 	}
 
-	if (nchanges > 0)
-		window.webkit.messageHandlers.formattingChanged.postMessage(changes);
+	if (nchanges > 0) {
+		if (EvoEditor.batchFormattingChanges) {
+			var key;
+
+			for (key in changes) {
+				EvoEditor.batchFormattingChanges[key] = changes[key];
+			}
+		} else {
+			window.webkit.messageHandlers.formattingChanged.postMessage(changes);
+		}
+	}
 }
 
 EvoEditor.IsBlockNode = function(node)
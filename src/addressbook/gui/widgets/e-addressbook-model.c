@@ -40,6 +40,7 @@ struct _EAddressbookModelPrivate {
 
 	/* Query Results */
 	GPtrArray *contacts;
+	GHashTable *contacts_index; /* const gchar *uid ~> index + 1 into contacts */
 
 	/* Signal Handler IDs */
 	gulong create_contact_id;
@@ -87,10 +88,41 @@ free_data (EAddressbookModel *model)
 	GPtrArray *array;
 
 	array = model->priv->contacts;
+	g_hash_table_remove_all (model->priv->contacts_index);
 	g_ptr_array_foreach (array, (GFunc) g_object_unref, NULL);
 	g_ptr_array_set_size (array, 0);
 }
 
+/* The index keys are the UID strings owned by the contacts themselves,
+ * thus any replaced contact needs to be re-indexed. */
+static void
+contacts_index_set (EAddressbookModel *model,
+                    EContact *contact,
+                    guint index)
+{
+	const gchar *uid;
+
+	uid = e_contact_get_const (contact, E_CONTACT_UID);
+	if (uid)
+		g_hash_table_replace (model->priv->contacts_index, (gpointer) uid, GUINT_TO_POINTER (index + 1));
+}
+
+static gint
+contacts_index_lookup (EAddressbookModel *model,
+                       const gchar *uid)
+{
+	gpointer value;
+
+	if (!uid)
+		return -1;
+
+	value = g_hash_table_lookup (model->priv->contacts_index, uid);
+	if (!value)
+		return -1;
+
+	return GPOINTER_TO_UINT (value) - 1;
+}
+
 static void
 remove_book_view (EAddressbookModel *model)
 {
@@ -160,6 +192,13 @@ view_create_contact_cb (EBookClientView *client_view,
 
 	while (contact_list != NULL) {
 		EContact *contact = contact_list->data;
+		const gchar *uid;
+
+		uid = e_contact_get_const (contact, E_CONTACT_UID);
+
+		/* Keep the first contact of the same UID indexed */
+		if (uid && !g_hash_table_contains (model->priv->contacts_index, uid))
+			contacts_index_set (model, contact, array->len);
 
 		g_ptr_array_add (array, g_object_ref (contact));
 		contact_list = contact_list->next;
@@ -184,51 +223,55 @@ view_remove_contact_cb (EBookClientView *client_view,
                         const GSList *ids,
                         EAddressbookModel *model)
 {
-	/* XXX we should keep a hash around instead of this O(n*m) loop */
 	const GSList *iter;
 	GArray *indices;
 	GPtrArray *array;
-	gint ii;
+	guint ii, jj;
 
 	array = model->priv->contacts;
 	indices = g_array_new (FALSE, FALSE, sizeof (gint));
 
 	for (iter = ids; iter != NULL; iter = iter->next) {
 		const gchar *target_uid = iter->data;
+		EContact *contact;
+		gint index;
+
+		index = contacts_index_lookup (model, target_uid);
+		if (index < 0)
+			continue;
+
+		contact = array->pdata[index];
+		g_hash_table_remove (model->priv->contacts_index, target_uid);
+		g_object_unref (contact);
+		g_array_append_val (indices, index);
+		array->pdata[index] = NULL;
+	}
 
-		for (ii = 0; ii < array->len; ii++) {
-			EContact *contact;
-			const gchar *uid;
+	/* Compact the array in one pass and fix the index
+	 * of the contacts which had been moved. */
+	if (indices->len > 0) {
+		for (ii = 0, jj = 0; ii < array->len; ii++) {
+			EContact *contact = array->pdata[ii];
 
-			contact = array->pdata[ii];
-			/* check if already removed */
 			if (!contact)
 				continue;
 
-			uid = e_contact_get_const (contact, E_CONTACT_UID);
-			g_return_if_fail (uid != NULL);
-
-			if (strcmp (uid, target_uid) == 0) {
-				g_object_unref (contact);
-				g_array_append_val (indices, ii);
-				array->pdata[ii] = NULL;
-				break;
+			/* This also indexes a contact with a duplicate UID,
+			 * which always follows the removed one. */
+			if (ii != jj) {
+				array->pdata[jj] = contact;
+				contacts_index_set (model, contact, jj);
 			}
+
+			jj++;
 		}
+
+		g_ptr_array_set_size (array, jj);
 	}
 
-	/* Sort the 'indices' array in descending order, since
-	 * g_ptr_array_remove_index() shifts subsequent elements
-	 * down one position to fill the gap. */
+	/* Listeners expect the indices in descending order. */
 	g_array_sort (indices, sort_descending);
 
-	for (ii = 0; ii < indices->len; ii++) {
-		gint index;
-
-		index = g_array_index (indices, gint, ii);
-		g_ptr_array_remove_index (array, index);
-	}
-
 	g_signal_emit (model, signals[CONTACTS_REMOVED], 0, indices);
 	g_array_free (indices, TRUE);
 
@@ -247,36 +290,22 @@ view_modify_contact_cb (EBookClientView *client_view,
 	while (contact_list != NULL) {
 		EContact *new_contact = contact_list->data;
 		const gchar *target_uid;
-		gint ii;
+		gint index;
 
 		target_uid = e_contact_get_const (new_contact, E_CONTACT_UID);
 		g_warn_if_fail (target_uid != NULL);
 
-		/* skip contacts without UID */
-		if (!target_uid) {
-			contact_list = contact_list->next;
-			continue;
-		}
-
-		for (ii = 0; ii < array->len; ii++) {
-			EContact *old_contact;
-			const gchar *uid;
-
-			old_contact = array->pdata[ii];
-			g_return_if_fail (old_contact != NULL);
+		index = contacts_index_lookup (model, target_uid);
 
-			uid = e_contact_get_const (old_contact, E_CONTACT_UID);
-			g_return_if_fail (uid != NULL);
-
-			if (strcmp (uid, target_uid) != 0)
-				continue;
+		if (index >= 0) {
+			EContact *old_contact = array->pdata[index];
 
+			array->pdata[index] = e_contact_duplicate (new_contact);
+			contacts_index_set (model, array->pdata[index], index);
 			g_object_unref (old_contact);
-			array->pdata[ii] = e_contact_duplicate (new_contact);
 
 			g_signal_emit (
-				model, signals[CONTACT_CHANGED], 0, ii);
-			break;
+				model, signals[CONTACT_CHANGED], 0, index);
 		}
 
 		contact_list = contact_list->next;
@@ -575,6 +604,7 @@ addressbook_model_finalize (GObject *object)
 {
 	EAddressbookModel *self = E_ADDRESSBOOK_MODEL (object);
 
+	g_hash_table_destroy (self->priv->contacts_index);
 	g_ptr_array_free (self->priv->contacts, TRUE);
 
 	/* Chain up to parent's finalize() method. */
@@ -779,6 +809,7 @@ e_addressbook_model_init (EAddressbookModel *model)
 {
 	model->priv = e_addressbook_model_get_instance_private (model);
 	model->priv->contacts = g_ptr_array_new ();
+	model->priv->contacts_index = g_hash_table_new (g_str_hash, g_str_equal);
 	model->priv->first_get_view = TRUE;
 }
 
@@ -866,20 +897,18 @@ gint
 e_addressbook_model_find (EAddressbookModel *model,
                           EContact *contact)
 {
-	GPtrArray *array;
-	gint ii;
+	const gchar *uid;
+	guint index;
 
 	g_return_val_if_fail (E_IS_ADDRESSBOOK_MODEL (model), -1);
 	g_return_val_if_fail (E_IS_CONTACT (contact), -1);
 
-	array = model->priv->contacts;
-	for (ii = 0; ii < array->len; ii++) {
-		EContact *candidate = array->pdata[ii];
+	uid = e_contact_get_const (contact, E_CONTACT_UID);
+	if (uid)
+		return contacts_index_lookup (model, uid);
 
-		if (contact == candidate ||
-		    g_strcmp0 (e_contact_get_const (contact, E_CONTACT_UID), e_contact_get_const (candidate, E_CONTACT_UID)) == 0)
-			return ii;
-	}
+	if (g_ptr_array_find (model->priv->contacts, contact, &index))
+		return index;
 
 	return -1;
 }
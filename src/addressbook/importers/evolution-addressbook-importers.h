@@ -18,6 +18,8 @@
  */
 
 #include <gtk/gtk.h>
+#include <libebook/libebook.h>
+#include <e-util/e-util.h>
 
 struct _EImportImporter *evolution_ldif_importer_peek (void);
 struct _EImportImporter *evolution_vcard_importer_peek (void);
@@ -27,3 +29,35 @@ struct _EImportImporter *evolution_csv_evolution_importer_peek (void);
 
 /* private utility function for importers only */
 GtkWidget *evolution_contact_importer_get_preview_widget (const GSList *contacts);
+
+typedef struct _EvolutionContactImporter EvolutionContactImporter;
+
+/* Parses the source and adds the contacts with evolution_contact_importer_add();
+ * it runs in a dedicated thread */
+typedef gboolean (* EvolutionContactImporterFunc)
+					(EvolutionContactImporter *importer,
+					 gpointer user_data,
+					 GCancellable *cancellable,
+					 GError **error);
+
+EvolutionContactImporter *
+		evolution_contact_importer_new	(EImport *import,
+						 EImportTarget *target,
+						 EBookClient *book_client);
+void		evolution_contact_importer_run	(EvolutionContactImporter *importer,
+						 EvolutionContactImporterFunc func,
+						 gpointer user_data,
+						 GDestroyNotify user_data_free);
+void		evolution_contact_importer_cancel
+						(EvolutionContactImporter *importer);
+gboolean	evolution_contact_importer_add	(EvolutionContactImporter *importer,
+						 EContact *contact,
+						 GCancellable *cancellable,
+						 GError **error);
+gboolean	evolution_contact_importer_flush
+						(EvolutionContactImporter *importer,
+						 GCancellable *cancellable,
+						 GError **error);
+void		evolution_contact_importer_set_progress
+						(EvolutionContactImporter *importer,
+						 gint percent);
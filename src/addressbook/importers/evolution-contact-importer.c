@@ -0,0 +1,340 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Shared core of the contact importers. The importer's function parses
+ * the source in a dedicated thread and hands over the contacts, which are
+ * added into the book in batches, thus the UI is not blocked by the import
+ * and there are no D-Bus round trips per contact. */
+
+#include "evolution-config.h"
+
+#include <glib/gi18n.h>
+
+#include <e-util/e-util.h>
+
+#include "evolution-addressbook-importers.h"
+
+#define DEFAULT_BATCH_SIZE 100
+
+struct _EvolutionContactImporter {
+	EImport *import;
+	EImportTarget *target;
+	EBookClient *book_client;
+	GCancellable *cancellable;
+
+	EvolutionContactImporterFunc func;
+	gpointer user_data;
+	GDestroyNotify user_data_free;
+
+	guint batch_size;
+	GSList *batch; /* EContact *, in reverse order */
+	guint batch_len;
+
+	gint percent; /* atomic */
+	gint status_scheduled; /* atomic */
+};
+
+EvolutionContactImporter *
+evolution_contact_importer_new (EImport *import,
+                                EImportTarget *target,
+                                EBookClient *book_client)
+{
+	EvolutionContactImporter *importer;
+	GSettings *settings;
+	gint batch_size;
+
+	g_return_val_if_fail (E_IS_IMPORT (import), NULL);
+	g_return_val_if_fail (target != NULL, NULL);
+	g_return_val_if_fail (E_IS_BOOK_CLIENT (book_client), NULL);
+
+	settings = e_util_ref_settings ("org.gnome.evolution.addressbook");
+	batch_size = g_settings_get_int (settings, "import-batch-size");
+	g_object_unref (settings);
+
+	importer = g_slice_new0 (EvolutionContactImporter);
+	importer->import = g_object_ref (import);
+	importer->target = target;
+	importer->book_client = g_object_ref (book_client);
+	importer->cancellable = g_cancellable_new ();
+	importer->batch_size = batch_size > 0 ? batch_size : DEFAULT_BATCH_SIZE;
+
+	return importer;
+}
+
+static void
+contact_importer_free (EvolutionContactImporter *importer)
+{
+	if (importer->user_data_free)
+		importer->user_data_free (importer->user_data);
+
+	g_slist_free_full (importer->batch, g_object_unref);
+	g_clear_object (&importer->import);
+	g_clear_object (&importer->book_client);
+	g_clear_object (&importer->cancellable);
+	g_slice_free (EvolutionContactImporter, importer);
+}
+
+/**
+ * evolution_contact_importer_flush:
+ * @importer: an #EvolutionContactImporter
+ * @cancellable: a #GCancellable
+ * @error: return location for a #GError, or %NULL
+ *
+ * Adds all the pending contacts into the book. The added contacts have
+ * set their UID after this. When the book refuses the batch, the contacts
+ * are added one by one and those the book refuses are skipped. Called only
+ * from the importer's function.
+ *
+ * Returns: whether succeeded
+ **/
+gboolean
+evolution_contact_importer_flush (EvolutionContactImporter *importer,
+                                  GCancellable *cancellable,
+                                  GError **error)
+{
+	GSList *contacts, *added_uids = NULL, *link, *uid_link;
+	gboolean success;
+	GError *local_error = NULL;
+
+	g_return_val_if_fail (importer != NULL, FALSE);
+
+	if (!importer->batch)
+		return TRUE;
+
+	contacts = g_slist_reverse (importer->batch);
+	importer->batch = NULL;
+	importer->batch_len = 0;
+
+	success = e_book_client_add_contacts_sync (
+		importer->book_client, contacts, E_BOOK_OPERATION_FLAG_NONE,
+		&added_uids, cancellable, &local_error);
+
+	if (success) {
+		for (link = contacts, uid_link = added_uids;
+		     link && uid_link;
+		     link = g_slist_next (link), uid_link = g_slist_next (uid_link)) {
+			if (uid_link->data)
+				e_contact_set (link->data, E_CONTACT_UID, uid_link->data);
+		}
+	} else if (g_error_matches (local_error, E_CLIENT_ERROR, E_CLIENT_ERROR_NOT_SUPPORTED) ||
+		   g_error_matches (local_error, E_CLIENT_ERROR, E_CLIENT_ERROR_INVALID_ARG) ||
+		   g_error_matches (local_error, E_BOOK_CLIENT_ERROR, E_BOOK_CLIENT_ERROR_CONTACT_ID_ALREADY_EXISTS)) {
+		gboolean any_added = FALSE;
+
+		/* One bad contact fails the whole batch and these errors
+		 * mean the book stored none of them; find the bad one by
+		 * adding the contacts one by one and skip those which fail.
+		 * Other errors can come after part of the batch had been
+		 * stored, where the fallback would import contacts twice. */
+		for (link = contacts; link && !g_cancellable_is_cancelled (cancellable); link = g_slist_next (link)) {
+			gchar *added_uid = NULL;
+			GError *contact_error = NULL;
+
+			if (e_book_client_add_contact_sync (importer->book_client, link->data,
+				E_BOOK_OPERATION_FLAG_NONE, &added_uid, cancellable, &contact_error)) {
+				if (added_uid)
+					e_contact_set (link->data, E_CONTACT_UID, added_uid);
+				any_added = TRUE;
+			} else if (contact_error) {
+				g_debug ("%s: Skipping contact: %s", G_STRFUNC, contact_error->message);
+			}
+
+			g_clear_error (&contact_error);
+			g_free (added_uid);
+		}
+
+		if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+			g_clear_error (&local_error);
+		} else if (any_added) {
+			g_clear_error (&local_error);
+			success = TRUE;
+		}
+
+		/* Otherwise the book refused all the contacts, thus stop
+		 * the import with the error of the batch */
+	}
+
+	if (local_error)
+		g_propagate_error (error, local_error);
+
+	g_slist_free_full (added_uids, g_free);
+	g_slist_free_full (contacts, g_object_unref);
+
+	return success;
+}
+
+/**
+ * evolution_contact_importer_add:
+ * @importer: an #EvolutionContactImporter
+ * @contact: an #EContact to add
+ * @cancellable: a #GCancellable
+ * @error: return location for a #GError, or %NULL
+ *
+ * Queues the @contact to be added into the book, flushing the queue
+ * when the batch is full. Called only from the importer's function.
+ *
+ * Returns: whether succeeded
+ **/
+gboolean
+evolution_contact_importer_add (EvolutionContactImporter *importer,
+                                EContact *contact,
+                                GCancellable *cancellable,
+                                GError **error)
+{
+	g_return_val_if_fail (importer != NULL, FALSE);
+	g_return_val_if_fail (E_IS_CONTACT (contact), FALSE);
+
+	importer->batch = g_slist_prepend (importer->batch, g_object_ref (contact));
+	importer->batch_len++;
+
+	if (importer->batch_len < importer->batch_size)
+		return TRUE;
+
+	return evolution_contact_importer_flush (importer, cancellable, error);
+}
+
+static gboolean
+contact_importer_status_idle_cb (gpointer user_data)
+{
+	EvolutionContactImporter *importer = user_data;
+
+	g_atomic_int_set (&importer->status_scheduled, 0);
+
+	e_import_status (
+		importer->import, importer->target, _("Importing…"),
+		g_atomic_int_get (&importer->percent));
+
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * evolution_contact_importer_set_progress:
+ * @importer: an #EvolutionContactImporter
+ * @percent: progress of the import, in percents
+ *
+ * Updates the progress of the import in the UI. Can be called
+ * from any thread.
+ **/
+void
+evolution_contact_importer_set_progress (EvolutionContactImporter *importer,
+                                         gint percent)
+{
+	g_return_if_fail (importer != NULL);
+
+	if (g_atomic_int_get (&importer->percent) == percent)
+		return;
+
+	g_atomic_int_set (&importer->percent, percent);
+
+	/* Coalesce the updates, the thread can be faster than the UI */
+	if (g_atomic_int_compare_and_exchange (&importer->status_scheduled, 0, 1)) {
+		g_idle_add_full (
+			G_PRIORITY_DEFAULT_IDLE,
+			contact_importer_status_idle_cb,
+			importer, NULL);
+	}
+}
+
+/**
+ * evolution_contact_importer_cancel:
+ * @importer: an #EvolutionContactImporter
+ *
+ * Cancels the running import.
+ **/
+void
+evolution_contact_importer_cancel (EvolutionContactImporter *importer)
+{
+	g_return_if_fail (importer != NULL);
+
+	g_cancellable_cancel (importer->cancellable);
+}
+
+static void
+contact_importer_thread (GTask *task,
+                         gpointer source_object,
+                         gpointer task_data,
+                         GCancellable *cancellable)
+{
+	EvolutionContactImporter *importer = task_data;
+	GError *local_error = NULL;
+
+	if (importer->func (importer, importer->user_data, cancellable, &local_error) &&
+	    evolution_contact_importer_flush (importer, cancellable, &local_error))
+		g_task_return_boolean (task, TRUE);
+	else
+		g_task_return_error (task, local_error);
+}
+
+static void
+contact_importer_done_cb (GObject *source_object,
+                          GAsyncResult *result,
+                          gpointer user_data)
+{
+	EvolutionContactImporter *importer = user_data;
+	GError *local_error = NULL;
+
+	g_task_propagate_boolean (G_TASK (result), &local_error);
+
+	if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		g_clear_error (&local_error);
+
+	/* Drop the pending status update, it uses the importer */
+	if (g_atomic_int_get (&importer->status_scheduled))
+		g_source_remove_by_user_data (importer);
+
+	/* Free the user data first, the target can be freed on completion */
+	if (importer->user_data_free) {
+		importer->user_data_free (importer->user_data);
+		importer->user_data_free = NULL;
+	}
+
+	e_import_complete (importer->import, importer->target, local_error);
+
+	contact_importer_free (importer);
+	g_clear_error (&local_error);
+}
+
+/**
+ * evolution_contact_importer_run:
+ * @importer: (transfer full): an #EvolutionContactImporter
+ * @func: a function to parse the source and add the contacts
+ * @user_data: user data for the @func
+ * @user_data_free: (nullable): a function to free the @user_data
+ *
+ * Runs the @func in a dedicated thread and completes the import when
+ * it finishes. The @importer and the @user_data are freed afterwards,
+ * in the main thread.
+ **/
+void
+evolution_contact_importer_run (EvolutionContactImporter *importer,
+                                EvolutionContactImporterFunc func,
+                                gpointer user_data,
+                                GDestroyNotify user_data_free)
+{
+	GTask *task;
+
+	g_return_if_fail (importer != NULL);
+	g_return_if_fail (func != NULL);
+
+	importer->func = func;
+	importer->user_data = user_data;
+	importer->user_data_free = user_data_free;
+
+	task = g_task_new (NULL, importer->cancellable, contact_importer_done_cb, importer);
+	g_task_set_source_tag (task, evolution_contact_importer_run);
+	g_task_set_task_data (task, importer, NULL);
+	g_task_run_in_thread (task, contact_importer_thread);
+	g_object_unref (task);
+}
@@ -53,9 +53,8 @@ typedef struct {
 	EImport *import;
 	EImportTarget *target;
 
-	guint idle_id;
+	gboolean cancelled;	/* while opening book */
 
-	gint state;
 	FILE *file;
 	gulong size;
 	gint count;
@@ -64,8 +63,7 @@ typedef struct {
 	 * file to an index in the known fields array. */
 	GHashTable *fields_map;
 
-	EBookClient *book_client;
-	GSList *contacts;
+	EvolutionContactImporter *contact_importer;
 } CSVImporter;
 
 static gint importer;
@@ -768,35 +766,26 @@ getNextCSVEntry (CSVImporter *gci,
 }
 
 static gboolean
-csv_import_contacts (gpointer d)
+csv_import_contacts_thread (EvolutionContactImporter *importer,
+                            gpointer user_data,
+                            GCancellable *cancellable,
+                            GError **error)
 {
-	CSVImporter *gci = d;
-	EContact *contact = NULL;
+	CSVImporter *gci = user_data;
+	EContact *contact;
+	gboolean success = TRUE;
 
-	while ((contact = getNextCSVEntry (gci, gci->file))) {
-		gchar *uid = NULL;
+	while (success && (contact = getNextCSVEntry (gci, gci->file))) {
+		success = !g_cancellable_set_error_if_cancelled (cancellable, error) &&
+			evolution_contact_importer_add (importer, contact, cancellable, error);
 
-		e_book_client_add_contact_sync (
-			gci->book_client, contact, E_BOOK_OPERATION_FLAG_NONE, &uid, NULL, NULL);
-		if (uid != NULL) {
-			e_contact_set (contact, E_CONTACT_UID, uid);
-			g_free (uid);
-		}
-		gci->contacts = g_slist_prepend (gci->contacts, contact);
-	}
-	if (contact == NULL) {
-		gci->state = 1;
-	}
-	if (gci->state == 1) {
-		csv_import_done (gci);
-		return FALSE;
-	}
-	else {
-		e_import_status (
-			gci->import, gci->target, _("Importing…"),
-			ftell (gci->file) * 100 / gci->size);
-		return TRUE;
+		g_object_unref (contact);
+
+		if (gci->size > 0)
+			evolution_contact_importer_set_progress (importer, ftell (gci->file) * 100 / gci->size);
 	}
+
+	return success;
 }
 
 static void
@@ -911,25 +900,34 @@ csv_supported (EImport *ei,
 }
 
 static void
-csv_import_done (CSVImporter *gci)
+csv_importer_free (gpointer ptr)
 {
-	if (gci->idle_id)
-		g_source_remove (gci->idle_id);
+	CSVImporter *gci = ptr;
+
+	g_datalist_set_data (&gci->target->data, "csv-data", NULL);
 
 	fclose (gci->file);
-	g_object_unref (gci->book_client);
-	g_slist_foreach (gci->contacts, (GFunc) g_object_unref, NULL);
-	g_slist_free (gci->contacts);
 
 	if (gci->fields_map)
 		g_hash_table_destroy (gci->fields_map);
 
-	e_import_complete (gci->import, gci->target, NULL);
 	g_object_unref (gci->import);
 
 	g_free (gci);
 }
 
+static void
+csv_import_done (CSVImporter *gci)
+{
+	EImport *import = g_object_ref (gci->import);
+	EImportTarget *target = gci->target;
+
+	csv_importer_free (gci);
+
+	e_import_complete (import, target, NULL);
+	g_object_unref (import);
+}
+
 static void
 book_client_connect_cb (GObject *source_object,
                         GAsyncResult *result,
@@ -940,13 +938,16 @@ book_client_connect_cb (GObject *source_object,
 
 	client = e_book_client_connect_finish (result, NULL);
 
-	if (client == NULL) {
+	if (client == NULL || gci->cancelled) {
+		g_clear_object (&client);
 		csv_import_done (gci);
 		return;
 	}
 
-	gci->book_client = E_BOOK_CLIENT (client);
-	gci->idle_id = g_idle_add (csv_import_contacts, gci);
+	gci->contact_importer = evolution_contact_importer_new (gci->import, gci->target, E_BOOK_CLIENT (client));
+	g_object_unref (client);
+
+	evolution_contact_importer_run (gci->contact_importer, csv_import_contacts_thread, gci, csv_importer_free);
 }
 
 static void
@@ -1036,8 +1037,12 @@ csv_cancel (EImport *ei,
 {
 	CSVImporter *gci = g_datalist_get_data (&target->data, "csv-data");
 
-	if (gci)
-		gci->state = 1;
+	if (gci) {
+		gci->cancelled = TRUE;
+
+		if (gci->contact_importer)
+			evolution_contact_importer_cancel (gci->contact_importer);
+	}
 }
 
 static GtkWidget *
@@ -49,19 +49,17 @@ typedef struct {
 	EImport *import;
 	EImportTarget *target;
 
-	guint idle_id;
+	gboolean cancelled;	/* while opening book */
 
 	GHashTable *dn_contact_hash;
 
-	gint state;		/* 0 - initial scan, 1 - list cards, 2 - cancelled/complete */
 	FILE *file;
 	gulong size;
 
-	EBookClient *book_client;
+	EvolutionContactImporter *contact_importer;
 
 	GSList *contacts;
 	GSList *list_contacts;
-	GSList *list_iterator;
 } LDIFImporter;
 
 static void ldif_import_done (LDIFImporter *gci);
@@ -482,72 +480,52 @@ add_to_notes (EContact *contact,
 }
 
 static gboolean
-ldif_import_contacts (gpointer d)
+ldif_import_contacts_thread (EvolutionContactImporter *importer,
+                             gpointer user_data,
+                             GCancellable *cancellable,
+                             GError **error)
 {
-	LDIFImporter *gci = d;
+	LDIFImporter *gci = user_data;
 	EContact *contact;
-	GSList *iter;
-	gint count = 0;
+	GSList *link;
+	gboolean success = TRUE;
 
 	/* We process all normal cards immediately and keep the list
-	 * ones till the end */
-
-	if (gci->state == 0) {
-		while (count < 50 && (contact = getNextLDIFEntry (
-			gci->dn_contact_hash, gci->file))) {
-			if (e_contact_get (contact, E_CONTACT_IS_LIST)) {
-				gci->list_contacts = g_slist_prepend (
-					gci->list_contacts, contact);
-			} else {
-				gchar *uid = NULL;
-
-				add_to_notes (contact, E_CONTACT_OFFICE);
-				add_to_notes (contact, E_CONTACT_SPOUSE);
-				add_to_notes (contact, E_CONTACT_BLOG_URL);
-
-				e_book_client_add_contact_sync (
-					gci->book_client,
-					contact, E_BOOK_OPERATION_FLAG_NONE, &uid, NULL, NULL);
-				if (uid != NULL) {
-					e_contact_set (contact, E_CONTACT_UID, uid);
-					g_free (uid);
-				}
-				gci->contacts = g_slist_prepend (gci->contacts, contact);
-			}
-			count++;
-		}
-		if (contact == NULL) {
-			gci->state = 1;
-			gci->list_iterator = gci->list_contacts;
-		}
-	}
-	if (gci->state == 1) {
-		for (iter = gci->list_iterator; count < 50 && iter; iter = iter->next) {
-			gchar *uid = NULL;
-
-			contact = iter->data;
-			resolve_list_card (gci, contact);
-			e_book_client_add_contact_sync (
-				gci->book_client, contact, E_BOOK_OPERATION_FLAG_NONE, &uid, NULL, NULL);
-			if (uid != NULL) {
-				e_contact_set (contact, E_CONTACT_UID, uid);
-				g_free (uid);
-			}
-			count++;
+	 * ones till the end, when the normal cards have their UID */
+
+	while (success && (contact = getNextLDIFEntry (gci->dn_contact_hash, gci->file))) {
+		if (e_contact_get (contact, E_CONTACT_IS_LIST)) {
+			gci->list_contacts = g_slist_prepend (
+				gci->list_contacts, contact);
+		} else {
+			add_to_notes (contact, E_CONTACT_OFFICE);
+			add_to_notes (contact, E_CONTACT_SPOUSE);
+			add_to_notes (contact, E_CONTACT_BLOG_URL);
+
+			success = !g_cancellable_set_error_if_cancelled (cancellable, error) &&
+				evolution_contact_importer_add (importer, contact, cancellable, error);
+
+			/* Keep it, the dn_contact_hash references it */
+			gci->contacts = g_slist_prepend (gci->contacts, contact);
 		}
-		gci->list_iterator = iter;
-		if (iter == NULL)
-			gci->state = 2;
+
+		if (gci->size > 0)
+			evolution_contact_importer_set_progress (importer, ftell (gci->file) * 100 / gci->size);
 	}
-	if (gci->state == 2) {
-		ldif_import_done (gci);
-		return FALSE;
-	} else {
-		e_import_status (
-			gci->import, gci->target, _("Importing…"),
-			ftell (gci->file) * 100 / gci->size);
-		return TRUE;
+
+	if (success)
+		success = evolution_contact_importer_flush (importer, cancellable, error);
+
+	for (link = gci->list_contacts; success && link; link = g_slist_next (link)) {
+		contact = link->data;
+
+		resolve_list_card (gci, contact);
+
+		success = !g_cancellable_set_error_if_cancelled (cancellable, error) &&
+			evolution_contact_importer_add (importer, contact, cancellable, error);
 	}
+
+	return success;
 }
 
 static void
@@ -655,25 +633,36 @@ ldif_supported (EImport *ei,
 }
 
 static void
-ldif_import_done (LDIFImporter *gci)
+ldif_importer_free (gpointer ptr)
 {
-	if (gci->idle_id)
-		g_source_remove (gci->idle_id);
+	LDIFImporter *gci = ptr;
+
+	g_datalist_set_data (&gci->target->data, "ldif-data", NULL);
 
 	fclose (gci->file);
-	g_object_unref (gci->book_client);
 	g_slist_foreach (gci->contacts, (GFunc) g_object_unref, NULL);
 	g_slist_foreach (gci->list_contacts, (GFunc) g_object_unref, NULL);
 	g_slist_free (gci->contacts);
 	g_slist_free (gci->list_contacts);
 	g_hash_table_destroy (gci->dn_contact_hash);
 
-	e_import_complete (gci->import, gci->target, NULL);
 	g_object_unref (gci->import);
 
 	g_free (gci);
 }
 
+static void
+ldif_import_done (LDIFImporter *gci)
+{
+	EImport *import = g_object_ref (gci->import);
+	EImportTarget *target = gci->target;
+
+	ldif_importer_free (gci);
+
+	e_import_complete (import, target, NULL);
+	g_object_unref (import);
+}
+
 static void
 book_client_connect_cb (GObject *source_object,
                         GAsyncResult *result,
@@ -684,13 +673,16 @@ book_client_connect_cb (GObject *source_object,
 
 	client = e_book_client_connect_finish (result, NULL);
 
-	if (client == NULL) {
+	if (client == NULL || gci->cancelled) {
+		g_clear_object (&client);
 		ldif_import_done (gci);
 		return;
 	}
 
-	gci->book_client = E_BOOK_CLIENT (client);
-	gci->idle_id = g_idle_add (ldif_import_contacts, gci);
+	gci->contact_importer = evolution_contact_importer_new (gci->import, gci->target, E_BOOK_CLIENT (client));
+	g_object_unref (client);
+
+	evolution_contact_importer_run (gci->contact_importer, ldif_import_contacts_thread, gci, ldif_importer_free);
 }
 
 static void
@@ -746,8 +738,12 @@ ldif_cancel (EImport *ei,
 {
 	LDIFImporter *gci = g_datalist_get_data (&target->data, "ldif-data");
 
-	if (gci)
-		gci->state = 2;
+	if (gci) {
+		gci->cancelled = TRUE;
+
+		if (gci->contact_importer)
+			evolution_contact_importer_cancel (gci->contact_importer);
+	}
 }
 
 static GtkWidget *
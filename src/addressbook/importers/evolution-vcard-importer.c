@@ -44,31 +44,19 @@ typedef struct {
 	EImport *import;
 	EImportTarget *target;
 
-	guint idle_id;
+	gboolean cancelled;	/* while opening book */
 
-	gint state;		/* 0 - importing, 1 - cancelled/complete */
-	gint total;
-	gint count;
-
-	ESource *primary;
-
-	GSList *contactlist;
-	GSList *iterator;
-	EBookClient *book_client;
-
-	/* when opening book */
-	gchar *contents;
+	gchar *filename;
+	EvolutionContactImporter *contact_importer;
 } VCardImporter;
 
 static void vcard_import_done (VCardImporter *gci);
 
 static void
-vcard_import_contact (VCardImporter *gci,
-                      EContact *contact)
+vcard_import_fixup_contact (EContact *contact)
 {
 	EContactPhoto *photo;
 	GList *attrs, *attr;
-	gchar *uid = NULL;
 
 	/* Apple's addressbook.app exports PHOTO's without a TYPE
 	 * param, so let's figure out the format here if there's a
@@ -202,42 +190,231 @@ vcard_import_contact (VCardImporter *gci,
 		}
 	}
 
-	/* FIXME Error checking */
-	e_book_client_add_contact_sync (
-		gci->book_client, contact, E_BOOK_OPERATION_FLAG_NONE, &uid, NULL, NULL);
-	if (uid != NULL) {
-		e_contact_set (contact, E_CONTACT_UID, uid);
-		g_free (uid);
+}
+
+/* Whether the file is UTF-16 encoded, the same way as
+ * e_import_util_get_file_contents() recognizes it. */
+static gboolean
+vcard_file_is_utf16 (const gchar *filename)
+{
+	guchar bytes[4];
+	gsize n_read;
+	FILE *file;
+
+	file = g_fopen (filename, "rb");
+	if (!file)
+		return FALSE;
+
+	n_read = fread (bytes, 1, sizeof (bytes), file);
+	fclose (file);
+
+	if (n_read < 2)
+		return FALSE;
+
+	if ((bytes[0] == 0xFF && bytes[1] == 0xFE) ||
+	    (bytes[0] == 0xFE && bytes[1] == 0xFF))
+		return TRUE;
+
+	return n_read == 4 && (
+		(bytes[0] && !bytes[1] && bytes[2] && !bytes[3]) ||
+		(!bytes[0] && bytes[1] && !bytes[2] && bytes[3]));
+}
+
+static gboolean
+vcard_import_add_contact (EvolutionContactImporter *importer,
+                          EContact *contact,
+                          GCancellable *cancellable,
+                          GError **error)
+{
+	vcard_import_fixup_contact (contact);
+
+	return evolution_contact_importer_add (importer, contact, cancellable, error);
+}
+
+/* UTF-16 files need to be converted as a whole */
+static gboolean
+vcard_import_contents_sync (EvolutionContactImporter *importer,
+                            const gchar *filename,
+                            GCancellable *cancellable,
+                            GError **error)
+{
+	GSList *contacts, *link;
+	gchar *contents;
+	gboolean success = TRUE;
+	guint total, count = 0;
+
+	contents = e_import_util_get_file_contents (filename, 0, error);
+	if (!contents)
+		return FALSE;
+
+	contacts = eab_contact_list_from_string (contents);
+	total = g_slist_length (contacts);
+	g_free (contents);
+
+	for (link = contacts; link && success; link = g_slist_next (link)) {
+		success = !g_cancellable_set_error_if_cancelled (cancellable, error) &&
+			vcard_import_add_contact (importer, link->data, cancellable, error);
+
+		count++;
+		evolution_contact_importer_set_progress (importer, count * 100 / total);
 	}
+
+	g_slist_free_full (contacts, g_object_unref);
+
+	return success;
 }
 
 static gboolean
-vcard_import_contacts (gpointer data)
+vcard_import_card (EvolutionContactImporter *importer,
+                   const gchar *card_str,
+                   GCancellable *cancellable,
+                   GError **error)
 {
-	VCardImporter *gci = data;
-	gint count = 0;
-	GSList *iterator = gci->iterator;
-
-	if (gci->state == 0) {
-		while (count < 50 && iterator) {
-			vcard_import_contact (gci, iterator->data);
-			count++;
-			iterator = iterator->next;
-		}
-		gci->count += count;
-		gci->iterator = iterator;
-		if (iterator == NULL)
-			gci->state = 1;
+	EContact *contact;
+	gboolean success;
+
+	contact = e_contact_new_from_vcard (card_str);
+	if (!contact)
+		return TRUE;
+
+	success = vcard_import_add_contact (importer, contact, cancellable, error);
+
+	g_object_unref (contact);
+
+	return success;
+}
+
+static gboolean
+vcard_line_is_end (const gchar *line)
+{
+	if (g_ascii_strncasecmp (line, "END:VCARD", 9) != 0)
+		return FALSE;
+
+	for (line += 9; *line; line++) {
+		if (!g_ascii_isspace (*line))
+			return FALSE;
 	}
-	if (gci->state == 1) {
-		vcard_import_done (gci);
+
+	return TRUE;
+}
+
+/* Reads the file line by line and adds each vCard as soon as it's read,
+ * thus the whole file is never held in the memory. Like in the
+ * eab_contact_list_from_string(), the vCard ends with an END:VCARD,
+ * which is followed by another BEGIN:VCARD or the end of the file. */
+static gboolean
+vcard_import_contacts_thread (EvolutionContactImporter *importer,
+                              gpointer user_data,
+                              GCancellable *cancellable,
+                              GError **error)
+{
+	VCardImporter *gci = user_data;
+	GFile *file;
+	GFileInfo *info;
+	GFileInputStream *file_stream;
+	GDataInputStream *data_stream;
+	GString *card;
+	goffset size = 0, n_read = 0;
+	gboolean after_end = FALSE, is_first = TRUE;
+	gboolean success = TRUE;
+
+	if (vcard_file_is_utf16 (gci->filename))
+		return vcard_import_contents_sync (importer, gci->filename, cancellable, error);
+
+	file = g_file_new_for_path (gci->filename);
+
+	file_stream = g_file_read (file, cancellable, error);
+	if (!file_stream) {
+		g_object_unref (file);
 		return FALSE;
-	} else {
-		e_import_status (
-			gci->import, gci->target, _("Importing…"),
-			gci->count * 100 / gci->total);
-		return TRUE;
 	}
+
+	info = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_SIZE, G_FILE_QUERY_INFO_NONE, cancellable, NULL);
+	if (info) {
+		size = g_file_info_get_size (info);
+		g_object_unref (info);
+	}
+
+	data_stream = g_data_input_stream_new (G_INPUT_STREAM (file_stream));
+	g_data_input_stream_set_newline_type (data_stream, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+
+	card = g_string_new (NULL);
+
+	while (success) {
+		GError *local_error = NULL;
+		const gchar *text, *begin;
+		gchar *line;
+		gsize len = 0;
+		gboolean is_begin;
+
+		line = g_data_input_stream_read_line (data_stream, &len, cancellable, &local_error);
+		if (!line) {
+			if (local_error) {
+				g_propagate_error (error, local_error);
+				success = FALSE;
+			}
+			break;
+		}
+
+		n_read += len + 1;
+
+		text = line;
+
+		/* Skip the UTF-8 byte order mark */
+		if (is_first && strncmp (text, "\xEF\xBB\xBF", 3) == 0)
+			text += 3;
+
+		if (is_first && strncmp (text, "Book: ", 6) == 0) {
+			is_first = FALSE;
+			g_free (line);
+			continue;
+		}
+
+		is_first = FALSE;
+
+		/* The BEGIN:VCARD can be indented */
+		begin = text;
+		while (g_ascii_isspace (*begin))
+			begin++;
+
+		is_begin = g_ascii_strncasecmp (begin, "BEGIN:VCARD", 11) == 0;
+
+		if (is_begin) {
+			text = begin;
+
+			if (after_end) {
+				success = vcard_import_card (importer, card->str, cancellable, error);
+				g_string_truncate (card, 0);
+				after_end = FALSE;
+			}
+		}
+
+		/* Skip anything before the first vCard */
+		if (card->len > 0 || is_begin) {
+			g_string_append (card, text);
+			g_string_append_c (card, '\n');
+
+			if (vcard_line_is_end (text))
+				after_end = TRUE;
+			else if (*text && !g_ascii_isspace (*text))
+				after_end = FALSE;
+		}
+
+		g_free (line);
+
+		if (size > 0)
+			evolution_contact_importer_set_progress (importer, MIN (n_read, size) * 100 / size);
+	}
+
+	if (success && after_end && card->len > 0)
+		success = vcard_import_card (importer, card->str, cancellable, error);
+
+	g_string_free (card, TRUE);
+	g_object_unref (data_stream);
+	g_object_unref (file_stream);
+	g_object_unref (file);
+
+	return success;
 }
 
 static void
@@ -316,7 +493,7 @@ vcard_supported (EImport *ei,
 {
 	EImportTargetURI *s;
 	gchar *filename, *contents;
-	gboolean retval;
+	gboolean retval = FALSE;
 
 	if (target->type != E_IMPORT_TARGET_URI)
 		return FALSE;
@@ -332,7 +509,18 @@ vcard_supported (EImport *ei,
 	if (filename == NULL)
 		return FALSE;
 	contents = e_import_util_get_file_contents (filename, 32, NULL);
-	retval = contents && g_ascii_strncasecmp (contents, "BEGIN:VCARD", 11) == 0;
+	if (contents) {
+		const gchar *text = contents;
+
+		/* Skip the UTF-8 byte order mark and any leading white space */
+		if (strncmp (text, "\xEF\xBB\xBF", 3) == 0)
+			text += 3;
+
+		while (g_ascii_isspace (*text))
+			text++;
+
+		retval = g_ascii_strncasecmp (text, "BEGIN:VCARD", 11) == 0;
+	}
 	g_free (contents);
 	g_free (filename);
 
@@ -340,20 +528,29 @@ vcard_supported (EImport *ei,
 }
 
 static void
-vcard_import_done (VCardImporter *gci)
+vcard_importer_free (gpointer ptr)
 {
-	if (gci->idle_id)
-		g_source_remove (gci->idle_id);
+	VCardImporter *gci = ptr;
 
-	g_free (gci->contents);
-	g_object_unref (gci->book_client);
-	g_slist_free_full (gci->contactlist, (GDestroyNotify) g_object_unref);
+	g_datalist_set_data (&gci->target->data, "vcard-data", NULL);
 
-	e_import_complete (gci->import, gci->target, NULL);
+	g_free (gci->filename);
 	g_object_unref (gci->import);
 	g_free (gci);
 }
 
+static void
+vcard_import_done (VCardImporter *gci)
+{
+	EImport *import = g_object_ref (gci->import);
+	EImportTarget *target = gci->target;
+
+	vcard_importer_free (gci);
+
+	e_import_complete (import, target, NULL);
+	g_object_unref (import);
+}
+
 static void
 book_client_connect_cb (GObject *source_object,
                         GAsyncResult *result,
@@ -364,22 +561,16 @@ book_client_connect_cb (GObject *source_object,
 
 	client = e_book_client_connect_finish (result, NULL);
 
-	if (client == NULL) {
+	if (client == NULL || gci->cancelled) {
+		g_clear_object (&client);
 		vcard_import_done (gci);
 		return;
 	}
 
-	gci->book_client = E_BOOK_CLIENT (client);
-	gci->contactlist = eab_contact_list_from_string (gci->contents);
-	g_free (gci->contents);
-	gci->contents = NULL;
-	gci->iterator = gci->contactlist;
-	gci->total = g_slist_length (gci->contactlist);
+	gci->contact_importer = evolution_contact_importer_new (gci->import, gci->target, E_BOOK_CLIENT (client));
+	g_object_unref (client);
 
-	if (gci->iterator)
-		gci->idle_id = g_idle_add (vcard_import_contacts, gci);
-	else
-		vcard_import_done (gci);
+	evolution_contact_importer_run (gci->contact_importer, vcard_import_contacts_thread, gci, vcard_importer_free);
 }
 
 static void
@@ -391,7 +582,6 @@ vcard_import (EImport *ei,
 	ESource *source;
 	EImportTargetURI *s = (EImportTargetURI *) target;
 	gchar *filename;
-	gchar *contents;
 	GError *error = NULL;
 
 	filename = g_filename_from_uri (s->uri_src, NULL, &error);
@@ -402,8 +592,8 @@ vcard_import (EImport *ei,
 		return;
 	}
 
-	contents = e_import_util_get_file_contents (filename, 0, &error);
-	if (!contents) {
+	if (!g_file_test (filename, G_FILE_TEST_IS_REGULAR)) {
+		error = g_error_new (G_FILE_ERROR, G_FILE_ERROR_NOENT, _("File “%s” does not exist"), filename);
 		g_free (filename);
 		e_import_complete (ei, target, error);
 		g_clear_error (&error);
@@ -411,12 +601,11 @@ vcard_import (EImport *ei,
 		return;
 	}
 
-	g_free (filename);
 	gci = g_malloc0 (sizeof (*gci));
 	g_datalist_set_data (&target->data, "vcard-data", gci);
 	gci->import = g_object_ref (ei);
 	gci->target = target;
-	gci->contents = contents;
+	gci->filename = filename;
 
 	source = g_datalist_get_data (&target->data, "vcard-source");
 
@@ -430,8 +619,12 @@ vcard_cancel (EImport *ei,
 {
 	VCardImporter *gci = g_datalist_get_data (&target->data, "vcard-data");
 
-	if (gci)
-		gci->state = 1;
+	if (gci) {
+		gci->cancelled = TRUE;
+
+		if (gci->contact_importer)
+			evolution_contact_importer_cancel (gci->contact_importer);
+	}
 }
 
 static GtkWidget *
@@ -68,6 +68,16 @@ static guint signals[LAST_SIGNAL];
 
 G_DEFINE_TYPE_WITH_PRIVATE (ECalDataModel, e_cal_data_model, G_TYPE_OBJECT)
 
+/* Width of one timeline bucket, in seconds */
+#define TIMELINE_BUCKET_SIZE	(24 * 60 * 60)
+/* Components spanning more buckets than this are kept aside in 'timeline_wide' */
+#define TIMELINE_MAX_SPAN	31
+
+/* How many internal thread jobs can expand recurrences of one view at once */
+#define EXPAND_RECURRENCES_MAX_JOBS	4
+/* Upper limit of remembered recurrence expansions per view */
+#define EXPAND_CACHE_MAX_SIZE		1000
+
 typedef struct _ComponentData {
 	ECalComponent *component;
 	time_t instance_start;
@@ -90,10 +100,15 @@ typedef struct _ViewData {
 
 	GHashTable *components; /* ECalComponentId ~> ComponentData */
 	GHashTable *lost_components; /* ECalComponentId ~> ComponentData; when re-running view, valid till 'complete' is received */
+	GHashTable *timeline; /* gint bucket ~> GHashTable { ComponentData ~> ECalComponentId }; indexes 'components' by time */
+	GHashTable *timeline_wide; /* ComponentData ~> ECalComponentId; too long or unordered intervals from 'components' */
 	gboolean received_complete;
 	GSList *to_expand_recurrences; /* ICalComponent */
 	GSList *expanded_recurrences; /* ComponentData */
 	gint pending_expand_recurrences; /* how many is waiting to be processed */
+	GCancellable *expand_cancellable; /* cancelled when the view is re-run, like on a time range change */
+	GHashTable *expand_cache; /* gchar *uid ~> GHashTable { gchar *key ~> GSList { ComponentData } }; expanded instances of a component */
+	guint expand_cache_generation; /* bumped whenever an 'expand_cache' entry is invalidated */
 
 	GCancellable *cancellable;
 } ViewData;
@@ -134,6 +149,35 @@ component_data_free (gpointer ptr)
 	}
 }
 
+static GSList *
+component_data_list_clone (const GSList *list)
+{
+	GSList *copy = NULL;
+	const GSList *link;
+
+	for (link = list; link; link = g_slist_next (link)) {
+		const ComponentData *comp_data = link->data;
+		ECalComponent *comp;
+
+		if (!comp_data)
+			continue;
+
+		comp = e_cal_component_clone (comp_data->component);
+		copy = g_slist_prepend (copy, component_data_new (comp,
+			comp_data->instance_start, comp_data->instance_end,
+			comp_data->is_detached));
+		g_object_unref (comp);
+	}
+
+	return g_slist_reverse (copy);
+}
+
+static void
+component_data_list_free (gpointer ptr)
+{
+	g_slist_free_full (ptr, component_data_free);
+}
+
 static gboolean
 component_data_equal (ComponentData *comp_data1,
 		      ComponentData *comp_data2)
@@ -215,10 +259,154 @@ view_data_new (ECalClient *client)
 	view_data->components = g_hash_table_new_full (
 		e_cal_component_id_hash, e_cal_component_id_equal,
 		e_cal_component_id_free, component_data_free);
+	view_data->timeline = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+		NULL, (GDestroyNotify) g_hash_table_destroy);
+	view_data->timeline_wide = g_hash_table_new (g_direct_hash, g_direct_equal);
+	view_data->expand_cancellable = g_cancellable_new ();
+	view_data->expand_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+		g_free, (GDestroyNotify) g_hash_table_destroy);
 
 	return view_data;
 }
 
+static gint
+view_data_timeline_bucket (time_t tt)
+{
+	gint64 value = (gint64) tt;
+
+	/* Round towards negative infinity, to not merge the buckets around zero */
+	if (value < 0)
+		value = -((-value + TIMELINE_BUCKET_SIZE - 1) / TIMELINE_BUCKET_SIZE);
+	else
+		value = value / TIMELINE_BUCKET_SIZE;
+
+	return (gint) CLAMP (value, G_MININT, G_MAXINT);
+}
+
+/* Returns FALSE when the component belongs to the 'timeline_wide' */
+static gboolean
+view_data_timeline_get_span (const ComponentData *comp_data,
+			     gint *out_first,
+			     gint *out_last)
+{
+	gint first, last;
+
+	if (comp_data->instance_end < comp_data->instance_start)
+		return FALSE;
+
+	first = view_data_timeline_bucket (comp_data->instance_start);
+
+	/* The 'instance_end' is exclusive, unless the instance has no duration */
+	if (comp_data->instance_end > comp_data->instance_start)
+		last = view_data_timeline_bucket (comp_data->instance_end - 1);
+	else
+		last = first;
+
+	if ((gint64) last - first >= TIMELINE_MAX_SPAN)
+		return FALSE;
+
+	*out_first = first;
+	*out_last = last;
+
+	return TRUE;
+}
+
+/* The 'id' should be the key owned by the view_data->components */
+static void
+view_data_timeline_add (ViewData *view_data,
+			ECalComponentId *id,
+			ComponentData *comp_data)
+{
+	gint first, last, bucket;
+
+	if (!view_data_timeline_get_span (comp_data, &first, &last)) {
+		g_hash_table_insert (view_data->timeline_wide, comp_data, id);
+		return;
+	}
+
+	for (bucket = first; bucket <= last; bucket++) {
+		GHashTable *items;
+
+		items = g_hash_table_lookup (view_data->timeline, GINT_TO_POINTER (bucket));
+		if (!items) {
+			items = g_hash_table_new (g_direct_hash, g_direct_equal);
+			g_hash_table_insert (view_data->timeline, GINT_TO_POINTER (bucket), items);
+		}
+
+		g_hash_table_insert (items, comp_data, id);
+	}
+}
+
+static void
+view_data_timeline_remove (ViewData *view_data,
+			   ComponentData *comp_data)
+{
+	gint first, last, bucket;
+
+	if (!view_data_timeline_get_span (comp_data, &first, &last)) {
+		g_hash_table_remove (view_data->timeline_wide, comp_data);
+		return;
+	}
+
+	for (bucket = first; bucket <= last; bucket++) {
+		GHashTable *items;
+
+		items = g_hash_table_lookup (view_data->timeline, GINT_TO_POINTER (bucket));
+		if (items && g_hash_table_remove (items, comp_data) &&
+		    !g_hash_table_size (items))
+			g_hash_table_remove (view_data->timeline, GINT_TO_POINTER (bucket));
+	}
+}
+
+static void
+view_data_timeline_clear (ViewData *view_data)
+{
+	g_hash_table_remove_all (view_data->timeline);
+	g_hash_table_remove_all (view_data->timeline_wide);
+}
+
+/* Takes ownership of both 'id' and 'comp_data' */
+static void
+view_data_add_component (ViewData *view_data,
+			 ECalComponentId *id,
+			 ComponentData *comp_data)
+{
+	gpointer stored_id = NULL, old_comp_data = NULL;
+
+	/* The hash table keeps the old key when there was any, and frees the 'id' */
+	if (g_hash_table_lookup_extended (view_data->components, id, &stored_id, &old_comp_data)) {
+		if (old_comp_data)
+			view_data_timeline_remove (view_data, old_comp_data);
+	} else {
+		stored_id = id;
+	}
+
+	g_hash_table_insert (view_data->components, id, comp_data);
+
+	if (comp_data)
+		view_data_timeline_add (view_data, stored_id, comp_data);
+}
+
+static void
+view_data_remove_component (ViewData *view_data,
+			    const ECalComponentId *id)
+{
+	ComponentData *comp_data;
+
+	comp_data = g_hash_table_lookup (view_data->components, id);
+	if (comp_data)
+		view_data_timeline_remove (view_data, comp_data);
+
+	g_hash_table_remove (view_data->components, id);
+}
+
+static void
+view_data_remove_all_components (ViewData *view_data)
+{
+	view_data_timeline_clear (view_data);
+	g_hash_table_remove_all (view_data->components);
+}
+
 static void
 view_data_disconnect_view (ViewData *view_data)
 {
@@ -261,13 +449,18 @@ view_data_unref (gpointer ptr)
 			if (view_data->cancellable)
 				g_cancellable_cancel (view_data->cancellable);
 			g_clear_object (&view_data->cancellable);
+			g_cancellable_cancel (view_data->expand_cancellable);
+			g_clear_object (&view_data->expand_cancellable);
 			g_clear_object (&view_data->client);
 			g_clear_object (&view_data->view);
+			g_hash_table_destroy (view_data->timeline);
+			g_hash_table_destroy (view_data->timeline_wide);
 			g_hash_table_destroy (view_data->components);
 			if (view_data->lost_components)
 				g_hash_table_destroy (view_data->lost_components);
 			g_slist_free_full (view_data->to_expand_recurrences, g_object_unref);
 			g_slist_free_full (view_data->expanded_recurrences, component_data_free);
+			g_hash_table_destroy (view_data->expand_cache);
 			g_rec_mutex_clear (&view_data->lock);
 			g_free (view_data);
 		}
@@ -680,7 +873,7 @@ static void
 cal_data_model_remove_components (ECalDataModel *data_model,
 				  ECalClient *client,
 				  GHashTable *components,
-				  GHashTable *also_remove_from)
+				  ViewData *also_remove_from)
 {
 	GList *ids, *ilink;
 
@@ -711,7 +904,7 @@ cal_data_model_remove_components (ECalDataModel *data_model,
 			cal_data_model_remove_one_view_component_cb, id);
 
 		if (also_remove_from)
-			g_hash_table_remove (also_remove_from, id);
+			view_data_remove_component (also_remove_from, id);
 	}
 
 	g_list_free (ids);
@@ -871,7 +1064,7 @@ cal_data_model_process_added_component (ECalDataModel *data_model,
 	/* Note: old_comp_data is freed or NULL now */
 
 	/* 'id' is stolen by view_data->components */
-	g_hash_table_insert (view_data->components, id, comp_data);
+	view_data_add_component (view_data, id, comp_data);
 
 	if (!comp_data_equal) {
 		if (!old_comp_data) {
@@ -1055,7 +1248,7 @@ cal_data_model_notify_recurrences_cb (gpointer user_data)
 		}
 
 		if (view_data->is_used && g_hash_table_size (known_instances) > 0) {
-			cal_data_model_remove_components (data_model, view_data->client, known_instances, view_data->components);
+			cal_data_model_remove_components (data_model, view_data->client, known_instances, view_data);
 			g_hash_table_remove_all (known_instances);
 		}
 
@@ -1144,13 +1337,73 @@ cal_data_model_instance_generated (ICalComponent *icomp,
 	return TRUE;
 }
 
+/* Identifies one expansion of a component within the 'expand_cache' entry of its UID;
+   the master component's SEQUENCE and LAST-MODIFIED cover its revision, changes
+   of the detached instances invalidate the whole UID entry */
+static gchar *
+cal_data_model_dup_expand_cache_key (ICalComponent *icomp,
+				     time_t range_start,
+				     time_t range_end,
+				     ICalTimezone *zone,
+				     gboolean skip_cancelled)
+{
+	ICalProperty *prop;
+	const gchar *tzid = NULL;
+	gchar *last_modified = NULL, *key;
+
+	if (zone)
+		tzid = i_cal_timezone_get_tzid (zone);
+
+	prop = i_cal_component_get_first_property (icomp, I_CAL_LASTMODIFIED_PROPERTY);
+	if (prop) {
+		ICalTime *itt;
+
+		itt = i_cal_property_get_lastmodified (prop);
+		if (itt)
+			last_modified = i_cal_time_as_ical_string (itt);
+
+		g_clear_object (&itt);
+		g_object_unref (prop);
+	}
+
+	key = g_strdup_printf ("%d:%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ":%s:%d",
+		i_cal_component_get_sequence (icomp),
+		last_modified ? last_modified : "",
+		(gint64) range_start, (gint64) range_end,
+		tzid ? tzid : "",
+		skip_cancelled ? 1 : 0);
+
+	g_free (last_modified);
+
+	return key;
+}
+
+/* The 'view_data' is supposed to be locked */
+static void
+view_data_invalidate_expand_cache (ViewData *view_data,
+				   const gchar *uid)
+{
+	g_return_if_fail (view_data != NULL);
+
+	if (!uid)
+		return;
+
+	g_hash_table_remove (view_data->expand_cache, uid);
+
+	/* Also any currently running expand can be out of date */
+	view_data->expand_cache_generation++;
+}
+
+/* Several of these can run for the same view at once; each picks components
+   from the view's 'to_expand_recurrences' one by one, until it is empty. */
 static void
 cal_data_model_expand_recurrences_thread (ECalDataModel *data_model,
 					  gpointer user_data)
 {
 	ECalClient *client = user_data;
-	GSList *to_expand_recurrences, *link;
-	GSList *expanded_recurrences = NULL;
+	GCancellable *cancellable = NULL;
+	ICalTimezone *zone;
+	gboolean skip_cancelled;
 	time_t range_start, range_end;
 	ViewData *view_data;
 
@@ -1159,56 +1412,115 @@ cal_data_model_expand_recurrences_thread (ECalDataModel *data_model,
 	LOCK_PROPS ();
 
 	view_data = g_hash_table_lookup (data_model->priv->views, client);
-	if (view_data)
+	if (view_data) {
 		view_data_ref (view_data);
 
+		/* Take the cancellable together with the range, thus the expansion
+		   stops as soon as the range it was done for is not used anymore */
+		view_data_lock (view_data);
+		cancellable = g_object_ref (view_data->expand_cancellable);
+		view_data_unlock (view_data);
+	}
+
 	range_start = data_model->priv->range_start;
 	range_end = data_model->priv->range_end;
+	zone = g_object_ref (data_model->priv->zone);
+	skip_cancelled = data_model->priv->skip_cancelled;
 
 	UNLOCK_PROPS ();
 
 	if (!view_data) {
+		g_object_unref (zone);
 		g_object_unref (client);
 		return;
 	}
 
-	view_data_lock (view_data);
+	while (!g_cancellable_is_cancelled (cancellable)) {
+		ICalComponent *icomp;
+		GSList *expanded_recurrences = NULL;
+		GSList *cached = NULL;
+		GHashTable *uid_cache;
+		gchar *cache_key;
+		guint cache_generation;
 
-	if (!view_data->is_used) {
-		view_data_unlock (view_data);
-		view_data_unref (view_data);
-		g_object_unref (client);
-		return;
-	}
+		view_data_lock (view_data);
 
-	to_expand_recurrences = view_data->to_expand_recurrences;
-	view_data->to_expand_recurrences = NULL;
+		if (!view_data->is_used || !view_data->to_expand_recurrences) {
+			view_data_unlock (view_data);
+			break;
+		}
 
-	view_data_unlock (view_data);
+		icomp = view_data->to_expand_recurrences->data;
+		view_data->to_expand_recurrences = g_slist_delete_link (view_data->to_expand_recurrences,
+			view_data->to_expand_recurrences);
 
-	for (link = to_expand_recurrences; link && view_data->is_used; link = g_slist_next (link)) {
-		ICalComponent *icomp = link->data;
-		GenerateInstancesData gid;
+		view_data_unlock (view_data);
 
 		if (!icomp)
 			continue;
 
-		gid.client = client;
-		gid.pexpanded_recurrences = &expanded_recurrences;
-		gid.zone = g_object_ref (data_model->priv->zone);
-		gid.skip_cancelled = data_model->priv->skip_cancelled;
+		cache_key = cal_data_model_dup_expand_cache_key (icomp, range_start, range_end, zone, skip_cancelled);
 
-		e_cal_client_generate_instances_for_object_sync (client, icomp, range_start, range_end, NULL,
-			cal_data_model_instance_generated, &gid);
+		view_data_lock (view_data);
+		uid_cache = g_hash_table_lookup (view_data->expand_cache, i_cal_component_get_uid (icomp));
+		if (uid_cache)
+			cached = g_hash_table_lookup (uid_cache, cache_key);
+		if (cached)
+			expanded_recurrences = component_data_list_clone (cached);
+		cache_generation = view_data->expand_cache_generation;
+		view_data_unlock (view_data);
 
-		g_clear_object (&gid.zone);
-	}
+		if (!cached) {
+			GenerateInstancesData gid;
 
-	g_slist_free_full (to_expand_recurrences, g_object_unref);
+			gid.client = client;
+			gid.pexpanded_recurrences = &expanded_recurrences;
+			gid.zone = zone;
+			gid.skip_cancelled = skip_cancelled;
+
+			e_cal_client_generate_instances_for_object_sync (client, icomp, range_start, range_end, cancellable,
+				cal_data_model_instance_generated, &gid);
+
+			if (expanded_recurrences && !g_cancellable_is_cancelled (cancellable)) {
+				view_data_lock (view_data);
+
+				/* Do not store what had been invalidated meanwhile */
+				if (cache_generation == view_data->expand_cache_generation) {
+					const gchar *uid = i_cal_component_get_uid (icomp);
+
+					uid_cache = g_hash_table_lookup (view_data->expand_cache, uid);
+					if (!uid_cache) {
+						if (g_hash_table_size (view_data->expand_cache) >= EXPAND_CACHE_MAX_SIZE)
+							g_hash_table_remove_all (view_data->expand_cache);
+
+						uid_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+							g_free, component_data_list_free);
+						g_hash_table_insert (view_data->expand_cache, g_strdup (uid), uid_cache);
+					}
+
+					g_hash_table_insert (uid_cache, cache_key,
+						component_data_list_clone (expanded_recurrences));
+					cache_key = NULL;
+				}
+
+				view_data_unlock (view_data);
+			}
+		}
+
+		g_free (cache_key);
+		g_object_unref (icomp);
+
+		/* Results are passed per component, to not split instances of one component
+		   between two notifications; see cal_data_model_notify_recurrences_cb() */
+		view_data_lock (view_data);
+		if (!g_cancellable_is_cancelled (cancellable))
+			view_data->expanded_recurrences = g_slist_concat (view_data->expanded_recurrences, expanded_recurrences);
+		else
+			g_slist_free_full (expanded_recurrences, component_data_free);
+		view_data_unlock (view_data);
+	}
 
 	view_data_lock (view_data);
-	if (expanded_recurrences)
-		view_data->expanded_recurrences = g_slist_concat (view_data->expanded_recurrences, expanded_recurrences);
 	if (view_data->is_used) {
 		NotifyRecurrencesData *notif_data;
 
@@ -1221,6 +1533,8 @@ cal_data_model_expand_recurrences_thread (ECalDataModel *data_model,
 
 	view_data_unlock (view_data);
 	view_data_unref (view_data);
+	g_object_unref (cancellable);
+	g_object_unref (zone);
 	g_object_unref (client);
 }
 
@@ -1281,6 +1595,11 @@ cal_data_model_process_modified_or_added_objects (ECalClientView *view,
 			if (!icomp || !i_cal_component_get_uid (icomp))
 				continue;
 
+			/* Any change of the series, including an added or modified
+			   detached instance, makes its cached expansion out of date */
+			if (!is_add || e_cal_util_component_is_instance (icomp))
+				view_data_invalidate_expand_cache (view_data, i_cal_component_get_uid (icomp));
+
 			if (data_model->priv->expand_recurrences &&
 			    !e_cal_util_component_is_instance (icomp) &&
 			    e_cal_util_component_has_recurrences (icomp)) {
@@ -1326,14 +1645,22 @@ cal_data_model_process_modified_or_added_objects (ECalClientView *view,
 		cal_data_model_thaw_all_subscribers (data_model);
 
 		if (to_expand_recurrences) {
+			guint ii, n_jobs;
+
+			n_jobs = MIN (g_slist_length (to_expand_recurrences), EXPAND_RECURRENCES_MAX_JOBS);
+
 			view_data_lock (view_data);
 			view_data->to_expand_recurrences = g_slist_concat (
 				view_data->to_expand_recurrences, to_expand_recurrences);
-			g_atomic_int_inc (&view_data->pending_expand_recurrences);
+			for (ii = 0; ii < n_jobs; ii++) {
+				g_atomic_int_inc (&view_data->pending_expand_recurrences);
+			}
 			view_data_unlock (view_data);
 
-			cal_data_model_submit_internal_thread_job (data_model,
-				cal_data_model_expand_recurrences_thread, g_object_ref (client));
+			for (ii = 0; ii < n_jobs; ii++) {
+				cal_data_model_submit_internal_thread_job (data_model,
+					cal_data_model_expand_recurrences_thread, g_object_ref (client));
+			}
 		}
 	}
 
@@ -1403,6 +1730,8 @@ cal_data_model_view_objects_removed (ECalClientView *view,
 			const ECalComponentId *id = link->data;
 
 			if (id) {
+				view_data_invalidate_expand_cache (view_data, e_cal_component_id_get_uid (id));
+
 				if (!e_cal_component_id_get_rid (id)) {
 					if (!g_hash_table_contains (gathered_uids, e_cal_component_id_get_uid (id))) {
 						GatherComponentsData gather_data;
@@ -1449,7 +1778,7 @@ cal_data_model_view_objects_removed (ECalClientView *view,
 					}
 				}
 
-				g_hash_table_remove (view_data->components, id);
+				view_data_remove_component (view_data, id);
 				if (view_data->lost_components)
 					g_hash_table_remove (view_data->lost_components, id);
 
@@ -1669,6 +1998,13 @@ cal_data_model_update_client_view (ECalDataModel *data_model,
 		g_cancellable_cancel (view_data->cancellable);
 	g_clear_object (&view_data->cancellable);
 
+	/* Any running expansion is for the previous view, thus stop it */
+	g_cancellable_cancel (view_data->expand_cancellable);
+	g_clear_object (&view_data->expand_cancellable);
+	view_data->expand_cancellable = g_cancellable_new ();
+	g_slist_free_full (view_data->to_expand_recurrences, g_object_unref);
+	view_data->to_expand_recurrences = NULL;
+
 	if (view_data->view) {
 		view_data_disconnect_view (view_data);
 		cal_data_model_emit_view_state_changed (data_model, view_data->view, E_CAL_DATA_MODEL_VIEW_STATE_STOP, 0, NULL, NULL);
@@ -1686,7 +2022,7 @@ cal_data_model_update_client_view (ECalDataModel *data_model,
 		g_hash_table_foreach (view_data->components,
 			cal_data_model_notify_remove_components_cb, &nrc_data);
 
-		g_hash_table_remove_all (view_data->components);
+		view_data_remove_all_components (view_data);
 		if (view_data->lost_components) {
 			g_hash_table_foreach (view_data->lost_components,
 				cal_data_model_notify_remove_components_cb, &nrc_data);
@@ -1712,6 +2048,7 @@ cal_data_model_update_client_view (ECalDataModel *data_model,
 			view_data->lost_components = NULL;
 		}
 
+		view_data_timeline_clear (view_data);
 		view_data->lost_components = view_data->components;
 		view_data->components = g_hash_table_new_full (
 			(GHashFunc) e_cal_component_id_hash, (GEqualFunc) e_cal_component_id_equal,
@@ -1782,7 +2119,7 @@ cal_data_model_remove_client_view (ECalDataModel *data_model,
 
 		g_hash_table_foreach (view_data->components,
 			cal_data_model_notify_remove_components_cb, &nrc_data);
-		g_hash_table_remove_all (view_data->components);
+		view_data_remove_all_components (view_data);
 
 		if (view_data->lost_components) {
 			g_hash_table_foreach (view_data->lost_components,
@@ -1796,6 +2133,7 @@ cal_data_model_remove_client_view (ECalDataModel *data_model,
 			cal_data_model_emit_view_state_changed (data_model, view_data->view, E_CAL_DATA_MODEL_VIEW_STATE_STOP, 0, NULL, NULL);
 
 		view_data->is_used = FALSE;
+		g_cancellable_cancel (view_data->expand_cancellable);
 		view_data_unlock (view_data);
 
 		g_hash_table_remove (data_model->priv->views, client);
@@ -2708,6 +3046,126 @@ e_cal_data_model_get_components (ECalDataModel *data_model,
 	return g_slist_reverse (components);
 }
 
+static gboolean
+cal_data_model_component_in_range (const ComponentData *comp_data,
+				   time_t in_range_start,
+				   time_t in_range_end)
+{
+	return (comp_data->instance_start < in_range_end && comp_data->instance_end > in_range_start) ||
+	       (comp_data->instance_start == comp_data->instance_end && comp_data->instance_end == in_range_start);
+}
+
+/* Calls 'func' for each component in the bucket, which is not reported
+   in an earlier bucket of the range already; returns FALSE to stop */
+static gboolean
+cal_data_model_foreach_timeline_bucket (ECalDataModel *data_model,
+					ViewData *view_data,
+					GHashTable *items,
+					gint bucket,
+					gint first_bucket,
+					time_t in_range_start,
+					time_t in_range_end,
+					ECalDataModelForeachFunc func,
+					gpointer user_data)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_hash_table_iter_init (&iter, items);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		ComponentData *comp_data = key;
+		ECalComponentId *id = value;
+		gint comp_first, comp_last;
+
+		if (!view_data_timeline_get_span (comp_data, &comp_first, &comp_last) ||
+		    MAX (comp_first, first_bucket) != bucket)
+			continue;
+
+		if (cal_data_model_component_in_range (comp_data, in_range_start, in_range_end) &&
+		    !func (data_model, view_data->client, id, comp_data->component,
+			   comp_data->instance_start, comp_data->instance_end, user_data))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* The view_data should be locked; returns FALSE when the 'func' stopped the walk */
+static gboolean
+cal_data_model_foreach_view_component (ECalDataModel *data_model,
+				       ViewData *view_data,
+				       time_t in_range_start,
+				       time_t in_range_end,
+				       ECalDataModelForeachFunc func,
+				       gpointer user_data)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	gint first_bucket, last_bucket;
+
+	if (in_range_start == in_range_end && in_range_start == (time_t) 0) {
+		g_hash_table_iter_init (&iter, view_data->components);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			ECalComponentId *id = key;
+			ComponentData *comp_data = value;
+
+			if (!comp_data)
+				continue;
+
+			if (!func (data_model, view_data->client, id, comp_data->component,
+				   comp_data->instance_start, comp_data->instance_end, user_data))
+				return FALSE;
+		}
+
+		return TRUE;
+	}
+
+	g_hash_table_iter_init (&iter, view_data->timeline_wide);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		ComponentData *comp_data = key;
+		ECalComponentId *id = value;
+
+		if (cal_data_model_component_in_range (comp_data, in_range_start, in_range_end) &&
+		    !func (data_model, view_data->client, id, comp_data->component,
+			   comp_data->instance_start, comp_data->instance_end, user_data))
+			return FALSE;
+	}
+
+	first_bucket = view_data_timeline_bucket (in_range_start);
+	if (in_range_end > in_range_start)
+		last_bucket = view_data_timeline_bucket (in_range_end - 1);
+	else
+		last_bucket = first_bucket;
+
+	/* Walk the range buckets only when there are less of them than the used buckets */
+	if ((gint64) last_bucket - first_bucket < (gint64) g_hash_table_size (view_data->timeline)) {
+		gint64 bucket;
+
+		for (bucket = first_bucket; bucket <= last_bucket; bucket++) {
+			GHashTable *items;
+
+			items = g_hash_table_lookup (view_data->timeline, GINT_TO_POINTER ((gint) bucket));
+			if (items && !cal_data_model_foreach_timeline_bucket (data_model, view_data, items,
+				(gint) bucket, first_bucket, in_range_start, in_range_end, func, user_data))
+				return FALSE;
+		}
+	} else {
+		g_hash_table_iter_init (&iter, view_data->timeline);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			gint bucket = GPOINTER_TO_INT (key);
+
+			if (bucket < first_bucket || bucket > last_bucket)
+				continue;
+
+			if (!cal_data_model_foreach_timeline_bucket (data_model, view_data, value,
+				bucket, first_bucket, in_range_start, in_range_end, func, user_data))
+				return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
 static gboolean
 cal_data_model_foreach_component (ECalDataModel *data_model,
 				  time_t in_range_start,
@@ -2743,22 +3201,8 @@ cal_data_model_foreach_component (ECalDataModel *data_model,
 
 		view_data_lock (view_data);
 
-		g_hash_table_iter_init (&citer, view_data->components);
-		while (checked_all && g_hash_table_iter_next (&citer, &key, &value)) {
-			ECalComponentId *id = key;
-			ComponentData *comp_data = value;
-
-			if (!comp_data)
-				continue;
-
-			if ((in_range_start == in_range_end && in_range_start == (time_t) 0) ||
-			    (comp_data->instance_start < in_range_end && comp_data->instance_end > in_range_start) ||
-			    (comp_data->instance_start == comp_data->instance_end && comp_data->instance_end == in_range_start)) {
-				if (!func (data_model, view_data->client, id, comp_data->component,
-					   comp_data->instance_start, comp_data->instance_end, user_data))
-					checked_all = FALSE;
-			}
-		}
+		checked_all = cal_data_model_foreach_view_component (data_model, view_data,
+			in_range_start, in_range_end, func, user_data);
 
 		if (include_lost_components && view_data->lost_components) {
 			g_hash_table_iter_init (&citer, view_data->lost_components);
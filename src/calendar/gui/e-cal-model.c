@@ -43,6 +43,12 @@
 struct _ECalModelComponentPrivate {
 	GString *categories_str;
 	gint icon_index;
+
+	/* Position in the ECalModel's objects array */
+	guint index;
+	/* Cached RECURRENCE-ID as string, empty when not set;
+	 * NULL when not computed yet */
+	gchar *rid;
 };
 
 struct _ECalModelPrivate {
@@ -56,6 +62,10 @@ struct _ECalModelPrivate {
 
 	/* Array for storing the objects. Each element is of type ECalModelComponent */
 	GPtrArray *objects;
+	/* gchar *uid ~> GSList * { ECalModelComponent * }, in the objects order */
+	GHashTable *objects_index;
+	/* Stored positions of the objects from this index on can be out of date */
+	guint objects_stale_from;
 
 	ICalComponentKind kind;
 	ICalTimezone *zone;
@@ -122,6 +132,7 @@ typedef struct {
 } AssignedColorData;
 
 static const gchar *cal_model_get_color_for_component (ECalModel *model, ECalModelComponent *comp_data);
+static void cal_model_objects_index_clear (ECalModel *model);
 
 enum {
 	PROP_0,
@@ -204,6 +215,7 @@ e_cal_model_component_set_icalcomponent (ECalModelComponent *comp_data,
 		g_string_free (comp_data->priv->categories_str, TRUE);
 	comp_data->priv->categories_str = NULL;
 	comp_data->priv->icon_index = -1;
+	g_clear_pointer (&comp_data->priv->rid, g_free);
 
 	g_clear_pointer (&comp_data->dtstart, e_cell_date_edit_value_free);
 	g_clear_pointer (&comp_data->dtend, e_cell_date_edit_value_free);
@@ -1164,6 +1176,8 @@ cal_model_finalize (GObject *object)
 		g_object_unref (comp_data);
 	}
 	g_ptr_array_free (self->priv->objects, TRUE);
+	cal_model_objects_index_clear (self);
+	g_hash_table_destroy (self->priv->objects_index);
 
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (e_cal_model_parent_class)->finalize (object);
@@ -1892,44 +1906,174 @@ cal_model_value_to_string (ETableModel *etm,
 	return g_strdup ("");
 }
 
-static gint
-e_cal_model_get_component_index (ECalModel *model,
-				 ECalClient *client,
-				 const ECalComponentId *id)
+static const gchar *
+cal_model_component_get_rid (ECalModelComponent *comp_data)
 {
-	gint ii;
+	if (!comp_data->priv->rid) {
+		comp_data->priv->rid = e_cal_util_component_get_recurid_as_string (comp_data->icalcomp);
 
-	for (ii = 0; ii < model->priv->objects->len; ii++) {
-		ECalModelComponent *comp_data = g_ptr_array_index (model->priv->objects, ii);
+		if (!comp_data->priv->rid)
+			comp_data->priv->rid = g_strdup ("");
+	}
 
-		if (comp_data) {
-			const gchar *uid;
-			gboolean has_rid = e_cal_component_id_get_rid (id) != NULL;
+	return comp_data->priv->rid;
+}
 
-			uid = i_cal_component_get_uid (comp_data->icalcomp);
+static void
+cal_model_objects_index_add (ECalModel *model,
+			     ECalModelComponent *comp_data)
+{
+	const gchar *uid;
+	GSList *comps;
 
-			if (uid && *uid) {
-				if ((!client || comp_data->client == client) && strcmp (uid, e_cal_component_id_get_uid (id)) == 0) {
-					if (has_rid) {
-						gchar *rid;
+	uid = i_cal_component_get_uid (comp_data->icalcomp);
+	if (!uid || !*uid)
+		return;
 
-						rid = e_cal_util_component_get_recurid_as_string (comp_data->icalcomp);
+	comps = g_hash_table_lookup (model->priv->objects_index, uid);
 
-						if (!(rid && *rid && strcmp (rid, e_cal_component_id_get_rid (id)) == 0)) {
-							g_free (rid);
-							continue;
-						}
+	if (comps) {
+		/* Components are appended to the objects array, thus
+		 * keep the same order; the lists are usually short. */
+		comps = g_slist_append (comps, comp_data);
+	} else {
+		g_hash_table_insert (model->priv->objects_index, g_strdup (uid), g_slist_prepend (NULL, comp_data));
+	}
+}
 
-						g_free (rid);
-					}
+static void
+cal_model_objects_index_remove (ECalModel *model,
+				ECalModelComponent *comp_data)
+{
+	const gchar *uid;
+	gpointer orig_key, value;
+	GSList *comps;
 
-					return ii;
-				}
-			}
+	uid = i_cal_component_get_uid (comp_data->icalcomp);
+	if (!uid || !*uid)
+		return;
+
+	if (!g_hash_table_lookup_extended (model->priv->objects_index, uid, &orig_key, &value))
+		return;
+
+	comps = g_slist_remove (value, comp_data);
+
+	if (!comps)
+		g_hash_table_remove (model->priv->objects_index, uid);
+	else if (comps != value)
+		g_hash_table_insert (model->priv->objects_index, g_strdup (uid), comps);
+}
+
+static void
+cal_model_objects_index_clear (ECalModel *model)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init (&iter, model->priv->objects_index);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		g_slist_free (value);
+	}
+
+	g_hash_table_remove_all (model->priv->objects_index);
+}
+
+/* Returns the position of the @comp_data in the objects array. The positions
+ * are fixed lazily, only when a stale one is asked for, thus removing many
+ * objects, highest position first, does not walk the array for each of them. */
+static guint
+cal_model_objects_get_position (ECalModel *model,
+				ECalModelComponent *comp_data)
+{
+	guint ii;
+
+	if (comp_data->priv->index < model->priv->objects_stale_from)
+		return comp_data->priv->index;
+
+	for (ii = model->priv->objects_stale_from; ii < model->priv->objects->len; ii++) {
+		ECalModelComponent *comp = g_ptr_array_index (model->priv->objects, ii);
+
+		comp->priv->index = ii;
+	}
+
+	model->priv->objects_stale_from = G_MAXUINT;
+
+	return comp_data->priv->index;
+}
+
+static void
+cal_model_objects_add (ECalModel *model,
+		       ECalModelComponent *comp_data)
+{
+	comp_data->priv->index = model->priv->objects->len;
+	g_ptr_array_add (model->priv->objects, comp_data);
+
+	cal_model_objects_index_add (model, comp_data);
+}
+
+static ECalModelComponent *
+cal_model_objects_remove_index (ECalModel *model,
+				guint index)
+{
+	ECalModelComponent *comp_data;
+
+	comp_data = g_ptr_array_remove_index (model->priv->objects, index);
+
+	if (comp_data)
+		cal_model_objects_index_remove (model, comp_data);
+
+	/* Objects after the removed one moved, fix their positions when needed */
+	if (index < model->priv->objects->len)
+		model->priv->objects_stale_from = MIN (model->priv->objects_stale_from, index);
+
+	return comp_data;
+}
+
+static ECalModelComponent *
+cal_model_objects_lookup (ECalModelPrivate *priv,
+			  ECalClient *client,
+			  const ECalComponentId *id)
+{
+	const gchar *rid;
+	GSList *link;
+
+	if (!e_cal_component_id_get_uid (id))
+		return NULL;
+
+	rid = e_cal_component_id_get_rid (id);
+
+	for (link = g_hash_table_lookup (priv->objects_index, e_cal_component_id_get_uid (id)); link; link = g_slist_next (link)) {
+		ECalModelComponent *comp_data = link->data;
+
+		if (client && comp_data->client != client)
+			continue;
+
+		if (rid) {
+			const gchar *comp_rid = cal_model_component_get_rid (comp_data);
+
+			if (!*comp_rid || strcmp (comp_rid, rid) != 0)
+				continue;
 		}
+
+		return comp_data;
 	}
 
-	return -1;
+	return NULL;
+}
+
+static gint
+e_cal_model_get_component_index (ECalModel *model,
+				 ECalClient *client,
+				 const ECalComponentId *id)
+{
+	ECalModelComponent *comp_data;
+
+	comp_data = cal_model_objects_lookup (model->priv, client, id);
+
+	if (!comp_data)
+		return -1;
+
+	return cal_model_objects_get_position (model, comp_data);
 }
 
 static void
@@ -1953,26 +2097,27 @@ cal_model_data_subscriber_component_added_or_modified (ECalDataModelSubscriber *
 	/* The component should not exist, when it's claimed being added, thus, when it's the main
 	   component, remove any existing instances and add it from scratch. */
 	if (is_added && !e_cal_component_id_get_rid (id)) {
-		GSList *removed_comps = NULL;
+		GSList *removed_comps = NULL, *link = NULL;
 
-		for (index = 0; index < model->priv->objects->len; index++) {
-			comp_data = g_ptr_array_index (model->priv->objects, index);
+		if (e_cal_component_id_get_uid (id))
+			link = g_hash_table_lookup (model->priv->objects_index, e_cal_component_id_get_uid (id));
 
-			if (comp_data && comp_data->client == client) {
-				const gchar *uid;
+		for (; link; link = g_slist_next (link)) {
+			comp_data = link->data;
 
-				uid = i_cal_component_get_uid (comp_data->icalcomp);
+			if (comp_data->client == client)
+				removed_comps = g_slist_prepend (removed_comps, comp_data);
+		}
 
-				if (uid && *uid && g_strcmp0 (uid, e_cal_component_id_get_uid (id)) == 0) {
-					e_table_model_pre_change (table_model);
+		/* Highest index first, the list is in the objects order */
+		for (link = removed_comps; link; link = g_slist_next (link)) {
+			comp_data = link->data;
+			index = cal_model_objects_get_position (model, comp_data);
 
-					g_ptr_array_remove_index (model->priv->objects, index);
-					removed_comps = g_slist_prepend (removed_comps, comp_data);
-					e_table_model_row_deleted (table_model, index);
+			e_table_model_pre_change (table_model);
 
-					index--;
-				}
-			}
+			cal_model_objects_remove_index (model, index);
+			e_table_model_row_deleted (table_model, index);
 		}
 
 		g_signal_emit (model, signals[COMPS_DELETED], 0, removed_comps);
@@ -1999,7 +2144,7 @@ cal_model_data_subscriber_component_added_or_modified (ECalDataModelSubscriber *
 		comp_data->client = g_object_ref (client);
 		comp_data->icalcomp = icomp;
 		e_cal_model_set_instance_times (comp_data, model->priv->zone);
-		g_ptr_array_add (model->priv->objects, comp_data);
+		cal_model_objects_add (model, comp_data);
 
 		e_table_model_row_inserted (table_model, model->priv->objects->len - 1);
 	} else {
@@ -2055,7 +2200,7 @@ e_cal_model_data_subscriber_component_removed (ECalDataModelSubscriber *subscrib
 	table_model = E_TABLE_MODEL (model);
 	e_table_model_pre_change (table_model);
 
-	comp_data = g_ptr_array_remove_index (model->priv->objects, index);
+	comp_data = cal_model_objects_remove_index (model, index);
 	if (!comp_data) {
 		e_table_model_no_change (table_model);
 		return;
@@ -2629,6 +2774,8 @@ e_cal_model_init (ECalModel *model)
 	model->priv->end = (time_t) -1;
 
 	model->priv->objects = g_ptr_array_new ();
+	model->priv->objects_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	model->priv->objects_stale_from = G_MAXUINT;
 	model->priv->kind = I_CAL_NO_COMPONENT;
 
 	model->priv->use_24_hour_format = TRUE;
@@ -3634,38 +3781,7 @@ search_by_id_and_client (ECalModelPrivate *priv,
                          ECalClient *client,
                          const ECalComponentId *id)
 {
-	gint i;
-
-	for (i = 0; i < priv->objects->len; i++) {
-		ECalModelComponent *comp_data = g_ptr_array_index (priv->objects, i);
-
-		if (comp_data) {
-			const gchar *uid;
-			gchar *rid;
-			gboolean has_rid = e_cal_component_id_get_rid (id) != NULL;
-
-			uid = i_cal_component_get_uid (comp_data->icalcomp);
-			rid = e_cal_util_component_get_recurid_as_string (comp_data->icalcomp);
-
-			if (uid && *uid) {
-				if ((!client || comp_data->client == client) &&
-				    !g_strcmp0 (e_cal_component_id_get_uid (id), uid)) {
-					if (has_rid) {
-						if (!(rid && *rid && !g_strcmp0 (e_cal_component_id_get_rid (id), rid))) {
-							g_free (rid);
-							continue;
-						}
-					}
-					g_free (rid);
-					return comp_data;
-				}
-			}
-
-			g_free (rid);
-		}
-	}
-
-	return NULL;
+	return cal_model_objects_lookup (priv, client, id);
 }
 
 void
@@ -3691,6 +3807,8 @@ e_cal_model_remove_all_objects (ECalModel *model)
 	e_table_model_rows_deleted (table_model, 0, ii);
 
 	g_ptr_array_set_size (model->priv->objects, 0);
+	model->priv->objects_stale_from = G_MAXUINT;
+	cal_model_objects_index_clear (model);
 
 	if (comps)
 		g_signal_emit (model, signals[COMPS_DELETED], 0, comps);
@@ -2179,3 +2179,269 @@ e_meeting_store_get_num_queries (EMeetingStore *store)
 
 	return store->priv->num_queries;
 }
+
+/* Busy time in minutes since the start of the Julian calendar */
+typedef struct _BusyBlock {
+	gint64 start;
+	gint64 end;
+} BusyBlock;
+
+struct _EMeetingBusyTimeline {
+	/* Merged busy time of the attendees who all need to be free */
+	GArray *blocks; /* BusyBlock */
+	/* Merged busy time of each resource, of which one needs to be free */
+	GPtrArray *resources; /* GArray { BusyBlock } */
+};
+
+static gint64
+meeting_time_to_minutes (const EMeetingTime *mtime)
+{
+	return ((gint64) g_date_get_julian (&mtime->date)) * 24 * 60 + mtime->hour * 60 + mtime->minute;
+}
+
+static void
+meeting_time_from_minutes (EMeetingTime *mtime,
+                           gint64 minutes)
+{
+	g_date_clear (&mtime->date, 1);
+	g_date_set_julian (&mtime->date, minutes / (24 * 60));
+	mtime->hour = (minutes / 60) % 24;
+	mtime->minute = minutes % 60;
+}
+
+static gint
+busy_block_compare (gconstpointer ptr1,
+                    gconstpointer ptr2)
+{
+	const BusyBlock *block1 = ptr1, *block2 = ptr2;
+
+	if (block1->start != block2->start)
+		return block1->start < block2->start ? -1 : 1;
+
+	if (block1->end != block2->end)
+		return block1->end < block2->end ? -1 : 1;
+
+	return 0;
+}
+
+static void
+busy_blocks_add_attendee (GArray *blocks,
+                          EMeetingAttendee *attendee)
+{
+	const GArray *busy_periods;
+	guint ii;
+
+	busy_periods = e_meeting_attendee_get_busy_periods (attendee);
+
+	for (ii = 0; busy_periods && ii < busy_periods->len; ii++) {
+		const EMeetingFreeBusyPeriod *period = &g_array_index (busy_periods, EMeetingFreeBusyPeriod, ii);
+		BusyBlock block;
+
+		if (!g_date_valid (&period->start.date) || !g_date_valid (&period->end.date))
+			continue;
+
+		block.start = meeting_time_to_minutes (&period->start);
+		block.end = meeting_time_to_minutes (&period->end);
+
+		if (block.start < block.end)
+			g_array_append_val (blocks, block);
+	}
+}
+
+/* Sorts the blocks and merges overlapping and adjacent ones */
+static void
+busy_blocks_merge (GArray *blocks)
+{
+	guint ii, jj;
+
+	if (blocks->len < 2)
+		return;
+
+	g_array_sort (blocks, busy_block_compare);
+
+	for (ii = 0, jj = 1; jj < blocks->len; jj++) {
+		BusyBlock *last = &g_array_index (blocks, BusyBlock, ii);
+		BusyBlock *block = &g_array_index (blocks, BusyBlock, jj);
+
+		if (block->start <= last->end) {
+			if (block->end > last->end)
+				last->end = block->end;
+		} else {
+			ii++;
+
+			if (ii != jj)
+				g_array_index (blocks, BusyBlock, ii) = *block;
+		}
+	}
+
+	g_array_set_size (blocks, ii + 1);
+}
+
+/* Returns the block overlapping the <start, end) interval, or NULL */
+static const BusyBlock *
+busy_blocks_find_clash (GArray *blocks,
+                        gint64 start,
+                        gint64 end)
+{
+	const BusyBlock *block;
+	guint lower = 0, upper = blocks->len;
+
+	/* Find the first block ending after the start */
+	while (lower < upper) {
+		guint middle = lower + (upper - lower) / 2;
+
+		if (g_array_index (blocks, BusyBlock, middle).end <= start)
+			lower = middle + 1;
+		else
+			upper = middle;
+	}
+
+	if (lower >= blocks->len)
+		return NULL;
+
+	block = &g_array_index (blocks, BusyBlock, lower);
+
+	return block->start < end ? block : NULL;
+}
+
+/**
+ * e_meeting_store_build_busy_timeline:
+ * @store: an #EMeetingStore
+ * @skip_optional: whether optional attendees can be ignored
+ * @need_one_resource: whether only one of the resources needs to be free
+ *
+ * Merges the busy periods of all the attendees into a sorted timeline,
+ * which can answer whether a meeting time suits everybody in logarithmic
+ * time, regardless of the number of the attendees. The timeline does not
+ * follow later changes of the busy periods.
+ *
+ * Free the returned timeline with e_meeting_busy_timeline_free(),
+ * when no longer needed.
+ *
+ * Returns: (transfer full): a new #EMeetingBusyTimeline
+ *
+ * Since: 3.56
+ **/
+EMeetingBusyTimeline *
+e_meeting_store_build_busy_timeline (EMeetingStore *store,
+                                     gboolean skip_optional,
+                                     gboolean need_one_resource)
+{
+	EMeetingBusyTimeline *timeline;
+	guint ii;
+
+	g_return_val_if_fail (E_IS_MEETING_STORE (store), NULL);
+
+	timeline = g_new0 (EMeetingBusyTimeline, 1);
+	timeline->blocks = g_array_new (FALSE, FALSE, sizeof (BusyBlock));
+	timeline->resources = g_ptr_array_new_with_free_func ((GDestroyNotify) g_array_unref);
+
+	for (ii = 0; ii < store->priv->attendees->len; ii++) {
+		EMeetingAttendee *attendee = g_ptr_array_index (store->priv->attendees, ii);
+		EMeetingAttendeeType atype;
+
+		atype = e_meeting_attendee_get_atype (attendee);
+
+		if (skip_optional && atype == E_MEETING_ATTENDEE_OPTIONAL_PERSON)
+			continue;
+
+		if (need_one_resource && atype == E_MEETING_ATTENDEE_RESOURCE) {
+			GArray *blocks;
+
+			blocks = g_array_new (FALSE, FALSE, sizeof (BusyBlock));
+			busy_blocks_add_attendee (blocks, attendee);
+			busy_blocks_merge (blocks);
+
+			g_ptr_array_add (timeline->resources, blocks);
+		} else {
+			busy_blocks_add_attendee (timeline->blocks, attendee);
+		}
+	}
+
+	busy_blocks_merge (timeline->blocks);
+
+	return timeline;
+}
+
+/**
+ * e_meeting_busy_timeline_free:
+ * @timeline: (nullable): an #EMeetingBusyTimeline
+ *
+ * Frees the @timeline.
+ *
+ * Since: 3.56
+ **/
+void
+e_meeting_busy_timeline_free (EMeetingBusyTimeline *timeline)
+{
+	if (timeline) {
+		g_array_unref (timeline->blocks);
+		g_ptr_array_unref (timeline->resources);
+		g_free (timeline);
+	}
+}
+
+/**
+ * e_meeting_busy_timeline_check:
+ * @timeline: an #EMeetingBusyTimeline
+ * @start: start of the meeting
+ * @end: end of the meeting
+ * @forward: which direction the caller searches in
+ * @out_next: (out): where to continue the search, when the time is not free
+ *
+ * Checks whether the meeting time from @start to @end is free for all
+ * the attendees of the @timeline. When it is not, the @out_next is set
+ * to the end of the clashing busy time when searching @forward, or to
+ * its start otherwise. All the times in between are busy too.
+ *
+ * Returns: whether the meeting time is free
+ *
+ * Since: 3.56
+ **/
+gboolean
+e_meeting_busy_timeline_check (EMeetingBusyTimeline *timeline,
+                               const EMeetingTime *start,
+                               const EMeetingTime *end,
+                               gboolean forward,
+                               EMeetingTime *out_next)
+{
+	const BusyBlock *block;
+	gint64 start_minutes, end_minutes, next;
+	guint ii;
+
+	g_return_val_if_fail (timeline != NULL, FALSE);
+	g_return_val_if_fail (start != NULL, FALSE);
+	g_return_val_if_fail (end != NULL, FALSE);
+	g_return_val_if_fail (out_next != NULL, FALSE);
+
+	start_minutes = meeting_time_to_minutes (start);
+	end_minutes = meeting_time_to_minutes (end);
+
+	block = busy_blocks_find_clash (timeline->blocks, start_minutes, end_minutes);
+	if (block) {
+		meeting_time_from_minutes (out_next, forward ? block->end : block->start);
+		return FALSE;
+	}
+
+	/* When there are no resources, any time is fine for them */
+	if (!timeline->resources->len)
+		return TRUE;
+
+	/* Remember the closest time any of the resources is free */
+	next = forward ? G_MAXINT64 : G_MININT64;
+
+	for (ii = 0; ii < timeline->resources->len; ii++) {
+		block = busy_blocks_find_clash (g_ptr_array_index (timeline->resources, ii), start_minutes, end_minutes);
+		if (!block)
+			return TRUE;
+
+		if (forward)
+			next = MIN (next, block->end);
+		else
+			next = MAX (next, block->start);
+	}
+
+	meeting_time_from_minutes (out_next, next);
+
+	return FALSE;
+}
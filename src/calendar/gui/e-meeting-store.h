@@ -154,6 +154,20 @@ void		e_meeting_store_refresh_busy_periods
 
 guint		e_meeting_store_get_num_queries	(EMeetingStore *meeting_store);
 
+typedef struct _EMeetingBusyTimeline EMeetingBusyTimeline;
+
+EMeetingBusyTimeline *
+		e_meeting_store_build_busy_timeline
+						(EMeetingStore *store,
+						 gboolean skip_optional,
+						 gboolean need_one_resource);
+void		e_meeting_busy_timeline_free	(EMeetingBusyTimeline *timeline);
+gboolean	e_meeting_busy_timeline_check	(EMeetingBusyTimeline *timeline,
+						 const EMeetingTime *start,
+						 const EMeetingTime *end,
+						 gboolean forward,
+						 EMeetingTime *out_next);
+
 G_END_DECLS
 
 #endif
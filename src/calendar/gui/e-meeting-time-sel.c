@@ -145,10 +145,6 @@ static void e_meeting_time_selector_find_nearest_interval_backward (EMeetingTime
 								    gint days, gint hours, gint mins);
 static void e_meeting_time_selector_adjust_time (EMeetingTime *mtstime,
 						 gint days, gint hours, gint minutes);
-static EMeetingFreeBusyPeriod * e_meeting_time_selector_find_time_clash (EMeetingTimeSelector *mts,
-									EMeetingAttendee *attendee,
-									EMeetingTime *start_time,
-									EMeetingTime *end_time);
 
 static void e_meeting_time_selector_recalc_grid (EMeetingTimeSelector *mts);
 static void e_meeting_time_selector_recalc_date_format (EMeetingTimeSelector *mts);
@@ -1654,13 +1650,61 @@ static void
 e_meeting_time_selector_autopick (EMeetingTimeSelector *mts,
                                   gboolean forward)
 {
-	EMeetingTime start_time, end_time, *resource_free;
-	EMeetingAttendee *attendee;
-	EMeetingFreeBusyPeriod *period;
+	GArray *slots;
+	EMeetingFreeBusyPeriod *slot;
+
+	slots = e_meeting_time_selector_find_free_slots (mts, forward, 1);
+	if (!slots->len) {
+		g_array_unref (slots);
+		return;
+	}
+
+	slot = &g_array_index (slots, EMeetingFreeBusyPeriod, 0);
+
+	mts->meeting_start_time = slot->start;
+	mts->meeting_end_time = slot->end;
+	mts->meeting_positions_valid = FALSE;
+	gtk_widget_queue_draw (mts->display_top);
+	gtk_widget_queue_draw (mts->display_main);
+
+	g_array_unref (slots);
+
+	/* Make sure the time is shown. */
+	e_meeting_time_selector_ensure_meeting_time_shown (mts);
+
+	/* Set the times in the EDateEdit widgets. */
+	e_meeting_time_selector_update_start_date_edit (mts);
+	e_meeting_time_selector_update_end_date_edit (mts);
+
+	g_signal_emit (mts, signals[CHANGED], 0);
+}
+
+/* Returns up to max_slots meeting times, of the current meeting duration,
+ * for which all the attendees are available, as EMeetingFreeBusyPeriod-s
+ * of type E_MEETING_FREE_BUSY_FREE. The search goes forward or backward
+ * from the current meeting time, honouring the autopick option and the
+ * working hours. The busy periods of all the attendees are merged into
+ * one timeline first, thus each candidate time is checked only once,
+ * instead of once per attendee, and the search can skip whole busy blocks.
+ * Free the returned array with g_array_unref(). */
+GArray *
+e_meeting_time_selector_find_free_slots (EMeetingTimeSelector *mts,
+                                         gboolean forward,
+                                         guint max_slots)
+{
+	EMeetingBusyTimeline *timeline;
+	EMeetingTime start_time, end_time, next_time;
 	EMeetingTimeSelectorAutopickOption autopick_option;
-	gint duration_days, duration_hours, duration_minutes, row;
-	gboolean meeting_time_ok, skip_optional = FALSE;
-	gboolean need_one_resource = FALSE, found_resource;
+	GArray *slots;
+	gint duration_days, duration_hours, duration_minutes;
+	gboolean skip_optional = FALSE, need_one_resource = FALSE;
+
+	g_return_val_if_fail (E_IS_MEETING_TIME_SELECTOR (mts), NULL);
+
+	slots = g_array_sized_new (FALSE, TRUE, sizeof (EMeetingFreeBusyPeriod), max_slots);
+
+	if (!max_slots)
+		return slots;
 
 	/* Get the current meeting duration in days + hours + minutes. */
 	e_meeting_time_selector_calculate_time_difference (&mts->meeting_start_time, &mts->meeting_end_time, &duration_days, &duration_hours, &duration_minutes);
@@ -1682,94 +1726,38 @@ e_meeting_time_selector_autopick (EMeetingTimeSelector *mts,
 	    || autopick_option == E_MEETING_TIME_SELECTOR_REQUIRED_PEOPLE_AND_ONE_RESOURCE)
 		need_one_resource = TRUE;
 
-	/* Keep moving forward or backward until we find a possible meeting
-	 * time. */
-	for (;;) {
-		meeting_time_ok = TRUE;
-		found_resource = FALSE;
-		resource_free = NULL;
-
-		/* Step through each attendee, checking if the meeting time
-		 * intersects one of the attendees busy periods. */
-		for (row = 0; row < e_meeting_store_count_actual_attendees (mts->model); row++) {
-			attendee = e_meeting_store_find_attendee_at_row (mts->model, row);
-
-			/* Skip optional people if they don't matter. */
-			if (skip_optional && e_meeting_attendee_get_atype (attendee) == E_MEETING_ATTENDEE_OPTIONAL_PERSON)
-				continue;
-
-			period = e_meeting_time_selector_find_time_clash (mts, attendee, &start_time, &end_time);
-
-			if (need_one_resource && e_meeting_attendee_get_atype (attendee) == E_MEETING_ATTENDEE_RESOURCE) {
-				if (period) {
-					/* We want to remember the closest
-					 * prev/next time that one resource is
-					 * available, in case we don't find any
-					 * free resources. */
-					if (forward) {
-						if (!resource_free || e_meeting_time_compare_times (resource_free, &period->end) > 0)
-							resource_free = &period->end;
-					} else {
-						if (!resource_free || e_meeting_time_compare_times (resource_free, &period->start) < 0)
-							resource_free = &period->start;
-					}
-
-				} else {
-					found_resource = TRUE;
-				}
-			} else if (period) {
-				/* Skip the period which clashed. */
-				if (forward) {
-					start_time = period->end;
-				} else {
-					start_time = period->start;
-					e_meeting_time_selector_adjust_time (&start_time, -duration_days, -duration_hours, -duration_minutes);
-				}
-				meeting_time_ok = FALSE;
-				break;
-			}
-		}
+	timeline = e_meeting_store_build_busy_timeline (mts->model, skip_optional, need_one_resource);
 
-		/* Check that we found one resource if necessary. If not, skip
-		 * to the closest time that a resource is free. Note that if
-		 * there are no resources, resource_free will never get set,
-		 * so we assume the meeting time is OK. */
-		if (meeting_time_ok && need_one_resource && !found_resource
-		    && resource_free) {
-			if (forward) {
-				start_time = *resource_free;
-			} else {
-				start_time = *resource_free;
-				e_meeting_time_selector_adjust_time (&start_time, -duration_days, -duration_hours, -duration_minutes);
-			}
-			meeting_time_ok = FALSE;
-		}
-
-		if (meeting_time_ok) {
-			mts->meeting_start_time = start_time;
-			mts->meeting_end_time = end_time;
-			mts->meeting_positions_valid = FALSE;
-			gtk_widget_queue_draw (mts->display_top);
-			gtk_widget_queue_draw (mts->display_main);
+	/* Keep moving forward or backward until we find enough possible
+	 * meeting times. */
+	while (slots->len < max_slots) {
+		if (e_meeting_busy_timeline_check (timeline, &start_time, &end_time, forward, &next_time)) {
+			EMeetingFreeBusyPeriod slot = { 0, };
 
-			/* Make sure the time is shown. */
-			e_meeting_time_selector_ensure_meeting_time_shown (mts);
+			slot.start = start_time;
+			slot.end = end_time;
+			slot.busy_type = E_MEETING_FREE_BUSY_FREE;
 
-			/* Set the times in the EDateEdit widgets. */
-			e_meeting_time_selector_update_start_date_edit (mts);
-			e_meeting_time_selector_update_end_date_edit (mts);
-
-			g_signal_emit (mts, signals[CHANGED], 0);
-
-			return;
+			g_array_append_val (slots, slot);
+		} else {
+			/* Skip the busy time which clashed. */
+			start_time = next_time;
+			if (!forward)
+				e_meeting_time_selector_adjust_time (&start_time, -duration_days, -duration_hours, -duration_minutes);
 		}
 
-		/* Move forward to the next possible interval. */
-		if (forward)
-			e_meeting_time_selector_find_nearest_interval (mts, &start_time, &end_time, duration_days, duration_hours, duration_minutes);
-		else
-			e_meeting_time_selector_find_nearest_interval_backward (mts, &start_time, &end_time, duration_days, duration_hours, duration_minutes);
+		/* Move to the next possible interval. */
+		if (slots->len < max_slots) {
+			if (forward)
+				e_meeting_time_selector_find_nearest_interval (mts, &start_time, &end_time, duration_days, duration_hours, duration_minutes);
+			else
+				e_meeting_time_selector_find_nearest_interval_backward (mts, &start_time, &end_time, duration_days, duration_hours, duration_minutes);
+		}
 	}
+
+	e_meeting_busy_timeline_free (timeline);
+
+	return slots;
 }
 
 static void
@@ -2016,47 +2004,6 @@ e_meeting_time_selector_adjust_time (EMeetingTime *mtstime,
 	e_meeting_time_selector_fix_time_overflows (mtstime);
 }
 
-/* This looks for any busy period of the given attendee which clashes with
- * the start and end time. It uses a binary search. */
-static EMeetingFreeBusyPeriod *
-e_meeting_time_selector_find_time_clash (EMeetingTimeSelector *mts,
-                                         EMeetingAttendee *attendee,
-                                         EMeetingTime *start_time,
-                                         EMeetingTime *end_time)
-{
-	EMeetingFreeBusyPeriod *period;
-	const GArray *busy_periods;
-	gint period_num;
-
-	busy_periods = e_meeting_attendee_get_busy_periods (attendee);
-	period_num = e_meeting_attendee_find_first_busy_period (attendee, &start_time->date);
-
-	if (period_num == -1)
-		return NULL;
-
-	/* Step forward through the busy periods until we find a clash or we
-	 * go past the end_time. */
-	while (period_num < busy_periods->len) {
-		period = &g_array_index (busy_periods,  EMeetingFreeBusyPeriod, period_num);
-
-		/* If the period starts at or after the end time, there is no
-		 * clash and we are finished. The busy periods are sorted by
-		 * their start times, so all the rest will be later. */
-		if (e_meeting_time_compare_times (&period->start, end_time) >= 0)
-			return NULL;
-
-		/* If the period ends after the start time, we have found a
-		 * clash. From the above test we already know the busy period
-		 * isn't completely after the meeting time. */
-		if (e_meeting_time_compare_times (&period->end, start_time) > 0)
-			return period;
-
-		period_num++;
-	}
-
-	return NULL;
-}
-
 static void
 e_meeting_time_selector_on_zoomed_out_toggled (GtkCheckMenuItem *menuitem,
                                                EMeetingTimeSelector *mts)
@@ -414,6 +414,10 @@ void		e_meeting_time_selector_refresh_free_busy
 						(EMeetingTimeSelector *mts,
 						 gint row,
 						 gboolean all);
+GArray *	e_meeting_time_selector_find_free_slots
+						(EMeetingTimeSelector *mts,
+						 gboolean forward,
+						 guint max_slots);
 
 G_END_DECLS
 
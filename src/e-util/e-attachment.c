@@ -32,6 +32,7 @@
 
 #include <libedataserver/libedataserver.h>
 
+#include "e-file-data-wrapper.h"
 #include "e-icon-factory.h"
 #include "e-mktemp.h"
 #include "e-misc-utils.h"
@@ -2021,51 +2022,57 @@ attachment_load_finish_common (EAttachment *attachment,
 	e_attachment_set_may_reload (attachment, FALSE);
 }
 
+/* Whether the file content should be streamed from the disk,
+ * instead of being read into the memory. Only plain local files
+ * larger than the configured threshold are streamed. */
+static gboolean
+attachment_load_should_stream (EAttachment *attachment,
+                               GFile *file,
+                               GFileInfo *file_info)
+{
+	GSettings *settings;
+	goffset threshold;
+
+	if (e_attachment_is_rfc822 (attachment) ||
+	    !g_file_is_native (file) ||
+	    g_file_info_get_file_type (file_info) != G_FILE_TYPE_REGULAR ||
+	    !g_file_info_has_attribute (file_info, G_FILE_ATTRIBUTE_STANDARD_SIZE))
+		return FALSE;
+
+	settings = e_util_ref_settings ("org.gnome.evolution.shell");
+	threshold = g_settings_get_int (settings, "attachment-stream-threshold");
+	g_object_unref (settings);
+
+	return threshold > 0 && g_file_info_get_size (file_info) > threshold * 1024 * 1024;
+}
+
 static void
-attachment_load_finish (GTask *task)
+attachment_load_finish_with_wrapper (GTask *task,
+                                     CamelDataWrapper *wrapper,
+                                     gsize size)
 {
 	LoadContext *load_context;
 	GFileInfo *file_info;
 	EAttachment *attachment;
-	GMemoryOutputStream *output_stream;
-	CamelDataWrapper *wrapper;
 	CamelMimePart *mime_part;
-	CamelStream *stream;
 	const gchar *content_type;
 	const gchar *display_name;
 	const gchar *description;
 	const gchar *disposition;
 	gchar *mime_type;
-	gpointer data;
-	gsize size;
 
 	load_context = g_task_get_task_data (task);
 	attachment = g_task_get_source_object (task);
 	file_info = load_context->file_info;
-	output_stream = G_MEMORY_OUTPUT_STREAM (load_context->output_stream);
-
-	if (e_attachment_is_rfc822 (attachment))
-		wrapper = (CamelDataWrapper *) camel_mime_message_new ();
-	else
-		wrapper = camel_data_wrapper_new ();
 
 	content_type = g_file_info_get_content_type (file_info);
 	mime_type = g_content_type_get_mime_type (content_type);
 
-	data = g_memory_output_stream_get_data (output_stream);
-	size = g_memory_output_stream_get_data_size (output_stream);
-
-	stream = camel_stream_mem_new_with_buffer (data, size);
-	camel_data_wrapper_construct_from_stream_sync (
-		wrapper, stream, NULL, NULL);
 	camel_data_wrapper_set_mime_type (wrapper, mime_type);
-	camel_stream_close (stream, NULL, NULL);
-	g_object_unref (stream);
 
 	mime_part = camel_mime_part_new ();
 	camel_medium_set_content (CAMEL_MEDIUM (mime_part), wrapper);
 
-	g_object_unref (wrapper);
 	g_free (mime_type);
 
 	if (g_file_info_has_attribute (file_info, G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME)) {
@@ -2098,6 +2105,45 @@ attachment_load_finish (GTask *task)
 	g_object_unref (task);
 }
 
+static void
+attachment_load_finish (GTask *task)
+{
+	LoadContext *load_context;
+	EAttachment *attachment;
+	GMemoryOutputStream *output_stream;
+	CamelDataWrapper *wrapper;
+	CamelStream *stream;
+	GByteArray *byte_array;
+	gsize size;
+
+	load_context = g_task_get_task_data (task);
+	attachment = g_task_get_source_object (task);
+	output_stream = G_MEMORY_OUTPUT_STREAM (load_context->output_stream);
+
+	if (e_attachment_is_rfc822 (attachment))
+		wrapper = (CamelDataWrapper *) camel_mime_message_new ();
+	else
+		wrapper = camel_data_wrapper_new ();
+
+	/* Hand the loaded data over to the CamelStream, rather than
+	 * copying it, and free it as soon as the wrapper is constructed,
+	 * thus there are at most two copies of the content in memory. */
+	g_output_stream_close (G_OUTPUT_STREAM (output_stream), NULL, NULL);
+	size = g_memory_output_stream_get_data_size (output_stream);
+	byte_array = g_byte_array_new_take (g_memory_output_stream_steal_data (output_stream), size);
+	g_clear_object (&load_context->output_stream);
+
+	stream = camel_stream_mem_new_with_byte_array (byte_array);
+	camel_data_wrapper_construct_from_stream_sync (
+		wrapper, stream, NULL, NULL);
+	camel_stream_close (stream, NULL, NULL);
+	g_object_unref (stream);
+
+	attachment_load_finish_with_wrapper (task, wrapper, size);
+
+	g_object_unref (wrapper);
+}
+
 static void
 attachment_load_write_cb (GObject *source_object,
                           GAsyncResult *result,
@@ -2220,6 +2266,24 @@ attachment_load_file_read_cb (GObject *source_object,
 		return;
 	}
 
+	/* Large files are read from the disk only when the message
+	 * is being written, which avoids having them in the memory. */
+	if (attachment_load_should_stream (g_task_get_source_object (task), file, load_context->file_info)) {
+		CamelDataWrapper *wrapper;
+		goffset size;
+
+		g_object_unref (input_stream);
+
+		size = g_file_info_get_size (load_context->file_info);
+		wrapper = e_file_data_wrapper_new (file, size);
+
+		attachment_progress_cb (size, size, g_task_get_source_object (task));
+		attachment_load_finish_with_wrapper (g_steal_pointer (&task), wrapper, size);
+
+		g_object_unref (wrapper);
+		return;
+	}
+
 	/* Load the contents into a GMemoryOutputStream. */
 	output_stream = g_memory_output_stream_new (
 		NULL, 0, g_realloc, g_free);
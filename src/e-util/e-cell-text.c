@@ -112,6 +112,37 @@ G_DEFINE_TYPE (ECellText, e_cell_text, E_TYPE_CELL)
 
 #define TEXT_PAD 4
 
+/* How many layouts each view remembers */
+#define LAYOUT_CACHE_MAX_SIZE 512
+
+/* Bumped whenever any ECellText property changes, which invalidates all cached layouts */
+static guint layout_cache_generation = 0;
+static guint64 layout_cache_hits = 0;
+static guint64 layout_cache_misses = 0;
+
+enum {
+	ATTR_FLAG_BOLD		= 1 << 0,
+	ATTR_FLAG_STRIKEOUT	= 1 << 1,
+	ATTR_FLAG_UNDERLINE	= 1 << 2,
+	ATTR_FLAG_ITALIC	= 1 << 3
+};
+
+typedef struct {
+	gint row;
+	gint model_col;
+	gint width;
+	guint attr_flags;
+	guint strikeout_color;
+	guint generation;
+	gchar *text;
+} LayoutCacheKey;
+
+typedef struct {
+	LayoutCacheKey key;
+	PangoLayout *layout;
+	GList *link;			/* in ECellTextView::layout_cache_lru */
+} LayoutCacheEntry;
+
 typedef struct {
 	gpointer lines;			/* Text split into lines (private field) */
 	gint num_lines;			/* Number of lines of text */
@@ -135,6 +166,15 @@ typedef struct {
 	gint xofs, yofs;                 /* This gets added to the x
                                            and y for the cell text. */
 	gdouble ellipsis_width[2];      /* The width of the ellipsis. */
+
+	GHashTable *layout_cache;	/* LayoutCacheKey ~> LayoutCacheEntry */
+	GQueue layout_cache_lru;	/* LayoutCacheEntry, the most recently used first */
+	ETableModel *layout_cache_model;	/* to invalidate the layout_cache on changes */
+	gulong model_changed_id;
+	gulong model_row_changed_id;
+	gulong model_cell_changed_id;
+	gulong model_rows_inserted_id;
+	gulong model_rows_deleted_id;
 } ECellTextView;
 
 struct _CellEdit {
@@ -330,6 +370,100 @@ ect_cancel_edit (ECellTextView *text_view)
 	e_table_item_leave_edit_ (text_view->cell_view.e_table_item_view);
 }
 
+static guint
+layout_cache_key_hash (gconstpointer ptr)
+{
+	const LayoutCacheKey *key = ptr;
+
+	return g_str_hash (key->text) ^ (guint) (key->row * 31 + key->model_col) ^ ((guint) key->width << 16);
+}
+
+static gboolean
+layout_cache_key_equal (gconstpointer ptr1,
+                        gconstpointer ptr2)
+{
+	const LayoutCacheKey *key1 = ptr1, *key2 = ptr2;
+
+	return key1->row == key2->row &&
+		key1->model_col == key2->model_col &&
+		key1->width == key2->width &&
+		key1->attr_flags == key2->attr_flags &&
+		key1->strikeout_color == key2->strikeout_color &&
+		key1->generation == key2->generation &&
+		g_strcmp0 (key1->text, key2->text) == 0;
+}
+
+static void
+layout_cache_entry_free (gpointer ptr)
+{
+	LayoutCacheEntry *entry = ptr;
+
+	if (entry) {
+		g_clear_object (&entry->layout);
+		g_free (entry->key.text);
+		g_free (entry);
+	}
+}
+
+static void
+layout_cache_clear (ECellTextView *text_view)
+{
+	g_queue_clear (&text_view->layout_cache_lru);
+	g_hash_table_remove_all (text_view->layout_cache);
+}
+
+static void
+layout_cache_remove_row (ECellTextView *text_view,
+                         gint row)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init (&iter, text_view->layout_cache);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		LayoutCacheEntry *entry = value;
+
+		if (entry->key.row == row) {
+			g_queue_delete_link (&text_view->layout_cache_lru, entry->link);
+			g_hash_table_iter_remove (&iter);
+		}
+	}
+}
+
+static void
+ect_model_changed_cb (ETableModel *table_model,
+                      ECellTextView *text_view)
+{
+	layout_cache_clear (text_view);
+}
+
+static void
+ect_model_row_changed_cb (ETableModel *table_model,
+                          gint row,
+                          ECellTextView *text_view)
+{
+	layout_cache_remove_row (text_view, row);
+}
+
+static void
+ect_model_cell_changed_cb (ETableModel *table_model,
+                           gint col,
+                           gint row,
+                           ECellTextView *text_view)
+{
+	layout_cache_remove_row (text_view, row);
+}
+
+static void
+ect_model_rows_changed_cb (ETableModel *table_model,
+                           gint row,
+                           gint count,
+                           ECellTextView *text_view)
+{
+	/* The rows moved, thus the cached row numbers are not valid anymore */
+	layout_cache_clear (text_view);
+}
+
 /*
  * ECell::new_view method
  */
@@ -352,6 +486,31 @@ ect_new_view (ECell *ecell,
 	text_view->xofs = 0.0;
 	text_view->yofs = 0.0;
 
+	text_view->layout_cache = g_hash_table_new_full (layout_cache_key_hash, layout_cache_key_equal,
+		NULL, layout_cache_entry_free);
+	g_queue_init (&text_view->layout_cache_lru);
+
+	if (table_model) {
+		/* Keep the model alive, to be able to disconnect from it in ect_kill_view() */
+		text_view->layout_cache_model = g_object_ref (table_model);
+
+		text_view->model_changed_id = g_signal_connect (
+			table_model, "model_changed",
+			G_CALLBACK (ect_model_changed_cb), text_view);
+		text_view->model_row_changed_id = g_signal_connect (
+			table_model, "model_row_changed",
+			G_CALLBACK (ect_model_row_changed_cb), text_view);
+		text_view->model_cell_changed_id = g_signal_connect (
+			table_model, "model_cell_changed",
+			G_CALLBACK (ect_model_cell_changed_cb), text_view);
+		text_view->model_rows_inserted_id = g_signal_connect (
+			table_model, "model_rows_inserted",
+			G_CALLBACK (ect_model_rows_changed_cb), text_view);
+		text_view->model_rows_deleted_id = g_signal_connect (
+			table_model, "model_rows_deleted",
+			G_CALLBACK (ect_model_rows_changed_cb), text_view);
+	}
+
 	return (ECellView *) text_view;
 }
 
@@ -369,6 +528,28 @@ ect_kill_view (ECellView *ecv)
 	if (text_view->cell_view.kill_view_cb_data)
 	    g_list_free (text_view->cell_view.kill_view_cb_data);
 
+	if (text_view->layout_cache_model) {
+		#define disconnect(x) G_STMT_START { \
+			if (text_view->x) { \
+				g_signal_handler_disconnect (text_view->layout_cache_model, text_view->x); \
+				text_view->x = 0; \
+			} \
+		} G_STMT_END
+
+		disconnect (model_changed_id);
+		disconnect (model_row_changed_id);
+		disconnect (model_cell_changed_id);
+		disconnect (model_rows_inserted_id);
+		disconnect (model_rows_deleted_id);
+
+		#undef disconnect
+
+		g_clear_object (&text_view->layout_cache_model);
+	}
+
+	layout_cache_clear (text_view);
+	g_hash_table_destroy (text_view->layout_cache);
+
 	g_free (text_view);
 }
 
@@ -400,11 +581,61 @@ ect_unrealize (ECellView *ecv)
 
 	g_clear_object (&text_view->i_cursor);
 
+	layout_cache_clear (text_view);
+
 	if (E_CELL_CLASS (e_cell_text_parent_class)->unrealize)
 		(* E_CELL_CLASS (e_cell_text_parent_class)->unrealize) (ecv);
 
 }
 
+/*
+ * ECell::style_updated method
+ */
+static void
+ect_style_updated (ECellView *ecell_view)
+{
+	ECellTextView *text_view = (ECellTextView *) ecell_view;
+
+	layout_cache_clear (text_view);
+
+	if (E_CELL_CLASS (e_cell_text_parent_class)->style_updated)
+		E_CELL_CLASS (e_cell_text_parent_class)->style_updated (ecell_view);
+}
+
+/* Returns ATTR_FLAG_... bit-or of the text attributes for the @row */
+static guint
+get_attr_flags (ECellTextView *text_view,
+                gint row,
+                guint *out_strikeout_color)
+{
+	ECellView *ecell_view = (ECellView *) text_view;
+	ECellText *ect = E_CELL_TEXT (ecell_view->ecell);
+	guint flags = 0;
+
+	*out_strikeout_color = 0;
+
+	if (row < 0)
+		return flags;
+
+	if (ect->bold_column >= 0 &&
+	    e_table_model_value_at (ecell_view->e_table_model, ect->bold_column, row))
+		flags |= ATTR_FLAG_BOLD;
+	if (ect->strikeout_column >= 0 &&
+	    e_table_model_value_at (ecell_view->e_table_model, ect->strikeout_column, row))
+		flags |= ATTR_FLAG_STRIKEOUT;
+	if (ect->underline_column >= 0 &&
+	    e_table_model_value_at (ecell_view->e_table_model, ect->underline_column, row))
+		flags |= ATTR_FLAG_UNDERLINE;
+	if (ect->italic_column >= 0 &&
+	    e_table_model_value_at (ecell_view->e_table_model, ect->italic_column, row))
+		flags |= ATTR_FLAG_ITALIC;
+
+	if ((flags & ATTR_FLAG_STRIKEOUT) != 0 && ect->strikeout_color_column >= 0)
+		*out_strikeout_color = GPOINTER_TO_UINT (e_table_model_value_at (ecell_view->e_table_model, ect->strikeout_color_column, row));
+
+	return flags;
+}
+
 static PangoAttrList *
 build_attr_list (ECellTextView *text_view,
                  gint row,
@@ -416,23 +647,14 @@ build_attr_list (ECellTextView *text_view,
 	ECellText *ect = E_CELL_TEXT (ecell_view->ecell);
 	PangoAttrList *attrs = out_attrs_span ? NULL : pango_attr_list_new ();
 	gboolean bold, strikeout, underline, italic;
-	gint strikeout_color = 0;
-
-	bold = ect->bold_column >= 0 &&
-		row >= 0 &&
-		e_table_model_value_at (ecell_view->e_table_model, ect->bold_column, row);
-	strikeout = ect->strikeout_column >= 0 &&
-		row >= 0 &&
-		e_table_model_value_at (ecell_view->e_table_model, ect->strikeout_column, row);
-	underline = ect->underline_column >= 0 &&
-		row >= 0 &&
-		e_table_model_value_at (ecell_view->e_table_model, ect->underline_column, row);
-	italic = ect->italic_column >= 0 &&
-		row >= 0 &&
-		e_table_model_value_at (ecell_view->e_table_model, ect->italic_column, row);
+	guint strikeout_color = 0;
+	guint flags;
 
-	if (strikeout && ect->strikeout_color_column >= 0 && row >= 0)
-		strikeout_color = GPOINTER_TO_UINT (e_table_model_value_at (ecell_view->e_table_model, ect->strikeout_color_column, row));
+	flags = get_attr_flags (text_view, row, &strikeout_color);
+	bold = (flags & ATTR_FLAG_BOLD) != 0;
+	strikeout = (flags & ATTR_FLAG_STRIKEOUT) != 0;
+	underline = (flags & ATTR_FLAG_UNDERLINE) != 0;
+	italic = (flags & ATTR_FLAG_ITALIC) != 0;
 
 	#define ensure_attrs_span() { if (out_attrs_span && !*out_attrs_span) *out_attrs_span = g_string_new ("<span"); }
 
@@ -691,7 +913,50 @@ generate_layout (ECellTextView *text_view,
 		return edit->layout;
 	}
 
-	if (row >= 0) {
+	if (row >= 0 && !edit) {
+		LayoutCacheEntry *entry;
+		LayoutCacheKey key;
+		gchar *temp = e_cell_text_get_text (ect, ecell_view->e_table_model, model_col, row);
+
+		key.row = row;
+		key.model_col = model_col;
+		key.width = width;
+		key.attr_flags = get_attr_flags (text_view, row, &key.strikeout_color);
+		key.generation = layout_cache_generation;
+		key.text = temp ? temp : (gchar *) "";
+
+		entry = g_hash_table_lookup (text_view->layout_cache, &key);
+		if (entry) {
+			layout_cache_hits++;
+
+			g_queue_unlink (&text_view->layout_cache_lru, entry->link);
+			g_queue_push_head_link (&text_view->layout_cache_lru, entry->link);
+		} else {
+			layout_cache_misses++;
+
+			if (g_hash_table_size (text_view->layout_cache) >= LAYOUT_CACHE_MAX_SIZE) {
+				LayoutCacheEntry *oldest = g_queue_pop_tail (&text_view->layout_cache_lru);
+
+				if (oldest)
+					g_hash_table_remove (text_view->layout_cache, &oldest->key);
+			}
+
+			entry = g_new0 (LayoutCacheEntry, 1);
+			entry->key = key;
+			entry->key.text = g_strdup (key.text);
+			entry->layout = build_layout (text_view, row, key.text, width);
+
+			g_queue_push_head (&text_view->layout_cache_lru, entry);
+			entry->link = text_view->layout_cache_lru.head;
+
+			g_hash_table_insert (text_view->layout_cache, &entry->key, entry);
+		}
+
+		e_cell_text_free_text (ect, ecell_view->e_table_model, model_col, temp);
+
+		/* The caller owns a reference, the same as with a newly built layout */
+		return g_object_ref (entry->layout);
+	} else if (row >= 0) {
 		gchar *temp = e_cell_text_get_text (ect, ecell_view->e_table_model, model_col, row);
 		layout = build_layout (text_view, row, temp ? temp : "", width);
 		e_cell_text_free_text (ect, ecell_view->e_table_model, model_col, temp);
@@ -1634,6 +1899,8 @@ ect_set_property (GObject *object,
 
 	text = E_CELL_TEXT (object);
 
+	layout_cache_generation++;
+
 	switch (property_id) {
 	case PROP_STRIKEOUT_COLUMN:
 		text->strikeout_column = g_value_get_int (value);
@@ -1767,6 +2034,7 @@ e_cell_text_class_init (ECellTextClass *class)
 	ecc->max_width = ect_max_width;
 	ecc->max_width_by_row = ect_max_width_by_row;
 	ecc->get_bg_color = ect_get_bg_color;
+	ecc->style_updated = ect_style_updated;
 
 	class->get_text = ect_real_get_text;
 	class->free_text = ect_real_free_text;
@@ -2191,6 +2459,42 @@ e_cell_text_set_value (ECellText *cell,
 	class->set_value (cell, model, col, row, text);
 }
 
+/**
+ * e_cell_text_get_layout_cache_stats:
+ * @out_hits: (out) (optional): return location for the count of cache hits, or %NULL
+ * @out_misses: (out) (optional): return location for the count of cache misses, or %NULL
+ *
+ * Returns how many times a cached #PangoLayout could be reused for drawing
+ * or measuring a text cell, and how many times a new layout had to be built,
+ * since the start or the last call of e_cell_text_reset_layout_cache_stats().
+ * The counts are shared by all #ECellText instances.
+ *
+ * Since: 3.56
+ **/
+void
+e_cell_text_get_layout_cache_stats (guint64 *out_hits,
+				    guint64 *out_misses)
+{
+	if (out_hits)
+		*out_hits = layout_cache_hits;
+	if (out_misses)
+		*out_misses = layout_cache_misses;
+}
+
+/**
+ * e_cell_text_reset_layout_cache_stats:
+ *
+ * Resets the counters returned by e_cell_text_get_layout_cache_stats().
+ *
+ * Since: 3.56
+ **/
+void
+e_cell_text_reset_layout_cache_stats (void)
+{
+	layout_cache_hits = 0;
+	layout_cache_misses = 0;
+}
+
 /* fixme: Handle Font attributes */
 /* position is in BYTES */
 
@@ -196,6 +196,13 @@ gchar *		e_cell_text_get_text_by_view	(ECellView *cell_view,
 						 gint col,
 						 gint row);
 
+/* Counters of reused and newly built layouts, for all ECellText-s */
+void		e_cell_text_get_layout_cache_stats
+						(guint64 *out_hits,
+						 guint64 *out_misses);
+void		e_cell_text_reset_layout_cache_stats
+						(void);
+
 G_END_DECLS
 
 #endif /* E_CELL_TEXT_H */
@@ -0,0 +1,193 @@
+/*
+ * e-file-data-wrapper.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-config.h"
+
+#include "e-file-data-wrapper.h"
+
+/* Size of the chunks the file content is copied in */
+#define READ_BUFFER_SIZE (64 * 1024)
+
+struct _EFileDataWrapperPrivate {
+	GFile *file;
+	goffset size;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE (EFileDataWrapper, e_file_data_wrapper, CAMEL_TYPE_DATA_WRAPPER)
+
+static gssize
+file_data_wrapper_write_to_stream_sync (CamelDataWrapper *data_wrapper,
+                                        CamelStream *stream,
+                                        GCancellable *cancellable,
+                                        GError **error)
+{
+	EFileDataWrapper *self = E_FILE_DATA_WRAPPER (data_wrapper);
+	GFileInputStream *input_stream;
+	gchar *buffer;
+	gssize total = 0;
+
+	input_stream = g_file_read (self->priv->file, cancellable, error);
+	if (!input_stream)
+		return -1;
+
+	buffer = g_malloc (READ_BUFFER_SIZE);
+
+	while (TRUE) {
+		gssize n_read;
+
+		n_read = g_input_stream_read (G_INPUT_STREAM (input_stream), buffer, READ_BUFFER_SIZE, cancellable, error);
+		if (n_read < 0) {
+			total = -1;
+			break;
+		}
+
+		if (n_read == 0)
+			break;
+
+		if (camel_stream_write (stream, buffer, n_read, cancellable, error) < 0) {
+			total = -1;
+			break;
+		}
+
+		total += n_read;
+	}
+
+	g_free (buffer);
+	g_object_unref (input_stream);
+
+	return total;
+}
+
+static gssize
+file_data_wrapper_write_to_output_stream_sync (CamelDataWrapper *data_wrapper,
+                                               GOutputStream *output_stream,
+                                               GCancellable *cancellable,
+                                               GError **error)
+{
+	EFileDataWrapper *self = E_FILE_DATA_WRAPPER (data_wrapper);
+	GFileInputStream *input_stream;
+	gssize total;
+
+	input_stream = g_file_read (self->priv->file, cancellable, error);
+	if (!input_stream)
+		return -1;
+
+	total = g_output_stream_splice (
+		output_stream, G_INPUT_STREAM (input_stream),
+		G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE,
+		cancellable, error);
+
+	g_object_unref (input_stream);
+
+	return total;
+}
+
+static void
+file_data_wrapper_finalize (GObject *object)
+{
+	EFileDataWrapper *self = E_FILE_DATA_WRAPPER (object);
+
+	g_clear_object (&self->priv->file);
+
+	/* Chain up to parent's method. */
+	G_OBJECT_CLASS (e_file_data_wrapper_parent_class)->finalize (object);
+}
+
+static void
+e_file_data_wrapper_class_init (EFileDataWrapperClass *class)
+{
+	GObjectClass *object_class;
+	CamelDataWrapperClass *data_wrapper_class;
+
+	object_class = G_OBJECT_CLASS (class);
+	object_class->finalize = file_data_wrapper_finalize;
+
+	/* The content is stored unencoded in the file, thus
+	 * the decode functions do the same as the write functions. */
+	data_wrapper_class = CAMEL_DATA_WRAPPER_CLASS (class);
+	data_wrapper_class->write_to_stream_sync = file_data_wrapper_write_to_stream_sync;
+	data_wrapper_class->decode_to_stream_sync = file_data_wrapper_write_to_stream_sync;
+	data_wrapper_class->write_to_output_stream_sync = file_data_wrapper_write_to_output_stream_sync;
+	data_wrapper_class->decode_to_output_stream_sync = file_data_wrapper_write_to_output_stream_sync;
+}
+
+static void
+e_file_data_wrapper_init (EFileDataWrapper *self)
+{
+	self->priv = e_file_data_wrapper_get_instance_private (self);
+}
+
+/**
+ * e_file_data_wrapper_new:
+ * @file: a #GFile to read the content from
+ * @size: size of the @file content, or -1 when not known
+ *
+ * Creates a new #CamelDataWrapper, which streams its content from
+ * the @file whenever it's written or decoded, thus the content is
+ * never held in memory as a whole. The @file should not change
+ * or be removed while the returned wrapper is in use.
+ *
+ * Returns: (transfer full): a new #EFileDataWrapper
+ *
+ * Since: 3.56
+ **/
+CamelDataWrapper *
+e_file_data_wrapper_new (GFile *file,
+                         goffset size)
+{
+	EFileDataWrapper *self;
+
+	g_return_val_if_fail (G_IS_FILE (file), NULL);
+
+	self = g_object_new (E_TYPE_FILE_DATA_WRAPPER, NULL);
+	self->priv->file = g_object_ref (file);
+	self->priv->size = size;
+
+	return CAMEL_DATA_WRAPPER (self);
+}
+
+/**
+ * e_file_data_wrapper_get_file:
+ * @wrapper: an #EFileDataWrapper
+ *
+ * Returns: (transfer none): a #GFile the @wrapper reads its content from
+ *
+ * Since: 3.56
+ **/
+GFile *
+e_file_data_wrapper_get_file (EFileDataWrapper *wrapper)
+{
+	g_return_val_if_fail (E_IS_FILE_DATA_WRAPPER (wrapper), NULL);
+
+	return wrapper->priv->file;
+}
+
+/**
+ * e_file_data_wrapper_get_size:
+ * @wrapper: an #EFileDataWrapper
+ *
+ * Returns: size of the content, as passed to e_file_data_wrapper_new()
+ *
+ * Since: 3.56
+ **/
+goffset
+e_file_data_wrapper_get_size (EFileDataWrapper *wrapper)
+{
+	g_return_val_if_fail (E_IS_FILE_DATA_WRAPPER (wrapper), -1);
+
+	return wrapper->priv->size;
+}
@@ -18,9 +18,11 @@
 #include "evolution-config.h"
 
 #include <sys/types.h>
+#include <errno.h>
 #include <string.h>
 
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 
 #include <libebackend/libebackend.h>
 
@@ -71,13 +73,17 @@ static GSList *ep_disabled;
 /* All classes which implement EPluginHooks, by class.id */
 static GHashTable *eph_types;
 
-struct _plugin_doc {
-	struct _plugin_doc *next;
-	struct _plugin_doc *prev;
-
-	gchar *filename;
-	xmlDocPtr doc;
-};
+/* The manifest caches the <e-plugin> elements of all the .eplug files,
+ * with their load level, thus the files are not read and parsed at every
+ * start. It is rebuilt when any plugin directory or .eplug file changes.
+ * It is a serialized GVariant of the EP_MANIFEST_TYPE:
+ *    version,
+ *    array of plugin directories with their modification time,
+ *    array of .eplug files with their size and modification time and
+ *       with an array of their <e-plugin> elements as
+ *       (load_level property or an empty string, XML of the element) */
+#define EP_MANIFEST_VERSION 1
+#define EP_MANIFEST_TYPE "(ua(sx)a(sxxa(ss)))"
 
 enum {
 	EP_PROP_0,
@@ -310,7 +316,7 @@ e_plugin_init (EPlugin *ep)
 
 static EPlugin *
 ep_load_plugin (xmlNodePtr root,
-                struct _plugin_doc *pdoc)
+                const gchar *filename)
 {
 	gchar *prop, *id;
 	EPluginClass *class;
@@ -318,7 +324,7 @@ ep_load_plugin (xmlNodePtr root,
 
 	id = e_plugin_xml_prop (root, "id");
 	if (id == NULL) {
-		g_warning ("Invalid e-plugin entry in '%s': no id", pdoc->filename);
+		g_warning ("Invalid e-plugin entry in '%s': no id", filename);
 		return NULL;
 	}
 
@@ -331,7 +337,7 @@ ep_load_plugin (xmlNodePtr root,
 	prop = (gchar *) xmlGetProp (root, (const guchar *)"type");
 	if (prop == NULL) {
 		g_free (id);
-		g_warning ("Invalid e-plugin entry in '%s': no type", pdoc->filename);
+		g_warning ("Invalid e-plugin entry in '%s': no type", filename);
 		return NULL;
 	}
 
@@ -347,7 +353,7 @@ ep_load_plugin (xmlNodePtr root,
 
 	ep = g_object_new (G_TYPE_FROM_CLASS (class), NULL);
 	ep->id = id;
-	ep->path = g_strdup (pdoc->filename);
+	ep->path = g_strdup (filename);
 	ep->enabled = ep_check_enabled (id);
 	if (e_plugin_construct (ep, root) == -1)
 		e_plugin_enable (ep, FALSE);
@@ -356,71 +362,52 @@ ep_load_plugin (xmlNodePtr root,
 	return ep;
 }
 
-static gint
+/* Loads the plugin from the XML of its <e-plugin> element, when it
+ * belongs to the load_level; the 'plugin_load_level' is the value of
+ * the element's load_level property, or an empty string, when unset */
+static void
 ep_load (const gchar *filename,
+         const gchar *plugin_load_level,
+         const gchar *xml,
          gint load_level)
 {
 	xmlDocPtr doc;
 	xmlNodePtr root;
-	EPlugin *ep = NULL;
-	struct _plugin_doc *pdoc;
-
-	doc = e_xml_parse_file (filename);
-	if (doc == NULL)
-		return -1;
+	EPlugin *ep;
+	gchar *is_system_plugin;
 
-	root = xmlDocGetRootElement (doc);
-	if (strcmp ((gchar *) root->name, "e-plugin-list") != 0) {
-		g_warning ("No <e-plugin-list> root element: %s", filename);
-		xmlFreeDoc (doc);
-		return -1;
+	if (*plugin_load_level) {
+		if (atoi (plugin_load_level) != load_level)
+			return;
+	} else if (load_level != 2) {
+		return;
 	}
 
-	pdoc = g_malloc0 (sizeof (*pdoc));
-	pdoc->doc = doc;
-	pdoc->filename = g_strdup (filename);
-
-	for (root = root->children; root; root = root->next) {
-		if (strcmp ((gchar *) root->name, "e-plugin") == 0) {
-			gchar *plugin_load_level, *is_system_plugin;
-
-			plugin_load_level = NULL;
-			plugin_load_level = e_plugin_xml_prop (root, "load_level");
-			if (plugin_load_level) {
-				if ((atoi (plugin_load_level) == load_level)) {
-					ep = ep_load_plugin (root, pdoc);
+	doc = xmlParseMemory (xml, strlen (xml));
+	if (!doc)
+		return;
 
-					if (ep && load_level == 1)
-						e_plugin_invoke (
-							ep, "load_plugin_type_register_function", NULL);
-				}
-			} else if (load_level == 2) {
-				ep = ep_load_plugin (root, pdoc);
-			}
+	root = xmlDocGetRootElement (doc);
 
-			if (ep) {
-				/* README: Maybe we can use load_levels to
-				 * achieve the same thing.  But it may be
-				 * confusing for a plugin writer. */
-				is_system_plugin =
-					e_plugin_xml_prop (root, "system_plugin");
-				if (g_strcmp0 (is_system_plugin, "true") == 0) {
-					e_plugin_enable (ep, TRUE);
-					ep->flags |= E_PLUGIN_FLAGS_SYSTEM_PLUGIN;
-				} else
-					ep->flags &= ~E_PLUGIN_FLAGS_SYSTEM_PLUGIN;
-				g_free (is_system_plugin);
-
-				ep = NULL;
-			}
-		}
+	ep = ep_load_plugin (root, filename);
+
+	if (ep && *plugin_load_level && load_level == 1)
+		e_plugin_invoke (ep, "load_plugin_type_register_function", NULL);
+
+	if (ep) {
+		/* README: Maybe we can use load_levels to
+		 * achieve the same thing.  But it may be
+		 * confusing for a plugin writer. */
+		is_system_plugin = e_plugin_xml_prop (root, "system_plugin");
+		if (g_strcmp0 (is_system_plugin, "true") == 0) {
+			e_plugin_enable (ep, TRUE);
+			ep->flags |= E_PLUGIN_FLAGS_SYSTEM_PLUGIN;
+		} else
+			ep->flags &= ~E_PLUGIN_FLAGS_SYSTEM_PLUGIN;
+		g_free (is_system_plugin);
 	}
 
-	xmlFreeDoc (pdoc->doc);
-	g_free (pdoc->filename);
-	g_free (pdoc);
-
-	return 0;
+	xmlFreeDoc (doc);
 }
 
 static void
@@ -470,31 +457,194 @@ plugin_hook_load_subclass (GType type,
 	g_hash_table_insert (hash_table, key, hook_class);
 }
 
+static gchar *
+ep_manifest_dup_filename (void)
+{
+	return g_build_filename (e_get_user_cache_dir (), "plugins.manifest", NULL);
+}
+
+/* Adds the .eplug file with its <e-plugin> elements into the 'files' builder */
 static void
-e_plugin_traverse_directory (const gchar *dirname,
-			     gint index)
+ep_manifest_add_file (GVariantBuilder *files,
+                      const gchar *filename)
 {
-	GDir *dir;
-	const gchar *d;
+	GVariantBuilder plugins;
+	GStatBuf st;
+	xmlDocPtr doc;
+	xmlNodePtr root;
 
-	pd (printf ("scanning plugin dir '%s'\n", dirname));
+	if (g_stat (filename, &st) != 0)
+		return;
 
-	dir = g_dir_open (dirname, 0, NULL);
+	g_variant_builder_init (&plugins, G_VARIANT_TYPE ("a(ss)"));
 
-	if (!dir)
-		return;
+	/* Invalid files are remembered too, thus they are not parsed again */
+	doc = e_xml_parse_file (filename);
+	root = doc ? xmlDocGetRootElement (doc) : NULL;
+
+	if (root && strcmp ((gchar *) root->name, "e-plugin-list") != 0) {
+		g_warning ("No <e-plugin-list> root element: %s", filename);
+		root = NULL;
+	}
+
+	for (root = root ? root->children : NULL; root; root = root->next) {
+		if (strcmp ((gchar *) root->name, "e-plugin") == 0) {
+			xmlBufferPtr buffer;
+			gchar *plugin_load_level;
+
+			plugin_load_level = e_plugin_xml_prop (root, "load_level");
+
+			buffer = xmlBufferCreate ();
+			xmlNodeDump (buffer, doc, root, 0, 0);
+
+			g_variant_builder_add (&plugins, "(ss)",
+				plugin_load_level ? plugin_load_level : "",
+				(const gchar *) xmlBufferContent (buffer));
+
+			xmlBufferFree (buffer);
+			g_free (plugin_load_level);
+		}
+	}
+
+	if (doc)
+		xmlFreeDoc (doc);
 
-	while ((d = g_dir_read_name (dir))) {
-		if (g_str_has_suffix  (d, ".eplug")) {
-			gchar *name;
+	g_variant_builder_add (files, "(sxx@a(ss))", filename,
+		(gint64) st.st_size, (gint64) st.st_mtime,
+		g_variant_builder_end (&plugins));
+}
 
-			name = g_build_filename (dirname, d, NULL);
-			ep_load (name, index);
-			g_free (name);
+/* Reads all the .eplug files in the 'dirnames' and stores the result
+ * into the manifest file for the next start */
+static GVariant *
+ep_manifest_build (GPtrArray *dirnames)
+{
+	GVariantBuilder dirs, files;
+	GVariant *manifest;
+	GError *local_error = NULL;
+	gchar *filename, *dirname;
+	guint ii;
+
+	g_variant_builder_init (&dirs, G_VARIANT_TYPE ("a(sx)"));
+	g_variant_builder_init (&files, G_VARIANT_TYPE ("a(sxxa(ss))"));
+
+	for (ii = 0; ii < dirnames->len; ii++) {
+		const gchar *plugin_dir = g_ptr_array_index (dirnames, ii);
+		const gchar *name;
+		GStatBuf st;
+		GDir *dir;
+
+		pd (printf ("scanning plugin dir '%s'\n", plugin_dir));
+
+		/* Check the time before reading the directory, thus a change
+		 * made meanwhile rather causes one more rebuild */
+		g_variant_builder_add (&dirs, "(sx)", plugin_dir,
+			g_stat (plugin_dir, &st) == 0 ? (gint64) st.st_mtime : (gint64) -1);
+
+		dir = g_dir_open (plugin_dir, 0, NULL);
+		if (!dir)
+			continue;
+
+		while ((name = g_dir_read_name (dir))) {
+			if (g_str_has_suffix (name, ".eplug")) {
+				gchar *path;
+
+				path = g_build_filename (plugin_dir, name, NULL);
+				ep_manifest_add_file (&files, path);
+				g_free (path);
+			}
 		}
+
+		g_dir_close (dir);
+	}
+
+	manifest = g_variant_ref_sink (g_variant_new ("(u@a(sx)@a(sxxa(ss)))",
+		EP_MANIFEST_VERSION,
+		g_variant_builder_end (&dirs),
+		g_variant_builder_end (&files)));
+
+	filename = ep_manifest_dup_filename ();
+	dirname = g_path_get_dirname (filename);
+
+	if (g_mkdir_with_parents (dirname, 0700) != 0 ||
+	    !g_file_set_contents (filename, g_variant_get_data (manifest), g_variant_get_size (manifest), &local_error)) {
+		g_debug ("%s: Failed to save '%s': %s", G_STRFUNC, filename,
+			local_error ? local_error->message : g_strerror (errno));
+		g_clear_error (&local_error);
 	}
 
-	g_dir_close (dir);
+	g_free (dirname);
+	g_free (filename);
+
+	return manifest;
+}
+
+/* Returns the manifest stored by the ep_manifest_build(), when it is still
+ * valid for the 'dirnames', or NULL otherwise. The manifest file is mapped,
+ * not read. A changed directory modification time covers added and removed
+ * .eplug files, the size and the modification time of the files cover
+ * their changes. */
+static GVariant *
+ep_manifest_load (GPtrArray *dirnames)
+{
+	GMappedFile *mapped_file;
+	GVariant *manifest, *dirs, *files;
+	GVariantIter iter;
+	GBytes *bytes;
+	const gchar *path;
+	gint64 size, mtime;
+	gchar *filename;
+	guint32 version = 0;
+	gboolean valid;
+	guint ii;
+
+	filename = ep_manifest_dup_filename ();
+	mapped_file = g_mapped_file_new (filename, FALSE, NULL);
+	g_free (filename);
+
+	if (!mapped_file)
+		return NULL;
+
+	bytes = g_mapped_file_get_bytes (mapped_file);
+	g_mapped_file_unref (mapped_file);
+
+	/* Not trusted, the data are checked on access */
+	manifest = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (EP_MANIFEST_TYPE), bytes, FALSE));
+	g_bytes_unref (bytes);
+
+	g_variant_get_child (manifest, 0, "u", &version);
+	dirs = g_variant_get_child_value (manifest, 1);
+	files = g_variant_get_child_value (manifest, 2);
+
+	valid = version == EP_MANIFEST_VERSION &&
+		g_variant_n_children (dirs) == dirnames->len;
+
+	for (ii = 0; valid && ii < dirnames->len; ii++) {
+		GStatBuf st;
+
+		g_variant_get_child (dirs, ii, "(&sx)", &path, &mtime);
+
+		valid = g_strcmp0 (path, g_ptr_array_index (dirnames, ii)) == 0 &&
+			mtime == (g_stat (path, &st) == 0 ? (gint64) st.st_mtime : (gint64) -1);
+	}
+
+	g_variant_iter_init (&iter, files);
+
+	while (valid && g_variant_iter_next (&iter, "(&sxx@a(ss))", &path, &size, &mtime, NULL)) {
+		GStatBuf st;
+
+		valid = g_stat (path, &st) == 0 &&
+			(gint64) st.st_size == size &&
+			(gint64) st.st_mtime == mtime;
+	}
+
+	g_variant_unref (dirs);
+	g_variant_unref (files);
+
+	if (!valid)
+		g_clear_pointer (&manifest, g_variant_unref);
+
+	return manifest;
 }
 
 /**
@@ -509,7 +659,8 @@ gint
 e_plugin_load_plugins (void)
 {
 	GSettings *settings;
-	GPtrArray *variants;
+	GPtrArray *variants, *dirnames;
+	GVariant *manifest, *files;
 	gchar **strv;
 	gint i;
 
@@ -538,22 +689,49 @@ e_plugin_load_plugins (void)
 	g_object_unref (settings);
 
 	variants = e_util_get_directory_variants (EVOLUTION_PLUGINDIR, EVOLUTION_PREFIX, TRUE);
+	dirnames = g_ptr_array_new ();
+
+	if (variants) {
+		guint jj;
+
+		for (jj = 0; jj < variants->len; jj++) {
+			const gchar *dirname = g_ptr_array_index (variants, jj);
+
+			if (dirname && *dirname)
+				g_ptr_array_add (dirnames, (gpointer) dirname);
+		}
+	} else {
+		g_ptr_array_add (dirnames, (gpointer) EVOLUTION_PLUGINDIR);
+	}
+
+	/* The .eplug files are read only when the manifest is out of date */
+	manifest = ep_manifest_load (dirnames);
+	if (!manifest)
+		manifest = ep_manifest_build (dirnames);
+
+	files = g_variant_get_child_value (manifest, 2);
 
 	for (i = 0; i < 3; i++) {
-		if (variants) {
-			guint jj;
+		GVariantIter iter, *plugins = NULL;
+		const gchar *filename;
+
+		g_variant_iter_init (&iter, files);
 
-			for (jj = 0; jj < variants->len; jj++) {
-				const gchar *dirname = g_ptr_array_index (variants, jj);
+		while (g_variant_iter_next (&iter, "(&sxxa(ss))", &filename, NULL, NULL, &plugins)) {
+			const gchar *plugin_load_level, *xml;
 
-				if (dirname && *dirname)
-					e_plugin_traverse_directory (dirname, i);
+			while (g_variant_iter_next (plugins, "(&s&s)", &plugin_load_level, &xml)) {
+				ep_load (filename, plugin_load_level, xml, i);
 			}
-		} else {
-			e_plugin_traverse_directory (EVOLUTION_PLUGINDIR, i);
+
+			g_variant_iter_free (plugins);
 		}
 	}
 
+	g_variant_unref (files);
+	g_variant_unref (manifest);
+	g_ptr_array_unref (dirnames);
+
 	if (variants)
 		g_ptr_array_unref (variants);
 
@@ -706,6 +706,131 @@ eti_row_height_real (ETableItem *eti,
 	return max_h;
 }
 
+/* Adds @delta to the value of the @row in the Fenwick @tree */
+static void
+height_tree_add (gint *tree,
+                 gint rows,
+                 gint row,
+                 gint delta)
+{
+	gint ii;
+
+	for (ii = row + 1; ii <= rows; ii += ii & (-ii))
+		tree[ii] += delta;
+}
+
+/* Returns sum of the values of rows [0, @row) in the Fenwick @tree */
+static gint
+height_tree_sum (const gint *tree,
+                 gint row)
+{
+	gint ii, sum = 0;
+
+	for (ii = row; ii > 0; ii -= ii & (-ii))
+		sum += tree[ii];
+
+	return sum;
+}
+
+static void
+free_height_tree (ETableItem *eti)
+{
+	g_clear_pointer (&eti->height_tree, g_free);
+	g_clear_pointer (&eti->height_unknown_tree, g_free);
+}
+
+/* Builds the trees from the height_cache in O(rows) */
+static void
+build_height_tree (ETableItem *eti)
+{
+	gint ii, jj;
+
+	free_height_tree (eti);
+
+	if (!eti->height_cache)
+		return;
+
+	eti->height_tree = g_new0 (gint, eti->rows + 1);
+	eti->height_unknown_tree = g_new0 (gint, eti->rows + 1);
+
+	for (ii = 1; ii <= eti->rows; ii++) {
+		if (eti->height_cache[ii - 1] == -1)
+			eti->height_unknown_tree[ii]++;
+		else
+			eti->height_tree[ii] += eti->height_cache[ii - 1];
+
+		jj = ii + (ii & (-ii));
+		if (jj <= eti->rows) {
+			eti->height_tree[jj] += eti->height_tree[ii];
+			eti->height_unknown_tree[jj] += eti->height_unknown_tree[ii];
+		}
+	}
+}
+
+/* Whether heights of all rows in [@start_row, @end_row) are known,
+ * thus the height_tree can be used for them */
+static gboolean
+height_tree_range_known (ETableItem *eti,
+                         gint start_row,
+                         gint end_row)
+{
+	if (!eti->height_tree)
+		return FALSE;
+
+	return height_tree_sum (eti->height_unknown_tree, end_row) ==
+		height_tree_sum (eti->height_unknown_tree, start_row);
+}
+
+/*
+ * Returns the largest row count 'n', for which the height of the first 'n' rows,
+ * including @height_extra for each of them, is less than @target (or less than
+ * or equal to, when @inclusive is set). The heights of all rows should be known.
+ */
+static gint
+height_tree_find (ETableItem *eti,
+                  gint target,
+                  gint height_extra,
+                  gboolean inclusive)
+{
+	gint pos = 0, sum = 0, step = 1;
+
+	while (step <= eti->rows / 2)
+		step <<= 1;
+
+	for (; step > 0; step >>= 1) {
+		gint next = pos + step;
+
+		if (next <= eti->rows) {
+			gint value = sum + eti->height_tree[next] + step * height_extra;
+
+			if (inclusive ? value <= target : value < target) {
+				pos = next;
+				sum = value;
+			}
+		}
+	}
+
+	return pos;
+}
+
+/* Sets known height of the @row, keeping the height trees in sync */
+static void
+set_height_cache (ETableItem *eti,
+                  gint row,
+                  gint height)
+{
+	if (eti->height_tree) {
+		if (eti->height_cache[row] == -1)
+			height_tree_add (eti->height_unknown_tree, eti->rows, row, -1);
+		else
+			height_tree_add (eti->height_tree, eti->rows, row, -eti->height_cache[row]);
+
+		height_tree_add (eti->height_tree, eti->rows, row, height);
+	}
+
+	eti->height_cache[row] = height;
+}
+
 static void
 confirm_height_cache (ETableItem *eti)
 {
@@ -717,6 +842,7 @@ confirm_height_cache (ETableItem *eti)
 	for (i = 0; i < eti->rows; i++) {
 		eti->height_cache[i] = -1;
 	}
+	build_height_tree (eti);
 }
 
 static gboolean
@@ -750,6 +876,7 @@ free_height_cache (ETableItem *eti)
 
 	if (item->flags & GNOME_CANVAS_ITEM_REALIZED) {
 		g_clear_pointer (&eti->height_cache, g_free);
+		free_height_tree (eti);
 		eti->height_cache_idle_count = 0;
 		eti->uniform_row_height_cache = -1;
 
@@ -788,7 +915,7 @@ eti_row_height (ETableItem *eti,
 			calculate_height_cache (eti);
 		}
 		if (eti->height_cache[row] == -1) {
-			eti->height_cache[row] = eti_row_height_real (eti, row);
+			set_height_cache (eti, row, eti_row_height_real (eti, row));
 			if (row > 0 &&
 			    eti->length_threshold != -1 &&
 			    eti->rows > eti->length_threshold &&
@@ -851,11 +978,7 @@ eti_get_height (ETableItem *eti)
 			}
 		}
 
-		height = height_extra;
-		for (row = 0; row < rows; row++)
-			height += ETI_ROW_HEIGHT (eti, row) + height_extra;
-
-		return height;
+		return height_extra + e_table_item_row_diff (eti, 0, rows);
 	}
 }
 
@@ -898,6 +1021,12 @@ e_table_item_row_diff (ETableItem *eti,
 
 	if (eti->uniform_row_height) {
 		return ((end_row - start_row) * (ETI_ROW_HEIGHT (eti, -1) + height_extra));
+	} else if (end_row <= start_row) {
+		return 0;
+	} else if (height_tree_range_known (eti, start_row, end_row)) {
+		return height_tree_sum (eti->height_tree, end_row) -
+			height_tree_sum (eti->height_tree, start_row) +
+			(end_row - start_row) * height_extra;
 	} else {
 		gint row, total;
 		total = 0;
@@ -1239,6 +1368,22 @@ eti_table_model_changed (ETableModel *table_model,
 	eti_idle_maybe_show_cursor (eti);
 }
 
+/* Only one row changed its height, thus there is no need to drop the whole height_cache */
+static void
+eti_table_model_row_height_changed (ETableItem *eti,
+                                    gint row,
+                                    gint height)
+{
+	set_height_cache (eti, row, height);
+
+	eti_unfreeze (eti);
+
+	eti->needs_compute_height = 1;
+	e_canvas_item_request_reflow (GNOME_CANVAS_ITEM (eti));
+	eti->needs_redraw = 1;
+	gnome_canvas_item_request_update (GNOME_CANVAS_ITEM (eti));
+}
+
 static void
 eti_table_model_row_changed (ETableModel *table_model,
                              gint row,
@@ -1251,9 +1396,13 @@ eti_table_model_row_changed (ETableModel *table_model,
 		return;
 	}
 
-	if ((!eti->uniform_row_height) && eti->height_cache && eti->height_cache[row] != -1 && eti_row_height_real (eti, row) != eti->height_cache[row]) {
-		eti_table_model_changed (table_model, eti);
-		return;
+	if ((!eti->uniform_row_height) && eti->height_cache && eti->height_cache[row] != -1) {
+		gint height = eti_row_height_real (eti, row);
+
+		if (height != eti->height_cache[row]) {
+			eti_table_model_row_height_changed (eti, row, height);
+			return;
+		}
 	}
 
 	eti_unfreeze (eti);
@@ -1274,9 +1423,13 @@ eti_table_model_cell_changed (ETableModel *table_model,
 		return;
 	}
 
-	if ((!eti->uniform_row_height) && eti->height_cache && eti->height_cache[row] != -1 && eti_row_height_real (eti, row) != eti->height_cache[row]) {
-		eti_table_model_changed (table_model, eti);
-		return;
+	if ((!eti->uniform_row_height) && eti->height_cache && eti->height_cache[row] != -1) {
+		gint height = eti_row_height_real (eti, row);
+
+		if (height != eti->height_cache[row]) {
+			eti_table_model_row_height_changed (eti, row, height);
+			return;
+		}
 	}
 
 	eti_unfreeze (eti);
@@ -1304,6 +1457,7 @@ eti_table_model_rows_inserted (ETableModel *table_model,
 		memmove (eti->height_cache + row + count, eti->height_cache + row, (eti->rows - count - row) * sizeof (gint));
 		for (i = row; i < row + count; i++)
 			eti->height_cache[i] = -1;
+		build_height_tree (eti);
 	}
 
 	eti_unfreeze (eti);
@@ -1335,6 +1489,9 @@ eti_table_model_rows_deleted (ETableModel *table_model,
 		memmove (eti->height_cache + row, eti->height_cache + row + count, (eti->rows - row) * sizeof (gint));
 	}
 
+	if (eti->height_cache)
+		build_height_tree (eti);
+
 	eti_unfreeze (eti);
 
 	eti_idle_maybe_show_cursor (eti);
@@ -1586,6 +1743,7 @@ eti_dispose (GObject *object)
 	}
 
 	g_clear_pointer (&eti->height_cache, g_free);
+	free_height_tree (eti);
 
 	/* Chain up to parent's dispose() method. */
 	G_OBJECT_CLASS (e_table_item_parent_class)->dispose (object);
@@ -1860,6 +2018,7 @@ eti_unrealize (GnomeCanvasItem *item)
 	}
 
 	g_clear_pointer (&eti->height_cache, g_free);
+	free_height_tree (eti);
 	eti->height_cache_idle_count = 0;
 
 	eti_unrealize_cell_views (eti);
@@ -1986,23 +2145,38 @@ eti_draw (GnomeCanvasItem *item,
 		y_offset = 0;
 		first_row = -1;
 
-		y1 = y2 = floor (eti_base_y) + height_extra;
-		for (row = 0; row < rows; row++, y1 = y2) {
+		if (height_tree_range_known (eti, 0, rows)) {
+			gint base_y = floor (eti_base_y) + height_extra;
 
-			y2 += ETI_ROW_HEIGHT (eti, row) + height_extra;
+			first_row = height_tree_find (eti, y - base_y, height_extra, FALSE);
+			last_row = height_tree_find (eti, y + height - base_y, height_extra, TRUE) + 1;
+			if (last_row > rows)
+				last_row = rows;
 
-			if (y1 > y + height)
-				break;
+			if (first_row >= last_row)
+				return;
 
-			if (y2 < y)
-				continue;
+			y_offset = base_y + height_tree_sum (eti->height_tree, first_row) +
+				first_row * height_extra - y;
+		} else {
+			y1 = y2 = floor (eti_base_y) + height_extra;
+			for (row = 0; row < rows; row++, y1 = y2) {
 
-			if (first_row == -1) {
-				y_offset = y1 - y;
-				first_row = row;
+				y2 += ETI_ROW_HEIGHT (eti, row) + height_extra;
+
+				if (y1 > y + height)
+					break;
+
+				if (y2 < y)
+					continue;
+
+				if (first_row == -1) {
+					y_offset = y1 - y;
+					first_row = row;
+				}
 			}
+			last_row = row;
 		}
-		last_row = row;
 
 		if (first_row == -1)
 			return;
@@ -2241,8 +2415,6 @@ find_cell (ETableItem *eti,
 
 	gint height_extra = eti->horizontal_draw_grid ? 1 : 0;
 
-	/* FIXME: this routine is inefficient, fix later */
-
 	if (eti->grabbed_col >= 0 && eti->grabbed_row >= 0) {
 		*view_col_res = eti->grabbed_col;
 		*view_row_res = eti->grabbed_row;
@@ -2274,6 +2446,16 @@ find_cell (ETableItem *eti,
 		y1 = row * (ETI_ROW_HEIGHT (eti, -1) + height_extra) + height_extra;
 		if (row >= eti->rows)
 			return FALSE;
+	} else if (height_tree_range_known (eti, 0, rows)) {
+		if (y < height_extra)
+			return FALSE;
+
+		/* The first row whose bottom edge is at or below the 'y' */
+		row = height_tree_find (eti, ceil (y - height_extra), height_extra, FALSE);
+		if (row >= rows)
+			return FALSE;
+
+		y1 = height_extra + height_tree_sum (eti->height_tree, row) + row * height_extra;
 	} else {
 		y1 = y2 = height_extra;
 		if (y < height_extra)
@@ -149,6 +149,13 @@ struct _ETableItem {
 	gint height_cache_idle_id;
 	gint height_cache_idle_count;
 
+	/*
+	 * Fenwick trees over the height_cache, with known row heights
+	 * and with count of not yet computed row heights
+	 */
+	gint *height_tree;
+	gint *height_unknown_tree;
+
 	/*
 	 * Lengh Threshold: above this, we stop computing correctly
 	 * the size
@@ -27,9 +27,30 @@
 
 #define d(x)
 
+/* Upper limit of threads used by the parallel sort. */
+#define MAX_SORT_JOBS 8
+
+struct _ETableSorterPrivate {
+	/* Sort keys as returned by e_table_model_value_at(), kept between
+	 * sorts and indexed by model row; only rows marked invalid are
+	 * fetched again on the next sort. */
+	gpointer *keys;
+	guint8 *keys_valid;
+	gint keys_rows;
+	gint keys_cols;
+	gint *keys_model_cols;
+
+	/* Compare caches (collation keys and such), one per sort job;
+	 * the first is also used by the final merge. */
+	gpointer cmp_caches[MAX_SORT_JOBS];
+
+	gint parallel_threshold;
+};
+
 enum {
 	PROP_0,
-	PROP_SORT_INFO
+	PROP_SORT_INFO,
+	PROP_PARALLEL_THRESHOLD
 };
 
 /* Forward Declarations */
@@ -39,6 +60,7 @@ G_DEFINE_TYPE_WITH_CODE (
 	ETableSorter,
 	e_table_sorter,
 	G_TYPE_OBJECT,
+	G_ADD_PRIVATE (ETableSorter)
 	G_IMPLEMENT_INTERFACE (
 		E_TYPE_SORTER,
 		e_table_sorter_interface_init))
@@ -52,7 +74,11 @@ struct qsort_data {
 	gpointer cmp_cache;
 };
 
-/* FIXME: Make it not cache the second and later columns (as if anyone cares.) */
+typedef struct _SortJob {
+	struct qsort_data qd;
+	gint *rows;
+	gint n_rows;
+} SortJob;
 
 static gint
 qsort_callback (gconstpointer data1,
@@ -63,17 +89,10 @@ qsort_callback (gconstpointer data1,
 	gint row1 = *(gint *) data1;
 	gint row2 = *(gint *) data2;
 	gint j;
-	gint sort_count;
 	gint comp_val = 0;
 	gint ascending = 1;
 
-	sort_count =
-		e_table_sort_info_sorting_get_count (
-			qd->table_sorter->sort_info) +
-		e_table_sort_info_grouping_get_count (
-			qd->table_sorter->sort_info);
-
-	for (j = 0; j < sort_count; j++) {
+	for (j = 0; j < qd->cols; j++) {
 		comp_val = (*(qd->compare[j]))(qd->vals[qd->cols * row1 + j], qd->vals[qd->cols * row2 + j], qd->cmp_cache);
 		ascending = qd->ascending[j];
 		if (comp_val != 0)
@@ -91,6 +110,278 @@ qsort_callback (gconstpointer data1,
 	return comp_val;
 }
 
+static void
+table_sorter_keys_free_row (ETableSorter *table_sorter,
+                            gint row)
+{
+	ETableSorterPrivate *priv = table_sorter->priv;
+	gint j;
+
+	if (!priv->keys_valid[row])
+		return;
+
+	for (j = 0; j < priv->keys_cols; j++) {
+		e_table_model_free_value (
+			table_sorter->source,
+			priv->keys_model_cols[j],
+			priv->keys[row * priv->keys_cols + j]);
+		priv->keys[row * priv->keys_cols + j] = NULL;
+	}
+
+	priv->keys_valid[row] = 0;
+}
+
+static void
+table_sorter_keys_clear (ETableSorter *table_sorter)
+{
+	ETableSorterPrivate *priv = table_sorter->priv;
+	gint ii;
+
+	if (priv->keys && table_sorter->source) {
+		for (ii = 0; ii < priv->keys_rows; ii++)
+			table_sorter_keys_free_row (table_sorter, ii);
+	}
+
+	g_clear_pointer (&priv->keys, g_free);
+	g_clear_pointer (&priv->keys_valid, g_free);
+	g_clear_pointer (&priv->keys_model_cols, g_free);
+	priv->keys_rows = 0;
+	priv->keys_cols = 0;
+
+	for (ii = 0; ii < MAX_SORT_JOBS; ii++) {
+		if (priv->cmp_caches[ii]) {
+			e_table_sorting_utils_free_cmp_cache (priv->cmp_caches[ii]);
+			priv->cmp_caches[ii] = NULL;
+		}
+	}
+}
+
+static void
+table_sorter_keys_invalidate_row (ETableSorter *table_sorter,
+                                  gint row)
+{
+	ETableSorterPrivate *priv = table_sorter->priv;
+
+	if (!priv->keys)
+		return;
+
+	if (row >= 0 && row < priv->keys_rows)
+		table_sorter_keys_free_row (table_sorter, row);
+	else
+		table_sorter_keys_clear (table_sorter);
+}
+
+static void
+table_sorter_keys_insert_rows (ETableSorter *table_sorter,
+                               gint row,
+                               gint count)
+{
+	ETableSorterPrivate *priv = table_sorter->priv;
+	gint cols = priv->keys_cols;
+
+	if (!priv->keys || count <= 0)
+		return;
+
+	if (row < 0 || row > priv->keys_rows) {
+		table_sorter_keys_clear (table_sorter);
+		return;
+	}
+
+	priv->keys = g_renew (gpointer, priv->keys, (priv->keys_rows + count) * cols);
+	priv->keys_valid = g_renew (guint8, priv->keys_valid, priv->keys_rows + count);
+
+	memmove (
+		priv->keys + (row + count) * cols,
+		priv->keys + row * cols,
+		sizeof (gpointer) * (priv->keys_rows - row) * cols);
+	memmove (
+		priv->keys_valid + row + count,
+		priv->keys_valid + row,
+		priv->keys_rows - row);
+
+	memset (priv->keys + row * cols, 0, sizeof (gpointer) * count * cols);
+	memset (priv->keys_valid + row, 0, count);
+
+	priv->keys_rows += count;
+}
+
+static void
+table_sorter_keys_delete_rows (ETableSorter *table_sorter,
+                               gint row,
+                               gint count)
+{
+	ETableSorterPrivate *priv = table_sorter->priv;
+	gint cols = priv->keys_cols;
+	gint ii;
+
+	if (!priv->keys || count <= 0)
+		return;
+
+	if (row < 0 || row + count > priv->keys_rows) {
+		table_sorter_keys_clear (table_sorter);
+		return;
+	}
+
+	for (ii = row; ii < row + count; ii++)
+		table_sorter_keys_free_row (table_sorter, ii);
+
+	memmove (
+		priv->keys + row * cols,
+		priv->keys + (row + count) * cols,
+		sizeof (gpointer) * (priv->keys_rows - row - count) * cols);
+	memmove (
+		priv->keys_valid + row,
+		priv->keys_valid + row + count,
+		priv->keys_rows - row - count);
+
+	priv->keys_rows -= count;
+}
+
+/* Makes sure the key cache matches the current sort columns and row count,
+ * then fetches values for the rows which are not cached yet. */
+static void
+table_sorter_keys_update (ETableSorter *table_sorter,
+                          gint rows,
+                          gint cols,
+                          const gint *model_cols)
+{
+	ETableSorterPrivate *priv = table_sorter->priv;
+	gint ii, j;
+
+	if (priv->keys && (priv->keys_rows != rows || priv->keys_cols != cols ||
+	    memcmp (priv->keys_model_cols, model_cols, sizeof (gint) * cols) != 0))
+		table_sorter_keys_clear (table_sorter);
+
+	if (!priv->keys) {
+		priv->keys = g_new0 (gpointer, MAX (rows * cols, 1));
+		priv->keys_valid = g_new0 (guint8, MAX (rows, 1));
+		priv->keys_model_cols = g_memdup (model_cols, sizeof (gint) * cols);
+		priv->keys_rows = rows;
+		priv->keys_cols = cols;
+	}
+
+	for (ii = 0; ii < rows; ii++) {
+		if (priv->keys_valid[ii])
+			continue;
+
+		for (j = 0; j < cols; j++) {
+			priv->keys[ii * cols + j] = e_table_model_value_at (
+				table_sorter->source, model_cols[j], ii);
+		}
+
+		priv->keys_valid[ii] = 1;
+	}
+}
+
+static gpointer
+table_sorter_sort_job_thread (gpointer user_data)
+{
+	SortJob *job = user_data;
+
+	g_qsort_with_data (job->rows, job->n_rows, sizeof (gint), qsort_callback, &job->qd);
+
+	return NULL;
+}
+
+static void
+table_sorter_merge (gint *dest,
+                    const gint *src1,
+                    gint n_src1,
+                    const gint *src2,
+                    gint n_src2,
+                    struct qsort_data *qd)
+{
+	gint i1 = 0, i2 = 0;
+
+	while (i1 < n_src1 && i2 < n_src2) {
+		if (qsort_callback (&src2[i2], &src1[i1], qd) < 0)
+			*dest++ = src2[i2++];
+		else
+			*dest++ = src1[i1++];
+	}
+
+	if (i1 < n_src1)
+		memcpy (dest, src1 + i1, sizeof (gint) * (n_src1 - i1));
+	if (i2 < n_src2)
+		memcpy (dest, src2 + i2, sizeof (gint) * (n_src2 - i2));
+}
+
+/* Sorts chunks of the array in worker threads, each with its own compare
+ * cache, because the compare functions fill the cache lazily, then merges
+ * the sorted chunks pairwise in the calling thread. */
+static void
+table_sorter_sort_parallel (ETableSorter *table_sorter,
+                            struct qsort_data *qd,
+                            gint rows,
+                            gint n_jobs)
+{
+	SortJob jobs[MAX_SORT_JOBS];
+	GThread *threads[MAX_SORT_JOBS];
+	gint starts[MAX_SORT_JOBS + 1];
+	gint *src, *dest, *tmp;
+	gint n_runs, ii;
+
+	for (ii = 0; ii < n_jobs; ii++) {
+		starts[ii] = (gint) (((gint64) rows) * ii / n_jobs);
+
+		if (!table_sorter->priv->cmp_caches[ii])
+			table_sorter->priv->cmp_caches[ii] = e_table_sorting_utils_create_cmp_cache ();
+	}
+	starts[n_jobs] = rows;
+
+	for (ii = 0; ii < n_jobs; ii++) {
+		jobs[ii].qd = *qd;
+		jobs[ii].qd.cmp_cache = table_sorter->priv->cmp_caches[ii];
+		jobs[ii].rows = table_sorter->sorted + starts[ii];
+		jobs[ii].n_rows = starts[ii + 1] - starts[ii];
+	}
+
+	/* The calling thread sorts the first chunk itself. */
+	for (ii = 1; ii < n_jobs; ii++)
+		threads[ii] = g_thread_new ("ETableSorter", table_sorter_sort_job_thread, &jobs[ii]);
+
+	table_sorter_sort_job_thread (&jobs[0]);
+
+	for (ii = 1; ii < n_jobs; ii++)
+		g_thread_join (threads[ii]);
+
+	src = table_sorter->sorted;
+	dest = g_new (gint, rows);
+	n_runs = n_jobs;
+
+	while (n_runs > 1) {
+		gint out = 0;
+
+		for (ii = 0; ii < n_runs; ii += 2) {
+			if (ii + 1 < n_runs) {
+				table_sorter_merge (
+					dest + starts[ii],
+					src + starts[ii], starts[ii + 1] - starts[ii],
+					src + starts[ii + 1], starts[ii + 2] - starts[ii + 1],
+					qd);
+			} else {
+				memcpy (dest + starts[ii], src + starts[ii], sizeof (gint) * (starts[ii + 1] - starts[ii]));
+			}
+
+			starts[out++] = starts[ii];
+		}
+
+		starts[out] = rows;
+		n_runs = out;
+
+		tmp = src;
+		src = dest;
+		dest = tmp;
+	}
+
+	if (src != table_sorter->sorted) {
+		g_free (table_sorter->sorted);
+		table_sorter->sorted = src;
+	} else {
+		g_free (dest);
+	}
+}
+
 static void
 table_sorter_clean (ETableSorter *table_sorter)
 {
@@ -111,6 +402,8 @@ table_sorter_sort (ETableSorter *table_sorter)
 	gint j;
 	gint cols;
 	gint group_cols;
+	gint n_jobs = 1;
+	gint *model_cols;
 	struct qsort_data qd;
 
 	if (table_sorter->sorted)
@@ -127,10 +420,9 @@ table_sorter_sort (ETableSorter *table_sorter)
 	qd.cols = cols;
 	qd.table_sorter = table_sorter;
 
-	qd.vals = g_new (gpointer , rows * cols);
 	qd.ascending = g_new (int, cols);
 	qd.compare = g_new (GCompareDataFunc, cols);
-	qd.cmp_cache = e_table_sorting_utils_create_cmp_cache ();
+	model_cols = g_new (gint, cols);
 
 	for (j = 0; j < cols; j++) {
 		ETableColumnSpecification *spec;
@@ -155,50 +447,31 @@ table_sorter_sort (ETableSorter *table_sorter)
 				table_sorter->full_header, last);
 		}
 
-		for (i = 0; i < rows; i++) {
-			qd.vals[i * cols + j] = e_table_model_value_at (
-				table_sorter->source,
-				col->spec->model_col, i);
-		}
-
+		model_cols[j] = col->spec->model_col;
 		qd.compare[j] = col->compare;
 		qd.ascending[j] = (sort_type == GTK_SORT_ASCENDING);
 	}
 
-	g_qsort_with_data (table_sorter->sorted, rows, sizeof (gint), qsort_callback, &qd);
+	table_sorter_keys_update (table_sorter, rows, cols, model_cols);
 
-	for (j = 0; j < cols; j++) {
-		ETableColumnSpecification *spec;
-		ETableCol *col;
-		GtkSortType sort_type;
+	if (!table_sorter->priv->cmp_caches[0])
+		table_sorter->priv->cmp_caches[0] = e_table_sorting_utils_create_cmp_cache ();
 
-		if (j < group_cols)
-			spec = e_table_sort_info_grouping_get_nth (
-				table_sorter->sort_info,
-				j, &sort_type);
-		else
-			spec = e_table_sort_info_sorting_get_nth (
-				table_sorter->sort_info,
-				j - group_cols, &sort_type);
+	qd.vals = table_sorter->priv->keys;
+	qd.cmp_cache = table_sorter->priv->cmp_caches[0];
 
-		col = e_table_header_get_column_by_spec (
-			table_sorter->full_header, spec);
-		if (col == NULL) {
-			gint last = e_table_header_count (
-				table_sorter->full_header) - 1;
-			col = e_table_header_get_column (
-				table_sorter->full_header, last);
-		}
+	if (table_sorter->priv->parallel_threshold > 0 &&
+	    rows >= table_sorter->priv->parallel_threshold)
+		n_jobs = CLAMP (g_get_num_processors (), 1, MAX_SORT_JOBS);
 
-		for (i = 0; i < rows; i++) {
-			e_table_model_free_value (table_sorter->source, col->spec->model_col, qd.vals[i * cols + j]);
-		}
-	}
+	if (n_jobs > 1)
+		table_sorter_sort_parallel (table_sorter, &qd, rows, n_jobs);
+	else
+		g_qsort_with_data (table_sorter->sorted, rows, sizeof (gint), qsort_callback, &qd);
 
-	g_free (qd.vals);
 	g_free (qd.ascending);
 	g_free (qd.compare);
-	e_table_sorting_utils_free_cmp_cache (qd.cmp_cache);
+	g_free (model_cols);
 }
 
 static void
@@ -224,6 +497,7 @@ table_sorter_model_changed_cb (ETableModel *table_model,
                                ETableSorter *table_sorter)
 {
 	table_sorter_clean (table_sorter);
+	table_sorter_keys_clear (table_sorter);
 }
 
 static void
@@ -232,6 +506,7 @@ table_sorter_model_row_changed_cb (ETableModel *table_model,
                                    ETableSorter *table_sorter)
 {
 	table_sorter_clean (table_sorter);
+	table_sorter_keys_invalidate_row (table_sorter, row);
 }
 
 static void
@@ -241,6 +516,7 @@ table_sorter_model_cell_changed_cb (ETableModel *table_model,
                                     ETableSorter *table_sorter)
 {
 	table_sorter_clean (table_sorter);
+	table_sorter_keys_invalidate_row (table_sorter, row);
 }
 
 static void
@@ -250,6 +526,7 @@ table_sorter_model_rows_inserted_cb (ETableModel *table_model,
                                      ETableSorter *table_sorter)
 {
 	table_sorter_clean (table_sorter);
+	table_sorter_keys_insert_rows (table_sorter, row, count);
 }
 
 static void
@@ -259,6 +536,7 @@ table_sorter_model_rows_deleted_cb (ETableModel *table_model,
                                     ETableSorter *table_sorter)
 {
 	table_sorter_clean (table_sorter);
+	table_sorter_keys_delete_rows (table_sorter, row, count);
 }
 
 static void
@@ -303,6 +581,11 @@ table_sorter_set_property (GObject *object,
 
 		table_sorter_clean (table_sorter);
 		break;
+	case PROP_PARALLEL_THRESHOLD:
+		e_table_sorter_set_parallel_threshold (
+			table_sorter,
+			g_value_get_int (value));
+		break;
 	default:
 		break;
 	}
@@ -319,6 +602,12 @@ table_sorter_get_property (GObject *object,
 	case PROP_SORT_INFO:
 		g_value_set_object (value, table_sorter->sort_info);
 		break;
+	case PROP_PARALLEL_THRESHOLD:
+		g_value_set_int (
+			value,
+			e_table_sorter_get_parallel_threshold (
+			table_sorter));
+		break;
 	}
 }
 
@@ -376,6 +665,8 @@ table_sorter_dispose (GObject *object)
 		table_sorter->group_info_changed_id = 0;
 	}
 
+	table_sorter_keys_clear (table_sorter);
+
 	g_clear_object (&table_sorter->sort_info);
 	g_clear_object (&table_sorter->full_header);
 	g_clear_object (&table_sorter->source);
@@ -491,6 +782,18 @@ e_table_sorter_class_init (ETableSorterClass *class)
 			NULL,
 			E_TYPE_TABLE_SORT_INFO,
 			G_PARAM_READWRITE));
+
+	g_object_class_install_property (
+		object_class,
+		PROP_PARALLEL_THRESHOLD,
+		g_param_spec_int (
+			"parallel-threshold",
+			"Parallel Threshold",
+			"Row count from which the rows are sorted in multiple threads, 0 to never",
+			0, G_MAXINT,
+			E_TABLE_SORTER_DEFAULT_PARALLEL_THRESHOLD,
+			G_PARAM_READWRITE |
+			G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -506,6 +809,8 @@ e_table_sorter_interface_init (ESorterInterface *iface)
 static void
 e_table_sorter_init (ETableSorter *table_sorter)
 {
+	table_sorter->priv = e_table_sorter_get_instance_private (table_sorter);
+	table_sorter->priv->parallel_threshold = E_TABLE_SORTER_DEFAULT_PARALLEL_THRESHOLD;
 	table_sorter->needs_sorting = -1;
 }
 
@@ -552,3 +857,48 @@ e_table_sorter_new (ETableModel *source,
 	return table_sorter;
 }
 
+/**
+ * e_table_sorter_get_parallel_threshold:
+ * @table_sorter: an #ETableSorter
+ *
+ * Returns the row count from which the @table_sorter sorts
+ * in multiple threads. Zero means it never does.
+ *
+ * Returns: the parallel sort threshold
+ *
+ * Since: 3.56
+ **/
+gint
+e_table_sorter_get_parallel_threshold (ETableSorter *table_sorter)
+{
+	g_return_val_if_fail (E_IS_TABLE_SORTER (table_sorter), 0);
+
+	return table_sorter->priv->parallel_threshold;
+}
+
+/**
+ * e_table_sorter_set_parallel_threshold:
+ * @table_sorter: an #ETableSorter
+ * @n_rows: a row count, or 0
+ *
+ * Sets the row count from which the @table_sorter splits the sort
+ * into multiple threads. Use 0 to always sort in the calling thread.
+ *
+ * Since: 3.56
+ **/
+void
+e_table_sorter_set_parallel_threshold (ETableSorter *table_sorter,
+                                       gint n_rows)
+{
+	g_return_if_fail (E_IS_TABLE_SORTER (table_sorter));
+
+	if (n_rows < 0)
+		n_rows = 0;
+
+	if (table_sorter->priv->parallel_threshold == n_rows)
+		return;
+
+	table_sorter->priv->parallel_threshold = n_rows;
+
+	g_object_notify (G_OBJECT (table_sorter), "parallel-threshold");
+}
@@ -49,11 +49,16 @@
 
 G_BEGIN_DECLS
 
+/* Tables with at least this many rows are sorted in parallel. */
+#define E_TABLE_SORTER_DEFAULT_PARALLEL_THRESHOLD 20000
+
 typedef struct _ETableSorter ETableSorter;
 typedef struct _ETableSorterClass ETableSorterClass;
+typedef struct _ETableSorterPrivate ETableSorterPrivate;
 
 struct _ETableSorter {
 	GObject parent;
+	ETableSorterPrivate *priv;
 
 	ETableModel *source;
 	ETableHeader *full_header;
@@ -83,6 +88,11 @@ GType		e_table_sorter_get_type		(void) G_GNUC_CONST;
 ETableSorter *	e_table_sorter_new		(ETableModel *etm,
 						 ETableHeader *full_header,
 						 ETableSortInfo *sort_info);
+gint		e_table_sorter_get_parallel_threshold
+						(ETableSorter *table_sorter);
+void		e_table_sorter_set_parallel_threshold
+						(ETableSorter *table_sorter,
+						 gint n_rows);
 
 G_END_DECLS
 
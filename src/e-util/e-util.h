@@ -106,6 +106,7 @@
 #include <e-util/e-emoticon-tool-button.h>
 #include <e-util/e-emoticon.h>
 #include <e-util/e-event.h>
+#include <e-util/e-file-data-wrapper.h>
 #include <e-util/e-file-request.h>
 #include <e-util/e-file-utils.h>
 #include <e-util/e-filter-code.h>
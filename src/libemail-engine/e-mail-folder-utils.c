@@ -640,191 +640,438 @@ mail_folder_find_duplicate_messages_thread (GTask *task,
 		g_task_return_pointer (task, g_steal_pointer (&hash_table), (GDestroyNotify) g_hash_table_unref);
 }
 
+/* How many messages are retrieved in parallel when looking for duplicates */
+#define DUPLICATES_MAX_JOBS 4
+
+/* Computes a digest string of the message content. Returns %NULL
+ * without setting the @error when the message has no content. */
+static gchar *
+emfu_compute_message_digest_sync (CamelFolder *folder,
+                                  const gchar *uid,
+                                  gboolean *out_success,
+                                  GCancellable *cancellable,
+                                  GError **error)
+{
+	CamelMimeMessage *message;
+	CamelDataWrapper *content;
+	gchar *digest = NULL;
+
+	*out_success = FALSE;
+
+	message = camel_folder_get_message_sync (folder, uid, cancellable, error);
+	if (!CAMEL_IS_MIME_MESSAGE (message)) {
+		g_clear_object (&message);
+		return NULL;
+	}
+
+	*out_success = TRUE;
+
+	/* Generate a digest string from the message's content. */
+	content = camel_medium_get_content (CAMEL_MEDIUM (message));
+
+	if (content != NULL) {
+		CamelStream *stream;
+		GByteArray *buffer;
+		gssize n_bytes;
+
+		stream = camel_stream_mem_new ();
+
+		n_bytes = camel_data_wrapper_decode_to_stream_sync (
+			content, stream, cancellable, NULL);
+
+		if (n_bytes >= 0) {
+			guint data_len;
+
+			/* The CamelStreamMem owns the buffer. */
+			buffer = camel_stream_mem_get_byte_array (
+				CAMEL_STREAM_MEM (stream));
+
+			data_len = buffer ? buffer->len : 0;
+
+			/* Strip trailing white-spaces and empty lines */
+			while (data_len > 0 && g_ascii_isspace (buffer->data[data_len - 1]))
+				data_len--;
+
+			if (data_len > 0)
+				digest = g_compute_checksum_for_data (G_CHECKSUM_SHA256, buffer->data, data_len);
+		}
+
+		g_object_unref (stream);
+	}
+
+	g_object_unref (message);
+
+	return digest;
+}
+
+/* The digests are cached per folder in a key file, keyed by message UID.
+ * Each value carries also the message size and received date, which
+ * invalidates the entry when the UID gets reused for another message. */
+
+static gchar *
+emfu_digest_cache_filename (CamelFolder *folder)
+{
+	gchar *folder_uri, *checksum, *basename, *filename;
+
+	folder_uri = e_mail_folder_uri_from_folder (folder);
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, folder_uri, -1);
+	basename = g_strconcat (checksum, ".ini", NULL);
+	filename = g_build_filename (mail_session_get_cache_dir (), "duplicate-digests", basename, NULL);
+
+	g_free (folder_uri);
+	g_free (checksum);
+	g_free (basename);
+
+	return filename;
+}
+
+static gchar *
+emfu_digest_cache_stamp (CamelMessageInfo *info)
+{
+	return g_strdup_printf ("%u;%" G_GINT64_FORMAT,
+		camel_message_info_get_size (info),
+		(gint64) camel_message_info_get_date_received (info));
+}
+
+/* Returns whether the cache has a valid entry for the @uid. The cached
+ * digest, which can be %NULL for messages without content, is returned
+ * in the @out_digest. */
+static gboolean
+emfu_digest_cache_lookup (GKeyFile *key_file,
+                          const gchar *uid,
+                          const gchar *stamp,
+                          gchar **out_digest)
+{
+	gchar *value;
+	gboolean found = FALSE;
+
+	*out_digest = NULL;
+
+	value = g_key_file_get_string (key_file, "Digests", uid, NULL);
+	if (!value)
+		return FALSE;
+
+	if (g_str_has_prefix (value, stamp) && value[strlen (stamp)] == ';') {
+		const gchar *digest = value + strlen (stamp) + 1;
+
+		if (*digest)
+			*out_digest = g_strdup (digest);
+
+		found = TRUE;
+	}
+
+	g_free (value);
+
+	return found;
+}
+
+typedef struct _DigestJobsData {
+	CamelFolder *folder;
+	GCancellable *cancellable;
+	GMutex lock;
+	GHashTable *digests; /* gchar *uid ~> gchar *digest */
+	GError *error;
+	guint n_done;
+	guint n_total;
+} DigestJobsData;
+
+static void
+emfu_digest_job_run (gpointer job_data,
+                     gpointer user_data)
+{
+	DigestJobsData *djd = user_data;
+	const gchar *uid = job_data;
+	gboolean success = FALSE;
+	gboolean skip;
+	gchar *digest = NULL;
+	GError *local_error = NULL;
+
+	g_mutex_lock (&djd->lock);
+	skip = djd->error != NULL;
+	g_mutex_unlock (&djd->lock);
+
+	/* This is an all or nothing operation, thus
+	 * stop retrieving when any message failed. */
+	if (!skip)
+		digest = emfu_compute_message_digest_sync (djd->folder, uid, &success, djd->cancellable, &local_error);
+
+	g_mutex_lock (&djd->lock);
+
+	djd->n_done++;
+
+	if (success) {
+		g_hash_table_insert (djd->digests, (gpointer) camel_pstring_strdup (uid), digest);
+	} else if (!skip && !djd->error) {
+		if (!local_error)
+			local_error = g_error_new (CAMEL_ERROR, CAMEL_ERROR_GENERIC, _("Failed to retrieve message “%s”"), uid);
+
+		djd->error = g_steal_pointer (&local_error);
+	}
+
+	camel_operation_progress (djd->cancellable, djd->n_done * 100 / djd->n_total);
+
+	g_mutex_unlock (&djd->lock);
+
+	g_clear_error (&local_error);
+}
+
+/* Returns a hash table of { MessageUID : digest-as-string } for
+ * the @message_uids, or %NULL on error. Only messages not found
+ * in the persistent digest cache are retrieved. */
 static GHashTable *
 emfu_get_messages_hash_sync (CamelFolder *folder,
                              GPtrArray *message_uids,
                              GCancellable *cancellable,
                              GError **error)
 {
+	DigestJobsData djd = { 0, };
 	GHashTable *hash_table;
-	CamelMimeMessage *message;
+	GPtrArray *to_fetch;
+	GKeyFile *key_file;
+	gchar *cache_filename;
 	guint ii;
 
 	g_return_val_if_fail (CAMEL_IS_FOLDER (folder), NULL);
 	g_return_val_if_fail (message_uids != NULL, NULL);
 
-	camel_operation_push_message (
-		cancellable,
-		ngettext (
-			"Retrieving %d message",
-			"Retrieving %d messages",
-			message_uids->len),
-		message_uids->len);
-
 	hash_table = g_hash_table_new_full (
 		(GHashFunc) g_str_hash,
 		(GEqualFunc) g_str_equal,
-		(GDestroyNotify) g_free,
+		(GDestroyNotify) camel_pstring_free,
 		(GDestroyNotify) g_free);
 
-	/* This is an all or nothing operation.  Destroy the
-	 * hash table if we fail to retrieve any message. */
+	cache_filename = emfu_digest_cache_filename (folder);
+	key_file = g_key_file_new ();
+	g_key_file_load_from_file (key_file, cache_filename, G_KEY_FILE_NONE, NULL);
+
+	to_fetch = g_ptr_array_new ();
 
 	for (ii = 0; ii < message_uids->len; ii++) {
-		const gchar *uid;
-		gint percent;
+		const gchar *uid = g_ptr_array_index (message_uids, ii);
+		CamelMessageInfo *info;
+		gchar *stamp, *digest = NULL;
 
-		uid = g_ptr_array_index (message_uids, ii);
-		percent = ((ii + 1) * 100) / message_uids->len;
+		info = camel_folder_get_message_info (folder, uid);
+		if (!info) {
+			g_ptr_array_add (to_fetch, (gpointer) uid);
+			continue;
+		}
 
-		message = camel_folder_get_message_sync (
-			folder, uid, cancellable, error);
+		stamp = emfu_digest_cache_stamp (info);
 
-		camel_operation_progress (cancellable, percent);
+		if (emfu_digest_cache_lookup (key_file, uid, stamp, &digest))
+			g_hash_table_insert (hash_table, (gpointer) camel_pstring_strdup (uid), digest);
+		else
+			g_ptr_array_add (to_fetch, (gpointer) uid);
 
-		if (CAMEL_IS_MIME_MESSAGE (message)) {
-			CamelDataWrapper *content;
-			gchar *digest = NULL;
+		g_free (stamp);
+		g_object_unref (info);
+	}
+
+	if (to_fetch->len > 0) {
+		GThreadPool *pool;
 
-			/* Generate a digest string from the message's content. */
-			content = camel_medium_get_content (CAMEL_MEDIUM (message));
+		camel_operation_push_message (
+			cancellable,
+			ngettext (
+				"Retrieving %d message",
+				"Retrieving %d messages",
+				to_fetch->len),
+			to_fetch->len);
 
-			if (content != NULL) {
-				CamelStream *stream;
-				GByteArray *buffer;
-				gssize n_bytes;
+		g_mutex_init (&djd.lock);
+		djd.folder = folder;
+		djd.cancellable = cancellable;
+		djd.digests = hash_table;
+		djd.n_total = to_fetch->len;
 
-				stream = camel_stream_mem_new ();
+		pool = g_thread_pool_new (emfu_digest_job_run, &djd,
+			MIN (DUPLICATES_MAX_JOBS, to_fetch->len), FALSE, NULL);
 
-				n_bytes = camel_data_wrapper_decode_to_stream_sync (
-					content, stream, cancellable, error);
+		for (ii = 0; ii < to_fetch->len; ii++)
+			g_thread_pool_push (pool, g_ptr_array_index (to_fetch, ii), NULL);
 
-				if (n_bytes >= 0) {
-					guint data_len;
+		/* Waits for all the jobs to finish */
+		g_thread_pool_free (pool, FALSE, TRUE);
+
+		g_mutex_clear (&djd.lock);
+
+		camel_operation_pop_message (cancellable);
+
+		if (djd.error) {
+			g_propagate_error (error, djd.error);
+			g_clear_pointer (&hash_table, g_hash_table_destroy);
+		} else {
+			gchar *dirname;
 
-					/* The CamelStreamMem owns the buffer. */
-					buffer = camel_stream_mem_get_byte_array (
-						CAMEL_STREAM_MEM (stream));
-					g_return_val_if_fail (buffer != NULL, NULL);
+			/* Remember the newly computed digests */
+			for (ii = 0; ii < to_fetch->len; ii++) {
+				const gchar *uid = g_ptr_array_index (to_fetch, ii);
+				CamelMessageInfo *info;
+				gchar *stamp, *value;
 
-					data_len = buffer->len;
+				info = camel_folder_get_message_info (folder, uid);
+				if (!info)
+					continue;
 
-					/* Strip trailing white-spaces and empty lines */
-					while (data_len > 0 && g_ascii_isspace (buffer->data[data_len - 1]))
-						data_len--;
+				stamp = emfu_digest_cache_stamp (info);
+				value = g_strconcat (stamp, ";", g_hash_table_lookup (hash_table, uid), NULL);
 
-					if (data_len > 0)
-						digest = g_compute_checksum_for_data (G_CHECKSUM_SHA256, buffer->data, data_len);
-				}
+				g_key_file_set_string (key_file, "Digests", uid, value);
 
-				g_object_unref (stream);
+				g_free (stamp);
+				g_free (value);
+				g_object_unref (info);
 			}
 
-			g_hash_table_insert (
-				hash_table, g_strdup (uid), digest);
-			g_object_unref (message);
-		} else {
-			g_hash_table_destroy (hash_table);
-			hash_table = NULL;
-			break;
+			dirname = g_path_get_dirname (cache_filename);
+			g_mkdir_with_parents (dirname, 0700);
+			g_free (dirname);
+
+			g_key_file_save_to_file (key_file, cache_filename, NULL);
 		}
 	}
 
-	camel_operation_pop_message (cancellable);
+	g_ptr_array_unref (to_fetch);
+	g_key_file_unref (key_file);
+	g_free (cache_filename);
 
 	return hash_table;
 }
 
+/* Messages are first grouped by their Message-ID, as stored in the folder
+ * summary, and only messages sharing the Message-ID with another message
+ * are retrieved and compared by their content. */
 GHashTable *
 e_mail_folder_find_duplicate_messages_sync (CamelFolder *folder,
                                             GPtrArray *message_uids,
                                             GCancellable *cancellable,
                                             GError **error)
 {
-	GQueue trash = G_QUEUE_INIT;
 	GHashTable *hash_table;
-	GHashTable *unique_ids;
+	GHashTable *groups; /* gint64 *message_id ~> GPtrArray * { gchar *uid } */
+	GHashTable *digests;
 	GHashTableIter iter;
-	gpointer key, value;
+	GPtrArray *candidates;
+	gpointer value;
+	guint ii;
 
 	g_return_val_if_fail (CAMEL_IS_FOLDER (folder), NULL);
 	g_return_val_if_fail (message_uids != NULL, NULL);
 
-	/* hash_table = { MessageUID : digest-as-string } */
-	hash_table = emfu_get_messages_hash_sync (
-		folder, message_uids, cancellable, error);
-
-	if (hash_table == NULL)
-		return NULL;
+	/* Phase 1: group by Message-ID, using only the folder summary */
 
 	camel_operation_push_message (
 		cancellable, _("Scanning messages for duplicates"));
 
-	unique_ids = g_hash_table_new_full (
+	groups = g_hash_table_new_full (
 		(GHashFunc) g_int64_hash,
 		(GEqualFunc) g_int64_equal,
 		(GDestroyNotify) g_free,
-		(GDestroyNotify) g_free);
-
-	g_hash_table_iter_init (&iter, hash_table);
+		(GDestroyNotify) g_ptr_array_unref);
 
-	while (g_hash_table_iter_next (&iter, &key, &value)) {
+	for (ii = 0; ii < message_uids->len; ii++) {
+		const gchar *uid = g_ptr_array_index (message_uids, ii);
 		CamelSummaryMessageID message_id;
-		CamelMessageFlags flags;
 		CamelMessageInfo *info;
-		gboolean duplicate;
-		const gchar *digest;
+		GPtrArray *group;
 
-		info = camel_folder_get_message_info (folder, key);
+		info = camel_folder_get_message_info (folder, uid);
 		if (!info)
 			continue;
 
-		message_id.id.id = camel_message_info_get_message_id (info);
-		flags = camel_message_info_get_flags (info);
-
 		/* Skip messages marked for deletion. */
-		if (flags & CAMEL_MESSAGE_DELETED) {
-			g_queue_push_tail (&trash, key);
+		if ((camel_message_info_get_flags (info) & CAMEL_MESSAGE_DELETED) != 0) {
 			g_clear_object (&info);
 			continue;
 		}
 
-		digest = value;
-
-		if (digest == NULL) {
-			g_queue_push_tail (&trash, key);
-			g_clear_object (&info);
-			continue;
-		}
-
-		/* Determine if the message a duplicate. */
-
-		value = g_hash_table_lookup (unique_ids, &message_id.id.id);
-		duplicate = (value != NULL) && g_str_equal (digest, value);
+		message_id.id.id = camel_message_info_get_message_id (info);
 
-		if (!duplicate) {
+		group = g_hash_table_lookup (groups, &message_id.id.id);
+		if (!group) {
 			gint64 *v_int64;
 
-			/* XXX Might be better to create a GArray
-			 *     of 64-bit integers and have the hash
-			 *     table keys point to array elements. */
 			v_int64 = g_new0 (gint64, 1);
 			*v_int64 = (gint64) message_id.id.id;
 
-			g_hash_table_insert (unique_ids, v_int64, g_strdup (digest));
-			g_queue_push_tail (&trash, key);
+			group = g_ptr_array_new ();
+			g_hash_table_insert (groups, v_int64, group);
 		}
 
+		g_ptr_array_add (group, (gpointer) uid);
+
 		g_clear_object (&info);
+
+		camel_operation_progress (cancellable, (ii + 1) * 100 / message_uids->len);
 	}
 
-	/* Delete all non-duplicate messages from the hash table. */
-	while ((key = g_queue_pop_head (&trash)) != NULL)
-		g_hash_table_remove (hash_table, key);
+	candidates = g_ptr_array_new ();
+
+	g_hash_table_iter_init (&iter, groups);
+
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		GPtrArray *group = value;
+
+		/* Messages with a unique Message-ID cannot be duplicates */
+		if (group->len > 1) {
+			for (ii = 0; ii < group->len; ii++)
+				g_ptr_array_add (candidates, g_ptr_array_index (group, ii));
+		}
+	}
 
 	camel_operation_pop_message (cancellable);
 
-	g_hash_table_destroy (unique_ids);
+	/* Phase 2: retrieve and hash only the candidates */
+
+	digests = emfu_get_messages_hash_sync (folder, candidates, cancellable, error);
+
+	g_ptr_array_unref (candidates);
+
+	if (!digests) {
+		g_hash_table_destroy (groups);
+		return NULL;
+	}
+
+	/* Phase 3: compare digests within each group, the first
+	 * message with each digest is the original one */
+
+	hash_table = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) g_free);
+
+	g_hash_table_iter_init (&iter, groups);
+
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		GPtrArray *group = value;
+		GHashTable *seen;
+
+		if (group->len < 2)
+			continue;
+
+		seen = g_hash_table_new (g_str_hash, g_str_equal);
+
+		for (ii = 0; ii < group->len; ii++) {
+			const gchar *uid = g_ptr_array_index (group, ii);
+			const gchar *digest;
+
+			digest = g_hash_table_lookup (digests, uid);
+			if (!digest)
+				continue;
+
+			if (g_hash_table_contains (seen, digest))
+				g_hash_table_insert (hash_table, g_strdup (uid), g_strdup (digest));
+			else
+				g_hash_table_add (seen, (gpointer) digest);
+		}
+
+		g_hash_table_destroy (seen);
+	}
+
+	g_hash_table_destroy (digests);
+	g_hash_table_destroy (groups);
 
 	return hash_table;
 }
@@ -37,6 +37,22 @@ static GHashTable *mail_msg_active_table;
 static GMutex mail_msg_lock;
 static GCond mail_msg_cond;
 
+/* Counters of one message queue, for statistics */
+typedef struct _MailMsgQueue {
+	gchar *name;
+	guint n_waiting;
+	guint n_running;
+	guint64 n_done;
+	gint64 total_wait_time;
+	gint64 max_wait_time;
+	gint64 total_run_time;
+} MailMsgQueue;
+
+/* All the queues used so far.  Must hold the queues lock to access
+ * them and their counters. */
+static GPtrArray *mail_msg_queues;
+G_LOCK_DEFINE_STATIC (queues);
+
 static MailMsgCreateActivityFunc create_activity = NULL;
 static MailMsgSubmitActivityFunc submit_activity = NULL;
 static MailMsgFreeActivityFunc free_activity = NULL;
@@ -358,13 +374,53 @@ mail_msg_idle_cb (void)
 	return FALSE;
 }
 
+static MailMsgQueue *
+mail_msg_queue_new (const gchar *name)
+{
+	MailMsgQueue *queue;
+
+	queue = g_new0 (MailMsgQueue, 1);
+	queue->name = g_strdup (name);
+
+	G_LOCK (queues);
+	if (!mail_msg_queues)
+		mail_msg_queues = g_ptr_array_new ();
+	g_ptr_array_add (mail_msg_queues, queue);
+	G_UNLOCK (queues);
+
+	return queue;
+}
+
 static void
-mail_msg_proxy (MailMsg *msg)
+mail_msg_queue_pushed (MailMsgQueue *queue,
+                       MailMsg *msg)
+{
+	msg->push_time = g_get_monotonic_time ();
+
+	G_LOCK (queues);
+	queue->n_waiting++;
+	G_UNLOCK (queues);
+}
+
+static void
+mail_msg_proxy (MailMsg *msg,
+                MailMsgQueue *queue)
 {
 	GCancellable *cancellable;
+	gint64 start_time, wait_time;
 
 	cancellable = msg->cancellable;
 
+	start_time = g_get_monotonic_time ();
+	wait_time = start_time - msg->push_time;
+
+	G_LOCK (queues);
+	queue->n_waiting--;
+	queue->n_running++;
+	queue->total_wait_time += wait_time;
+	queue->max_wait_time = MAX (queue->max_wait_time, wait_time);
+	G_UNLOCK (queues);
+
 	if (msg->info->desc != NULL) {
 		gchar *text = msg->info->desc (msg);
 		camel_operation_push_message (cancellable, "%s", text);
@@ -383,6 +439,13 @@ mail_msg_proxy (MailMsg *msg)
 	if (msg->info->desc != NULL)
 		camel_operation_pop_message (cancellable);
 
+	/* The msg can be freed as soon as it is in the reply queue */
+	G_LOCK (queues);
+	queue->n_running--;
+	queue->n_done++;
+	queue->total_run_time += g_get_monotonic_time () - start_time;
+	G_UNLOCK (queues);
+
 	g_async_queue_push (msg_reply_queue, msg);
 
 	G_LOCK (idle_source_id);
@@ -420,19 +483,35 @@ mail_msg_compare (const MailMsg *msg1,
 	return (priority1 < priority2) ? 1 : -1;
 }
 
-static gpointer
-create_thread_pool (gpointer data)
-{
+typedef struct _MailMsgPool {
+	const gchar *name;
+	gint max_threads;
 	GThreadPool *thread_pool;
-	gint max_threads = GPOINTER_TO_INT (data);
+	MailMsgQueue *queue;
+} MailMsgPool;
+
+static void
+mail_msg_pool_push (MailMsgPool *pool,
+                    MailMsg *msg)
+{
+	if (g_once_init_enter (&pool->thread_pool)) {
+		GThreadPool *thread_pool;
+
+		pool->queue = mail_msg_queue_new (pool->name);
 
-	/* once created, run forever */
-	thread_pool = g_thread_pool_new (
-		(GFunc) mail_msg_proxy, NULL, max_threads, FALSE, NULL);
-	g_thread_pool_set_sort_function (
-		thread_pool, (GCompareDataFunc) mail_msg_compare, NULL);
+		/* once created, run forever */
+		thread_pool = g_thread_pool_new (
+			(GFunc) mail_msg_proxy, pool->queue,
+			pool->max_threads, FALSE, NULL);
+		g_thread_pool_set_sort_function (
+			thread_pool, (GCompareDataFunc) mail_msg_compare, NULL);
+
+		g_once_init_leave (&pool->thread_pool, thread_pool);
+	}
 
-	return thread_pool;
+	mail_msg_queue_pushed (pool->queue, msg);
+
+	g_thread_pool_push (pool->thread_pool, msg, NULL);
 }
 
 void
@@ -454,31 +533,319 @@ mail_msg_main_loop_push (gpointer msg)
 void
 mail_msg_unordered_push (gpointer msg)
 {
-	static GOnce once = G_ONCE_INIT;
-
-	g_once (&once, (GThreadFunc) create_thread_pool, GINT_TO_POINTER (10));
+	static MailMsgPool pool = { "unordered", 10, NULL, NULL };
 
-	g_thread_pool_push ((GThreadPool *) once.retval, msg, NULL);
+	mail_msg_pool_push (&pool, msg);
 }
 
 void
 mail_msg_fast_ordered_push (gpointer msg)
 {
-	static GOnce once = G_ONCE_INIT;
+	static MailMsgPool pool = { "fast ordered", 1, NULL, NULL };
 
-	g_once (&once, (GThreadFunc) create_thread_pool, GINT_TO_POINTER (1));
+	mail_msg_pool_push (&pool, msg);
+}
 
-	g_thread_pool_push ((GThreadPool *) once.retval, msg, NULL);
+/* A message of the ordered queues with the stores it works with; the
+ * stores array is NULL for messages which can touch any store. */
+typedef struct _StoreMsg {
+	MailMsg *msg;
+	GPtrArray *stores; /* CamelStore * */
+	MailMsgQueue *queue;
+} StoreMsg;
+
+/* Pending StoreMsg-s, sorted by priority and then by push order, and
+ * the stores of the dispatched messages.  Must hold the store_queues
+ * lock to access them. */
+static GQueue store_msgs_pending = G_QUEUE_INIT;
+static GHashTable *store_msgs_running; /* CamelStore * ~> nothing */
+static gboolean store_msgs_running_any;
+/* CamelService::uid ~> MailMsgQueue * */
+static GHashTable *store_queue_stats;
+static MailMsgQueue *store_msgs_any_queue;
+static GThreadPool *store_queues_pool;
+G_LOCK_DEFINE_STATIC (store_queues);
+
+static void
+store_msg_free (StoreMsg *store_msg)
+{
+	if (store_msg) {
+		if (store_msg->stores)
+			g_ptr_array_unref (store_msg->stores);
+		g_slice_free (StoreMsg, store_msg);
+	}
 }
 
+/* Whether the store_msg works with any of the stores in the 'stores'
+ * hash table; messages working with any store conflict with all */
+static gboolean
+store_msg_conflicts (StoreMsg *store_msg,
+                     GHashTable *stores)
+{
+	guint ii;
+
+	if (!store_msg->stores)
+		return g_hash_table_size (stores) > 0;
+
+	for (ii = 0; ii < store_msg->stores->len; ii++) {
+		if (g_hash_table_contains (stores, g_ptr_array_index (store_msg->stores, ii)))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void
+store_msg_add_stores (StoreMsg *store_msg,
+                      GHashTable *stores,
+                      gboolean *any)
+{
+	guint ii;
+
+	if (!store_msg->stores) {
+		*any = TRUE;
+		return;
+	}
+
+	for (ii = 0; ii < store_msg->stores->len; ii++) {
+		g_hash_table_add (stores, g_ptr_array_index (store_msg->stores, ii));
+	}
+}
+
+/* Dispatches all the pending messages which do not share a store with
+ * a running message or with a pending message queued before them.
+ * Must hold the store_queues lock. */
+static void
+store_msgs_dispatch_locked (void)
+{
+	GHashTable *blocked;
+	gboolean blocked_any = FALSE;
+	GList *link;
+
+	if (store_msgs_running_any)
+		return;
+
+	blocked = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	/* A message working with any store runs alone, thus stop after it */
+	for (link = store_msgs_pending.head; link && !blocked_any && !store_msgs_running_any;) {
+		StoreMsg *store_msg = link->data;
+		GList *next = g_list_next (link);
+
+		if (store_msg_conflicts (store_msg, store_msgs_running) ||
+		    store_msg_conflicts (store_msg, blocked)) {
+			store_msg_add_stores (store_msg, blocked, &blocked_any);
+		} else {
+			g_queue_delete_link (&store_msgs_pending, link);
+
+			store_msg_add_stores (store_msg, store_msgs_running, &store_msgs_running_any);
+
+			g_thread_pool_push (store_queues_pool, store_msg, NULL);
+		}
+
+		link = next;
+	}
+
+	g_hash_table_destroy (blocked);
+}
+
+static void
+store_msg_run (StoreMsg *store_msg,
+               gpointer user_data)
+{
+	guint ii;
+
+	/* The msg can be freed after this, the store_msg cannot */
+	mail_msg_proxy (store_msg->msg, store_msg->queue);
+
+	G_LOCK (store_queues);
+
+	if (store_msg->stores) {
+		for (ii = 0; ii < store_msg->stores->len; ii++) {
+			g_hash_table_remove (store_msgs_running, g_ptr_array_index (store_msg->stores, ii));
+		}
+	} else {
+		store_msgs_running_any = FALSE;
+	}
+
+	store_msgs_dispatch_locked ();
+
+	G_UNLOCK (store_queues);
+
+	store_msg_free (store_msg);
+}
+
+/* Must hold the store_queues lock */
+static MailMsgQueue *
+store_queue_stats_get_locked (CamelStore *store)
+{
+	MailMsgQueue *queue;
+	const gchar *uid;
+
+	uid = camel_service_get_uid (CAMEL_SERVICE (store));
+	queue = g_hash_table_lookup (store_queue_stats, uid);
+
+	if (!queue) {
+		gchar *name;
+
+		name = g_strconcat ("store ", uid, NULL);
+		queue = mail_msg_queue_new (name);
+		g_free (name);
+
+		g_hash_table_insert (store_queue_stats, g_strdup (uid), queue);
+	}
+
+	return queue;
+}
+
+/* Takes ownership of the 'stores', which can be NULL for any store */
+static void
+store_msgs_push (MailMsg *msg,
+                 GPtrArray *stores)
+{
+	StoreMsg *store_msg;
+	GList *link;
+
+	G_LOCK (store_queues);
+
+	if (!store_msgs_running) {
+		store_msgs_running = g_hash_table_new (g_direct_hash, g_direct_equal);
+		store_queue_stats = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+		store_msgs_any_queue = mail_msg_queue_new ("slow ordered");
+		store_queues_pool = g_thread_pool_new (
+			(GFunc) store_msg_run, NULL,
+			CLAMP (g_get_num_processors (), 4, 16), FALSE, NULL);
+	}
+
+	store_msg = g_slice_new0 (StoreMsg);
+	store_msg->msg = msg;
+	store_msg->stores = stores;
+
+	/* Count the statistics to the first store, which is the one
+	 * the message works with the most, like the transfer source */
+	if (stores)
+		store_msg->queue = store_queue_stats_get_locked (g_ptr_array_index (stores, 0));
+	else
+		store_msg->queue = store_msgs_any_queue;
+
+	mail_msg_queue_pushed (store_msg->queue, msg);
+
+	/* Keep the push order among messages of the same priority */
+	for (link = store_msgs_pending.head; link; link = g_list_next (link)) {
+		if (((StoreMsg *) link->data)->msg->priority < msg->priority)
+			break;
+	}
+
+	if (link)
+		g_queue_insert_before (&store_msgs_pending, link, store_msg);
+	else
+		g_queue_push_tail (&store_msgs_pending, store_msg);
+
+	store_msgs_dispatch_locked ();
+
+	G_UNLOCK (store_queues);
+}
+
+/* Slow ordered messages can work with any store, like the search folders
+ * do, thus they run one after another and also in order with the messages
+ * pushed with mail_msg_store_ordered_push() and mail_msg_stores_ordered_push(). */
 void
 mail_msg_slow_ordered_push (gpointer msg)
 {
-	static GOnce once = G_ONCE_INIT;
+	g_return_if_fail (msg != NULL);
+
+	store_msgs_push (msg, NULL);
+}
+
+/* Messages pushed for the same store run one after another, in the order
+ * of their priority and then of their push, while messages of different
+ * stores run concurrently, thus a slow account does not block the others. */
+void
+mail_msg_store_ordered_push (gpointer msg,
+                             CamelStore *store)
+{
+	g_return_if_fail (CAMEL_IS_STORE (store));
+
+	mail_msg_stores_ordered_push (msg, &store, 1);
+}
+
+/* Similar to mail_msg_store_ordered_push(), for messages working with
+ * more stores, like a transfer between accounts; such message runs in
+ * order with the messages of all the 'stores'. */
+void
+mail_msg_stores_ordered_push (gpointer msg,
+                              CamelStore **stores,
+                              guint n_stores)
+{
+	GPtrArray *array;
+	guint ii;
+
+	g_return_if_fail (msg != NULL);
+	g_return_if_fail (stores != NULL);
+	g_return_if_fail (n_stores > 0);
+
+	array = g_ptr_array_new_full (n_stores, g_object_unref);
+
+	for (ii = 0; ii < n_stores; ii++) {
+		if (CAMEL_IS_STORE (stores[ii]) &&
+		    !g_ptr_array_find (array, stores[ii], NULL))
+			g_ptr_array_add (array, g_object_ref (stores[ii]));
+	}
+
+	if (!array->len) {
+		g_ptr_array_unref (array);
+		array = NULL;
+	}
+
+	store_msgs_push (msg, array);
+}
+
+void
+mail_msg_queue_stats_free (MailMsgQueueStats *stats)
+{
+	if (stats) {
+		g_free (stats->name);
+		g_free (stats);
+	}
+}
+
+/* Returns a snapshot of the statistics of all the message queues, as
+ * MailMsgQueueStats *; free it with g_ptr_array_unref(). */
+GPtrArray *
+mail_msg_dup_queue_stats (void)
+{
+	GPtrArray *array;
+	guint ii;
+
+	array = g_ptr_array_new_with_free_func ((GDestroyNotify) mail_msg_queue_stats_free);
+
+	G_LOCK (queues);
+
+	for (ii = 0; mail_msg_queues && ii < mail_msg_queues->len; ii++) {
+		MailMsgQueue *queue = g_ptr_array_index (mail_msg_queues, ii);
+		MailMsgQueueStats *stats;
+		guint64 n_started;
+
+		stats = g_new0 (MailMsgQueueStats, 1);
+		stats->name = g_strdup (queue->name);
+		stats->n_waiting = queue->n_waiting;
+		stats->n_running = queue->n_running;
+		stats->n_done = queue->n_done;
+		stats->max_wait_time = queue->max_wait_time;
+
+		n_started = queue->n_done + queue->n_running;
+
+		if (n_started > 0)
+			stats->avg_wait_time = queue->total_wait_time / (gint64) n_started;
+		if (queue->n_done > 0)
+			stats->avg_run_time = queue->total_run_time / (gint64) queue->n_done;
+
+		g_ptr_array_add (array, stats);
+	}
 
-	g_once (&once, (GThreadFunc) create_thread_pool, GINT_TO_POINTER (1));
+	G_UNLOCK (queues);
 
-	g_thread_pool_push ((GThreadPool *) once.retval, msg, NULL);
+	return array;
 }
 
 gboolean
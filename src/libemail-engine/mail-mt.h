@@ -59,6 +59,7 @@ struct _MailMsg {
 	gint priority;			/* priority (default = 0) */
 	GCancellable *cancellable;
 	GError *error;			/* up to the caller to use this */
+	gint64 push_time;		/* when it was queued, in monotonic time */
 };
 
 struct _MailMsgInfo {
@@ -69,6 +70,17 @@ struct _MailMsgInfo {
 	MailMsgFreeFunc free;
 };
 
+/* Statistics of one message queue, times are in microseconds */
+typedef struct _MailMsgQueueStats {
+	gchar *name;
+	guint n_waiting;		/* messages waiting to be run */
+	guint n_running;		/* messages being run */
+	guint64 n_done;			/* messages finished so far */
+	gint64 avg_wait_time;
+	gint64 max_wait_time;
+	gint64 avg_run_time;
+} MailMsgQueueStats;
+
 /* Just till we move this out to EDS */
 EAlertSink *	mail_msg_get_alert_sink (void);
 
@@ -99,6 +111,15 @@ void mail_msg_main_loop_push (gpointer msg);
 void mail_msg_unordered_push (gpointer msg);
 void mail_msg_fast_ordered_push (gpointer msg);
 void mail_msg_slow_ordered_push (gpointer msg);
+void mail_msg_store_ordered_push (gpointer msg,
+				  CamelStore *store);
+void mail_msg_stores_ordered_push (gpointer msg,
+				   CamelStore **stores,
+				   guint n_stores);
+
+/* queue statistics */
+GPtrArray *mail_msg_dup_queue_stats (void);
+void mail_msg_queue_stats_free (MailMsgQueueStats *stats);
 
 /* Call a function in the GUI thread, wait for it to return, type is
  * the marshaller to use.  FIXME This thing is horrible, please put
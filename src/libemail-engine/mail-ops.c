@@ -1201,6 +1201,23 @@ mail_send_queue (EMailSession *session,
 	mail_msg_unordered_push (m);
 }
 
+/* Queues the msg behind other operations of the folder's store, while
+ * operations of other stores can run meanwhile. */
+static void
+mail_ops_folder_ordered_push (gpointer msg,
+                              CamelFolder *folder)
+{
+	CamelStore *store;
+
+	store = camel_folder_get_parent_store (folder);
+
+	/* Search folders work with folders of any store */
+	if (store && !CAMEL_IS_VEE_STORE (store))
+		mail_msg_store_ordered_push (msg, store);
+	else
+		mail_msg_slow_ordered_push (msg);
+}
+
 /* ** TRANSFER MESSAGES **************************************************** */
 
 struct _transfer_msg {
@@ -1309,6 +1326,7 @@ mail_transfer_messages (EMailSession *session,
                         gpointer data)
 {
 	struct _transfer_msg *m;
+	CamelStore *dest_store = NULL;
 
 	g_return_if_fail (CAMEL_IS_FOLDER (source));
 	g_return_if_fail (uids != NULL);
@@ -1324,7 +1342,23 @@ mail_transfer_messages (EMailSession *session,
 	m->done = done;
 	m->data = data;
 
-	mail_msg_slow_ordered_push (m);
+	/* Run in order with the operations of both the source
+	 * and the destination store, like their sync */
+	if (e_mail_folder_uri_parse (CAMEL_SESSION (session), dest_uri, &dest_store, NULL, NULL)) {
+		CamelStore *stores[2];
+
+		stores[0] = camel_folder_get_parent_store (source);
+		stores[1] = dest_store;
+
+		if (stores[0] && !CAMEL_IS_VEE_STORE (stores[0]) && !CAMEL_IS_VEE_STORE (stores[1]))
+			mail_msg_stores_ordered_push (m, stores, G_N_ELEMENTS (stores));
+		else
+			mail_msg_slow_ordered_push (m);
+
+		g_object_unref (dest_store);
+	} else {
+		mail_msg_slow_ordered_push (m);
+	}
 }
 
 /* ** SYNC FOLDER ********************************************************* */
@@ -1444,7 +1478,7 @@ mail_sync_folder (CamelFolder *folder,
 	m->data = data;
 	m->done = done;
 
-	mail_msg_slow_ordered_push (m);
+	mail_ops_folder_ordered_push (m, folder);
 }
 
 /* ** SYNC STORE ********************************************************* */
@@ -1525,7 +1559,7 @@ mail_sync_store (CamelStore *store,
 	m->data = data;
 	m->done = done;
 
-	mail_msg_slow_ordered_push (m);
+	mail_msg_store_ordered_push (m, store);
 }
 
 /* ******************************************************************************** */
@@ -1601,7 +1635,7 @@ mail_empty_trash (CamelStore *store)
 	m = mail_msg_new (&empty_trash_info);
 	m->store = g_object_ref (store);
 
-	mail_msg_slow_ordered_push (m);
+	mail_msg_store_ordered_push (m, store);
 }
 
 /* ** Execute Shell Command ************************************************ */
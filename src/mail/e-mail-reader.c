@@ -64,8 +64,20 @@
 
 #define d(x)
 
+/* How many messages ahead of the displayed one, in the direction
+ * the user moves through the message list, are fetched and parsed
+ * in the background. */
+#define PREFETCH_MAX_MESSAGES 3
+
+/* Limits of the strong cache of prefetched part lists. The size is
+ * estimated from the message size, thus it's only approximate. */
+#define PREFETCH_CACHE_MAX_ENTRIES 16
+#define PREFETCH_CACHE_MAX_BYTES (32 * 1024 * 1024)
+
 typedef struct _EMailReaderClosure EMailReaderClosure;
 typedef struct _EMailReaderPrivate EMailReaderPrivate;
+typedef struct _PrefetchEntry PrefetchEntry;
+typedef struct _PrefetchData PrefetchData;
 
 struct _EMailReaderClosure {
 	EMailReader *reader;
@@ -76,6 +88,22 @@ struct _EMailReaderClosure {
 	gboolean selection_is_html;
 };
 
+struct _PrefetchEntry {
+	gchar *mail_uri;
+	EMailPartList *part_list;
+	gsize size;
+};
+
+struct _PrefetchData {
+	GWeakRef *reader_weakref;
+	EMailSession *session;
+	CamelFolder *folder;
+	GCancellable *cancellable;
+	gchar *message_uid;
+	gchar *mail_uri;
+	gsize size;
+};
+
 struct _EMailReaderPrivate {
 
 	EMailForwardStyle forward_style;
@@ -110,6 +138,17 @@ struct _EMailReaderPrivate {
 
 	guint main_menu_label_merge_id;
 	guint popup_menu_label_merge_id;
+
+	/* Predictive prefetch of messages adjacent to the displayed one.
+	 * The cache holds strong references, thus the prefetched part
+	 * lists stay in the registry until evicted. */
+	GCancellable *prefetch_cancellable;
+	GHashTable *prefetch_pending; /* gchar *mail_uri */
+	GQueue prefetch_cache; /* PrefetchEntry *, most recently used first */
+	gsize prefetch_cache_size;
+	gchar *prefetch_last_uid;
+	guint prefetch_hits;
+	guint prefetch_misses;
 };
 
 enum {
@@ -150,6 +189,51 @@ mail_reader_closure_free (EMailReaderClosure *closure)
 	g_slice_free (EMailReaderClosure, closure);
 }
 
+static void
+prefetch_entry_free (gpointer ptr)
+{
+	PrefetchEntry *entry = ptr;
+
+	if (entry) {
+		g_free (entry->mail_uri);
+		g_clear_object (&entry->part_list);
+		g_slice_free (PrefetchEntry, entry);
+	}
+}
+
+static void
+prefetch_data_free (gpointer ptr)
+{
+	PrefetchData *pd = ptr;
+
+	if (pd) {
+		e_weak_ref_free (pd->reader_weakref);
+		g_clear_object (&pd->session);
+		g_clear_object (&pd->folder);
+		g_clear_object (&pd->cancellable);
+		g_free (pd->message_uid);
+		g_free (pd->mail_uri);
+		g_slice_free (PrefetchData, pd);
+	}
+}
+
+static void
+mail_reader_prefetch_cancel (EMailReaderPrivate *priv)
+{
+	if (priv->prefetch_cancellable) {
+		g_cancellable_cancel (priv->prefetch_cancellable);
+		g_clear_object (&priv->prefetch_cancellable);
+	}
+
+	if (priv->prefetch_pending)
+		g_hash_table_remove_all (priv->prefetch_pending);
+
+	g_queue_clear_full (&priv->prefetch_cache, prefetch_entry_free);
+	priv->prefetch_cache_size = 0;
+
+	g_clear_pointer (&priv->prefetch_last_uid, g_free);
+}
+
 static void
 mail_reader_private_free (EMailReaderPrivate *priv)
 {
@@ -162,6 +246,9 @@ mail_reader_private_free (EMailReaderPrivate *priv)
 		priv->retrieving_message = NULL;
 	}
 
+	mail_reader_prefetch_cancel (priv);
+	g_clear_pointer (&priv->prefetch_pending, g_hash_table_destroy);
+
 	g_slice_free (EMailReaderPrivate, priv);
 }
 
@@ -4256,6 +4343,269 @@ mail_reader_get_selected_uids_with_collapsed_threads (EMailReader *reader)
 	return message_list_get_selected_with_collapsed_threads (MESSAGE_LIST (message_list));
 }
 
+/* Moves the cache entry for the @mail_uri to the head of the LRU.
+ * Returns whether such entry exists. */
+static gboolean
+mail_reader_prefetch_cache_touch (EMailReaderPrivate *priv,
+                                  const gchar *mail_uri)
+{
+	GList *link;
+
+	for (link = priv->prefetch_cache.head; link; link = g_list_next (link)) {
+		PrefetchEntry *entry = link->data;
+
+		if (g_strcmp0 (entry->mail_uri, mail_uri) == 0) {
+			if (link != priv->prefetch_cache.head) {
+				g_queue_unlink (&priv->prefetch_cache, link);
+				g_queue_push_head_link (&priv->prefetch_cache, link);
+			}
+
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static void
+mail_reader_prefetch_cache_add (EMailReaderPrivate *priv,
+                                const gchar *mail_uri,
+                                EMailPartList *part_list,
+                                gsize size)
+{
+	PrefetchEntry *entry;
+
+	if (mail_reader_prefetch_cache_touch (priv, mail_uri))
+		return;
+
+	entry = g_slice_new0 (PrefetchEntry);
+	entry->mail_uri = g_strdup (mail_uri);
+	entry->part_list = g_object_ref (part_list);
+	entry->size = size;
+
+	g_queue_push_head (&priv->prefetch_cache, entry);
+	priv->prefetch_cache_size += size;
+
+	/* Always keep at least the just added entry */
+	while (priv->prefetch_cache.length > 1 &&
+	       (priv->prefetch_cache.length > PREFETCH_CACHE_MAX_ENTRIES ||
+	        priv->prefetch_cache_size > PREFETCH_CACHE_MAX_BYTES)) {
+		entry = g_queue_pop_tail (&priv->prefetch_cache);
+		priv->prefetch_cache_size -= MIN (priv->prefetch_cache_size, entry->size);
+		prefetch_entry_free (entry);
+	}
+}
+
+static void
+mail_reader_prefetch_parse_thread (GTask *task,
+                                   gpointer source_object,
+                                   gpointer task_data,
+                                   GCancellable *cancellable)
+{
+	PrefetchData *pd = task_data;
+	CamelMimeMessage *message = source_object;
+	CamelObjectBag *registry;
+	EMailPartList *part_list;
+
+	registry = e_mail_part_list_get_registry ();
+
+	/* Blocks when the same message is being parsed for the display */
+	part_list = camel_object_bag_reserve (registry, pd->mail_uri);
+
+	if (part_list == NULL) {
+		EMailParser *parser;
+
+		parser = e_mail_parser_new (CAMEL_SESSION (pd->session));
+		part_list = e_mail_parser_parse_sync (parser, pd->folder, pd->message_uid, message, cancellable);
+		g_object_unref (parser);
+
+		/* Do not store partially parsed messages */
+		if (part_list && g_cancellable_is_cancelled (cancellable))
+			g_clear_object (&part_list);
+
+		if (part_list == NULL)
+			camel_object_bag_abort (registry, pd->mail_uri);
+		else
+			camel_object_bag_add (registry, pd->mail_uri, part_list);
+	}
+
+	if (!g_task_return_error_if_cancelled (task))
+		g_task_return_pointer (task, g_steal_pointer (&part_list), g_object_unref);
+	else
+		g_clear_object (&part_list);
+}
+
+static void
+mail_reader_prefetch_parsed_cb (GObject *source_object,
+                                GAsyncResult *result,
+                                gpointer user_data)
+{
+	PrefetchData *pd = g_task_get_task_data (G_TASK (result));
+	EMailPartList *part_list;
+	EMailReader *reader;
+
+	part_list = g_task_propagate_pointer (G_TASK (result), NULL);
+	reader = g_weak_ref_get (pd->reader_weakref);
+
+	if (reader) {
+		EMailReaderPrivate *priv;
+
+		priv = E_MAIL_READER_GET_PRIVATE (reader);
+
+		/* The folder could change meanwhile, which cancels the prefetch */
+		if (pd->cancellable == priv->prefetch_cancellable) {
+			g_hash_table_remove (priv->prefetch_pending, pd->mail_uri);
+
+			if (part_list)
+				mail_reader_prefetch_cache_add (priv, pd->mail_uri, part_list, pd->size);
+		}
+
+		g_object_unref (reader);
+	}
+
+	g_clear_object (&part_list);
+}
+
+static void
+mail_reader_prefetch_got_message_cb (GObject *source_object,
+                                     GAsyncResult *result,
+                                     gpointer user_data)
+{
+	PrefetchData *pd = user_data;
+	CamelMimeMessage *message;
+	EMailReader *reader;
+
+	message = camel_folder_get_message_finish (CAMEL_FOLDER (source_object), result, NULL);
+	reader = g_weak_ref_get (pd->reader_weakref);
+
+	if (message && reader && !g_cancellable_is_cancelled (pd->cancellable)) {
+		GTask *task;
+
+		task = g_task_new (message, pd->cancellable, mail_reader_prefetch_parsed_cb, NULL);
+		g_task_set_source_tag (task, mail_reader_prefetch_got_message_cb);
+		g_task_set_priority (task, G_PRIORITY_LOW);
+		g_task_set_task_data (task, pd, prefetch_data_free);
+		g_task_run_in_thread (task, mail_reader_prefetch_parse_thread);
+		g_object_unref (task);
+
+		pd = NULL;
+	} else if (reader) {
+		EMailReaderPrivate *priv;
+
+		priv = E_MAIL_READER_GET_PRIVATE (reader);
+
+		if (pd->cancellable == priv->prefetch_cancellable)
+			g_hash_table_remove (priv->prefetch_pending, pd->mail_uri);
+	}
+
+	g_clear_object (&message);
+	g_clear_object (&reader);
+	prefetch_data_free (pd);
+}
+
+/* Fetches and parses several messages following the @message_uid in
+ * the direction the user moves through the message list, thus they
+ * can be shown without waiting when the user gets to them. */
+static void
+mail_reader_prefetch_adjacent (EMailReader *reader,
+                               CamelFolder *folder,
+                               const gchar *message_uid)
+{
+	EMailReaderPrivate *priv;
+	EMailBackend *backend;
+	EMailDisplay *display;
+	MessageList *message_list;
+	MessageListSelectDirection direction = MESSAGE_LIST_SELECT_NEXT;
+	CamelObjectBag *registry;
+	GPtrArray *uids;
+	guint ii;
+
+	priv = E_MAIL_READER_GET_PRIVATE (reader);
+	display = e_mail_reader_get_mail_display (reader);
+
+	if (!folder || !display || e_mail_display_get_mode (display) == E_MAIL_FORMATTER_MODE_SOURCE)
+		return;
+
+	message_list = MESSAGE_LIST (e_mail_reader_get_message_list (reader));
+
+	/* Moving up the list when the previously shown message is
+	 * the one right below the current one; down otherwise. */
+	if (priv->prefetch_last_uid) {
+		uids = message_list_get_adjacent_uids (message_list, MESSAGE_LIST_SELECT_NEXT, 1);
+
+		if (uids->len == 1 && g_strcmp0 (g_ptr_array_index (uids, 0), priv->prefetch_last_uid) == 0)
+			direction = MESSAGE_LIST_SELECT_PREVIOUS;
+
+		g_ptr_array_unref (uids);
+	}
+
+	g_free (priv->prefetch_last_uid);
+	priv->prefetch_last_uid = g_strdup (message_uid);
+
+	uids = message_list_get_adjacent_uids (message_list, direction, PREFETCH_MAX_MESSAGES);
+	if (!uids->len) {
+		g_ptr_array_unref (uids);
+		return;
+	}
+
+	if (!priv->prefetch_cancellable)
+		priv->prefetch_cancellable = g_cancellable_new ();
+
+	if (!priv->prefetch_pending)
+		priv->prefetch_pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	backend = e_mail_reader_get_backend (reader);
+	registry = e_mail_part_list_get_registry ();
+
+	for (ii = 0; ii < uids->len; ii++) {
+		const gchar *uid = g_ptr_array_index (uids, ii);
+		CamelMessageInfo *info;
+		EMailPartList *part_list;
+		PrefetchData *pd;
+		gchar *mail_uri;
+		gsize size = 0;
+
+		mail_uri = e_mail_part_build_uri (folder, uid, NULL, NULL);
+
+		if (g_hash_table_contains (priv->prefetch_pending, mail_uri)) {
+			g_free (mail_uri);
+			continue;
+		}
+
+		info = camel_folder_get_message_info (folder, uid);
+		if (info) {
+			size = camel_message_info_get_size (info);
+			g_object_unref (info);
+		}
+
+		/* Already parsed, only make sure it stays around */
+		part_list = camel_object_bag_peek (registry, mail_uri);
+		if (part_list) {
+			mail_reader_prefetch_cache_add (priv, mail_uri, part_list, size);
+			g_object_unref (part_list);
+			g_free (mail_uri);
+			continue;
+		}
+
+		pd = g_slice_new0 (PrefetchData);
+		pd->reader_weakref = e_weak_ref_new (reader);
+		pd->session = g_object_ref (e_mail_backend_get_session (backend));
+		pd->folder = g_object_ref (folder);
+		pd->cancellable = g_object_ref (priv->prefetch_cancellable);
+		pd->message_uid = g_strdup (uid);
+		pd->mail_uri = mail_uri;
+		pd->size = size;
+
+		g_hash_table_add (priv->prefetch_pending, g_strdup (mail_uri));
+
+		camel_folder_get_message (
+			folder, uid, G_PRIORITY_LOW, pd->cancellable,
+			mail_reader_prefetch_got_message_cb, pd);
+	}
+
+	g_ptr_array_unref (uids);
+}
+
 static CamelFolder *
 mail_reader_ref_folder (EMailReader *reader)
 {
@@ -4300,6 +4650,8 @@ mail_reader_set_folder (EMailReader *reader,
 	if (folder != previous_folder) {
 		e_web_view_clear (E_WEB_VIEW (display));
 
+		mail_reader_prefetch_cancel (priv);
+
 		priv->folder_was_just_selected = (folder != NULL) && !priv->mark_seen_always;
 		priv->did_try_to_open_message = FALSE;
 
@@ -4399,8 +4751,16 @@ mail_reader_set_display_formatter_for_message (EMailReader *reader,
 	mail_uri = e_mail_part_build_uri (folder, message_uid, NULL, NULL);
 	registry = e_mail_part_list_get_registry ();
 	parts = camel_object_bag_peek (registry, mail_uri);
+
+	if (parts && mail_reader_prefetch_cache_touch (priv, mail_uri))
+		priv->prefetch_hits++;
+	else
+		priv->prefetch_misses++;
+
 	g_free (mail_uri);
 
+	d (printf ("%s: prefetch hits:%u misses:%u\n", G_STRFUNC, priv->prefetch_hits, priv->prefetch_misses));
+
 	if (parts == NULL) {
 		if (!priv->retrieving_message)
 			priv->retrieving_message = camel_operation_new ();
@@ -4414,6 +4774,8 @@ mail_reader_set_display_formatter_for_message (EMailReader *reader,
 		e_mail_display_load (display, NULL);
 		g_object_unref (parts);
 	}
+
+	mail_reader_prefetch_adjacent (reader, folder, message_uid);
 }
 
 static void
@@ -6818,6 +7180,36 @@ e_mail_reader_avoid_next_mark_as_seen (EMailReader *reader)
 	priv->avoid_next_mark_as_seen = TRUE;
 }
 
+/**
+ * e_mail_reader_get_prefetch_stats:
+ * @reader: an #EMailReader
+ * @out_hits: (out) (optional): return location for the number of hits
+ * @out_misses: (out) (optional): return location for the number of misses
+ *
+ * Returns how many displayed messages had been prefetched in advance
+ * (hits) and how many had to be fetched and parsed on demand (misses).
+ *
+ * Since: 3.56
+ **/
+void
+e_mail_reader_get_prefetch_stats (EMailReader *reader,
+                                  guint *out_hits,
+                                  guint *out_misses)
+{
+	EMailReaderPrivate *priv;
+
+	g_return_if_fail (E_IS_MAIL_READER (reader));
+
+	priv = E_MAIL_READER_GET_PRIVATE (reader);
+	g_return_if_fail (priv != NULL);
+
+	if (out_hits)
+		*out_hits = priv->prefetch_hits;
+
+	if (out_misses)
+		*out_misses = priv->prefetch_misses;
+}
+
 void
 e_mail_reader_unset_folder_just_selected (EMailReader *reader)
 {
@@ -209,6 +209,10 @@ void		e_mail_reader_avoid_next_mark_as_seen
 						(EMailReader *reader);
 void		e_mail_reader_unset_folder_just_selected
 						(EMailReader *reader);
+void		e_mail_reader_get_prefetch_stats
+						(EMailReader *reader,
+						 guint *out_hits,
+						 guint *out_misses);
 void		e_mail_reader_composer_created	(EMailReader *reader,
 						 EMsgComposer *composer,
 						 CamelMimeMessage *message);
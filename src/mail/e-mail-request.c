@@ -90,6 +90,163 @@ save_gicon_to_stream (GIcon *icon,
 	g_object_unref (icon_info);
 }
 
+/* Formatted fragments are kept for the recently viewed messages,
+   thus reloads and re-displays do not need to format them again. */
+#define FRAGMENT_CACHE_MAX_ENTRIES 64
+#define FRAGMENT_CACHE_MAX_SIZE (16 * 1024 * 1024)
+
+typedef struct _FragmentCacheEntry {
+	gchar *key;
+	GBytes *bytes;
+	GPtrArray *attachments; /* EAttachment *, claimed while formatting */
+	gboolean converted_to_utf8;
+} FragmentCacheEntry;
+
+/* The cache is used only from the main thread, where the formatting happens */
+static GHashTable *fragment_cache = NULL; /* gchar *key ~> GList *link in fragment_cache_lru */
+static GQueue fragment_cache_lru = G_QUEUE_INIT; /* FragmentCacheEntry *, most recently used first */
+static gsize fragment_cache_size = 0;
+static guint fragment_cache_generation = 0;
+
+static void
+fragment_cache_entry_free (gpointer ptr)
+{
+	FragmentCacheEntry *entry = ptr;
+
+	if (entry) {
+		g_free (entry->key);
+		g_bytes_unref (entry->bytes);
+		g_ptr_array_unref (entry->attachments);
+		g_slice_free (FragmentCacheEntry, entry);
+	}
+}
+
+static void
+fragment_cache_formatter_notify_cb (GObject *formatter,
+				    GParamSpec *param,
+				    gpointer user_data)
+{
+	/* The charsets are set by each request and are part of the key */
+	if (g_strcmp0 (param->name, "charset") == 0 ||
+	    g_strcmp0 (param->name, "default-charset") == 0)
+		return;
+
+	/* Any other change, like colours or image loading policy,
+	   can change the output, thus start a new generation. */
+	g_object_set_data (formatter, "e-mail-request-generation", GUINT_TO_POINTER (++fragment_cache_generation));
+}
+
+/* Returns a number which changes whenever the @object changes in
+   a way affecting the formatted output. Part lists get one number
+   for their whole life, thus a re-parsed message is not mixed up
+   with an older part list which happened to use the same address. */
+static guint
+fragment_cache_get_generation (GObject *object)
+{
+	guint generation;
+
+	generation = GPOINTER_TO_UINT (g_object_get_data (object, "e-mail-request-generation"));
+	if (!generation) {
+		generation = ++fragment_cache_generation;
+		g_object_set_data (object, "e-mail-request-generation", GUINT_TO_POINTER (generation));
+
+		if (E_IS_MAIL_FORMATTER (object)) {
+			g_signal_connect (object, "notify",
+				G_CALLBACK (fragment_cache_formatter_notify_cb), NULL);
+		}
+	}
+
+	return generation;
+}
+
+static gchar *
+fragment_cache_dup_key (EMailPartList *part_list,
+			EMailFormatter *formatter,
+			const gchar *uri)
+{
+	gchar *charset, *default_charset, *key;
+
+	charset = e_mail_formatter_dup_charset (formatter);
+	default_charset = e_mail_formatter_dup_default_charset (formatter);
+
+	/* The URI carries the part ID, the formatter mode and the header flags */
+	key = g_strdup_printf ("%u\n%p:%u\n%s\n%s\n%s",
+		fragment_cache_get_generation (G_OBJECT (part_list)),
+		formatter, fragment_cache_get_generation (G_OBJECT (formatter)),
+		charset ? charset : "", default_charset ? default_charset : "", uri);
+
+	g_free (default_charset);
+	g_free (charset);
+
+	return key;
+}
+
+static FragmentCacheEntry *
+fragment_cache_lookup (const gchar *key)
+{
+	GList *link;
+
+	if (!fragment_cache)
+		return NULL;
+
+	link = g_hash_table_lookup (fragment_cache, key);
+	if (!link)
+		return NULL;
+
+	g_queue_unlink (&fragment_cache_lru, link);
+	g_queue_push_head_link (&fragment_cache_lru, link);
+
+	return link->data;
+}
+
+static void
+fragment_cache_add (gchar *key, /* (transfer full) */
+		    GBytes *bytes,
+		    GPtrArray *attachments,
+		    gboolean converted_to_utf8)
+{
+	FragmentCacheEntry *entry;
+
+	/* Do not let one huge message push out everything else */
+	if (g_bytes_get_size (bytes) > FRAGMENT_CACHE_MAX_SIZE / 4) {
+		g_free (key);
+		return;
+	}
+
+	if (!fragment_cache)
+		fragment_cache = g_hash_table_new (g_str_hash, g_str_equal);
+
+	entry = g_slice_new0 (FragmentCacheEntry);
+	entry->key = key;
+	entry->bytes = g_bytes_ref (bytes);
+	entry->attachments = g_ptr_array_ref (attachments);
+	entry->converted_to_utf8 = converted_to_utf8;
+
+	g_queue_push_head (&fragment_cache_lru, entry);
+	g_hash_table_insert (fragment_cache, entry->key, fragment_cache_lru.head);
+	fragment_cache_size += g_bytes_get_size (bytes);
+
+	while (fragment_cache_lru.length > FRAGMENT_CACHE_MAX_ENTRIES ||
+	       fragment_cache_size > FRAGMENT_CACHE_MAX_SIZE) {
+		entry = g_queue_pop_tail (&fragment_cache_lru);
+
+		g_hash_table_remove (fragment_cache, entry->key);
+		fragment_cache_size -= g_bytes_get_size (entry->bytes);
+
+		fragment_cache_entry_free (entry);
+	}
+}
+
+static void
+mail_request_claim_attachment_cb (EMailFormatter *formatter,
+				  EAttachment *attachment,
+				  gpointer user_data)
+{
+	GPtrArray *attachments = user_data;
+
+	g_ptr_array_add (attachments, g_object_ref (attachment));
+}
+
 static gboolean
 mail_request_process_mail_sync (EContentRequest *request,
 				GUri *guri,
@@ -105,8 +262,9 @@ mail_request_process_mail_sync (EContentRequest *request,
 	EMailPartList *part_list;
 	CamelObjectBag *registry;
 	GOutputStream *output_stream;
-	GBytes *bytes;
-	gchar *tmp, *use_mime_type = NULL;
+	GBytes *bytes = NULL;
+	GPtrArray *claimed_attachments = NULL;
+	gchar *tmp, *use_mime_type = NULL, *cache_key = NULL;
 	const gchar *val;
 	const gchar *default_charset, *charset;
 	gboolean part_converted_to_utf8 = FALSE;
@@ -233,6 +391,36 @@ mail_request_process_mail_sync (EContentRequest *request,
 		goto no_part;
 	}
 
+	/* The print formatter and formatters not belonging to a display
+	   are created for the request, thus their output is not reused. */
+	if (context.mode != E_MAIL_FORMATTER_MODE_PRINTING && E_IS_MAIL_DISPLAY (requester)) {
+		FragmentCacheEntry *entry;
+
+		cache_key = fragment_cache_dup_key (part_list, formatter, context.uri);
+		entry = fragment_cache_lookup (cache_key);
+
+		if (entry) {
+			guint ii;
+
+			/* Attachments are claimed as a side effect of the formatting */
+			for (ii = 0; ii < entry->attachments->len; ii++) {
+				e_mail_formatter_claim_attachment (formatter, g_ptr_array_index (entry->attachments, ii));
+			}
+
+			bytes = g_bytes_ref (entry->bytes);
+			part_converted_to_utf8 = entry->converted_to_utf8;
+
+			g_clear_pointer (&cache_key, g_free);
+
+			goto no_part;
+		}
+
+		claimed_attachments = g_ptr_array_new_with_free_func (g_object_unref);
+
+		g_signal_connect (formatter, "claim-attachment",
+			G_CALLBACK (mail_request_claim_attachment_cb), claimed_attachments);
+	}
+
 	val = uri_query ? g_hash_table_lookup (uri_query, "part_id") : NULL;
 	if (val != NULL) {
 		EMailPart *part;
@@ -280,7 +468,20 @@ mail_request_process_mail_sync (EContentRequest *request,
 
 	g_output_stream_close (output_stream, NULL, NULL);
 
-	bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (output_stream));
+	if (claimed_attachments) {
+		g_signal_handlers_disconnect_by_func (formatter,
+			G_CALLBACK (mail_request_claim_attachment_cb), claimed_attachments);
+	}
+
+	if (!bytes) {
+		bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (output_stream));
+
+		if (cache_key && g_bytes_get_size (bytes) > 0 &&
+		    !g_cancellable_is_cancelled (cancellable)) {
+			fragment_cache_add (cache_key, bytes, claimed_attachments, part_converted_to_utf8);
+			cache_key = NULL;
+		}
+	}
 
 	if (g_bytes_get_size (bytes) == 0) {
 		gchar *data;
@@ -304,10 +505,14 @@ mail_request_process_mail_sync (EContentRequest *request,
 		use_mime_type = tmp;
 	}
 
+	/* Shares the bytes with the cache, no copy is made */
 	*out_stream = g_memory_input_stream_new_from_bytes (bytes);
 	*out_stream_length = g_bytes_get_size (bytes);
 	*out_mime_type = use_mime_type;
 
+	if (claimed_attachments)
+		g_ptr_array_unref (claimed_attachments);
+	g_free (cache_key);
 	g_object_unref (output_stream);
 	g_object_unref (part_list);
 	g_object_unref (formatter);
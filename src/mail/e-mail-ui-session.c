@@ -66,6 +66,7 @@ static ca_context *cactx = NULL;
 static gint eca_debug = -1;
 
 typedef struct _SourceContext SourceContext;
+typedef struct _FilterRuleSet FilterRuleSet;
 
 struct _EMailUISessionPrivate {
 	FILE *filter_logfile;
@@ -75,8 +76,14 @@ struct _EMailUISessionPrivate {
 	EPhotoCache *photo_cache;
 	gboolean check_junk;
 
-	GSList *address_cache; /* data is AddressCacheData struct */
+	GHashTable *address_cache; /* gchar *key ~> AddressCacheData */
+	GHashTable *address_book_views; /* gchar *ESource::uid ~> EBookClientView */
 	GMutex address_cache_mutex;
+	guint address_cache_generation; /* increased on any contact change */
+
+	GMutex filter_rules_lock;
+	FilterRuleSet *filter_rules; /* compiled user filters; owned */
+	gboolean filter_rules_invalid;
 };
 
 enum {
@@ -103,60 +110,233 @@ struct _SourceContext {
 	CamelService *service;
 };
 
+typedef struct _CompiledFilterRule {
+	gchar *name;
+	gchar *code;
+	gchar *action;
+} CompiledFilterRule;
+
+/* Enabled user filters, already converted to S-expressions, grouped
+   by the filter source. Read-only once built, shared by all drivers. */
+struct _FilterRuleSet {
+	volatile gint ref_count;
+	GHashTable *rules; /* gchar *source ~> GPtrArray { CompiledFilterRule * } */
+	GStatBuf user_stat;
+	GStatBuf system_stat;
+	gboolean user_exists;
+	gboolean system_exists;
+};
+
+/* let the cache values live for 5 minutes */
+#define ADDRESS_CACHE_TIMEOUT (5 * 60 * G_USEC_PER_SEC)
+/* at most this many addresses are remembered */
+#define ADDRESS_CACHE_MAX_SIZE 4096
+
 typedef struct _AddressCacheData {
-	gchar *email_address;
 	gint64 stamp; /* when it was added to cache, in microseconds */
 	gboolean is_known;
 } AddressCacheData;
 
+static gchar *
+address_cache_dup_key (const gchar *email_address,
+		       const gchar *book_uid)
+{
+	gchar *lowercase, *key;
+
+	lowercase = g_utf8_strdown (email_address, -1);
+	key = g_strconcat (book_uid, ":", lowercase, NULL);
+	g_free (lowercase);
+
+	return key;
+}
+
+/* The address_cache_mutex should be locked */
+static gboolean
+address_cache_lookup (EMailUISession *session,
+		      const gchar *key,
+		      gboolean *out_is_known)
+{
+	AddressCacheData *data;
+
+	data = g_hash_table_lookup (session->priv->address_cache, key);
+	if (!data)
+		return FALSE;
+
+	if (data->stamp <= g_get_real_time () - ADDRESS_CACHE_TIMEOUT) {
+		g_hash_table_remove (session->priv->address_cache, key);
+		return FALSE;
+	}
+
+	*out_is_known = data->is_known;
+
+	return TRUE;
+}
+
+static gboolean
+address_cache_is_expired_cb (gpointer key,
+			     gpointer value,
+			     gpointer user_data)
+{
+	AddressCacheData *data = value;
+	gint64 *old_when = user_data;
+
+	return data->stamp <= *old_when;
+}
+
+/* The address_cache_mutex should be locked; takes ownership of the 'key' */
 static void
-address_cache_data_free (gpointer pdata)
+address_cache_add (EMailUISession *session,
+		   gchar *key,
+		   gboolean is_known)
 {
-	AddressCacheData *data = pdata;
+	AddressCacheData *data;
+
+	if (g_hash_table_size (session->priv->address_cache) >= ADDRESS_CACHE_MAX_SIZE) {
+		gint64 old_when = g_get_real_time () - ADDRESS_CACHE_TIMEOUT;
 
-	if (data) {
-		g_free (data->email_address);
-		g_free (data);
+		g_hash_table_foreach_remove (session->priv->address_cache,
+			address_cache_is_expired_cb, &old_when);
+
+		if (g_hash_table_size (session->priv->address_cache) >= ADDRESS_CACHE_MAX_SIZE)
+			g_hash_table_remove_all (session->priv->address_cache);
 	}
+
+	data = g_new0 (AddressCacheData, 1);
+	data->stamp = g_get_real_time ();
+	data->is_known = is_known;
+
+	g_hash_table_insert (session->priv->address_cache, key, data);
 }
 
-static GSList *
-address_cache_data_remove_old_and_test (GSList *items,
-					const gchar *email_address,
-					gboolean *found,
-					gboolean *is_known)
+static void
+address_cache_book_view_changed_cb (EBookClientView *client_view,
+				    const GSList *objects,
+				    gpointer user_data)
 {
-	gint64 old_when;
-	GSList *iter, *prev = NULL;
+	EMailUISession *session = user_data;
 
-	if (!items)
-		return NULL;
+	/* Any contact change can make a known address unknown or the other way around;
+	   the lookups running meanwhile do not store their results with the new generation */
+	g_mutex_lock (&session->priv->address_cache_mutex);
+	g_hash_table_remove_all (session->priv->address_cache);
+	session->priv->address_cache_generation++;
+	g_mutex_unlock (&session->priv->address_cache_mutex);
+}
 
-	/* let the cache value live for 5 minutes */
-	old_when = g_get_real_time () - 5 * 60 * 1000 * 1000;
+static void address_book_view_free (gpointer ptr);
 
-	for (iter = items; iter; prev = iter, iter = iter->next) {
-		AddressCacheData *data = iter->data;
+/* Watches changes in the 'book_client', to invalidate the address cache */
+static void
+address_cache_ensure_book_view (EMailUISession *session,
+				EBookClient *book_client,
+				GCancellable *cancellable)
+{
+	EBookClientView *client_view = NULL;
+	EBookQuery *book_query;
+	ESource *source;
+	GSList *fields;
+	gchar *query;
+	gboolean has_view;
+	GError *local_error = NULL;
 
-		if (!data || data->stamp <= old_when || !data->email_address)
-			break;
+	source = e_client_get_source (E_CLIENT (book_client));
+
+	g_mutex_lock (&session->priv->address_cache_mutex);
+	has_view = g_hash_table_contains (session->priv->address_book_views, e_source_get_uid (source));
+	g_mutex_unlock (&session->priv->address_cache_mutex);
 
-		if (g_ascii_strcasecmp (email_address, data->email_address) == 0) {
-			*found = TRUE;
-			*is_known = data->is_known;
+	if (has_view)
+		return;
 
-			/* a match was found, shorten the list later */
-			return items;
-		}
+	book_query = e_book_query_field_exists (E_CONTACT_EMAIL);
+	query = e_book_query_to_string (book_query);
+	e_book_query_unref (book_query);
+
+	if (!e_book_client_get_view_sync (book_client, query, &client_view, cancellable, &local_error) || !client_view) {
+		if (local_error && !g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_debug ("%s: Failed to get view for book '%s': %s", G_STRFUNC,
+				e_source_get_display_name (source), local_error->message);
+		g_clear_error (&local_error);
+		g_free (query);
+		return;
 	}
 
-	g_slist_free_full (iter, address_cache_data_free);
-	if (prev)
-		prev->next = NULL;
-	else
-		items = NULL;
+	g_free (query);
+
+	/* Only changes are interesting, not the current content */
+	e_book_client_view_set_flags (client_view, E_BOOK_CLIENT_VIEW_FLAGS_NONE, NULL);
+
+	fields = g_slist_prepend (NULL, (gpointer) e_contact_field_name (E_CONTACT_EMAIL));
+	e_book_client_view_set_fields_of_interest (client_view, fields, NULL);
+	g_slist_free (fields);
 
-	return items;
+	g_signal_connect_object (client_view, "objects-added",
+		G_CALLBACK (address_cache_book_view_changed_cb), session, 0);
+	g_signal_connect_object (client_view, "objects-modified",
+		G_CALLBACK (address_cache_book_view_changed_cb), session, 0);
+	g_signal_connect_object (client_view, "objects-removed",
+		G_CALLBACK (address_cache_book_view_changed_cb), session, 0);
+
+	e_book_client_view_start (client_view, &local_error);
+
+	if (local_error) {
+		g_debug ("%s: Failed to start view for book '%s': %s", G_STRFUNC,
+			e_source_get_display_name (source), local_error->message);
+		g_clear_error (&local_error);
+		g_object_unref (client_view);
+		return;
+	}
+
+	g_mutex_lock (&session->priv->address_cache_mutex);
+
+	/* Another thread could create the view meanwhile */
+	if (!g_hash_table_contains (session->priv->address_book_views, e_source_get_uid (source))) {
+		g_hash_table_insert (session->priv->address_book_views, g_strdup (e_source_get_uid (source)), client_view);
+		client_view = NULL;
+	}
+
+	g_mutex_unlock (&session->priv->address_cache_mutex);
+
+	address_book_view_free (client_view);
+}
+
+static void
+address_book_view_free (gpointer ptr)
+{
+	EBookClientView *client_view = ptr;
+
+	if (client_view) {
+		g_signal_handlers_disconnect_matched (client_view, G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
+			address_cache_book_view_changed_cb, NULL);
+		e_book_client_view_stop (client_view, NULL);
+		g_object_unref (client_view);
+	}
+}
+
+static void
+address_cache_source_removed_cb (ESourceRegistry *registry,
+				 ESource *source,
+				 gpointer user_data)
+{
+	EMailUISession *session = user_data;
+	gpointer source_uid = NULL, client_view = NULL;
+
+	if (!e_source_has_extension (source, E_SOURCE_EXTENSION_ADDRESS_BOOK))
+		return;
+
+	g_mutex_lock (&session->priv->address_cache_mutex);
+
+	/* Stop the view out of the lock */
+	g_hash_table_steal_extended (session->priv->address_book_views, e_source_get_uid (source), &source_uid, &client_view);
+
+	/* Contacts of the removed book are not known anymore */
+	g_hash_table_remove_all (session->priv->address_cache);
+	session->priv->address_cache_generation++;
+
+	g_mutex_unlock (&session->priv->address_cache_mutex);
+
+	g_free (source_uid);
+	address_book_view_free (client_view);
 }
 
 /* Support for CamelSession.get_filter_driver () *****************************/
@@ -231,6 +411,163 @@ session_system_beep (CamelFilterDriver *driver,
 	g_idle_add ((GSourceFunc) session_play_sound_cb, NULL);
 }
 
+static void
+compiled_filter_rule_free (gpointer ptr)
+{
+	CompiledFilterRule *crule = ptr;
+
+	if (crule) {
+		g_free (crule->name);
+		g_free (crule->code);
+		g_free (crule->action);
+		g_slice_free (CompiledFilterRule, crule);
+	}
+}
+
+static FilterRuleSet *
+filter_rule_set_ref (FilterRuleSet *rule_set)
+{
+	g_atomic_int_inc (&rule_set->ref_count);
+
+	return rule_set;
+}
+
+static void
+filter_rule_set_unref (FilterRuleSet *rule_set)
+{
+	if (rule_set && g_atomic_int_dec_and_test (&rule_set->ref_count)) {
+		g_hash_table_destroy (rule_set->rules);
+		g_slice_free (FilterRuleSet, rule_set);
+	}
+}
+
+static gboolean
+filter_rule_set_stat_equal (gboolean exists,
+			    const GStatBuf *stat_buf,
+			    const gchar *filename)
+{
+	GStatBuf now;
+
+	if (g_stat (filename, &now) != 0)
+		return !exists;
+
+	return exists &&
+		now.st_mtime == stat_buf->st_mtime &&
+		now.st_size == stat_buf->st_size;
+}
+
+static FilterRuleSet *
+filter_rule_set_new (EMailSession *session,
+		     const gchar *system,
+		     const gchar *user)
+{
+	FilterRuleSet *rule_set;
+	ERuleContext *fc;
+	EFilterRule *rule = NULL;
+	GString *fsearch, *faction;
+
+	rule_set = g_slice_new0 (FilterRuleSet);
+	rule_set->ref_count = 1;
+	rule_set->rules = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_ptr_array_unref);
+
+	/* Stat before loading, thus a save racing with the load
+	   rather causes one more rebuild than a stale rule set. */
+	rule_set->system_exists = g_stat (system, &rule_set->system_stat) == 0;
+	rule_set->user_exists = g_stat (user, &rule_set->user_stat) == 0;
+
+	fc = (ERuleContext *) em_filter_context_new (session);
+	e_rule_context_load (fc, system, user);
+
+	fsearch = g_string_new ("");
+	faction = g_string_new ("");
+
+	while ((rule = e_rule_context_next_rule (fc, rule, NULL))) {
+		CompiledFilterRule *crule;
+		GPtrArray *rules;
+		const gchar *source;
+
+		/* skip disabled rules and those not bound to any source */
+		if (!rule->enabled || !rule->source)
+			continue;
+
+		source = rule->source;
+
+		g_string_truncate (fsearch, 0);
+		g_string_truncate (faction, 0);
+
+		e_filter_rule_build_code (rule, fsearch);
+		em_filter_rule_build_action (EM_FILTER_RULE (rule), faction);
+
+		crule = g_slice_new0 (CompiledFilterRule);
+		crule->name = g_strdup (rule->name);
+		crule->code = g_strdup (fsearch->str);
+		crule->action = g_strdup (faction->str);
+
+		rules = g_hash_table_lookup (rule_set->rules, source);
+		if (!rules) {
+			rules = g_ptr_array_new_with_free_func (compiled_filter_rule_free);
+			g_hash_table_insert (rule_set->rules, g_strdup (source), rules);
+		}
+
+		g_ptr_array_add (rules, crule);
+	}
+
+	g_string_free (fsearch, TRUE);
+	g_string_free (faction, TRUE);
+	g_object_unref (fc);
+
+	return rule_set;
+}
+
+/* Returns the compiled user filters, rebuilding them when filters.xml
+   or filtertypes.xml changed on the disk or when the set was explicitly
+   invalidated. Free the returned set with filter_rule_set_unref(). */
+static FilterRuleSet *
+mail_ui_session_ref_filter_rules (EMailUISession *self)
+{
+	FilterRuleSet *rule_set;
+	const gchar *config_dir;
+	gchar *user, *system;
+
+	config_dir = mail_session_get_config_dir ();
+	user = g_build_filename (config_dir, "filters.xml", NULL);
+	system = g_build_filename (EVOLUTION_PRIVDATADIR, "filtertypes.xml", NULL);
+
+	g_mutex_lock (&self->priv->filter_rules_lock);
+
+	rule_set = self->priv->filter_rules;
+
+	if (rule_set && !self->priv->filter_rules_invalid &&
+	    filter_rule_set_stat_equal (rule_set->user_exists, &rule_set->user_stat, user) &&
+	    filter_rule_set_stat_equal (rule_set->system_exists, &rule_set->system_stat, system)) {
+		rule_set = filter_rule_set_ref (rule_set);
+	} else {
+		rule_set = NULL;
+		self->priv->filter_rules_invalid = FALSE;
+	}
+
+	g_mutex_unlock (&self->priv->filter_rules_lock);
+
+	if (!rule_set) {
+		/* Loading the rule context can touch GTK (the dynamic options
+		   of the filter elements), thus do it in the main thread and
+		   share only the compiled rules with the other threads. */
+		rule_set = mail_call_main (
+			MAIL_CALL_p_ppp, G_CALLBACK (filter_rule_set_new),
+			self, system, user);
+
+		g_mutex_lock (&self->priv->filter_rules_lock);
+		g_clear_pointer (&self->priv->filter_rules, filter_rule_set_unref);
+		self->priv->filter_rules = filter_rule_set_ref (rule_set);
+		g_mutex_unlock (&self->priv->filter_rules_lock);
+	}
+
+	g_free (system);
+	g_free (user);
+
+	return rule_set;
+}
+
 static gboolean
 session_folder_can_filter_junk (CamelFolder *folder)
 {
@@ -243,36 +580,25 @@ session_folder_can_filter_junk (CamelFolder *folder)
 }
 
 static CamelFilterDriver *
-main_get_filter_driver (CamelSession *session,
-			const gchar *type,
-			CamelFolder *for_folder,
-			GError **error)
+mail_ui_session_create_filter_driver (EMailUISession *self,
+				      const gchar *type,
+				      CamelFolder *for_folder)
 {
-	EMailSession *ms = E_MAIL_SESSION (session);
-	EMailUISession *self = E_MAIL_UI_SESSION (session);
+	CamelSession *session = CAMEL_SESSION (self);
 	CamelFilterDriver *driver;
-	EFilterRule *rule = NULL;
-	const gchar *config_dir;
-	gchar *user, *system;
 	GSettings *settings;
-	ERuleContext *fc;
 	gboolean add_junk_test;
 
 	settings = e_util_ref_settings ("org.gnome.evolution.mail");
 
-	config_dir = mail_session_get_config_dir ();
-	user = g_build_filename (config_dir, "filters.xml", NULL);
-	system = g_build_filename (EVOLUTION_PRIVDATADIR, "filtertypes.xml", NULL);
-	fc = (ERuleContext *) em_filter_context_new (ms);
-	e_rule_context_load (fc, system, user);
-	g_free (system);
-	g_free (user);
-
 	driver = camel_filter_driver_new (session);
 	camel_filter_driver_set_folder_func (driver, get_folder, session);
 
 	if (g_settings_get_boolean (settings, "filters-log-actions") ||
 	    camel_debug ("filters")) {
+		/* Drivers are created from multiple threads */
+		g_mutex_lock (&self->priv->filter_rules_lock);
+
 		if (!self->priv->filter_logfile &&
 		    g_settings_get_boolean (settings, "filters-log-actions")) {
 			gchar *filename;
@@ -292,6 +618,8 @@ main_get_filter_driver (CamelSession *session,
 
 		if (self->priv->filter_logfile)
 			camel_filter_driver_set_logfile (driver, self->priv->filter_logfile);
+
+		g_mutex_unlock (&self->priv->filter_rules_lock);
 	}
 
 	camel_filter_driver_set_shell_func (driver, mail_execute_shell_command, NULL);
@@ -311,36 +639,31 @@ main_get_filter_driver (CamelSession *session,
 	}
 
 	if (strcmp (type, E_FILTER_SOURCE_JUNKTEST) != 0) {
-		GString *fsearch, *faction;
-
-		fsearch = g_string_new ("");
-		faction = g_string_new ("");
+		FilterRuleSet *rule_set;
+		GPtrArray *rules;
 
 		if (!strcmp (type, E_FILTER_SOURCE_DEMAND))
 			type = E_FILTER_SOURCE_INCOMING;
 
+		rule_set = mail_ui_session_ref_filter_rules (self);
+
 		/* add the user-defined rules next */
-		while ((rule = e_rule_context_next_rule (fc, rule, type))) {
-			g_string_truncate (fsearch, 0);
-			g_string_truncate (faction, 0);
+		rules = g_hash_table_lookup (rule_set->rules, type);
+		if (rules) {
+			guint ii;
 
-			/* skip disabled rules */
-			if (!rule->enabled)
-				continue;
+			for (ii = 0; ii < rules->len; ii++) {
+				CompiledFilterRule *crule = g_ptr_array_index (rules, ii);
 
-			e_filter_rule_build_code (rule, fsearch);
-			em_filter_rule_build_action (
-				EM_FILTER_RULE (rule), faction);
-			camel_filter_driver_add_rule (
-				driver, rule->name,
-				fsearch->str, faction->str);
+				camel_filter_driver_add_rule (
+					driver, crule->name,
+					crule->code, crule->action);
+			}
 		}
 
-		g_string_free (fsearch, TRUE);
-		g_string_free (faction, TRUE);
+		filter_rule_set_unref (rule_set);
 	}
 
-	g_object_unref (fc);
 	g_object_unref (settings);
 
 	return driver;
@@ -442,8 +765,8 @@ mail_ui_session_dispose (GObject *object)
 	g_clear_object (&self->priv->photo_cache);
 
 	g_mutex_lock (&self->priv->address_cache_mutex);
-	g_slist_free_full (self->priv->address_cache, address_cache_data_free);
-	self->priv->address_cache = NULL;
+	g_hash_table_remove_all (self->priv->address_cache);
+	g_hash_table_remove_all (self->priv->address_book_views);
 	g_mutex_unlock (&self->priv->address_cache_mutex);
 
 	/* Chain up to parent's dispose() method. */
@@ -455,7 +778,11 @@ mail_ui_session_finalize (GObject *object)
 {
 	EMailUISession *self = E_MAIL_UI_SESSION (object);
 
+	g_hash_table_destroy (self->priv->address_cache);
+	g_hash_table_destroy (self->priv->address_book_views);
 	g_mutex_clear (&self->priv->address_cache_mutex);
+	g_clear_pointer (&self->priv->filter_rules, filter_rule_set_unref);
+	g_mutex_clear (&self->priv->filter_rules_lock);
 
 #ifdef HAVE_CANBERRA
 	g_clear_pointer (&cactx, ca_context_destroy);
@@ -492,6 +819,9 @@ mail_ui_session_constructed (GObject *object)
 	registry = e_mail_session_get_registry (session);
 	self->priv->registry = g_object_ref (registry);
 
+	g_signal_connect_object (registry, "source-removed",
+		G_CALLBACK (address_cache_source_removed_cb), self, 0);
+
 	client_cache = e_shell_get_client_cache (shell);
 	self->priv->photo_cache = e_photo_cache_new (client_cache);
 
@@ -563,9 +893,10 @@ mail_ui_session_get_filter_driver (CamelSession *session,
 				   CamelFolder *for_folder,
 				   GError **error)
 {
-	return (CamelFilterDriver *) mail_call_main (
-		MAIL_CALL_p_pppp, G_CALLBACK (main_get_filter_driver),
-		session, type, for_folder, error);
+	/* The rule set is compiled in the main thread, but only when
+	   the filters changed; the driver itself can be created here. */
+	return mail_ui_session_create_filter_driver (
+		E_MAIL_UI_SESSION (session), type, for_folder);
 }
 
 static gboolean
@@ -606,51 +937,12 @@ mail_ui_session_lookup_addressbook (CamelSession *session,
 	return known_address;
 }
 
-static gboolean
-mail_ui_session_check_book_contains_sync (EMailUISession *ui_session,
-					  ESource *source,
-					  const gchar *email_address,
-					  GCancellable *cancellable,
-					  GError **error)
-{
-	EPhotoCache *photo_cache;
-	EClientCache *client_cache;
-	EClient *client;
-	gboolean success = FALSE;
-
-	g_return_val_if_fail (E_IS_MAIL_UI_SESSION (ui_session), FALSE);
-	g_return_val_if_fail (E_IS_SOURCE (source), FALSE);
-	g_return_val_if_fail (email_address != NULL, FALSE);
-
-	if (g_cancellable_set_error_if_cancelled (cancellable, error))
-		return FALSE;
-
-	if (!e_source_get_enabled (source))
-		return FALSE;
-
-	/* XXX EPhotoCache holds a reference on EClientCache, which
-	 *     we need.  EMailUISession should probably hold its own
-	 *     EClientCache reference, but this will do for now. */
-	photo_cache = e_mail_ui_session_get_photo_cache (ui_session);
-	client_cache = e_photo_cache_ref_client_cache (photo_cache);
-
-	client = e_client_cache_get_client_sync (
-		client_cache, source,
-		E_SOURCE_EXTENSION_ADDRESS_BOOK, (guint32) -1,
-		cancellable, error);
-
-	if (client != NULL) {
-		success = e_book_client_contains_email_sync (
-			E_BOOK_CLIENT (client), email_address,
-			cancellable, error);
-
-		g_object_unref (client);
-	}
-
-	g_object_unref (client_cache);
-
-	return success;
-}
+static gboolean mail_ui_session_check_known_addresses_sync (EMailUISession *session,
+							    const gchar * const *emails,
+							    const gchar *book_uid,
+							    GHashTable *known,
+							    GCancellable *cancellable,
+							    GError **error);
 
 static gboolean
 mail_ui_session_addressbook_contains_sync (CamelSession *session,
@@ -660,53 +952,28 @@ mail_ui_session_addressbook_contains_sync (CamelSession *session,
 					   GError **error)
 {
 	EMailUISession *ui_session = E_MAIL_UI_SESSION (session);
-	GError *local_error = NULL;
-	GList *books = NULL, *link;
+	CamelInternetAddress *cia;
+	GHashTable *known;
+	const gchar *emails[2] = { NULL, NULL };
 	gboolean found = FALSE;
 
-	if (g_strcmp0 (book_uid, CAMEL_SESSION_BOOK_UID_ANY) == 0) {
-		books = e_source_registry_list_enabled (ui_session->priv->registry, E_SOURCE_EXTENSION_ADDRESS_BOOK);
-	} else if (g_strcmp0 (book_uid, CAMEL_SESSION_BOOK_UID_COMPLETION) == 0) {
-		GList *next = NULL;
-
-		books = e_source_registry_list_enabled (ui_session->priv->registry, E_SOURCE_EXTENSION_ADDRESS_BOOK);
-
-		for (link = books; link; link = next) {
-			ESource *source = link->data;
-
-			next = g_list_next (link);
-
-			if (e_source_has_extension (source, E_SOURCE_EXTENSION_AUTOCOMPLETE) &&
-			    !e_source_autocomplete_get_include_me (E_SOURCE_AUTOCOMPLETE (e_source_get_extension (source, E_SOURCE_EXTENSION_AUTOCOMPLETE)))) {
-				g_object_unref (source);
-				books = g_list_delete_link (books, link);
-			}
-		}
-	} else {
-		ESource *source;
+	g_return_val_if_fail (book_uid != NULL, FALSE);
+	g_return_val_if_fail (email_address != NULL, FALSE);
 
-		source = e_source_registry_ref_source (ui_session->priv->registry, book_uid);
-		if (source) {
-			found = mail_ui_session_check_book_contains_sync (ui_session, source, email_address, cancellable, error);
-			g_object_unref (source);
-		} else {
-			g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, _("Book '%s' not found"), book_uid);
-		}
-	}
+	/* Filters run this for each message, thus go through the address cache */
+	cia = camel_internet_address_new ();
 
-	for (link = books; link && !found && !g_cancellable_is_cancelled (cancellable); link = g_list_next (link)) {
-		ESource *source = link->data;
+	if (camel_address_decode (CAMEL_ADDRESS (cia), email_address) <= 0 ||
+	    !camel_internet_address_get (cia, 0, NULL, &emails[0]) || !emails[0])
+		emails[0] = email_address;
 
-		/* use the error from the first book, if looking in more books */
-		found = mail_ui_session_check_book_contains_sync (ui_session, source, email_address, cancellable, local_error ? NULL : &local_error);
-	}
+	known = g_hash_table_new (g_str_hash, g_str_equal);
 
-	g_list_free_full (books, g_object_unref);
+	if (mail_ui_session_check_known_addresses_sync (ui_session, emails, book_uid, known, cancellable, error))
+		found = GPOINTER_TO_INT (g_hash_table_lookup (known, emails[0]));
 
-	if (!found && local_error)
-		g_propagate_error (error, local_error);
-	else
-		g_clear_error (&local_error);
+	g_hash_table_destroy (known);
+	g_object_unref (cia);
 
 	return found;
 }
@@ -1148,6 +1415,9 @@ e_mail_ui_session_init (EMailUISession *session)
 {
 	session->priv = e_mail_ui_session_get_instance_private (session);
 	g_mutex_init (&session->priv->address_cache_mutex);
+	g_mutex_init (&session->priv->filter_rules_lock);
+	session->priv->address_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	session->priv->address_book_views = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, address_book_view_free);
 	session->priv->label_store = e_mail_label_list_store_new ();
 }
 
@@ -1231,6 +1501,27 @@ e_mail_ui_session_get_photo_cache (EMailUISession *session)
 	return session->priv->photo_cache;
 }
 
+/**
+ * e_mail_ui_session_invalidate_filter_rules:
+ * @session: an #EMailUISession
+ *
+ * Drops the cached compiled message filters, thus they are read again
+ * from the disk the next time a filter driver is created. This is done
+ * automatically when the filter files change their modification time,
+ * but that can be too coarse right after a save.
+ *
+ * Since: 3.56
+ **/
+void
+e_mail_ui_session_invalidate_filter_rules (EMailUISession *session)
+{
+	g_return_if_fail (E_IS_MAIL_UI_SESSION (session));
+
+	g_mutex_lock (&session->priv->filter_rules_lock);
+	session->priv->filter_rules_invalid = TRUE;
+	g_mutex_unlock (&session->priv->filter_rules_lock);
+}
+
 void
 e_mail_ui_session_add_activity (EMailUISession *session,
                                 EActivity *activity)
@@ -1267,62 +1558,109 @@ sort_local_books_first_cb (gconstpointer a,
 			  e_source_backend_get_backend_name (bbackend));
 }
 
-/**
- * e_mail_ui_session_check_known_address_sync:
- * @session: an #EMailUISession
- * @addr: a #CamelInternetAddress
- * @check_local_only: only check the builtin address book
- * @cancellable: optional #GCancellable object, or %NULL
- * @out_known_address: return location for the determination of
- *                     whether @addr is a known address
- * @error: return location for a #GError, or %NULL
- *
- * Determines whether @addr is a known email address by querying address
- * books for contacts with a matching email address.  If @check_local_only
- * is %TRUE then only the builtin address book is checked, otherwise all
- * enabled address books are checked.
- *
- * The result of the query is returned through the @out_known_address
- * boolean pointer, not through the return value.  The return value only
- * indicates whether the address book queries were completed successfully.
- * If an error occurred, the function sets @error and returns %FALSE.
- *
- * Returns: whether address books were successfully queried
- **/
-gboolean
-e_mail_ui_session_check_known_address_sync (EMailUISession *session,
-                                            CamelInternetAddress *addr,
-                                            gboolean check_local_only,
-                                            GCancellable *cancellable,
-                                            gboolean *out_known_address,
-                                            GError **error)
+/* Returns the address books to look into for the 'book_uid', which can be
+   also CAMEL_SESSION_BOOK_UID_ANY or CAMEL_SESSION_BOOK_UID_COMPLETION */
+static GList *
+mail_ui_session_list_books (EMailUISession *session,
+			    const gchar *book_uid,
+			    GError **error)
+{
+	GList *list, *link, *next = NULL;
+
+	if (g_strcmp0 (book_uid, CAMEL_SESSION_BOOK_UID_ANY) != 0 &&
+	    g_strcmp0 (book_uid, CAMEL_SESSION_BOOK_UID_COMPLETION) != 0) {
+		ESource *source;
+
+		source = e_source_registry_ref_source (session->priv->registry, book_uid);
+		if (!source) {
+			g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, _("Book '%s' not found"), book_uid);
+			return NULL;
+		}
+
+		return g_list_prepend (NULL, source);
+	}
+
+	list = e_source_registry_list_enabled (session->priv->registry, E_SOURCE_EXTENSION_ADDRESS_BOOK);
+
+	if (g_strcmp0 (book_uid, CAMEL_SESSION_BOOK_UID_COMPLETION) == 0) {
+		for (link = list; link; link = next) {
+			ESource *source = link->data;
+
+			next = g_list_next (link);
+
+			if (e_source_has_extension (source, E_SOURCE_EXTENSION_AUTOCOMPLETE) &&
+			    !e_source_autocomplete_get_include_me (E_SOURCE_AUTOCOMPLETE (e_source_get_extension (source, E_SOURCE_EXTENSION_AUTOCOMPLETE)))) {
+				g_object_unref (source);
+				list = g_list_delete_link (list, link);
+			}
+		}
+	}
+
+	return g_list_sort (list, sort_local_books_first_cb);
+}
+
+/* Resolves all 'emails' which are not known yet, with one query per address book
+   from the 'book_uid' (see mail_ui_session_list_books()); stores the results into
+   the 'known' as email ~> GINT_TO_POINTER (is_known) */
+static gboolean
+mail_ui_session_check_known_addresses_sync (EMailUISession *session,
+					    const gchar * const *emails,
+					    const gchar *book_uid,
+					    GHashTable *known,
+					    GCancellable *cancellable,
+					    GError **error)
 {
 	EPhotoCache *photo_cache;
 	EClientCache *client_cache;
-	ESourceRegistry *registry;
+	CamelInternetAddress *cia;
+	GPtrArray *unresolved, *queried;
 	GList *list, *link;
-	const gchar *email_address = NULL;
-	gboolean known_address = FALSE;
-	gboolean success = FALSE;
+	gboolean success = TRUE;
+	guint ii, generation;
+	GError *books_error = NULL;
 
-	g_return_val_if_fail (E_IS_MAIL_UI_SESSION (session), FALSE);
-	g_return_val_if_fail (CAMEL_IS_INTERNET_ADDRESS (addr), FALSE);
-	g_return_val_if_fail (camel_internet_address_get (addr, 0, NULL, &email_address), FALSE);
-	g_return_val_if_fail (email_address != NULL, FALSE);
+	unresolved = g_ptr_array_new ();
 
 	g_mutex_lock (&session->priv->address_cache_mutex);
 
-	session->priv->address_cache = address_cache_data_remove_old_and_test (
-		session->priv->address_cache,
-		email_address, &success, &known_address);
+	generation = session->priv->address_cache_generation;
 
-	if (success) {
-		g_mutex_unlock (&session->priv->address_cache_mutex);
+	for (ii = 0; emails[ii]; ii++) {
+		gboolean is_known = FALSE;
+		gchar *key;
+
+		if (g_hash_table_contains (known, emails[ii]))
+			continue;
+
+		key = address_cache_dup_key (emails[ii], book_uid);
 
-		if (out_known_address)
-			*out_known_address = known_address;
+		if (address_cache_lookup (session, key, &is_known))
+			g_hash_table_insert (known, (gpointer) emails[ii], GINT_TO_POINTER (is_known));
+		else
+			g_ptr_array_add (unresolved, (gpointer) emails[ii]);
 
-		return success;
+		g_free (key);
+	}
+
+	g_mutex_unlock (&session->priv->address_cache_mutex);
+
+	if (!unresolved->len) {
+		g_ptr_array_unref (unresolved);
+
+		return TRUE;
+	}
+
+	list = mail_ui_session_list_books (session, book_uid, &books_error);
+	if (books_error) {
+		g_propagate_error (error, books_error);
+		g_ptr_array_unref (unresolved);
+
+		return FALSE;
+	}
+
+	queried = g_ptr_array_sized_new (unresolved->len);
+	for (ii = 0; ii < unresolved->len; ii++) {
+		g_ptr_array_add (queried, g_ptr_array_index (unresolved, ii));
 	}
 
 	/* XXX EPhotoCache holds a reference on EClientCache, which
@@ -1330,23 +1668,15 @@ e_mail_ui_session_check_known_address_sync (EMailUISession *session,
 	 *     EClientCache reference, but this will do for now. */
 	photo_cache = e_mail_ui_session_get_photo_cache (session);
 	client_cache = e_photo_cache_ref_client_cache (photo_cache);
-	registry = e_client_cache_ref_registry (client_cache);
-
-	if (check_local_only) {
-		ESource *source;
-
-		source = e_source_registry_ref_builtin_address_book (registry);
-		list = g_list_prepend (NULL, g_object_ref (source));
-		g_object_unref (source);
-	} else {
-		list = e_source_registry_list_enabled (
-			registry, E_SOURCE_EXTENSION_ADDRESS_BOOK);
-		list = g_list_sort (list, sort_local_books_first_cb);
-	}
+	cia = camel_internet_address_new ();
 
-	for (link = list; link != NULL && !g_cancellable_is_cancelled (cancellable); link = g_list_next (link)) {
+	for (link = list; link != NULL && unresolved->len > 0 && !g_cancellable_is_cancelled (cancellable); link = g_list_next (link)) {
 		ESource *source = E_SOURCE (link->data);
+		EBookQuery **queries;
+		EBookQuery *book_query;
 		EClient *client;
+		GSList *contacts = NULL, *clink;
+		gchar *query;
 		GError *local_error = NULL;
 
 		/* Skip disabled sources. */
@@ -1373,43 +1703,241 @@ e_mail_ui_session_check_known_address_sync (EMailUISession *session,
 			break;
 		}
 
-		success = e_book_client_contains_email_sync (
-			E_BOOK_CLIENT (client), email_address,
-			cancellable, &local_error);
+		address_cache_ensure_book_view (session, E_BOOK_CLIENT (client), cancellable);
 
-		g_object_unref (client);
+		queries = g_new0 (EBookQuery *, unresolved->len);
+		for (ii = 0; ii < unresolved->len; ii++) {
+			queries[ii] = e_book_query_field_test (E_CONTACT_EMAIL, E_BOOK_QUERY_IS, g_ptr_array_index (unresolved, ii));
+		}
+
+		book_query = e_book_query_or (unresolved->len, queries, TRUE);
+		query = e_book_query_to_string (book_query);
+		e_book_query_unref (book_query);
+		g_free (queries);
 
-		if (!success) {
+		if (!e_book_client_get_contacts_sync (E_BOOK_CLIENT (client), query, &contacts, cancellable, &local_error)) {
 			/* ignore book-specific errors here and continue with the next */
 			g_clear_error (&local_error);
+			g_free (query);
+			g_object_unref (client);
 			continue;
 		}
 
-		known_address = TRUE;
-		break;
+		g_free (query);
+		g_object_unref (client);
+
+		for (clink = contacts; clink && unresolved->len > 0; clink = g_slist_next (clink)) {
+			EContact *contact = clink->data;
+			GList *contact_emails, *elink;
+
+			contact_emails = e_contact_get (contact, E_CONTACT_EMAIL);
+
+			for (elink = contact_emails; elink; elink = g_list_next (elink)) {
+				const gchar *contact_email = elink->data;
+				gint jj, n_addrs;
+
+				if (!contact_email)
+					continue;
+
+				/* The value can be also in the "Name <user@example.com>" form */
+				camel_address_remove (CAMEL_ADDRESS (cia), -1);
+				n_addrs = camel_address_decode (CAMEL_ADDRESS (cia), contact_email);
+
+				for (jj = 0; jj < n_addrs; jj++) {
+					const gchar *addr = NULL;
+
+					if (!camel_internet_address_get (cia, jj, NULL, &addr) || !addr)
+						continue;
+
+					for (ii = 0; ii < unresolved->len; ii++) {
+						const gchar *email = g_ptr_array_index (unresolved, ii);
+
+						if (g_ascii_strcasecmp (email, addr) == 0) {
+							g_hash_table_insert (known, (gpointer) email, GINT_TO_POINTER (TRUE));
+							g_ptr_array_remove_index_fast (unresolved, ii);
+							break;
+						}
+					}
+				}
+			}
+
+			g_list_free_full (contact_emails, g_free);
+		}
+
+		g_slist_free_full (contacts, g_object_unref);
 	}
 
 	g_list_free_full (list, (GDestroyNotify) g_object_unref);
 
-	g_object_unref (registry);
+	g_object_unref (cia);
 	g_object_unref (client_cache);
 
+	if (success && !g_cancellable_is_cancelled (cancellable)) {
+		for (ii = 0; ii < unresolved->len; ii++) {
+			g_hash_table_insert (known, g_ptr_array_index (unresolved, ii), GINT_TO_POINTER (FALSE));
+		}
+
+		g_mutex_lock (&session->priv->address_cache_mutex);
+
+		/* Remember both the known and the unknown addresses, unless
+		   any contact changed while the address books were queried */
+		for (ii = 0; ii < queried->len && generation == session->priv->address_cache_generation; ii++) {
+			const gchar *email = g_ptr_array_index (queried, ii);
+
+			address_cache_add (session,
+				address_cache_dup_key (email, book_uid),
+				GPOINTER_TO_INT (g_hash_table_lookup (known, email)));
+		}
+
+		g_mutex_unlock (&session->priv->address_cache_mutex);
+	}
+
+	g_ptr_array_unref (unresolved);
+	g_ptr_array_unref (queried);
+
+	return success;
+}
+
+static gchar *
+mail_ui_session_dup_book_uid (EMailUISession *session,
+			      gboolean check_local_only)
+{
+	ESource *source;
+	gchar *book_uid;
+
+	if (!check_local_only)
+		return g_strdup (CAMEL_SESSION_BOOK_UID_ANY);
+
+	source = e_source_registry_ref_builtin_address_book (session->priv->registry);
+	book_uid = e_source_dup_uid (source);
+	g_object_unref (source);
+
+	return book_uid;
+}
+
+/**
+ * e_mail_ui_session_check_known_address_sync:
+ * @session: an #EMailUISession
+ * @addr: a #CamelInternetAddress
+ * @check_local_only: only check the builtin address book
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @out_known_address: return location for the determination of
+ *                     whether @addr is a known address
+ * @error: return location for a #GError, or %NULL
+ *
+ * Determines whether @addr is a known email address by querying address
+ * books for contacts with a matching email address.  If @check_local_only
+ * is %TRUE then only the builtin address book is checked, otherwise all
+ * enabled address books are checked.
+ *
+ * The result of the query is returned through the @out_known_address
+ * boolean pointer, not through the return value.  The return value only
+ * indicates whether the address book queries were completed successfully.
+ * If an error occurred, the function sets @error and returns %FALSE.
+ *
+ * Returns: whether address books were successfully queried
+ **/
+gboolean
+e_mail_ui_session_check_known_address_sync (EMailUISession *session,
+                                            CamelInternetAddress *addr,
+                                            gboolean check_local_only,
+                                            GCancellable *cancellable,
+                                            gboolean *out_known_address,
+                                            GError **error)
+{
+	GHashTable *known;
+	const gchar *emails[2] = { NULL, NULL };
+	gchar *book_uid;
+	gboolean success;
+
+	g_return_val_if_fail (E_IS_MAIL_UI_SESSION (session), FALSE);
+	g_return_val_if_fail (CAMEL_IS_INTERNET_ADDRESS (addr), FALSE);
+	g_return_val_if_fail (camel_internet_address_get (addr, 0, NULL, &emails[0]), FALSE);
+	g_return_val_if_fail (emails[0] != NULL, FALSE);
+
+	known = g_hash_table_new (g_str_hash, g_str_equal);
+	book_uid = mail_ui_session_dup_book_uid (session, check_local_only);
+
+	success = mail_ui_session_check_known_addresses_sync (session, emails,
+		book_uid, known, cancellable, error);
+
 	if (success && out_known_address != NULL)
-		*out_known_address = known_address;
+		*out_known_address = GPOINTER_TO_INT (g_hash_table_lookup (known, emails[0]));
 
-	if (!g_cancellable_is_cancelled (cancellable)) {
-		AddressCacheData *data = g_new0 (AddressCacheData, 1);
+	g_hash_table_destroy (known);
+	g_free (book_uid);
 
-		data->email_address = g_strdup (email_address);
-		data->stamp = g_get_real_time ();
-		data->is_known = known_address;
+	return success;
+}
 
-		/* this makes the list sorted by time, from newest to oldest */
-		session->priv->address_cache = g_slist_prepend (
-			session->priv->address_cache, data);
+/**
+ * e_mail_ui_session_check_known_addresses_sync:
+ * @session: an #EMailUISession
+ * @addrs: a #CamelInternetAddress
+ * @check_local_only: only check the builtin address book
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @out_known_addresses: (out) (transfer container) (element-type utf8 gboolean):
+ *                       return location for a #GHashTable with the results
+ * @error: return location for a #GError, or %NULL
+ *
+ * Similar to e_mail_ui_session_check_known_address_sync(), only determines
+ * for all email addresses in the @addrs, whether they are known, at once.
+ * Each address book is asked once for all the addresses not resolved yet.
+ *
+ * The @out_known_addresses is set to a #GHashTable, which has each email
+ * address from @addrs as the key and %TRUE or %FALSE as the value, stored
+ * with GINT_TO_POINTER(). The keys are valid as long as the @addrs is not
+ * modified. Free the hash table with g_hash_table_destroy(), when no longer
+ * needed. The @out_known_addresses is set only when the function succeeds.
+ *
+ * Returns: whether address books were successfully queried
+ *
+ * Since: 3.56
+ **/
+gboolean
+e_mail_ui_session_check_known_addresses_sync (EMailUISession *session,
+					      CamelInternetAddress *addrs,
+					      gboolean check_local_only,
+					      GCancellable *cancellable,
+					      GHashTable **out_known_addresses,
+					      GError **error)
+{
+	GHashTable *known;
+	GPtrArray *emails;
+	gchar *book_uid;
+	gboolean success;
+	gint ii, len;
+
+	g_return_val_if_fail (E_IS_MAIL_UI_SESSION (session), FALSE);
+	g_return_val_if_fail (CAMEL_IS_INTERNET_ADDRESS (addrs), FALSE);
+	g_return_val_if_fail (out_known_addresses != NULL, FALSE);
+
+	len = camel_address_length (CAMEL_ADDRESS (addrs));
+	emails = g_ptr_array_sized_new (len + 1);
+
+	for (ii = 0; ii < len; ii++) {
+		const gchar *email = NULL;
+
+		if (camel_internet_address_get (addrs, ii, NULL, &email) && email && *email)
+			g_ptr_array_add (emails, (gpointer) email);
 	}
 
-	g_mutex_unlock (&session->priv->address_cache_mutex);
+	g_ptr_array_add (emails, NULL);
+
+	known = g_hash_table_new (g_str_hash, g_str_equal);
+	book_uid = mail_ui_session_dup_book_uid (session, check_local_only);
+
+	success = mail_ui_session_check_known_addresses_sync (session,
+		(const gchar * const *) emails->pdata, book_uid,
+		known, cancellable, error);
+
+	g_ptr_array_unref (emails);
+	g_free (book_uid);
+
+	if (success)
+		*out_known_addresses = known;
+	else
+		g_hash_table_destroy (known);
 
 	return success;
 }
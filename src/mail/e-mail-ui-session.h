@@ -86,6 +86,8 @@ EMailLabelListStore *
 						(EMailUISession *session);
 EPhotoCache *	e_mail_ui_session_get_photo_cache
 						(EMailUISession *session);
+void		e_mail_ui_session_invalidate_filter_rules
+						(EMailUISession *session);
 void		e_mail_ui_session_add_activity	(EMailUISession *session,
 						 EActivity *activity);
 CamelCertTrust	e_mail_ui_session_trust_prompt	(CamelSession *session,
@@ -99,6 +101,13 @@ gboolean	e_mail_ui_session_check_known_address_sync
 						 GCancellable *cancellable,
 						 gboolean *out_known_address,
 						 GError **error);
+gboolean	e_mail_ui_session_check_known_addresses_sync
+						(EMailUISession *session,
+						 CamelInternetAddress *addrs,
+						 gboolean check_local_only,
+						 GCancellable *cancellable,
+						 GHashTable **out_known_addresses,
+						 GError **error);
 
 G_END_DECLS
 
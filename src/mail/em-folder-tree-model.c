@@ -46,6 +46,9 @@
  * Animation cycles over 12 frames in 750 ms. */
 #define SPINNER_PULSE_INTERVAL (750 / 12)
 
+/* Unread count changes are applied at most once per frame. */
+#define UNREAD_UPDATE_INTERVAL 16
+
 typedef struct _StoreInfo StoreInfo;
 
 struct _EMFolderTreeModelPrivate {
@@ -62,8 +65,26 @@ struct _EMFolderTreeModelPrivate {
 	GMutex store_index_lock;
 
 	EMailFolderTweaks *folder_tweaks;
+
+	/* "store pointer\nfull name" -> PendingUnread *; the unread
+	 * counts received since the last update, only the last one
+	 * for each folder is applied. */
+	GHashTable *pending_unread;
+
+	/* path string -> GtkTreeRowReference *; rows whose
+	 * COL_UINT_SUBDIRS_UNREAD needs to be recalculated. */
+	GHashTable *dirty_rows;
+
+	guint update_id;
+	gboolean updating_subdirs_unread;
 };
 
+typedef struct _PendingUnread {
+	CamelStore *store;
+	gchar *full_name;
+	gint unread;
+} PendingUnread;
+
 typedef struct _FolderUnreadInfo {
 	guint unread;
 	guint unread_last_sel;
@@ -963,6 +984,14 @@ folder_tree_model_dispose (GObject *object)
 	g_signal_handlers_disconnect_by_func (self->priv->folder_tweaks,
 		em_folder_tree_model_folder_tweaks_changed_cb, object);
 
+	if (self->priv->update_id) {
+		g_source_remove (self->priv->update_id);
+		self->priv->update_id = 0;
+	}
+
+	g_hash_table_remove_all (self->priv->pending_unread);
+	g_hash_table_remove_all (self->priv->dirty_rows);
+
 	/* Chain up to parent's dispose() method. */
 	G_OBJECT_CLASS (em_folder_tree_model_parent_class)->dispose (object);
 }
@@ -973,6 +1002,8 @@ folder_tree_model_finalize (GObject *object)
 	EMFolderTreeModel *self = EM_FOLDER_TREE_MODEL (object);
 
 	g_hash_table_destroy (self->priv->store_index);
+	g_hash_table_destroy (self->priv->pending_unread);
+	g_hash_table_destroy (self->priv->dirty_rows);
 	g_mutex_clear (&self->priv->store_index_lock);
 	g_clear_object (&self->priv->folder_tweaks);
 
@@ -1003,7 +1034,8 @@ folder_tree_model_constructed (GObject *object)
 		G_TYPE_ICON,      /* COL_GICON_CUSTOM_ICON */
 		GDK_TYPE_RGBA,    /* COL_RGBA_FOREGROUND_RGBA */
 		G_TYPE_UINT,      /* COL_UINT_SORT_ORDER */
-		G_TYPE_UINT       /* COL_UINT_STATUS_CODE */
+		G_TYPE_UINT,      /* COL_UINT_STATUS_CODE */
+		G_TYPE_UINT       /* COL_UINT_SUBDIRS_UNREAD */
 	};
 
 	g_warn_if_fail (G_N_ELEMENTS (col_types) == NUM_COLUMNS);
@@ -1103,16 +1135,27 @@ em_folder_tree_model_class_init (EMFolderTreeModelClass *class)
 }
 
 static void
-folder_tree_model_set_unread_count (EMFolderTreeModel *model,
-                                    CamelStore *store,
-                                    const gchar *full,
-                                    gint unread,
-				    MailFolderCache *folder_cache)
+pending_unread_free (gpointer ptr)
+{
+	PendingUnread *pu = ptr;
+
+	if (pu) {
+		g_object_unref (pu->store);
+		g_free (pu->full_name);
+		g_free (pu);
+	}
+}
+
+static void
+folder_tree_model_apply_unread_count (EMFolderTreeModel *model,
+                                      CamelStore *store,
+                                      const gchar *full,
+                                      gint unread,
+                                      MailFolderCache *folder_cache)
 {
 	GtkTreeRowReference *reference;
 	GtkTreeModel *tree_model;
 	GtkTreePath *path;
-	GtkTreeIter parent;
 	GtkTreeIter iter;
 	StoreInfo *si;
 	guint old_unread = 0;
@@ -1189,21 +1232,15 @@ folder_tree_model_set_unread_count (EMFolderTreeModel *model,
 
 	unread_increased = unread > old_unread;
 
+	/* Folders are displayed with a bold weight to indicate that
+	 * they contain unread messages.  The parent rows are updated
+	 * through their COL_UINT_SUBDIRS_UNREAD, which changes only
+	 * when the sum of the unread counts changes. */
 	gtk_tree_store_set (
 		GTK_TREE_STORE (model), &iter,
 		COL_UINT_UNREAD, unread,
 		COL_UINT_UNREAD_LAST_SEL, MIN (old_unread, unread), -1);
 
-	/* Folders are displayed with a bold weight to indicate that
-	 * they contain unread messages.  We signal that parent rows
-	 * have changed here to update them. */
-	while (gtk_tree_model_iter_parent (tree_model, &parent, &iter)) {
-		path = gtk_tree_model_get_path (tree_model, &parent);
-		gtk_tree_model_row_changed (tree_model, path, &parent);
-		gtk_tree_path_free (path);
-		iter = parent;
-	}
-
 exit:
 	if (unread_increased && !is_drafts && gtk_tree_row_reference_valid (si->row)) {
 		path = gtk_tree_row_reference_get_path (si->row);
@@ -1220,6 +1257,243 @@ exit:
 	store_info_unref (si);
 }
 
+typedef struct _DirtyRow {
+	GtkTreeRowReference *reference;
+	gint depth;
+} DirtyRow;
+
+static gint
+folder_tree_model_compare_dirty_rows (gconstpointer ptr1,
+                                      gconstpointer ptr2)
+{
+	const DirtyRow *row1 = ptr1, *row2 = ptr2;
+
+	/* The deepest rows first */
+	return row2->depth - row1->depth;
+}
+
+static gboolean folder_tree_model_update_cb (gpointer user_data);
+
+static void
+folder_tree_model_schedule_update (EMFolderTreeModel *model)
+{
+	if (!model->priv->update_id) {
+		model->priv->update_id = e_named_timeout_add (
+			UNREAD_UPDATE_INTERVAL,
+			folder_tree_model_update_cb, model);
+	}
+}
+
+static void
+folder_tree_model_mark_parent_dirty (EMFolderTreeModel *model,
+                                     GtkTreePath *child_path)
+{
+	GtkTreePath *path;
+	gchar *path_str;
+
+	path = gtk_tree_path_copy (child_path);
+
+	if (gtk_tree_path_up (path) && gtk_tree_path_get_depth (path) > 0) {
+		path_str = gtk_tree_path_to_string (path);
+
+		if (!g_hash_table_contains (model->priv->dirty_rows, path_str)) {
+			g_hash_table_insert (
+				model->priv->dirty_rows, path_str,
+				gtk_tree_row_reference_new (GTK_TREE_MODEL (model), path));
+			path_str = NULL;
+		}
+
+		g_free (path_str);
+
+		folder_tree_model_schedule_update (model);
+	}
+
+	gtk_tree_path_free (path);
+}
+
+static void
+folder_tree_model_row_changed_cb (GtkTreeModel *tree_model,
+                                  GtkTreePath *path,
+                                  GtkTreeIter *iter,
+                                  gpointer user_data)
+{
+	EMFolderTreeModel *model = EM_FOLDER_TREE_MODEL (tree_model);
+
+	/* Changes of the COL_UINT_SUBDIRS_UNREAD mark the parent on their own */
+	if (!model->priv->updating_subdirs_unread)
+		folder_tree_model_mark_parent_dirty (model, path);
+}
+
+static void
+folder_tree_model_row_deleted_cb (GtkTreeModel *tree_model,
+                                  GtkTreePath *path,
+                                  gpointer user_data)
+{
+	folder_tree_model_mark_parent_dirty (EM_FOLDER_TREE_MODEL (tree_model), path);
+}
+
+/* Recalculates the COL_UINT_SUBDIRS_UNREAD of the dirty rows, from the
+ * deepest to the top-level, summing only the direct children, which
+ * already have their own sums up to date. */
+static void
+folder_tree_model_update_subdirs_unread (EMFolderTreeModel *model)
+{
+	GtkTreeModel *tree_model = GTK_TREE_MODEL (model);
+
+	while (g_hash_table_size (model->priv->dirty_rows) > 0) {
+		GHashTableIter hiter;
+		GArray *rows;
+		gpointer value;
+		guint ii;
+
+		rows = g_array_sized_new (FALSE, FALSE, sizeof (DirtyRow), g_hash_table_size (model->priv->dirty_rows));
+
+		g_hash_table_iter_init (&hiter, model->priv->dirty_rows);
+		while (g_hash_table_iter_next (&hiter, NULL, &value)) {
+			GtkTreePath *path;
+			DirtyRow row;
+
+			path = gtk_tree_row_reference_get_path (value);
+			if (!path)
+				continue;
+
+			row.reference = gtk_tree_row_reference_copy (value);
+			row.depth = gtk_tree_path_get_depth (path);
+
+			g_array_append_val (rows, row);
+
+			gtk_tree_path_free (path);
+		}
+
+		g_hash_table_remove_all (model->priv->dirty_rows);
+
+		g_array_sort (rows, folder_tree_model_compare_dirty_rows);
+
+		for (ii = 0; ii < rows->len; ii++) {
+			DirtyRow *row = &g_array_index (rows, DirtyRow, ii);
+			GtkTreePath *path;
+			GtkTreeIter iter, child;
+			guint subdirs_unread = 0, old_subdirs_unread = 0;
+
+			/* Setting a value can reorder the rows, thus
+			 * the path is always taken from the reference */
+			path = gtk_tree_row_reference_get_path (row->reference);
+
+			if (path && gtk_tree_model_get_iter (tree_model, &iter, path)) {
+				if (gtk_tree_model_iter_children (tree_model, &child, &iter)) {
+					do {
+						guint unread = 0, child_subdirs_unread = 0;
+
+						gtk_tree_model_get (
+							tree_model, &child,
+							COL_UINT_UNREAD, &unread,
+							COL_UINT_SUBDIRS_UNREAD, &child_subdirs_unread,
+							-1);
+
+						subdirs_unread += unread + child_subdirs_unread;
+					} while (gtk_tree_model_iter_next (tree_model, &child));
+				}
+
+				gtk_tree_model_get (
+					tree_model, &iter,
+					COL_UINT_SUBDIRS_UNREAD, &old_subdirs_unread,
+					-1);
+
+				if (subdirs_unread != old_subdirs_unread) {
+					model->priv->updating_subdirs_unread = TRUE;
+					gtk_tree_store_set (
+						GTK_TREE_STORE (model), &iter,
+						COL_UINT_SUBDIRS_UNREAD, subdirs_unread,
+						-1);
+					model->priv->updating_subdirs_unread = FALSE;
+
+					gtk_tree_path_free (path);
+					path = gtk_tree_row_reference_get_path (row->reference);
+
+					if (path)
+						folder_tree_model_mark_parent_dirty (model, path);
+				}
+			}
+
+			if (path)
+				gtk_tree_path_free (path);
+			gtk_tree_row_reference_free (row->reference);
+		}
+
+		g_array_free (rows, TRUE);
+	}
+}
+
+static gboolean
+folder_tree_model_update_cb (gpointer user_data)
+{
+	EMFolderTreeModel *model = user_data;
+
+	model->priv->update_id = 0;
+
+	if (g_hash_table_size (model->priv->pending_unread) > 0 && model->priv->session) {
+		MailFolderCache *folder_cache;
+		GHashTable *pending_unread;
+		GHashTableIter iter;
+		gpointer value;
+
+		folder_cache = e_mail_session_get_folder_cache (model->priv->session);
+
+		pending_unread = model->priv->pending_unread;
+		model->priv->pending_unread = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, pending_unread_free);
+
+		g_hash_table_iter_init (&iter, pending_unread);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			PendingUnread *pu = value;
+
+			folder_tree_model_apply_unread_count (model, pu->store, pu->full_name, pu->unread, folder_cache);
+		}
+
+		g_hash_table_destroy (pending_unread);
+	}
+
+	folder_tree_model_update_subdirs_unread (model);
+
+	/* Marking the rows dirty above could schedule it again */
+	if (model->priv->update_id) {
+		g_source_remove (model->priv->update_id);
+		model->priv->update_id = 0;
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+/* The folder cache can notify about many folders in a quick succession,
+ * like during the first sync of an account with many folders, thus the
+ * changes are collected and applied to the tree at most once per frame. */
+static void
+folder_tree_model_set_unread_count (EMFolderTreeModel *model,
+                                    CamelStore *store,
+                                    const gchar *full,
+                                    gint unread,
+                                    MailFolderCache *folder_cache)
+{
+	PendingUnread *pu;
+
+	g_return_if_fail (EM_IS_FOLDER_TREE_MODEL (model));
+	g_return_if_fail (CAMEL_IS_STORE (store));
+	g_return_if_fail (full != NULL);
+
+	if (unread < 0)
+		return;
+
+	pu = g_new0 (PendingUnread, 1);
+	pu->store = g_object_ref (store);
+	pu->full_name = g_strdup (full);
+	pu->unread = unread;
+
+	g_hash_table_insert (
+		model->priv->pending_unread,
+		g_strdup_printf ("%p\n%s", store, full), pu);
+
+	folder_tree_model_schedule_update (model);
+}
+
 static void
 em_folder_tree_model_init (EMFolderTreeModel *model)
 {
@@ -1234,11 +1508,18 @@ em_folder_tree_model_init (EMFolderTreeModel *model)
 	model->priv = em_folder_tree_model_get_instance_private (model);
 	model->priv->store_index = store_index;
 	model->priv->folder_tweaks = e_mail_folder_tweaks_new ();
+	model->priv->pending_unread = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, pending_unread_free);
+	model->priv->dirty_rows = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) gtk_tree_row_reference_free);
 
 	g_mutex_init (&model->priv->store_index_lock);
 
 	g_signal_connect (model->priv->folder_tweaks, "changed",
 		G_CALLBACK (em_folder_tree_model_folder_tweaks_changed_cb), model);
+
+	g_signal_connect (model, "row-changed",
+		G_CALLBACK (folder_tree_model_row_changed_cb), NULL);
+	g_signal_connect (model, "row-deleted",
+		G_CALLBACK (folder_tree_model_row_deleted_cb), NULL);
 }
 
 EMFolderTreeModel *
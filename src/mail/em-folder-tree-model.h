@@ -92,6 +92,8 @@ enum {
 
 	COL_UINT_STATUS_CODE,		/* Status code for the store - one of EMFT_STATUS_CODE_ constancts */
 
+	COL_UINT_SUBDIRS_UNREAD,	/* sum of unread counts of all subfolders */
+
 	NUM_COLUMNS
 };
 
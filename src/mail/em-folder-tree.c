@@ -794,23 +794,12 @@ static gboolean
 subdirs_contain_unread (GtkTreeModel *model,
                         GtkTreeIter *root)
 {
-	guint unread;
-	GtkTreeIter iter;
+	guint subdirs_unread = 0;
 
-	if (!gtk_tree_model_iter_children (model, &iter, root))
-		return FALSE;
+	/* The model keeps the sum of the whole subtree */
+	gtk_tree_model_get (model, root, COL_UINT_SUBDIRS_UNREAD, &subdirs_unread, -1);
 
-	do {
-		gtk_tree_model_get (model, &iter, COL_UINT_UNREAD, &unread, -1);
-		if (unread)
-			return TRUE;
-
-		if (gtk_tree_model_iter_has_child (model, &iter))
-			if (subdirs_contain_unread (model, &iter))
-				return TRUE;
-	} while (gtk_tree_model_iter_next (model, &iter));
-
-	return FALSE;
+	return subdirs_unread > 0;
 }
 
 static void
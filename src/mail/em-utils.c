@@ -47,6 +47,7 @@
 #include "em-format/e-mail-formatter-utils.h"
 
 #include "e-mail-printer.h"
+#include "e-mail-ui-session.h"
 #include "e-mail-tag-editor.h"
 #include "em-composer-utils.h"
 #include "em-filter-editor.h"
@@ -98,6 +99,7 @@ em_filter_editor_response (GtkWidget *dialog,
 	EMFilterContext *fc;
 
 	if (button == GTK_RESPONSE_OK) {
+		EMailSession *session;
 		const gchar *config_dir;
 		gchar *user;
 
@@ -106,6 +108,10 @@ em_filter_editor_response (GtkWidget *dialog,
 		user = g_build_filename (config_dir, "filters.xml", NULL);
 		e_rule_context_save ((ERuleContext *) fc, user);
 		g_free (user);
+
+		session = em_filter_context_get_session (fc);
+		if (E_IS_MAIL_UI_SESSION (session))
+			e_mail_ui_session_invalidate_filter_rules (E_MAIL_UI_SESSION (session));
 	}
 
 	gtk_widget_destroy (dialog);
@@ -38,6 +38,16 @@
 #include "mail-importer.h"
 #include "kmail-libs.h"
 
+/* Messages of an mbox file are constructed by several threads in
+ * batches, while the previously constructed batch is being appended
+ * to the destination folder. */
+#define IMPORT_MBOX_BATCH_SIZE 64
+#define IMPORT_MBOX_MAX_JOBS 4
+
+/* How often, in bytes of the mbox file, the destination folder
+ * is synchronized and the resume checkpoint saved. */
+#define IMPORT_MBOX_CHECKPOINT_BYTES (64 * 1024 * 1024)
+
 struct _import_mbox_msg {
 	MailMsg base;
 
@@ -102,20 +112,13 @@ decode_mozilla_status (const gchar *tmp)
 	return flags;
 }
 
-static void
-import_mbox_add_message (CamelFolder *folder,
-			 CamelMimeMessage *msg,
-			 GCancellable *cancellable,
-			 GError **error)
+static guint32
+import_mbox_get_flags (CamelMimeMessage *msg)
 {
-	CamelMessageInfo *info;
 	CamelMedium *medium;
 	guint32 flags = 0;
 	const gchar *tmp;
 
-	g_return_if_fail (CAMEL_IS_FOLDER (folder));
-	g_return_if_fail (CAMEL_IS_MIME_MESSAGE (msg));
-
 	medium = CAMEL_MEDIUM (msg);
 
 	tmp = camel_medium_get_header (medium, "X-Mozilla-Status");
@@ -128,6 +131,18 @@ import_mbox_add_message (CamelFolder *folder,
 	if (tmp)
 		flags |= decode_status (tmp);
 
+	return flags;
+}
+
+static void
+import_mbox_append_message (CamelFolder *folder,
+			    CamelMimeMessage *msg,
+			    guint32 flags,
+			    GCancellable *cancellable,
+			    GError **error)
+{
+	CamelMessageInfo *info;
+
 	info = camel_message_info_new (NULL);
 
 	camel_message_info_set_flags (info, flags, ~0);
@@ -137,6 +152,332 @@ import_mbox_add_message (CamelFolder *folder,
 	g_clear_object (&info);
 }
 
+static void
+import_mbox_add_message (CamelFolder *folder,
+			 CamelMimeMessage *msg,
+			 GCancellable *cancellable,
+			 GError **error)
+{
+	g_return_if_fail (CAMEL_IS_FOLDER (folder));
+	g_return_if_fail (CAMEL_IS_MIME_MESSAGE (msg));
+
+	import_mbox_append_message (folder, msg, import_mbox_get_flags (msg), cancellable, error);
+}
+
+typedef struct _ImportMboxBatch ImportMboxBatch;
+
+typedef struct _ImportMboxChunk {
+	ImportMboxBatch *batch;
+	const gchar *data;
+	gsize len;
+	gsize end_offset; /* where the next message starts in the file */
+	CamelMimeMessage *message;
+	guint32 flags;
+} ImportMboxChunk;
+
+struct _ImportMboxBatch {
+	ImportMboxChunk chunks[IMPORT_MBOX_BATCH_SIZE];
+	guint n_chunks;
+	guint n_pending;
+	GMutex lock;
+	GCond cond;
+};
+
+/* The checkpoint is bound to the source file and its state,
+ * thus a changed file is imported from the beginning again. */
+static gchar *
+import_mbox_dup_checkpoint_filename (const gchar *path,
+				     const gchar *uri,
+				     const struct stat *st)
+{
+	gchar *key, *checksum, *filename;
+
+	key = g_strdup_printf ("%s\n%s\n%" G_GINT64_FORMAT "\n%" G_GINT64_FORMAT,
+		path, uri ? uri : "", (gint64) st->st_size, (gint64) st->st_mtime);
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, key, -1);
+	filename = g_build_filename (mail_session_get_cache_dir (), "import-checkpoints", checksum, NULL);
+
+	g_free (checksum);
+	g_free (key);
+
+	return filename;
+}
+
+static gsize
+import_mbox_read_checkpoint (const gchar *filename)
+{
+	gchar *contents = NULL;
+	gsize offset = 0;
+
+	if (g_file_get_contents (filename, &contents, NULL, NULL) && contents)
+		offset = (gsize) g_ascii_strtoull (contents, NULL, 10);
+
+	g_free (contents);
+
+	return offset;
+}
+
+static void
+import_mbox_write_checkpoint (const gchar *filename,
+			      gsize offset)
+{
+	gchar *dirname, *contents;
+
+	dirname = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dirname, 0700);
+	g_free (dirname);
+
+	contents = g_strdup_printf ("%" G_GUINT64_FORMAT, (guint64) offset);
+	g_file_set_contents (filename, contents, -1, NULL);
+	g_free (contents);
+}
+
+static gboolean
+import_mbox_is_from_line (const gchar *data,
+			  gsize len,
+			  gsize offset)
+{
+	return offset + 5 <= len &&
+		(offset == 0 || data[offset - 1] == '\n') &&
+		strncmp (data + offset, "From ", 5) == 0;
+}
+
+/* Returns offset of the first "From " line after the line
+ * the @offset points into, or @len when there is none. */
+static gsize
+import_mbox_find_next_from (const gchar *data,
+			    gsize len,
+			    gsize offset)
+{
+	const gchar *ptr;
+
+	while (offset < len && (ptr = memchr (data + offset, '\n', len - offset)) != NULL) {
+		offset = ptr - data + 1;
+
+		if (import_mbox_is_from_line (data, len, offset))
+			return offset;
+	}
+
+	return len;
+}
+
+static void
+import_mbox_construct_job (gpointer job_data,
+			   gpointer user_data)
+{
+	ImportMboxChunk *chunk = job_data;
+	ImportMboxBatch *batch = chunk->batch;
+	CamelMimeParser *mp;
+	CamelStream *stream;
+
+	stream = camel_stream_mem_new_with_buffer (chunk->data, chunk->len);
+
+	mp = camel_mime_parser_new ();
+	camel_mime_parser_scan_from (mp, TRUE);
+	camel_mime_parser_init_with_stream (mp, stream, NULL);
+
+	if (camel_mime_parser_step (mp, NULL, NULL) == CAMEL_MIME_PARSER_STATE_FROM) {
+		CamelMimeMessage *msg;
+
+		msg = camel_mime_message_new ();
+
+		if (camel_mime_part_construct_from_parser_sync (CAMEL_MIME_PART (msg), mp, NULL, NULL)) {
+			chunk->flags = import_mbox_get_flags (msg);
+			chunk->message = msg;
+		} else {
+			g_object_unref (msg);
+		}
+	}
+
+	g_object_unref (mp);
+	g_object_unref (stream);
+
+	g_mutex_lock (&batch->lock);
+	batch->n_pending--;
+	if (!batch->n_pending)
+		g_cond_signal (&batch->cond);
+	g_mutex_unlock (&batch->lock);
+}
+
+/* Splits the next messages from the @data and lets the @pool construct them */
+static void
+import_mbox_submit_batch (ImportMboxBatch *batch,
+			  GThreadPool *pool,
+			  const gchar *data,
+			  gsize len,
+			  gsize *inout_offset)
+{
+	guint ii;
+
+	batch->n_chunks = 0;
+
+	while (batch->n_chunks < IMPORT_MBOX_BATCH_SIZE && *inout_offset < len) {
+		ImportMboxChunk *chunk = &batch->chunks[batch->n_chunks];
+		gsize end;
+
+		end = import_mbox_find_next_from (data, len, *inout_offset);
+
+		chunk->batch = batch;
+		chunk->data = data + *inout_offset;
+		chunk->len = end - *inout_offset;
+		chunk->end_offset = end;
+		chunk->message = NULL;
+		chunk->flags = 0;
+
+		batch->n_chunks++;
+		*inout_offset = end;
+	}
+
+	g_mutex_lock (&batch->lock);
+	batch->n_pending = batch->n_chunks;
+	g_mutex_unlock (&batch->lock);
+
+	for (ii = 0; ii < batch->n_chunks; ii++)
+		g_thread_pool_push (pool, &batch->chunks[ii], NULL);
+}
+
+static void
+import_mbox_wait_batch (ImportMboxBatch *batch)
+{
+	g_mutex_lock (&batch->lock);
+	while (batch->n_pending > 0)
+		g_cond_wait (&batch->cond, &batch->lock);
+	g_mutex_unlock (&batch->lock);
+}
+
+static void
+import_mbox_clear_batch (ImportMboxBatch *batch)
+{
+	guint ii;
+
+	for (ii = 0; ii < batch->n_chunks; ii++)
+		g_clear_object (&batch->chunks[ii].message);
+
+	batch->n_chunks = 0;
+}
+
+/* Imports the mbox file mapped into the memory; returns whether the file
+ * contains any message. The import continues from the last checkpoint,
+ * when a previous import of the same file had been interrupted. */
+static gboolean
+import_mbox_exec_pipelined (struct _import_mbox_msg *m,
+			    CamelFolder *folder,
+			    GMappedFile *mapped_file,
+			    const struct stat *st,
+			    GCancellable *cancellable,
+			    GError **error)
+{
+	ImportMboxBatch *batches;
+	GThreadPool *pool;
+	const gchar *data;
+	gchar *checkpoint_filename;
+	gsize len, offset, committed, last_checkpoint;
+	guint current = 0;
+	GError *local_error = NULL;
+
+	data = g_mapped_file_get_contents (mapped_file);
+	len = g_mapped_file_get_length (mapped_file);
+
+	if (!data || !len)
+		return FALSE;
+
+	if (import_mbox_is_from_line (data, len, 0))
+		offset = 0;
+	else
+		offset = import_mbox_find_next_from (data, len, 0);
+
+	if (offset >= len)
+		return FALSE;
+
+	checkpoint_filename = import_mbox_dup_checkpoint_filename (m->path, m->uri, st);
+	committed = import_mbox_read_checkpoint (checkpoint_filename);
+
+	if (committed > offset && committed <= len &&
+	    (committed == len || import_mbox_is_from_line (data, len, committed)))
+		offset = committed;
+
+	committed = offset;
+	last_checkpoint = offset;
+
+	batches = g_new0 (ImportMboxBatch, 2);
+	g_mutex_init (&batches[0].lock);
+	g_cond_init (&batches[0].cond);
+	g_mutex_init (&batches[1].lock);
+	g_cond_init (&batches[1].cond);
+
+	pool = g_thread_pool_new (import_mbox_construct_job, NULL, IMPORT_MBOX_MAX_JOBS, FALSE, NULL);
+
+	import_mbox_submit_batch (&batches[current], pool, data, len, &offset);
+
+	while (batches[current].n_chunks > 0) {
+		ImportMboxBatch *batch = &batches[current];
+		guint ii;
+
+		/* Construct the next batch while this one is being appended */
+		if (!g_cancellable_is_cancelled (cancellable))
+			import_mbox_submit_batch (&batches[1 - current], pool, data, len, &offset);
+
+		import_mbox_wait_batch (batch);
+
+		for (ii = 0; ii < batch->n_chunks && !local_error; ii++) {
+			ImportMboxChunk *chunk = &batch->chunks[ii];
+
+			if (g_cancellable_set_error_if_cancelled (cancellable, &local_error))
+				break;
+
+			if (chunk->message)
+				import_mbox_append_message (folder, chunk->message, chunk->flags, cancellable, &local_error);
+
+			if (!local_error)
+				committed = chunk->end_offset;
+		}
+
+		camel_operation_progress (cancellable, (gint) (100.0 * ((gdouble) committed / (gdouble) len)));
+
+		import_mbox_clear_batch (batch);
+
+		if (local_error)
+			break;
+
+		if (committed - last_checkpoint >= IMPORT_MBOX_CHECKPOINT_BYTES) {
+			/* Not passing a GCancellable or GError here. */
+			camel_folder_synchronize_sync (folder, FALSE, NULL, NULL);
+			import_mbox_write_checkpoint (checkpoint_filename, committed);
+			last_checkpoint = committed;
+		}
+
+		current = 1 - current;
+	}
+
+	/* Waits for any batch still being constructed */
+	g_thread_pool_free (pool, FALSE, TRUE);
+
+	import_mbox_clear_batch (&batches[0]);
+	import_mbox_clear_batch (&batches[1]);
+
+	/* Not passing a GCancellable or GError here. */
+	camel_folder_synchronize_sync (folder, FALSE, NULL, NULL);
+
+	if (committed >= len)
+		g_unlink (checkpoint_filename);
+	else if (committed > last_checkpoint)
+		import_mbox_write_checkpoint (checkpoint_filename, committed);
+
+	g_mutex_clear (&batches[0].lock);
+	g_cond_clear (&batches[0].cond);
+	g_mutex_clear (&batches[1].lock);
+	g_cond_clear (&batches[1].cond);
+	g_free (batches);
+	g_free (checkpoint_filename);
+
+	if (local_error && !g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		g_propagate_error (error, local_error);
+	else
+		g_clear_error (&local_error);
+
+	return TRUE;
+}
+
 static void
 import_mbox_exec (struct _import_mbox_msg *m,
                   GCancellable *cancellable,
@@ -169,6 +510,7 @@ import_mbox_exec (struct _import_mbox_msg *m,
 
 	if (S_ISREG (st.st_mode)) {
 		CamelMimeParser *mp = NULL;
+		GMappedFile *mapped_file = NULL;
 		gboolean any_read = FALSE;
 
 		fd = g_open (m->path, O_RDONLY | O_BINARY, 0);
@@ -185,7 +527,18 @@ import_mbox_exec (struct _import_mbox_msg *m,
 
 		camel_folder_freeze (folder);
 
-		if (mail_importer_file_is_mbox (m->path)) {
+		/* Files which cannot be mapped into the memory, like those
+		 * larger than the address space, are parsed sequentially. */
+		if (mail_importer_file_is_mbox (m->path))
+			mapped_file = g_mapped_file_new (m->path, FALSE, NULL);
+
+		if (mapped_file) {
+			close (fd);
+
+			any_read = import_mbox_exec_pipelined (m, folder, mapped_file, &st, cancellable, error);
+
+			g_mapped_file_unref (mapped_file);
+		} else if (mail_importer_file_is_mbox (m->path)) {
 			mp = camel_mime_parser_new ();
 			camel_mime_parser_scan_from (mp, TRUE);
 			if (camel_mime_parser_init_with_fd (mp, fd) == -1) {
@@ -28,6 +28,7 @@
 
 #include "mail-vfolder-ui.h"
 #include "mail-autofilter.h"
+#include "e-mail-ui-session.h"
 #include "em-utils.h"
 #include "e-util/e-util-private.h"
 
@@ -372,6 +373,20 @@ filter_rule_from_message (EMFilterContext *context,
 	return rule;
 }
 
+static void
+filter_gui_rule_added_cb (ERuleContext *context,
+                          EFilterRule *rule,
+                          gpointer user_data)
+{
+	EMailSession *session = user_data;
+
+	/* The dialog saves the rules right after the rule is added, still
+	 * in the main thread, thus the filters are recompiled only after
+	 * the save, from the updated file. */
+	if (E_IS_MAIL_UI_SESSION (session))
+		e_mail_ui_session_invalidate_filter_rules (E_MAIL_UI_SESSION (session));
+}
+
 void
 filter_gui_add_from_message (EMailSession *session,
                              CamelMimeMessage *msg,
@@ -397,6 +412,11 @@ filter_gui_add_from_message (EMailSession *session,
 
 	e_filter_rule_set_source (rule, source);
 
+	/* The dialog keeps the context alive until it's closed */
+	g_signal_connect_object (
+		fc, "rule-added",
+		G_CALLBACK (filter_gui_rule_added_cb), session, 0);
+
 	e_rule_context_add_rule_gui (
 		(ERuleContext *) fc, rule, _("Add Filter Rule"), user);
 	g_free (user);
@@ -437,6 +457,8 @@ mail_filter_rename_folder (CamelStore *store,
 	if (changed) {
 		if (e_rule_context_save ((ERuleContext *) fc, user) == -1)
 			g_warning ("Could not write out changed filter rules\n");
+		if (E_IS_MAIL_UI_SESSION (session))
+			e_mail_ui_session_invalidate_filter_rules (E_MAIL_UI_SESSION (session));
 		e_rule_context_free_uri_list ((ERuleContext *) fc, changed);
 	}
 
@@ -571,6 +593,8 @@ mail_filter_delete_folder (CamelStore *store,
 
 		if (e_rule_context_save ((ERuleContext *) fc, user) == -1)
 			g_warning ("Could not write out changed filter rules\n");
+		if (E_IS_MAIL_UI_SESSION (session))
+			e_mail_ui_session_invalidate_filter_rules (E_MAIL_UI_SESSION (session));
 		e_rule_context_free_uri_list ((ERuleContext *) fc, deleted);
 	}
 
@@ -67,6 +67,11 @@
 #define EXCLUDE_DELETED_MESSAGES_EXPR	"(not (system-flag \"deleted\"))"
 #define EXCLUDE_JUNK_MESSAGES_EXPR	"(not (system-flag \"junk\"))"
 
+/* Folder changes with more added or removed messages than this
+ * are handled by a full message list regeneration, which is
+ * cheaper than many single-node tree model updates. */
+#define INCREMENTAL_REGEN_MAX_CHANGES	100
+
 typedef struct _ExtendedGNode ExtendedGNode;
 typedef struct _RegenData RegenData;
 
@@ -113,6 +118,12 @@ struct _MessageListPrivate {
 	GNode *tree_model_root;
 	gint tree_model_frozen;
 
+	/* Lazily built indexes used by the incremental regen; both are
+	 * dropped whenever the tree is cleared.  The keys are allocated
+	 * guint64 message-id hashes. */
+	GHashTable *msgid_nodemap; /* guint64 * ~> GNode * */
+	GHashTable *orphan_refs; /* guint64 * ~> NULL, references of thread roots */
+
 	/* This aids in automatic message selection. */
 	time_t newest_read_date;
 	const gchar *newest_read_uid;
@@ -294,6 +305,7 @@ static void	mail_regen_cancel		(MessageList *message_list);
 static void	clear_info			(gchar *key,
 						 GNode *node,
 						 MessageList *message_list);
+static void	message_list_update_tree_text	(MessageList *message_list);
 
 enum {
 	MESSAGE_SELECTED,
@@ -670,6 +682,41 @@ message_list_tree_model_remove (MessageList *message_list,
 		e_tree_model_node_deleted (tree_model, node);
 }
 
+static void
+message_list_tree_model_move (MessageList *message_list,
+                              GNode *node,
+                              GNode *new_parent)
+{
+	ETreeModel *tree_model;
+	GNode *old_parent = node->parent;
+	gboolean tree_model_frozen;
+	gint old_position = 0;
+
+	g_return_if_fail (node != NULL);
+	g_return_if_fail (new_parent != NULL);
+
+	tree_model = E_TREE_MODEL (message_list);
+	tree_model_frozen = (message_list->priv->tree_model_frozen > 0);
+
+	if (!tree_model_frozen) {
+		e_tree_model_pre_change (tree_model);
+		old_position = g_node_child_position (old_parent, node);
+	}
+
+	extended_g_node_unlink (node);
+
+	if (!tree_model_frozen) {
+		e_tree_model_node_removed (
+			tree_model, old_parent, node, old_position);
+		e_tree_model_pre_change (tree_model);
+	}
+
+	extended_g_node_insert (new_parent, -1, node);
+
+	if (!tree_model_frozen)
+		e_tree_model_node_inserted (tree_model, new_parent, node);
+}
+
 static gint
 address_compare (gconstpointer address1,
                  gconstpointer address2,
@@ -1155,6 +1202,73 @@ message_list_can_select (MessageList *message_list,
 	return ml_search_path (message_list, direction, flags, mask) != NULL;
 }
 
+/**
+ * message_list_get_adjacent_uids:
+ * @message_list: a #MessageList
+ * @direction: a #MessageListSelectDirection, only the direction bit is used
+ * @max_count: how many UIDs to return at most
+ *
+ * Returns UIDs of up to @max_count visible rows following (or preceding)
+ * the row with the cursor, ordered from the nearest one. Collapsed thread
+ * children are not included, because they are not part of the view.
+ *
+ * Returns: (transfer full): a #GPtrArray of UIDs; free it with
+ *    g_ptr_array_unref() when done with it
+ *
+ * Since: 3.56
+ **/
+GPtrArray *
+message_list_get_adjacent_uids (MessageList *message_list,
+                                MessageListSelectDirection direction,
+                                guint max_count)
+{
+	ETreeTableAdapter *adapter;
+	GPtrArray *uids;
+	GNode *node;
+	gint row_count;
+	gint step;
+	gint row;
+
+	g_return_val_if_fail (IS_MESSAGE_LIST (message_list), NULL);
+
+	uids = g_ptr_array_new_with_free_func ((GDestroyNotify) camel_pstring_free);
+
+	if (message_list->cursor_uid == NULL || max_count == 0)
+		return uids;
+
+	node = g_hash_table_lookup (
+		message_list->uid_nodemap,
+		message_list->cursor_uid);
+	if (node == NULL)
+		return uids;
+
+	adapter = e_tree_get_table_adapter (E_TREE (message_list));
+	row_count = e_table_model_row_count (E_TABLE_MODEL (adapter));
+
+	row = e_tree_table_adapter_row_of_node (adapter, node);
+	if (row == -1)
+		return uids;
+
+	if ((direction & MESSAGE_LIST_SELECT_DIRECTION) == MESSAGE_LIST_SELECT_NEXT)
+		step = 1;
+	else
+		step = -1;
+
+	for (row += step; row >= 0 && row < row_count && uids->len < max_count; row += step) {
+		const gchar *uid;
+
+		node = e_tree_table_adapter_node_at_row (adapter, row);
+		if (node == NULL || node->data == NULL)
+			continue;
+
+		uid = get_message_uid (message_list, node);
+		if (uid != NULL)
+			g_ptr_array_add (uids, (gpointer) camel_pstring_strdup (uid));
+	}
+
+	return uids;
+}
+
 /**
  * message_list_select_uid:
  * @message_list:
@@ -3437,6 +3551,9 @@ message_list_dispose (GObject *object)
 		message_list->uid_nodemap = NULL;
 	}
 
+	g_clear_pointer (&priv->msgid_nodemap, g_hash_table_destroy);
+	g_clear_pointer (&priv->orphan_refs, g_hash_table_destroy);
+
 	if (priv->mail_settings) {
 		g_signal_handlers_disconnect_by_func (priv->mail_settings,
 			G_CALLBACK (message_list_localized_re_changed_cb), message_list);
@@ -4499,6 +4616,9 @@ clear_tree (MessageList *message_list,
 	message_list->uid_nodemap = g_hash_table_new (g_str_hash, g_str_equal);
 	g_clear_object (&folder);
 
+	g_clear_pointer (&message_list->priv->msgid_nodemap, g_hash_table_destroy);
+	g_clear_pointer (&message_list->priv->orphan_refs, g_hash_table_destroy);
+
 	message_list->priv->newest_read_date = 0;
 	message_list->priv->newest_read_uid = NULL;
 	message_list->priv->oldest_unread_date = 0;
@@ -5079,6 +5199,353 @@ mail_folder_hide_by_flag (CamelFolder *folder,
 	return newchanges;
 }
 
+static guint64 *
+ml_msgid_dup (guint64 msgid)
+{
+	guint64 *copy;
+
+	copy = g_new (guint64, 1);
+	*copy = msgid;
+
+	return copy;
+}
+
+static void
+ml_msgid_index_add_refs (GHashTable *orphan_refs,
+                         CamelMessageInfo *info)
+{
+	GArray *references;
+	guint ii;
+
+	references = camel_message_info_dup_references (info);
+	if (!references)
+		return;
+
+	for (ii = 0; ii < references->len; ii++) {
+		guint64 ref_msgid = g_array_index (references, guint64, ii);
+
+		if (ref_msgid && !g_hash_table_contains (orphan_refs, &ref_msgid))
+			g_hash_table_add (orphan_refs, ml_msgid_dup (ref_msgid));
+	}
+
+	g_array_unref (references);
+}
+
+static void
+ml_msgid_index_insert (MessageList *message_list,
+                       GNode *node)
+{
+	guint64 msgid;
+
+	if (!node->data)
+		return;
+
+	msgid = camel_message_info_get_message_id (node->data);
+	if (msgid && !g_hash_table_contains (message_list->priv->msgid_nodemap, &msgid)) {
+		g_hash_table_insert (
+			message_list->priv->msgid_nodemap,
+			ml_msgid_dup (msgid), node);
+	}
+
+	/* Thread roots which reference something not shown in the list
+	 * would be re-parented by a full rethreading once the referenced
+	 * message arrives, thus remember what they wait for. */
+	if (node->parent == message_list->priv->tree_model_root)
+		ml_msgid_index_add_refs (message_list->priv->orphan_refs, node->data);
+}
+
+static gboolean
+ml_msgid_index_build_cb (GNode *node,
+                         gpointer user_data)
+{
+	MessageList *message_list = user_data;
+
+	if (node != message_list->priv->tree_model_root)
+		ml_msgid_index_insert (message_list, node);
+
+	return FALSE;
+}
+
+static void
+ml_msgid_index_ensure (MessageList *message_list)
+{
+	if (message_list->priv->msgid_nodemap)
+		return;
+
+	message_list->priv->msgid_nodemap = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+	message_list->priv->orphan_refs = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+
+	g_node_traverse (
+		message_list->priv->tree_model_root,
+		G_PRE_ORDER, G_TRAVERSE_ALL, -1,
+		ml_msgid_index_build_cb, message_list);
+}
+
+static GNode *
+ml_incremental_find_parent (MessageList *message_list,
+                            CamelMessageInfo *info,
+                            gboolean thread_flat)
+{
+	GNode *parent = NULL;
+	GArray *references;
+	guint ii;
+
+	references = camel_message_info_dup_references (info);
+	if (!references)
+		return NULL;
+
+	/* The last reference is the closest ancestor. */
+	for (ii = references->len; ii > 0 && !parent; ii--) {
+		guint64 ref_msgid = g_array_index (references, guint64, ii - 1);
+
+		if (ref_msgid)
+			parent = g_hash_table_lookup (message_list->priv->msgid_nodemap, &ref_msgid);
+	}
+
+	g_array_unref (references);
+
+	if (parent && thread_flat) {
+		while (parent->parent && parent->parent != message_list->priv->tree_model_root)
+			parent = parent->parent;
+	}
+
+	return parent;
+}
+
+static void
+ml_incremental_remove_node (MessageList *message_list,
+                            GNode *node,
+                            gboolean group_by_threads)
+{
+	CamelMessageInfo *info = node->data;
+	const gchar *uid;
+	guint64 msgid;
+
+	uid = camel_message_info_get_uid (info);
+
+	if (message_list->priv->newest_read_uid == uid) {
+		message_list->priv->newest_read_uid = NULL;
+		message_list->priv->newest_read_date = 0;
+	}
+
+	if (message_list->priv->oldest_unread_uid == uid) {
+		message_list->priv->oldest_unread_uid = NULL;
+		message_list->priv->oldest_unread_date = 0;
+	}
+
+	if (message_list->priv->msgid_nodemap) {
+		msgid = camel_message_info_get_message_id (info);
+		if (msgid && g_hash_table_lookup (message_list->priv->msgid_nodemap, &msgid) == node)
+			g_hash_table_remove (message_list->priv->msgid_nodemap, &msgid);
+	}
+
+	/* Replies lose their parent; promote them one level up, the same
+	 * way the threading code does for messages with missing parents. */
+	if (group_by_threads) {
+		GNode *parent = node->parent;
+
+		while (node->children) {
+			GNode *child = node->children;
+
+			message_list_tree_model_move (message_list, child, parent);
+
+			if (parent == message_list->priv->tree_model_root && message_list->priv->orphan_refs)
+				ml_msgid_index_add_refs (message_list->priv->orphan_refs, child->data);
+		}
+	}
+
+	g_hash_table_remove (message_list->uid_nodemap, uid);
+
+	message_list_tree_model_remove (message_list, node);
+
+	g_object_unref (info);
+}
+
+static gint
+ml_incremental_compare_date_cb (gconstpointer ptr1,
+                                gconstpointer ptr2)
+{
+	CamelMessageInfo *info1 = *((CamelMessageInfo **) ptr1);
+	CamelMessageInfo *info2 = *((CamelMessageInfo **) ptr2);
+	gint64 date1, date2;
+
+	date1 = camel_message_info_get_date_sent (info1);
+	date2 = camel_message_info_get_date_sent (info2);
+
+	return date1 < date2 ? -1 : date1 > date2 ? 1 : 0;
+}
+
+/* Applies the folder changes directly to the existing tree, re-threading
+ * only the conversations touched by the change.  Returns %FALSE when the
+ * changes cannot be applied this way, in which case the caller should
+ * schedule a full regen; the tree is left in a consistent state even
+ * when this gives up half way. */
+static gboolean
+message_list_regen_incremental (MessageList *message_list,
+                                CamelFolder *folder,
+                                CamelFolderChangeInfo *changes,
+                                gboolean hide_junk,
+                                gboolean hide_deleted)
+{
+	ETreeModel *tree_model;
+	GPtrArray *added;
+	GHashTable *touched_threads = NULL;
+	CamelMessageFlags hide_flags = 0;
+	gboolean group_by_threads;
+	gboolean thread_flat;
+	gboolean success = TRUE;
+	guint ii;
+
+	if (message_list->just_set_folder ||
+	    message_list->priv->tree_model_root == NULL ||
+	    message_list_is_searching (message_list))
+		return FALSE;
+
+	if (changes->uid_added->len + changes->uid_removed->len > INCREMENTAL_REGEN_MAX_CHANGES)
+		return FALSE;
+
+	group_by_threads = message_list_get_group_by_threads (message_list);
+	thread_flat = message_list_get_thread_flat (message_list);
+
+	/* Subject threading and the latest-message swap in flat threads
+	 * depend on the whole folder content. */
+	if (group_by_threads && (message_list_get_thread_subject (message_list) ||
+	    (thread_flat && message_list_get_thread_latest (message_list))))
+		return FALSE;
+
+	/* The full regen moves the cursor to the next selectable message,
+	 * let it deal with the currently shown message going away. */
+	if (message_list->cursor_uid) {
+		for (ii = 0; ii < changes->uid_removed->len; ii++) {
+			if (g_strcmp0 (message_list->cursor_uid, changes->uid_removed->pdata[ii]) == 0)
+				return FALSE;
+		}
+	}
+
+	if (group_by_threads && thread_flat) {
+		for (ii = 0; ii < changes->uid_removed->len; ii++) {
+			GNode *node;
+
+			node = g_hash_table_lookup (message_list->uid_nodemap, changes->uid_removed->pdata[ii]);
+			if (node && node->children)
+				return FALSE;
+		}
+	}
+
+	if (hide_junk)
+		hide_flags |= CAMEL_MESSAGE_JUNK;
+	if (hide_deleted)
+		hide_flags |= CAMEL_MESSAGE_DELETED;
+
+	added = g_ptr_array_new_with_free_func (g_object_unref);
+
+	for (ii = 0; ii < changes->uid_added->len; ii++) {
+		const gchar *uid = changes->uid_added->pdata[ii];
+		CamelMessageInfo *info;
+
+		if (g_hash_table_contains (message_list->uid_nodemap, uid))
+			continue;
+
+		info = camel_folder_get_message_info (folder, uid);
+		if (!info)
+			continue;
+
+		if ((camel_message_info_get_flags (info) & hide_flags) != 0) {
+			g_object_unref (info);
+			continue;
+		}
+
+		g_ptr_array_add (added, info);
+	}
+
+	if (group_by_threads) {
+		ml_msgid_index_ensure (message_list);
+
+		/* Insert parents before their replies. */
+		g_ptr_array_sort (added, ml_incremental_compare_date_cb);
+
+		touched_threads = g_hash_table_new (g_direct_hash, g_direct_equal);
+	}
+
+	for (ii = 0; ii < changes->uid_removed->len; ii++) {
+		GNode *node;
+
+		node = g_hash_table_lookup (message_list->uid_nodemap, changes->uid_removed->pdata[ii]);
+		if (node)
+			ml_incremental_remove_node (message_list, node, group_by_threads);
+	}
+
+	for (ii = 0; ii < added->len && success; ii++) {
+		CamelMessageInfo *info = added->pdata[ii];
+		GNode *parent = NULL;
+		GNode *node;
+
+		if (group_by_threads) {
+			guint64 msgid;
+
+			/* An existing thread root waits for this message as its
+			 * ancestor; only a full rethreading can move it. */
+			msgid = camel_message_info_get_message_id (info);
+			if (msgid && g_hash_table_contains (message_list->priv->orphan_refs, &msgid)) {
+				success = FALSE;
+				break;
+			}
+
+			parent = ml_incremental_find_parent (message_list, info, thread_flat);
+		}
+
+		node = ml_uid_nodemap_insert (message_list, info, parent, -1);
+
+		if (group_by_threads) {
+			GNode *thread_root = node;
+
+			ml_msgid_index_insert (message_list, node);
+
+			while (thread_root->parent && thread_root->parent != message_list->priv->tree_model_root)
+				thread_root = thread_root->parent;
+
+			if (thread_root != node)
+				g_hash_table_add (touched_threads, thread_root);
+		}
+	}
+
+	tree_model = E_TREE_MODEL (message_list);
+
+	if (touched_threads) {
+		GHashTableIter iter;
+		gpointer key;
+
+		/* Thread roots sort by their subtree content (latest message,
+		 * collapsed flags and such), thus let them be re-evaluated. */
+		g_hash_table_iter_init (&iter, touched_threads);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			e_tree_model_pre_change (tree_model);
+			e_tree_model_node_data_changed (tree_model, key);
+		}
+
+		g_hash_table_destroy (touched_threads);
+	}
+
+	g_ptr_array_unref (added);
+
+	for (ii = 0; ii < changes->uid_changed->len; ii++) {
+		GNode *node;
+
+		node = g_hash_table_lookup (message_list->uid_nodemap, changes->uid_changed->pdata[ii]);
+		if (node) {
+			e_tree_model_pre_change (tree_model);
+			e_tree_model_node_data_changed (tree_model, node);
+
+			message_list_change_first_visible_parent (message_list, node);
+		}
+	}
+
+	if (success)
+		message_list_update_tree_text (message_list);
+
+	return success;
+}
+
 static void
 message_list_folder_changed (CamelFolder *folder,
 			     CamelFolderChangeInfo *changes,
@@ -5150,6 +5617,12 @@ message_list_folder_changed (CamelFolder *folder,
 				}
 			}
 
+			g_signal_emit (
+				message_list,
+				signals[MESSAGE_LIST_BUILT], 0);
+
+			need_list_regen = FALSE;
+		} else if (message_list_regen_incremental (message_list, folder, altered_changes, hide_junk, hide_deleted)) {
 			g_signal_emit (
 				message_list,
 				signals[MESSAGE_LIST_BUILT], 0);
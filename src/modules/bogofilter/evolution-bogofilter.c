@@ -17,8 +17,11 @@
 
 #include "evolution-config.h"
 
+#include <fcntl.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <glib/gstdio.h>
 #include <glib/gi18n-lib.h>
 
 #include <camel/camel.h>
@@ -37,6 +40,11 @@
 #define BOGOFILTER_EXIT_STATUS_UNSURE		2
 #define BOGOFILTER_EXIT_STATUS_ERROR		3
 
+/* How long to spawn a process per message after the bulk mode failed */
+#define BOGOFILTER_BULK_RETRY_INTERVAL		(60 * G_USEC_PER_SEC)
+/* How many seconds to wait for a response of the bulk process */
+#define BOGOFILTER_BULK_TIMEOUT			30
+
 typedef struct _EBogofilter EBogofilter;
 typedef struct _EBogofilterClass EBogofilterClass;
 
@@ -44,6 +52,17 @@ struct _EBogofilter {
 	EMailJunkFilter parent;
 	gboolean convert_to_unicode;
 	gchar *command;
+
+	/* A long-running 'bogofilter -b', which classifies messages
+	 * saved in the bulk_tmpdir, without starting a new process
+	 * and opening the wordlist for each of them. */
+	GMutex bulk_lock;
+	GSubprocess *bulk_process;
+	GDataInputStream *bulk_stdout;
+	gchar *bulk_argv_key;
+	gchar *bulk_tmpdir;
+	guint bulk_counter;
+	gint64 bulk_disabled_until;
 };
 
 struct _EBogofilterClass {
@@ -228,6 +247,229 @@ bogofilter_command (const gchar **argv,
 	return source_data.exit_code;
 }
 
+/* Call with the bulk_lock held */
+static void
+bogofilter_bulk_stop_locked (EBogofilter *extension)
+{
+	if (extension->bulk_process) {
+		g_subprocess_force_exit (extension->bulk_process);
+		g_clear_object (&extension->bulk_process);
+	}
+
+	g_clear_object (&extension->bulk_stdout);
+	g_clear_pointer (&extension->bulk_argv_key, g_free);
+
+	if (extension->bulk_tmpdir) {
+		g_rmdir (extension->bulk_tmpdir);
+		g_clear_pointer (&extension->bulk_tmpdir, g_free);
+	}
+}
+
+/* Call with the bulk_lock held */
+static gboolean
+bogofilter_bulk_start_locked (EBogofilter *extension,
+                              const gchar **argv,
+                              GError **error)
+{
+	gchar *argv_key;
+
+	argv_key = g_strjoinv (" ", (gchar **) argv);
+
+	/* Restart it when the command or the options changed */
+	if (extension->bulk_process && g_strcmp0 (argv_key, extension->bulk_argv_key) != 0)
+		bogofilter_bulk_stop_locked (extension);
+
+	if (extension->bulk_process) {
+		g_free (argv_key);
+		return TRUE;
+	}
+
+	extension->bulk_tmpdir = g_dir_make_tmp ("evolution-bogofilter-XXXXXX", error);
+
+	if (extension->bulk_tmpdir) {
+		extension->bulk_process = g_subprocess_newv (
+			argv,
+			G_SUBPROCESS_FLAGS_STDIN_PIPE |
+			G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+			G_SUBPROCESS_FLAGS_STDERR_SILENCE,
+			error);
+	}
+
+	if (!extension->bulk_process) {
+		g_prefix_error (
+			error, _("Failed to spawn Bogofilter (%s): "),
+			argv_key);
+		g_free (argv_key);
+		bogofilter_bulk_stop_locked (extension);
+
+		return FALSE;
+	}
+
+	extension->bulk_stdout = g_data_input_stream_new (
+		g_subprocess_get_stdout_pipe (extension->bulk_process));
+	g_data_input_stream_set_newline_type (
+		extension->bulk_stdout, G_DATA_STREAM_NEWLINE_TYPE_LF);
+	extension->bulk_argv_key = argv_key;
+
+	return TRUE;
+}
+
+static void
+bogofilter_bulk_cancelled_cb (GCancellable *cancellable,
+                              gpointer user_data)
+{
+	g_cancellable_cancel (user_data);
+}
+
+static gboolean
+bogofilter_bulk_timeout_cb (gpointer user_data)
+{
+	g_cancellable_cancel (user_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Classifies the message with the long-running 'bogofilter -b', which
+ * reads names of the files to classify on its standard input and writes
+ * one line with the file name and the result for each of them. */
+static CamelJunkStatus
+bogofilter_bulk_classify (EBogofilter *extension,
+                          const gchar **argv,
+                          CamelMimeMessage *message,
+                          GCancellable *cancellable,
+                          GError **error)
+{
+	CamelJunkStatus status = CAMEL_JUNK_STATUS_ERROR;
+	CamelStream *stream;
+	GOutputStream *stdin_pipe;
+	GCancellable *watchdog;
+	GSource *timeout_source;
+	gchar *filename = NULL, *request = NULL, *line = NULL;
+	gulong cancelled_id = 0;
+	gboolean success, timed_out = FALSE;
+	GError *local_error = NULL;
+
+	g_mutex_lock (&extension->bulk_lock);
+
+	if (extension->bulk_disabled_until > g_get_monotonic_time ()) {
+		g_mutex_unlock (&extension->bulk_lock);
+		g_set_error_literal (
+			error, CAMEL_ERROR, CAMEL_ERROR_GENERIC,
+			_("Bogofilter bulk mode is not available"));
+		return CAMEL_JUNK_STATUS_ERROR;
+	}
+
+	if (!bogofilter_bulk_start_locked (extension, argv, error))
+		goto exit;
+
+	filename = g_strdup_printf ("%s" G_DIR_SEPARATOR_S "%u.eml",
+		extension->bulk_tmpdir, ++extension->bulk_counter);
+
+	stream = camel_stream_fs_new_with_name (filename, O_WRONLY | O_CREAT | O_TRUNC, 0600, error);
+	if (!stream)
+		goto exit;
+
+	success = camel_data_wrapper_write_to_stream_sync (
+		CAMEL_DATA_WRAPPER (message), stream, cancellable, error) >= 0 &&
+		camel_stream_close (stream, cancellable, error) == 0;
+	g_object_unref (stream);
+
+	if (!success)
+		goto exit;
+
+	request = g_strconcat (filename, "\n", NULL);
+	stdin_pipe = g_subprocess_get_stdin_pipe (extension->bulk_process);
+
+	/* Do not wait forever for a stuck process with the bulk_lock held;
+	 * the watchdog is cancelled either by the caller or by the timer. */
+	watchdog = g_cancellable_new ();
+
+	if (cancellable)
+		cancelled_id = g_cancellable_connect (cancellable, G_CALLBACK (bogofilter_bulk_cancelled_cb), watchdog, NULL);
+
+	timeout_source = g_timeout_source_new_seconds (BOGOFILTER_BULK_TIMEOUT);
+	g_source_set_callback (timeout_source, bogofilter_bulk_timeout_cb, g_object_ref (watchdog), g_object_unref);
+	g_source_set_name (timeout_source, "[evolution] bogofilter_bulk_timeout_cb");
+	g_source_attach (timeout_source, NULL);
+
+	if (g_output_stream_write_all (stdin_pipe, request, strlen (request), NULL, watchdog, &local_error) &&
+	    g_output_stream_flush (stdin_pipe, watchdog, &local_error))
+		line = g_data_input_stream_read_line (extension->bulk_stdout, NULL, watchdog, &local_error);
+
+	g_source_destroy (timeout_source);
+	g_source_unref (timeout_source);
+
+	if (cancelled_id)
+		g_cancellable_disconnect (cancellable, cancelled_id);
+
+	if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED) &&
+	    !g_cancellable_is_cancelled (cancellable)) {
+		timed_out = TRUE;
+		g_clear_error (&local_error);
+		g_set_error_literal (
+			&local_error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+			_("Bogofilter did not respond in time"));
+	}
+
+	g_object_unref (watchdog);
+
+	if (local_error) {
+		g_propagate_error (error, local_error);
+		goto exit;
+	}
+
+	/* The response is like "<filename> S 0.999", with the first letter
+	 * of Spam, Ham or Unsure, because of the terse output format */
+	if (line && g_str_has_prefix (line, filename)) {
+		const gchar *result = line + strlen (filename);
+
+		while (*result == ' ' || *result == '\t')
+			result++;
+
+		if (*result == 'S')
+			status = CAMEL_JUNK_STATUS_MESSAGE_IS_JUNK;
+		else if (*result == 'H')
+			status = CAMEL_JUNK_STATUS_MESSAGE_IS_NOT_JUNK;
+		else if (*result == 'U')
+			status = CAMEL_JUNK_STATUS_INCONCLUSIVE;
+	}
+
+	if (status == CAMEL_JUNK_STATUS_ERROR && (!error || !*error))
+		g_set_error (
+			error, CAMEL_ERROR, CAMEL_ERROR_GENERIC,
+			_("Unexpected response from Bogofilter: %s"),
+			line ? line : "");
+
+exit:
+	if (filename)
+		g_unlink (filename);
+
+	/* The process state is unknown after any failure; a stuck process
+	 * is killed and a new one is started for the next message */
+	if (status == CAMEL_JUNK_STATUS_ERROR) {
+		bogofilter_bulk_stop_locked (extension);
+
+		if (!timed_out && !g_cancellable_is_cancelled (cancellable))
+			extension->bulk_disabled_until = g_get_monotonic_time () + BOGOFILTER_BULK_RETRY_INTERVAL;
+	}
+
+	g_mutex_unlock (&extension->bulk_lock);
+
+	g_free (filename);
+	g_free (request);
+	g_free (line);
+
+	return status;
+}
+
+static void
+bogofilter_bulk_stop (EBogofilter *extension)
+{
+	g_mutex_lock (&extension->bulk_lock);
+	bogofilter_bulk_stop_locked (extension);
+	g_mutex_unlock (&extension->bulk_lock);
+}
+
 static void
 bogofilter_init_wordlist (EBogofilter *extension)
 {
@@ -344,6 +586,9 @@ bogofilter_finalize (GObject *object)
 {
 	EBogofilter *extension = E_BOGOFILTER (object);
 
+	bogofilter_bulk_stop_locked (extension);
+	g_mutex_clear (&extension->bulk_lock);
+
 	g_free (extension->command);
 	extension->command = NULL;
 
@@ -399,6 +644,7 @@ bogofilter_classify (CamelJunkFilter *junk_filter,
 	EBogofilter *extension = E_BOGOFILTER (junk_filter);
 	static gboolean wordlist_initialized = FALSE;
 	CamelJunkStatus status = CAMEL_JUNK_STATUS_ERROR;
+	GError *local_error = NULL;
 	gint exit_code;
 
 	const gchar *argv[] = {
@@ -407,8 +653,33 @@ bogofilter_classify (CamelJunkFilter *junk_filter,
 		NULL
 	};
 
-	if (bogofilter_get_convert_to_unicode (extension))
+	const gchar *bulk_argv[] = {
+		bogofilter_get_command_path (extension),
+		"-b",
+		"-T",
+		NULL,  /* leave room for unicode option */
+		NULL
+	};
+
+	if (bogofilter_get_convert_to_unicode (extension)) {
 		argv[1] = "--unicode=yes";
+		bulk_argv[3] = "--unicode=yes";
+	}
+
+	status = bogofilter_bulk_classify (extension, bulk_argv, message, cancellable, &local_error);
+
+	if (status != CAMEL_JUNK_STATUS_ERROR)
+		return status;
+
+	if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_propagate_error (error, local_error);
+		return CAMEL_JUNK_STATUS_ERROR;
+	}
+
+	/* Fall back to a process per message, which also
+	 * initializes the wordlist when it is missing */
+	g_debug ("%s: %s", G_STRFUNC, local_error ? local_error->message : "Unknown error");
+	g_clear_error (&local_error);
 
 retry:
 	exit_code = bogofilter_command (argv, message, cancellable, error);
@@ -467,6 +738,9 @@ bogofilter_learn_junk (CamelJunkFilter *junk_filter,
 		NULL
 	};
 
+	/* Let the bulk process reopen the changed wordlist */
+	bogofilter_bulk_stop (extension);
+
 	if (bogofilter_get_convert_to_unicode (extension))
 		argv[2] = "--unicode=yes";
 
@@ -502,6 +776,9 @@ bogofilter_learn_not_junk (CamelJunkFilter *junk_filter,
 		NULL
 	};
 
+	/* Let the bulk process reopen the changed wordlist */
+	bogofilter_bulk_stop (extension);
+
 	if (bogofilter_get_convert_to_unicode (extension))
 		argv[2] = "--unicode=yes";
 
@@ -577,6 +854,8 @@ e_bogofilter_init (EBogofilter *extension)
 {
 	GSettings *settings;
 
+	g_mutex_init (&extension->bulk_lock);
+
 	settings = e_util_ref_settings ("org.gnome.evolution.bogofilter");
 	g_settings_bind (
 		settings, "utf8-for-spam-filter",
@@ -20,6 +20,7 @@
 #include "e-autosave-utils.h"
 
 #include <errno.h>
+#include <string.h>
 #include <glib/gstdio.h>
 #include <camel/camel.h>
 
@@ -29,13 +30,52 @@
 #define SNAPSHOT_FILE_PREFIX	".evolution-composer.autosave"
 #define SNAPSHOT_FILE_SEED	SNAPSHOT_FILE_PREFIX "-XXXXXX"
 
+/* The snapshot file holds the whole message, while the journal file
+ * next to it gets appended the message without its attachments, as
+ * long as the attachments do not change. Each journal record is
+ * "<base-token> <length>\n<message>\n" and is valid only with the
+ * snapshot file carrying the same token in the SNAPSHOT_BASE_HEADER. */
+#define SNAPSHOT_STATE_KEY	"e-composer-snapshot-state"
+#define SNAPSHOT_JOURNAL_SUFFIX	".journal"
+#define SNAPSHOT_BASE_HEADER	"X-Evolution-Autosave-Base"
+
+/* The snapshot is written whole again once the journal gets this big */
+#define JOURNAL_MAX_RECORDS	50
+#define JOURNAL_MAX_SIZE	(4 * 1024 * 1024)
+
+/* Serializes the writes to the snapshot and journal files; the order
+ * of the writes of one composer is kept by its SnapshotState. */
+G_LOCK_DEFINE_STATIC (journal);
+
 typedef struct _SaveContext SaveContext;
+typedef struct _SnapshotState SnapshotState;
+typedef struct _WriteData WriteData;
 
 struct _SaveContext {
 	GCancellable *cancellable;
 	GFile *snapshot_file;
 };
 
+/* What the files on the disk hold for a composer; main thread only.
+ * Only one write runs at a time, the next waits in the pending_task. */
+struct _SnapshotState {
+	gchar *base_token; /* of the last written snapshot file; NULL, when the next save should be a full one */
+	GPtrArray *attachments; /* CamelMimePart *, in the snapshot file */
+	guint n_records;
+	gsize journal_size;
+
+	gboolean writing;
+	GTask *pending_task;
+	CamelMimeMessage *pending_message;
+};
+
+struct _WriteData {
+	GFile *snapshot_file;
+	gchar *base_token;
+	GPtrArray *attachments; /* for full writes */
+	gboolean is_delta;
+};
+
 static void
 save_context_free (SaveContext *context)
 {
@@ -45,13 +85,235 @@ save_context_free (SaveContext *context)
 	g_free (context);
 }
 
+static void
+snapshot_state_free (SnapshotState *state)
+{
+	if (state) {
+		g_free (state->base_token);
+		g_clear_pointer (&state->attachments, g_ptr_array_unref);
+		g_clear_object (&state->pending_task);
+		g_clear_object (&state->pending_message);
+		g_free (state);
+	}
+}
+
+static SnapshotState *
+snapshot_state_get (EMsgComposer *composer)
+{
+	SnapshotState *state;
+
+	state = g_object_get_data (G_OBJECT (composer), SNAPSHOT_STATE_KEY);
+	if (!state) {
+		state = g_new0 (SnapshotState, 1);
+
+		g_object_set_data_full (G_OBJECT (composer), SNAPSHOT_STATE_KEY,
+			state, (GDestroyNotify) snapshot_state_free);
+	}
+
+	return state;
+}
+
+static void
+write_data_free (WriteData *wd)
+{
+	if (wd) {
+		g_clear_object (&wd->snapshot_file);
+		g_free (wd->base_token);
+		g_clear_pointer (&wd->attachments, g_ptr_array_unref);
+		g_free (wd);
+	}
+}
+
+static GFile *
+snapshot_journal_file_new (GFile *snapshot_file)
+{
+	GFile *journal_file;
+	gchar *path, *journal_path;
+
+	path = g_file_get_path (snapshot_file);
+	journal_path = g_strconcat (path, SNAPSHOT_JOURNAL_SUFFIX, NULL);
+	journal_file = g_file_new_for_path (journal_path);
+
+	g_free (journal_path);
+	g_free (path);
+
+	return journal_file;
+}
+
 static void
 delete_snapshot_file (GFile *snapshot_file)
 {
+	GFile *journal_file;
+
+	journal_file = snapshot_journal_file_new (snapshot_file);
+	g_file_delete (journal_file, NULL, NULL);
+	g_object_unref (journal_file);
+
 	g_file_delete (snapshot_file, NULL, NULL);
 	g_object_unref (snapshot_file);
 }
 
+/* Returns the attachment parts of the draft 'message', or NULL, when
+   it has none. The first part of a multipart/mixed draft is the body. */
+static GPtrArray *
+snapshot_dup_attachments (CamelMimeMessage *message)
+{
+	CamelDataWrapper *content;
+	CamelMultipart *multipart;
+	GPtrArray *attachments;
+	guint ii, n_parts;
+
+	content = camel_medium_get_content (CAMEL_MEDIUM (message));
+
+	if (!CAMEL_IS_MULTIPART (content) ||
+	    !camel_content_type_is (camel_data_wrapper_get_mime_type_field (content), "multipart", "mixed"))
+		return NULL;
+
+	multipart = CAMEL_MULTIPART (content);
+	n_parts = camel_multipart_get_number (multipart);
+
+	if (n_parts < 2)
+		return NULL;
+
+	attachments = g_ptr_array_new_full (n_parts - 1, g_object_unref);
+
+	for (ii = 1; ii < n_parts; ii++) {
+		g_ptr_array_add (attachments, g_object_ref (camel_multipart_get_part (multipart, ii)));
+	}
+
+	return attachments;
+}
+
+/* The composer reuses the attachments' CamelMimePart-s for each draft */
+static gboolean
+snapshot_attachments_equal (GPtrArray *attachments1,
+			    GPtrArray *attachments2)
+{
+	guint ii;
+
+	if (!attachments1 || !attachments2 || attachments1->len != attachments2->len)
+		return FALSE;
+
+	for (ii = 0; ii < attachments1->len; ii++) {
+		if (g_ptr_array_index (attachments1, ii) != g_ptr_array_index (attachments2, ii))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Replaces the content of the 'message' with its body, dropping the attachments */
+static void
+snapshot_strip_attachments (CamelMimeMessage *message)
+{
+	CamelMultipart *multipart;
+	CamelMimePart *body;
+
+	multipart = CAMEL_MULTIPART (camel_medium_get_content (CAMEL_MEDIUM (message)));
+	body = g_object_ref (camel_multipart_get_part (multipart, 0));
+
+	camel_medium_set_content (CAMEL_MEDIUM (message), camel_medium_get_content (CAMEL_MEDIUM (body)));
+	camel_mime_part_set_encoding (CAMEL_MIME_PART (message), camel_mime_part_get_encoding (body));
+
+	g_object_unref (body);
+}
+
+/* Puts the attachments of the 'base' message after the body of the 'delta' */
+static void
+snapshot_graft_attachments (CamelMimeMessage *delta,
+			    CamelMimeMessage *base)
+{
+	CamelMultipart *base_multipart, *multipart;
+	CamelMimePart *body;
+	guint ii, n_parts;
+
+	if (!CAMEL_IS_MULTIPART (camel_medium_get_content (CAMEL_MEDIUM (base))))
+		return;
+
+	base_multipart = CAMEL_MULTIPART (camel_medium_get_content (CAMEL_MEDIUM (base)));
+	n_parts = camel_multipart_get_number (base_multipart);
+
+	body = camel_mime_part_new ();
+	camel_medium_set_content (CAMEL_MEDIUM (body), camel_medium_get_content (CAMEL_MEDIUM (delta)));
+	camel_mime_part_set_encoding (body, camel_mime_part_get_encoding (CAMEL_MIME_PART (delta)));
+
+	multipart = camel_multipart_new ();
+	camel_data_wrapper_set_mime_type (CAMEL_DATA_WRAPPER (multipart), "multipart/mixed");
+	camel_multipart_set_boundary (multipart, NULL);
+	camel_multipart_add_part (multipart, body);
+
+	for (ii = 1; ii < n_parts; ii++) {
+		camel_multipart_add_part (multipart, camel_multipart_get_part (base_multipart, ii));
+	}
+
+	camel_medium_set_content (CAMEL_MEDIUM (delta), CAMEL_DATA_WRAPPER (multipart));
+
+	g_object_unref (multipart);
+	g_object_unref (body);
+}
+
+/* Returns the last complete journal record belonging to the 'base_token' */
+static CamelMimeMessage *
+snapshot_journal_parse_last (const gchar *contents,
+			     gsize length,
+			     const gchar *base_token)
+{
+	CamelMimeMessage *message;
+	CamelStream *camel_stream;
+	const gchar *record = NULL;
+	gsize record_length = 0, pos = 0;
+
+	while (pos < length) {
+		const gchar *eol;
+		gchar *line, *space;
+		guint64 size;
+
+		eol = memchr (contents + pos, '\n', length - pos);
+		if (!eol)
+			break;
+
+		line = g_strndup (contents + pos, eol - contents - pos);
+		space = strchr (line, ' ');
+
+		if (!space) {
+			g_free (line);
+			break;
+		}
+
+		*space = '\0';
+		size = g_ascii_strtoull (space + 1, NULL, 10);
+		pos = eol - contents + 1;
+
+		/* A record cut by a crash can be only at the end */
+		if (size > length - pos) {
+			g_free (line);
+			break;
+		}
+
+		if (g_strcmp0 (line, base_token) == 0) {
+			record = contents + pos;
+			record_length = size;
+		}
+
+		pos += size + 1;
+
+		g_free (line);
+	}
+
+	if (!record)
+		return NULL;
+
+	message = camel_mime_message_new ();
+	camel_stream = camel_stream_mem_new_with_buffer (record, record_length);
+
+	if (!camel_data_wrapper_construct_from_stream_sync (CAMEL_DATA_WRAPPER (message), camel_stream, NULL, NULL))
+		g_clear_object (&message);
+
+	g_object_unref (camel_stream);
+
+	return message;
+}
+
 static GFile *
 create_snapshot_file (EMsgComposer *composer,
                       GError **error)
@@ -152,6 +414,7 @@ load_snapshot_loaded_cb (GObject *source_object,
 	CamelStream *camel_stream;
 	gchar *contents = NULL;
 	gsize length;
+	const gchar *base_token;
 	CreateComposerData *ccd;
 	GError *local_error = NULL;
 
@@ -185,6 +448,33 @@ load_snapshot_loaded_cb (GObject *source_object,
 		return;
 	}
 
+	/* Apply the newest journal record, if any; it carries the current
+	 * message headers and body, while the attachments are taken from
+	 * the snapshot file. */
+	base_token = camel_medium_get_header (CAMEL_MEDIUM (message), SNAPSHOT_BASE_HEADER);
+	if (base_token && *base_token) {
+		GFile *journal_file;
+
+		journal_file = snapshot_journal_file_new (snapshot_file);
+
+		if (g_file_load_contents (journal_file, g_task_get_cancellable (task), &contents, &length, NULL, NULL)) {
+			CamelMimeMessage *delta;
+
+			delta = snapshot_journal_parse_last (contents, length, base_token);
+			if (delta) {
+				snapshot_graft_attachments (delta, message);
+				g_object_unref (message);
+				message = delta;
+			}
+
+			g_free (contents);
+		}
+
+		g_object_unref (journal_file);
+	}
+
+	camel_medium_remove_header (CAMEL_MEDIUM (message), SNAPSHOT_BASE_HEADER);
+
 	/* Create a new composer window from the loaded message and
 	 * restore its snapshot file so it continues auto-saving to
 	 * the same file. */
@@ -199,6 +489,8 @@ load_snapshot_loaded_cb (GObject *source_object,
 	e_msg_composer_new (shell, autosave_composer_created_cb, task);
 }
 
+static void save_snapshot_write (GTask *parent_task, CamelMimeMessage *message);
+
 static void
 save_snapshot_splice_cb (GObject *source_object,
                          GAsyncResult *result,
@@ -206,6 +498,9 @@ save_snapshot_splice_cb (GObject *source_object,
 {
 	GTask *parent_task;
 	CamelDataWrapper *data_wrapper;
+	SnapshotState *state;
+	WriteData *wd;
+	gssize bytes_written;
 	GError *local_error = NULL;
 
 	parent_task = G_TASK (user_data);
@@ -213,16 +508,113 @@ save_snapshot_splice_cb (GObject *source_object,
 
 	g_return_if_fail (g_task_is_valid (result, data_wrapper));
 
-	g_task_propagate_int (G_TASK (result), &local_error);
+	wd = g_task_get_task_data (G_TASK (result));
+	state = snapshot_state_get (E_MSG_COMPOSER (g_task_get_source_object (parent_task)));
 
-	if (local_error != NULL)
+	bytes_written = g_task_propagate_int (G_TASK (result), &local_error);
+
+	state->writing = FALSE;
+
+	if (local_error != NULL) {
+		/* Not knowing what made it to the disk, write it whole next time */
+		g_clear_pointer (&state->base_token, g_free);
+		g_clear_pointer (&state->attachments, g_ptr_array_unref);
 		g_task_return_error (parent_task, g_steal_pointer (&local_error));
-	else
+	} else if (wd->is_delta) {
+		state->n_records++;
+		state->journal_size += MAX (bytes_written, 0);
+		g_task_return_boolean (parent_task, TRUE);
+	} else {
+		/* The snapshot file is on the disk, deltas can use it from now on */
+		g_free (state->base_token);
+		state->base_token = g_steal_pointer (&wd->base_token);
+		g_clear_pointer (&state->attachments, g_ptr_array_unref);
+		state->attachments = g_steal_pointer (&wd->attachments);
+		state->n_records = 0;
+		state->journal_size = 0;
 		g_task_return_boolean (parent_task, TRUE);
+	}
+
+	if (state->pending_task) {
+		GTask *pending_task = g_steal_pointer (&state->pending_task);
+		CamelMimeMessage *pending_message = g_steal_pointer (&state->pending_message);
+
+		save_snapshot_write (pending_task, pending_message);
+
+		g_object_unref (pending_message);
+	}
 
 	g_object_unref (parent_task);
 }
 
+static void
+append_message_to_journal (GTask *task,
+			   CamelDataWrapper *message,
+			   WriteData *wd,
+			   GCancellable *cancellable)
+{
+	GFileOutputStream *file_output_stream;
+	GOutputStream *mem_stream;
+	GFile *journal_file;
+	GString *record_header;
+	gsize bytes_written = 0;
+	GError *local_error = NULL;
+
+	mem_stream = g_memory_output_stream_new_resizable ();
+
+	if (camel_data_wrapper_decode_to_output_stream_sync (message, mem_stream, cancellable, &local_error) < 0 ||
+	    !g_output_stream_close (mem_stream, cancellable, &local_error)) {
+		g_object_unref (mem_stream);
+		g_task_return_error (task, local_error);
+		return;
+	}
+
+	record_header = g_string_new (NULL);
+	g_string_printf (record_header, "%s %" G_GSIZE_FORMAT "\n", wd->base_token,
+		g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (mem_stream)));
+
+	journal_file = snapshot_journal_file_new (wd->snapshot_file);
+
+	G_LOCK (journal);
+
+	file_output_stream = g_file_append_to (journal_file, G_FILE_CREATE_PRIVATE, cancellable, &local_error);
+
+	if (file_output_stream) {
+		GOutputStream *output_stream = G_OUTPUT_STREAM (file_output_stream);
+		gsize written = 0;
+
+		/* Not cancellable, a record cut in the middle would
+		 * make the records appended after it unreadable. */
+		if (g_output_stream_write_all (output_stream, record_header->str, record_header->len, &written, NULL, &local_error)) {
+			bytes_written += written;
+
+			if (g_output_stream_write_all (output_stream,
+				g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (mem_stream)),
+				g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (mem_stream)),
+				&written, NULL, &local_error)) {
+				bytes_written += written;
+
+				if (g_output_stream_write_all (output_stream, "\n", 1, &written, NULL, &local_error))
+					bytes_written += written;
+			}
+		}
+
+		g_output_stream_close (output_stream, NULL, local_error ? NULL : &local_error);
+		g_object_unref (file_output_stream);
+	}
+
+	G_UNLOCK (journal);
+
+	g_object_unref (journal_file);
+	g_string_free (record_header, TRUE);
+	g_object_unref (mem_stream);
+
+	if (local_error != NULL)
+		g_task_return_error (task, local_error);
+	else
+		g_task_return_int (task, bytes_written);
+}
+
 static void
 write_message_to_stream_thread (GTask *task,
 				gpointer source_object,
@@ -231,16 +623,24 @@ write_message_to_stream_thread (GTask *task,
 {
 	GFileOutputStream *file_output_stream;
 	GOutputStream *output_stream;
-	GFile *snapshot_file;
+	WriteData *wd = task_data;
+	GFile *journal_file;
 	gssize bytes_written;
 	GError *local_error = NULL;
 
-	snapshot_file = task_data;
+	if (wd->is_delta) {
+		append_message_to_journal (task, CAMEL_DATA_WRAPPER (source_object), wd, cancellable);
+		return;
+	}
+
+	G_LOCK (journal);
 
-	file_output_stream = g_file_replace (snapshot_file, NULL, FALSE,
+	file_output_stream = g_file_replace (wd->snapshot_file, NULL, FALSE,
 		G_FILE_CREATE_PRIVATE, cancellable, &local_error);
 
 	if (!file_output_stream) {
+		G_UNLOCK (journal);
+
 		if (local_error)
 			g_task_return_error (task, local_error);
 		else
@@ -259,6 +659,16 @@ write_message_to_stream_thread (GTask *task,
 
 	g_object_unref (file_output_stream);
 
+	/* The records belong to the previous snapshot, thus
+	 * they are ignored on load anyway; this compacts it. */
+	if (local_error == NULL) {
+		journal_file = snapshot_journal_file_new (wd->snapshot_file);
+		g_file_delete (journal_file, NULL, NULL);
+		g_object_unref (journal_file);
+	}
+
+	G_UNLOCK (journal);
+
 	if (local_error != NULL) {
 		g_task_return_error (task, local_error);
 	} else {
@@ -266,20 +676,72 @@ write_message_to_stream_thread (GTask *task,
 	}
 }
 
+/* Writes the 'message' either whole or as a journal record, depending on
+ * what the last finished write put on the disk; the 'parent_task' is
+ * completed in the save_snapshot_splice_cb(). */
+static void
+save_snapshot_write (GTask *parent_task,
+                     CamelMimeMessage *message)
+{
+	EMsgComposer *composer;
+	SaveContext *context;
+	SnapshotState *state;
+	GPtrArray *attachments;
+	GTask *task;
+	WriteData *wd;
+
+	composer = E_MSG_COMPOSER (g_task_get_source_object (parent_task));
+	context = g_task_get_task_data (parent_task);
+	state = snapshot_state_get (composer);
+	attachments = snapshot_dup_attachments (message);
+
+	wd = g_new0 (WriteData, 1);
+	wd->snapshot_file = g_object_ref (context->snapshot_file);
+
+	/* With unchanged attachments only the rest of the message is
+	 * appended to the journal; a message without attachments is
+	 * small, thus it is always written whole. */
+	wd->is_delta = attachments && state->base_token &&
+		state->n_records < JOURNAL_MAX_RECORDS &&
+		state->journal_size < JOURNAL_MAX_SIZE &&
+		snapshot_attachments_equal (attachments, state->attachments);
+
+	if (wd->is_delta) {
+		snapshot_strip_attachments (message);
+		wd->base_token = g_strdup (state->base_token);
+		g_clear_pointer (&attachments, g_ptr_array_unref);
+	} else {
+		wd->base_token = e_util_generate_uid ();
+		wd->attachments = g_steal_pointer (&attachments);
+
+		camel_medium_set_header (CAMEL_MEDIUM (message), SNAPSHOT_BASE_HEADER, wd->base_token);
+	}
+
+	state->writing = TRUE;
+
+	task = g_task_new (message, g_task_get_cancellable (parent_task),
+		save_snapshot_splice_cb, parent_task);
+
+	g_task_set_task_data (task, wd, (GDestroyNotify) write_data_free);
+
+	g_task_run_in_thread (task, write_message_to_stream_thread);
+
+	g_object_unref (task);
+}
+
 static void
 save_snapshot_get_message_cb (GObject *source_object,
                               GAsyncResult *result,
                               gpointer user_data)
 {
 	EMsgComposer *composer;
-	SaveContext *context;
+	SnapshotState *state;
 	CamelMimeMessage *message;
-	GTask *parent_task, *task;
+	GTask *parent_task;
 	GError *local_error = NULL;
 
 	composer = E_MSG_COMPOSER (source_object);
 	parent_task = G_TASK (user_data);
-	context = g_task_get_task_data (parent_task);
 
 	message = e_msg_composer_get_message_draft_finish (
 		composer, result, &local_error);
@@ -293,14 +755,28 @@ save_snapshot_get_message_cb (GObject *source_object,
 
 	g_return_if_fail (CAMEL_IS_MIME_MESSAGE (message));
 
-	task = g_task_new (message, g_task_get_cancellable (parent_task),
-		save_snapshot_splice_cb, parent_task);
+	state = snapshot_state_get (composer);
 
-	g_task_set_task_data (task, g_object_ref (context->snapshot_file), g_object_unref);
+	if (state->writing) {
+		/* The newer draft replaces the one waiting for the running write */
+		if (state->pending_task) {
+			GTask *pending_task = g_steal_pointer (&state->pending_task);
 
-	g_task_run_in_thread (task, write_message_to_stream_thread);
+			g_clear_object (&state->pending_message);
+
+			/* Cancelled saves are not reported */
+			g_task_return_new_error (pending_task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+				"Superseded by a newer snapshot");
+			g_object_unref (pending_task);
+		}
+
+		state->pending_task = parent_task;
+		state->pending_message = message;
+		return;
+	}
+
+	save_snapshot_write (parent_task, message);
 
-	g_object_unref (task);
 	g_object_unref (message);
 }
 
@@ -357,7 +833,8 @@ e_composer_find_orphans (GQueue *registry,
 		struct stat st;
 
 		/* Is this a snapshot file? */
-		if (!g_str_has_prefix (basename, SNAPSHOT_FILE_PREFIX))
+		if (!g_str_has_prefix (basename, SNAPSHOT_FILE_PREFIX) ||
+		    g_str_has_suffix (basename, SNAPSHOT_JOURNAL_SUFFIX))
 			continue;
 
 		/* Is this an orphaned snapshot file? */
@@ -379,11 +856,18 @@ e_composer_find_orphans (GQueue *registry,
 		/* If the file is empty, delete it.  Failure here
 		 * is non-fatal; just emit a warning and move on. */
 		if (st.st_size == 0) {
+			gchar *journal_filename;
+
 			errno = 0;
 			if (g_unlink (filename) < 0) {
 				errmsg = g_strerror (errno);
 				g_warning ("%s: %s", filename, errmsg);
 			}
+
+			journal_filename = g_strconcat (filename, SNAPSHOT_JOURNAL_SUFFIX, NULL);
+			g_unlink (journal_filename);
+			g_free (journal_filename);
+
 			g_free (filename);
 			continue;
 		}
@@ -45,63 +45,214 @@ static const gchar *SEARCH_RESULTS_STATE =
 "  </grouping>"
 "</ETableState>";
 
+/* at most this many folders of one store are opened and searched at once */
+#define SEARCH_FOLDERS_PER_STORE 4
+/* at most this many folders are opened and searched at once in total */
+#define SEARCH_FOLDERS_MAX_THREADS 16
+
+typedef struct _SearchStoreJob {
+	CamelStore *store;
+	GQueue folder_names; /* gchar *; guarded by SearchFoldersData::lock */
+	guint n_folders;
+} SearchStoreJob;
+
+typedef struct _SearchFoldersData {
+	CamelVeeFolder *vfolder;
+	GCancellable *cancellable;
+	gboolean skip_vee_folders;
+	GMutex lock;
+} SearchFoldersData;
+
 static void
-add_folders_from_store (GList **folders,
-                        CamelStore *store,
-                        GCancellable *cancellable,
-                        GError **error)
+search_store_job_free (gpointer ptr)
 {
-	CamelFolderInfo *root, *fi;
+	SearchStoreJob *job = ptr;
 
-	g_return_if_fail (folders != NULL);
-	g_return_if_fail (store != NULL);
+	if (job) {
+		g_queue_clear_full (&job->folder_names, g_free);
+		g_clear_object (&job->store);
+		g_slice_free (SearchStoreJob, job);
+	}
+}
 
-	if (CAMEL_IS_VEE_STORE (store))
-		return;
+static gint
+search_folder_info_rank (const CamelFolderInfo *fi)
+{
+	switch (fi->flags & CAMEL_FOLDER_TYPE_MASK) {
+		case CAMEL_FOLDER_TYPE_INBOX:
+			return 0;
+		case CAMEL_FOLDER_TYPE_TRASH:
+		case CAMEL_FOLDER_TYPE_JUNK:
+			return 2;
+		default:
+			break;
+	}
+
+	return 1;
+}
+
+/* The folder info carries no activity time, thus the Inbox goes first,
+   then the folders with the most unread messages, which are the ones
+   most likely receiving new mail; Trash and Junk go last. */
+static gint
+search_folder_info_compare (gconstpointer ptr1,
+			    gconstpointer ptr2)
+{
+	const CamelFolderInfo *fi1 = *((const CamelFolderInfo **) ptr1);
+	const CamelFolderInfo *fi2 = *((const CamelFolderInfo **) ptr2);
+	gint rank1, rank2;
+
+	rank1 = search_folder_info_rank (fi1);
+	rank2 = search_folder_info_rank (fi2);
+
+	if (rank1 != rank2)
+		return rank1 - rank2;
+
+	if (MAX (fi1->unread, 0) != MAX (fi2->unread, 0))
+		return MAX (fi2->unread, 0) - MAX (fi1->unread, 0);
+
+	return g_strcmp0 (fi1->full_name, fi2->full_name);
+}
+
+/* Adds a job for the @store to the @jobs, with selectable folders
+   under the @top (or all folders, when NULL) in the search order. */
+static void
+search_folders_add_store (GPtrArray *jobs,
+			  CamelStore *store,
+			  const gchar *top,
+			  GCancellable *cancellable)
+{
+	SearchStoreJob *job;
+	CamelFolderInfo *root;
+	GPtrArray *infos;
+	const CamelFolderInfo *fi;
+	guint ii;
 
 	root = camel_store_get_folder_info_sync (
-		store, NULL,
-		CAMEL_STORE_FOLDER_INFO_RECURSIVE, cancellable, error);
+		store, top,
+		CAMEL_STORE_FOLDER_INFO_RECURSIVE, cancellable, NULL);
+
+	if (!root)
+		return;
+
+	infos = g_ptr_array_new ();
+
 	fi = root;
 	while (fi && !g_cancellable_is_cancelled (cancellable)) {
-		CamelFolderInfo *next;
-
-		if ((fi->flags & CAMEL_FOLDER_NOSELECT) == 0) {
-			CamelFolder *fldr;
-
-			fldr = camel_store_get_folder_sync (
-				store, fi->full_name, 0, cancellable, error);
-			if (fldr) {
-				if (CAMEL_IS_VEE_FOLDER (fldr)) {
-					g_object_unref (fldr);
-				} else {
-					*folders = g_list_prepend (*folders, fldr);
-				}
+		if ((fi->flags & CAMEL_FOLDER_NOSELECT) == 0)
+			g_ptr_array_add (infos, (gpointer) fi);
+
+		/* move to the next fi */
+		if (fi->child) {
+			fi = fi->child;
+		} else if (fi->next) {
+			fi = fi->next;
+		} else {
+			while (fi && !fi->next) {
+				fi = fi->parent;
 			}
+
+			if (fi)
+				fi = fi->next;
 		}
+	}
 
-		/* pick the next */
-		next = fi->child;
-		if (!next)
-			next = fi->next;
-		if (!next) {
-			next = fi->parent;
-			while (next) {
-				if (next->next) {
-					next = next->next;
-					break;
-				}
+	g_ptr_array_sort (infos, search_folder_info_compare);
 
-				next = next->parent;
-			}
-		}
+	job = g_slice_new0 (SearchStoreJob);
+	job->store = g_object_ref (store);
+	g_queue_init (&job->folder_names);
+
+	for (ii = 0; ii < infos->len; ii++) {
+		fi = g_ptr_array_index (infos, ii);
 
-		fi = next;
+		g_queue_push_tail (&job->folder_names, g_strdup (fi->full_name));
 	}
 
+	job->n_folders = infos->len;
+
+	g_ptr_array_add (jobs, job);
+
+	g_ptr_array_free (infos, TRUE);
 	camel_folder_info_free (root);
 }
 
+static void
+search_folders_thread (gpointer job_data,
+		       gpointer user_data)
+{
+	SearchStoreJob *job = job_data;
+	SearchFoldersData *sfd = user_data;
+
+	while (!g_cancellable_is_cancelled (sfd->cancellable)) {
+		CamelFolder *folder;
+		gchar *full_name;
+
+		g_mutex_lock (&sfd->lock);
+		full_name = g_queue_pop_head (&job->folder_names);
+		g_mutex_unlock (&sfd->lock);
+
+		if (!full_name)
+			break;
+
+		folder = camel_store_get_folder_sync (
+			job->store, full_name, 0, sfd->cancellable, NULL);
+
+		/* Matches from this folder show in the search results
+		   right away, without waiting for the other folders. */
+		if (folder && !(sfd->skip_vee_folders && CAMEL_IS_VEE_FOLDER (folder)) &&
+		    !g_cancellable_is_cancelled (sfd->cancellable))
+			camel_vee_folder_add_folder (sfd->vfolder, folder, sfd->cancellable);
+
+		g_clear_object (&folder);
+		g_free (full_name);
+	}
+}
+
+/* Opens folders of all the @jobs in parallel, at most
+   SEARCH_FOLDERS_PER_STORE of each store at once, and adds
+   them to the @vfolder one by one as they are opened. */
+static void
+search_folders_run (CamelVeeFolder *vfolder,
+		    GPtrArray *jobs,
+		    gboolean skip_vee_folders,
+		    GCancellable *cancellable)
+{
+	SearchFoldersData sfd;
+	GThreadPool *pool;
+	guint ii, jj, n_threads;
+
+	/* Start with no folders, the same as the set_folders() would */
+	camel_vee_folder_set_folders (vfolder, NULL, cancellable);
+
+	if (!jobs->len || g_cancellable_is_cancelled (cancellable))
+		return;
+
+	sfd.vfolder = vfolder;
+	sfd.cancellable = cancellable;
+	sfd.skip_vee_folders = skip_vee_folders;
+	g_mutex_init (&sfd.lock);
+
+	n_threads = MIN (jobs->len * SEARCH_FOLDERS_PER_STORE, SEARCH_FOLDERS_MAX_THREADS);
+	pool = g_thread_pool_new (search_folders_thread, &sfd, n_threads, FALSE, NULL);
+
+	/* Round-robin over the stores, thus each store has its most
+	   likely folders opened before less likely folders elsewhere. */
+	for (ii = 0; ii < SEARCH_FOLDERS_PER_STORE; ii++) {
+		for (jj = 0; jj < jobs->len; jj++) {
+			SearchStoreJob *job = g_ptr_array_index (jobs, jj);
+
+			if (ii < job->n_folders)
+				g_thread_pool_push (pool, job, NULL);
+		}
+	}
+
+	/* Waits for all the pushed jobs to finish */
+	g_thread_pool_free (pool, FALSE, TRUE);
+
+	g_mutex_clear (&sfd.lock);
+}
+
 typedef struct {
 	MailMsg base;
 
@@ -122,7 +273,10 @@ search_results_exec (SearchResultsMsg *msg,
                      GCancellable *cancellable,
                      GError **error)
 {
-	GList *folders = NULL, *link;
+	GPtrArray *jobs;
+	GList *link;
+
+	jobs = g_ptr_array_new_with_free_func (search_store_job_free);
 
 	for (link = msg->stores_list; link != NULL; link = link->next) {
 		CamelStore *store = CAMEL_STORE (link->data);
@@ -130,18 +284,16 @@ search_results_exec (SearchResultsMsg *msg,
 		if (g_cancellable_is_cancelled (cancellable))
 			break;
 
-		add_folders_from_store (&folders, store, cancellable, error);
-	}
-
-	if (!g_cancellable_is_cancelled (cancellable)) {
-		CamelVeeFolder *vfolder = CAMEL_VEE_FOLDER (msg->folder);
+		if (CAMEL_IS_VEE_STORE (store))
+			continue;
 
-		folders = g_list_reverse (folders);
-
-		camel_vee_folder_set_folders (vfolder, folders, cancellable);
+		search_folders_add_store (jobs, store, NULL, cancellable);
 	}
 
-	g_list_free_full (folders, g_object_unref);
+	if (!g_cancellable_is_cancelled (cancellable))
+		search_folders_run (CAMEL_VEE_FOLDER (msg->folder), jobs, TRUE, cancellable);
+
+	g_ptr_array_unref (jobs);
 }
 
 static void
@@ -211,57 +363,22 @@ search_results_with_subfolders_exec (SearchResultsWithSubfoldersMsg *msg,
 				     GCancellable *cancellable,
 				     GError **error)
 {
-	GList *folders = NULL;
 	CamelStore *root_store;
-	CamelFolderInfo *fi;
-	const CamelFolderInfo *cur;
-	const gchar *root_folder_name;
+	GPtrArray *jobs;
 
 	root_store = camel_folder_get_parent_store (msg->root_folder);
 	if (!root_store)
 		return;
 
-	root_folder_name = camel_folder_get_full_name (msg->root_folder);
-
-	fi = camel_store_get_folder_info_sync (root_store, root_folder_name,
-		CAMEL_STORE_FOLDER_INFO_RECURSIVE, cancellable, NULL);
-
-	cur = fi;
-	while (cur && !g_cancellable_is_cancelled (cancellable)) {
-		if ((cur->flags & CAMEL_FOLDER_NOSELECT) == 0) {
-			CamelFolder *folder;
+	jobs = g_ptr_array_new_with_free_func (search_store_job_free);
 
-			folder = camel_store_get_folder_sync (root_store, cur->full_name, 0, cancellable, NULL);
-			if (folder)
-				folders = g_list_prepend (folders, folder);
-		}
+	search_folders_add_store (jobs, root_store,
+		camel_folder_get_full_name (msg->root_folder), cancellable);
 
-		/* move to the next fi */
-		if (cur->child) {
-			cur = cur->child;
-		} else if (cur->next) {
-			cur = cur->next;
-		} else {
-			while (cur && !cur->next) {
-				cur = cur->parent;
-			}
-
-			if (cur)
-				cur = cur->next;
-		}
-	}
-
-	camel_folder_info_free (fi);
-
-	if (!g_cancellable_is_cancelled (cancellable)) {
-		CamelVeeFolder *vfolder = CAMEL_VEE_FOLDER (msg->vfolder);
-
-		folders = g_list_reverse (folders);
-
-		camel_vee_folder_set_folders (vfolder, folders, cancellable);
-	}
+	if (!g_cancellable_is_cancelled (cancellable))
+		search_folders_run (CAMEL_VEE_FOLDER (msg->vfolder), jobs, FALSE, cancellable);
 
-	g_list_free_full (folders, g_object_unref);
+	g_ptr_array_unref (jobs);
 }
 
 static void
@@ -25,6 +25,10 @@
 
 #include <camel/camel.h>
 
+#ifdef G_OS_UNIX
+#include <gio/gunixsocketaddress.h>
+#endif
+
 #include <shell/e-shell.h>
 #include <libemail-engine/libemail-engine.h>
 
@@ -38,6 +42,12 @@
 #define SPAM_ASSASSIN_EXIT_STATUS_SUCCESS	0
 #define SPAM_ASSASSIN_EXIT_STATUS_ERROR		-1
 
+#define SPAMD_DEFAULT_PORT			783
+/* How long, in seconds, to wait for the spamd, like with the bogofilter */
+#define SPAMD_TIMEOUT				30
+/* How long to use the command after the spamd could not be used */
+#define SPAMD_RETRY_INTERVAL			(60 * G_USEC_PER_SEC)
+
 typedef struct _ESpamAssassin ESpamAssassin;
 typedef struct _ESpamAssassinClass ESpamAssassinClass;
 
@@ -47,6 +57,12 @@ struct _ESpamAssassin {
 	gboolean local_only;
 	gchar *command;
 	gchar *learn_command;
+	gchar *spamd_address;
+
+	/* Guards the spamd_address and the spamd_disabled_until */
+	GMutex spamd_lock;
+	/* Monotonic time until which the spamd is not tried */
+	gint64 spamd_disabled_until;
 
 	gboolean version_set;
 	gint version;
@@ -60,7 +76,8 @@ enum {
 	PROP_0,
 	PROP_LOCAL_ONLY,
 	PROP_COMMAND,
-	PROP_LEARN_COMMAND
+	PROP_LEARN_COMMAND,
+	PROP_SPAMD_ADDRESS
 };
 
 /* Module Entry Points */
@@ -383,6 +400,39 @@ spam_assassin_set_learn_command (ESpamAssassin *extension,
 	g_object_notify (G_OBJECT (extension), "learn-command");
 }
 
+static gchar *
+spam_assassin_dup_spamd_address (ESpamAssassin *extension)
+{
+	gchar *spamd_address;
+
+	/* The property can change in the main thread while classifying */
+	g_mutex_lock (&extension->spamd_lock);
+	spamd_address = g_strdup (extension->spamd_address);
+	g_mutex_unlock (&extension->spamd_lock);
+
+	return spamd_address;
+}
+
+static void
+spam_assassin_set_spamd_address (ESpamAssassin *extension,
+				 const gchar *spamd_address)
+{
+	g_mutex_lock (&extension->spamd_lock);
+
+	if (g_strcmp0 (extension->spamd_address, spamd_address) == 0) {
+		g_mutex_unlock (&extension->spamd_lock);
+		return;
+	}
+
+	g_free (extension->spamd_address);
+	extension->spamd_address = g_strdup (spamd_address);
+	extension->spamd_disabled_until = 0;
+
+	g_mutex_unlock (&extension->spamd_lock);
+
+	g_object_notify (G_OBJECT (extension), "spamd-address");
+}
+
 static void
 spam_assassin_set_property (GObject *object,
                             guint property_id,
@@ -407,6 +457,12 @@ spam_assassin_set_property (GObject *object,
 				E_SPAM_ASSASSIN (object),
 				g_value_get_string (value));
 			return;
+
+		case PROP_SPAMD_ADDRESS:
+			spam_assassin_set_spamd_address (
+				E_SPAM_ASSASSIN (object),
+				g_value_get_string (value));
+			return;
 	}
 
 	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -436,6 +492,12 @@ spam_assassin_get_property (GObject *object,
 				value, spam_assassin_get_learn_command (
 				E_SPAM_ASSASSIN (object)));
 			return;
+
+		case PROP_SPAMD_ADDRESS:
+			g_value_take_string (
+				value, spam_assassin_dup_spamd_address (
+				E_SPAM_ASSASSIN (object)));
+			return;
 	}
 
 	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -452,6 +514,11 @@ spam_assassin_finalize (GObject *object)
 	g_free (extension->learn_command);
 	extension->learn_command = NULL;
 
+	g_free (extension->spamd_address);
+	extension->spamd_address = NULL;
+
+	g_mutex_clear (&extension->spamd_lock);
+
 	/* Chain up to parent's method. */
 	G_OBJECT_CLASS (e_spam_assassin_parent_class)->finalize (object);
 }
@@ -574,6 +641,126 @@ spam_assassin_new_config_widget (EMailJunkFilter *junk_filter)
 	return box;
 }
 
+/* Asks the spamd daemon directly, which has the rules already loaded,
+ * instead of starting a new spamassassin process, which loads them on
+ * every start. The spamd protocol handles one message per connection. */
+static CamelJunkStatus
+spam_assassin_classify_with_spamd (const gchar *spamd_address,
+                                   CamelMimeMessage *message,
+                                   GCancellable *cancellable,
+                                   GError **error)
+{
+	CamelJunkStatus status = CAMEL_JUNK_STATUS_ERROR;
+	GSocketClient *client;
+	GSocketConnection *connection = NULL;
+	GDataInputStream *data_stream = NULL;
+	GOutputStream *output_stream;
+	CamelStream *stream;
+	GByteArray *content;
+	gboolean response_ok = FALSE;
+	gchar *header, *line;
+	GError *local_error = NULL;
+
+	content = g_byte_array_new ();
+	stream = camel_stream_mem_new ();
+	camel_stream_mem_set_byte_array (CAMEL_STREAM_MEM (stream), content);
+
+	if (camel_data_wrapper_write_to_stream_sync (CAMEL_DATA_WRAPPER (message), stream, cancellable, &local_error) < 0)
+		goto exit;
+
+	client = g_socket_client_new ();
+	g_socket_client_set_timeout (client, SPAMD_TIMEOUT);
+
+#ifdef G_OS_UNIX
+	if (*spamd_address == '/') {
+		GSocketAddress *socket_address;
+
+		socket_address = g_unix_socket_address_new (spamd_address);
+		connection = g_socket_client_connect (client, G_SOCKET_CONNECTABLE (socket_address), cancellable, &local_error);
+		g_object_unref (socket_address);
+	} else
+#endif
+	connection = g_socket_client_connect_to_host (client, spamd_address, SPAMD_DEFAULT_PORT, cancellable, &local_error);
+
+	g_object_unref (client);
+
+	if (!connection)
+		goto exit;
+
+	output_stream = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+
+	/* Let the spamd use the per-user preferences and the Bayes database
+	   of the current user, the same as the spamassassin command does */
+	header = g_strdup_printf ("CHECK SPAMC/1.2\r\nContent-length: %u\r\nUser: %s\r\n\r\n",
+		content->len, g_get_user_name ());
+
+	if (!g_output_stream_write_all (output_stream, header, strlen (header), NULL, cancellable, &local_error) ||
+	    !g_output_stream_write_all (output_stream, content->data, content->len, NULL, cancellable, &local_error)) {
+		g_free (header);
+		goto exit;
+	}
+
+	g_free (header);
+
+	data_stream = g_data_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM (connection)));
+	g_data_input_stream_set_newline_type (data_stream, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+
+	/* The response is like:
+	 *    SPAMD/1.1 0 EX_OK
+	 *    Spam: True ; 15.0 / 5.0
+	 */
+	while (status == CAMEL_JUNK_STATUS_ERROR &&
+	       (line = g_data_input_stream_read_line (data_stream, NULL, cancellable, &local_error)) != NULL) {
+		if (!response_ok) {
+			gchar **parts;
+
+			parts = g_strsplit (line, " ", 3);
+			response_ok = g_str_has_prefix (line, "SPAMD/") && g_strcmp0 (parts[1], "0") == 0;
+			g_strfreev (parts);
+
+			if (!response_ok) {
+				g_set_error (
+					&local_error, CAMEL_ERROR, CAMEL_ERROR_GENERIC,
+					_("SpamAssassin daemon failed to process a mail message: %s"), line);
+				g_free (line);
+				break;
+			}
+		} else if (!*line) {
+			g_free (line);
+			break;
+		} else if (g_ascii_strncasecmp (line, "Spam:", 5) == 0) {
+			const gchar *value = line + 5;
+
+			while (*value == ' ')
+				value++;
+
+			if (g_ascii_strncasecmp (value, "True", 4) == 0 ||
+			    g_ascii_strncasecmp (value, "Yes", 3) == 0)
+				status = CAMEL_JUNK_STATUS_MESSAGE_IS_JUNK;
+			else
+				status = CAMEL_JUNK_STATUS_MESSAGE_IS_NOT_JUNK;
+		}
+
+		g_free (line);
+	}
+
+	if (status == CAMEL_JUNK_STATUS_ERROR && !local_error)
+		g_set_error_literal (
+			&local_error, CAMEL_ERROR, CAMEL_ERROR_GENERIC,
+			_("SpamAssassin daemon did not return any result"));
+
+exit:
+	if (local_error)
+		g_propagate_error (error, local_error);
+
+	g_clear_object (&data_stream);
+	g_clear_object (&connection);
+	g_object_unref (stream);
+	g_byte_array_free (content, TRUE);
+
+	return status;
+}
+
 static CamelJunkStatus
 spam_assassin_classify (CamelJunkFilter *junk_filter,
                         CamelMimeMessage *message,
@@ -585,10 +772,52 @@ spam_assassin_classify (CamelJunkFilter *junk_filter,
 	const gchar *argv[7];
 	gint exit_code;
 	gint ii = 0;
+	gchar *spamd_address;
 
 	if (g_cancellable_set_error_if_cancelled (cancellable, error))
 		return CAMEL_JUNK_STATUS_ERROR;
 
+	/* The spamd runs with its own configuration, which can include
+	   the network tests, thus it cannot be used for the local-only
+	   checks, which pass --local to the spamassassin command. */
+	if (extension->local_only)
+		spamd_address = NULL;
+	else
+		spamd_address = spam_assassin_dup_spamd_address (extension);
+
+	g_mutex_lock (&extension->spamd_lock);
+	if (extension->spamd_disabled_until > g_get_monotonic_time ())
+		g_clear_pointer (&spamd_address, g_free);
+	g_mutex_unlock (&extension->spamd_lock);
+
+	if (spamd_address && *spamd_address) {
+		GError *local_error = NULL;
+
+		status = spam_assassin_classify_with_spamd (
+			spamd_address, message,
+			cancellable, &local_error);
+
+		g_free (spamd_address);
+
+		if (status != CAMEL_JUNK_STATUS_ERROR)
+			return status;
+
+		if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_propagate_error (error, local_error);
+			return CAMEL_JUNK_STATUS_ERROR;
+		}
+
+		/* Fall back to the command and try the spamd again later */
+		g_debug ("%s: %s", G_STRFUNC, local_error ? local_error->message : "Unknown error");
+		g_clear_error (&local_error);
+
+		g_mutex_lock (&extension->spamd_lock);
+		extension->spamd_disabled_until = g_get_monotonic_time () + SPAMD_RETRY_INTERVAL;
+		g_mutex_unlock (&extension->spamd_lock);
+	} else {
+		g_free (spamd_address);
+	}
+
 	argv[ii++] = spam_assassin_get_command_path (extension);
 	argv[ii++] = "--exit-code";
 	if (extension->local_only)
@@ -770,6 +999,16 @@ e_spam_assassin_class_init (ESpamAssassinClass *class)
 			"Full path command to use to run sa-learn",
 			"",
 			G_PARAM_READWRITE));
+
+	g_object_class_install_property (
+		object_class,
+		PROP_SPAMD_ADDRESS,
+		g_param_spec_string (
+			"spamd-address",
+			"Spamd Address",
+			"Address of the spamd daemon to use for classification",
+			"",
+			G_PARAM_READWRITE));
 }
 
 static void
@@ -791,6 +1030,8 @@ e_spam_assassin_init (ESpamAssassin *extension)
 {
 	GSettings *settings;
 
+	g_mutex_init (&extension->spamd_lock);
+
 	settings = e_util_ref_settings ("org.gnome.evolution.spamassassin");
 
 	g_settings_bind (
@@ -805,6 +1046,10 @@ e_spam_assassin_init (ESpamAssassin *extension)
 		settings, "learn-command",
 		G_OBJECT (extension), "learn-command",
 		G_SETTINGS_BIND_DEFAULT);
+	g_settings_bind (
+		settings, "spamd-address",
+		G_OBJECT (extension), "spamd-address",
+		G_SETTINGS_BIND_DEFAULT);
 
 	g_object_unref (settings);
 }
@@ -18,6 +18,7 @@
 #include "evolution-config.h"
 
 #include "e-mail-formatter-text-highlight.h"
+#include "highlighter.h"
 #include "languages.h"
 
 #include <em-format/e-mail-formatter-extension.h>
@@ -37,16 +38,6 @@ typedef EMailFormatterExtensionClass EMailFormatterTextHighlightClass;
 typedef EExtension EMailFormatterTextHighlightLoader;
 typedef EExtensionClass EMailFormatterTextHighlightLoaderClass;
 
-typedef struct _TextHighlightClosure TextHighlightClosure;
-
-struct _TextHighlightClosure {
-	gboolean wrote_anything;
-	CamelStream *read_stream;
-	GOutputStream *output_stream;
-	GCancellable *cancellable;
-	GError *error;
-};
-
 GType e_mail_formatter_text_highlight_get_type (void);
 
 G_DEFINE_DYNAMIC_TYPE (
@@ -130,121 +121,6 @@ get_syntax (EMailPart *part,
 	return syntax;
 }
 
-static gpointer
-text_hightlight_read_data_thread (gpointer user_data)
-{
-	TextHighlightClosure *closure = user_data;
-	gint nbuffer = 10240;
-	gssize read;
-	gsize wrote = 0;
-	gchar *buffer;
-
-	g_return_val_if_fail (closure != NULL, NULL);
-
-	buffer = g_new (gchar, nbuffer);
-
-	strcpy (buffer, "<style>body{margin:0; padding:8px;}</style>");
-	read = strlen (buffer);
-
-	if (!g_output_stream_write_all (closure->output_stream, buffer, read, &wrote, closure->cancellable, &closure->error) ||
-	    (gssize) wrote != read || closure->error) {
-		g_free (buffer);
-		return NULL;
-	}
-
-	while (!camel_stream_eos (closure->read_stream) &&
-	       !g_cancellable_set_error_if_cancelled (closure->cancellable, &closure->error)) {
-		wrote = 0;
-
-		read = camel_stream_read (closure->read_stream, buffer, nbuffer, closure->cancellable, &closure->error);
-		if (read < 0 || closure->error)
-			break;
-
-		closure->wrote_anything = closure->wrote_anything || read > 0;
-
-		if (!g_output_stream_write_all (closure->output_stream, buffer, read, &wrote, closure->cancellable, &closure->error) ||
-		    (gssize) wrote != read || closure->error)
-			break;
-	}
-
-	g_free (buffer);
-
-	return NULL;
-}
-
-static gboolean
-text_highlight_feed_data (GOutputStream *output_stream,
-                          CamelDataWrapper *data_wrapper,
-                          gint pipe_stdin,
-                          gint pipe_stdout,
-                          GCancellable *cancellable,
-                          GError **error)
-{
-	TextHighlightClosure closure;
-	CamelContentType *content_type;
-	CamelStream *write_stream;
-	gboolean success = TRUE;
-	GThread *thread;
-
-	closure.wrote_anything = FALSE;
-	closure.read_stream = camel_stream_fs_new_with_fd (pipe_stdout);
-	closure.output_stream = output_stream;
-	closure.cancellable = cancellable;
-	closure.error = NULL;
-
-	write_stream = camel_stream_fs_new_with_fd (pipe_stdin);
-
-	thread = g_thread_new (NULL, text_hightlight_read_data_thread, &closure);
-
-	content_type = camel_data_wrapper_get_mime_type_field (data_wrapper);
-	if (content_type) {
-		const gchar *charset = camel_content_type_param (content_type, "charset");
-
-		/* Convert to UTF-8 charset, if needed, which the 'highlight' expects;
-		   it can cope with non-UTF-8 letters, thus no need for a content UTF-8-validation */
-		if (charset && g_ascii_strcasecmp (charset, "utf-8") != 0) {
-			CamelMimeFilter *filter;
-
-			filter = camel_mime_filter_charset_new (charset, "UTF-8");
-			if (filter != NULL) {
-				CamelStream *filtered = camel_stream_filter_new (write_stream);
-
-				if (filtered) {
-					camel_stream_filter_add (CAMEL_STREAM_FILTER (filtered), filter);
-					g_object_unref (write_stream);
-					write_stream = filtered;
-				}
-
-				g_object_unref (filter);
-			}
-		}
-	}
-
-	if (camel_data_wrapper_decode_to_stream_sync (data_wrapper, write_stream, cancellable, error) < 0) {
-		g_cancellable_cancel (cancellable);
-		success = FALSE;
-	} else {
-		/* Close the stream, thus the highlight knows no more data will come */
-		g_clear_object (&write_stream);
-	}
-
-	g_thread_join (thread);
-
-	g_clear_object (&closure.read_stream);
-	g_clear_object (&write_stream);
-
-	if (closure.error) {
-		if (error && !*error)
-			g_propagate_error (error, closure.error);
-		else
-			g_clear_error (&closure.error);
-
-		return FALSE;
-	}
-
-	return success && closure.wrote_anything;
-}
-
 static gboolean
 emfe_text_highlight_format (EMailFormatterExtension *extension,
                             EMailFormatter *formatter,
@@ -278,26 +154,9 @@ emfe_text_highlight_format (EMailFormatterExtension *extension,
 		goto exit;
 
 	} else if (context->mode == E_MAIL_FORMATTER_MODE_RAW) {
-		gint pipe_stdin, pipe_stdout;
-		GPid pid;
 		CamelDataWrapper *dw;
-		gchar *font_family, *font_size, *syntax, *theme;
-		PangoFontDescription *fd;
-		GSettings *settings;
-		gchar *font = NULL;
-
-		const gchar *argv[] = {
-			HIGHLIGHT_COMMAND,
-			NULL,	/* --font= */
-			NULL,   /* --font-size= */
-			NULL,   /* --syntax= */
-			NULL,   /* --style= */
-			"--out-format=html",
-			"--include-style",
-			"--inline-css",
-			"--encoding=none",
-			"--failsafe",
-			NULL };
+		gchar *syntax;
+		GError *local_error = NULL;
 
 		if (!emfe_text_highlight_formatter_is_enabled ()) {
 			gboolean can_process = FALSE;
@@ -338,76 +197,21 @@ emfe_text_highlight_format (EMailFormatterExtension *extension,
 			goto exit;
 		}
 
-		settings = e_util_ref_settings ("org.gnome.evolution.mail");
-		if (g_settings_get_boolean (settings, "use-custom-font"))
-			font = g_settings_get_string (
-				settings, "monospace-font");
-		g_object_unref (settings);
-
-		if (font == NULL) {
-			settings = e_util_ref_settings ("org.gnome.desktop.interface");
-			font = g_settings_get_string (
-				settings, "monospace-font-name");
-			g_object_unref (settings);
-		}
-
-		if (font == NULL)
-			font = g_strdup ("monospace 10");
-
-		fd = pango_font_description_from_string (font);
+		success = highlighter_format (dw, syntax, stream, cancellable, &local_error);
 
-		g_free (font);
+		if (g_error_matches (
+			local_error, G_IO_ERROR,
+			G_IO_ERROR_CANCELLED)) {
+			/* Do nothing. */
 
-		font_family = g_strdup_printf (
-			"--font='%s'",
-			pango_font_description_get_family (fd));
-		font_size = g_strdup_printf (
-			"--font-size=%d",
-			pango_font_description_get_size (fd) / PANGO_SCALE);
-
-		settings = e_util_ref_settings ("org.gnome.evolution.text-highlight");
-		theme = g_settings_get_string (settings, "theme");
-		g_object_unref (settings);
-
-		if (!theme || !*theme) {
-			g_free (theme);
-			theme = g_strdup ("bclear");
+		} else if (local_error != NULL) {
+			g_warning (
+				"%s: %s", G_STRFUNC,
+				local_error->message);
 		}
 
-		argv[1] = font_family;
-		argv[2] = font_size;
-		argv[3] = g_strdup_printf ("--syntax=%s", syntax);
-		argv[4] = g_strdup_printf ("--style=%s", theme);
+		g_clear_error (&local_error);
 		g_free (syntax);
-		g_free (theme);
-
-		success = g_spawn_async_with_pipes (
-			NULL, (gchar **) argv, NULL, 0, NULL, NULL,
-			&pid, &pipe_stdin, &pipe_stdout, NULL, NULL);
-
-		if (success) {
-			GError *local_error = NULL;
-
-			success = text_highlight_feed_data (
-				stream, dw,
-				pipe_stdin, pipe_stdout,
-				cancellable, &local_error);
-
-			if (g_error_matches (
-				local_error, G_IO_ERROR,
-				G_IO_ERROR_CANCELLED)) {
-				/* Do nothing. */
-
-			} else if (local_error != NULL) {
-				g_warning (
-					"%s: %s", G_STRFUNC,
-					local_error->message);
-			}
-
-			g_clear_error (&local_error);
-
-			g_spawn_close_pid (pid);
-		}
 
 		if (!success) {
 			/* We can't call e_mail_formatter_format_as on text/plain,
@@ -429,12 +233,6 @@ emfe_text_highlight_format (EMailFormatterExtension *extension,
 			}
 		}
 
-		g_free (font_family);
-		g_free (font_size);
-		g_free ((gchar *) argv[3]);
-		g_free ((gchar *) argv[4]);
-		pango_font_description_free (fd);
-
 		if (!success)
 			goto exit;
 	} else {
@@ -0,0 +1,409 @@
+/*
+ * highlighter.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-config.h"
+
+#include <string.h>
+
+#include <pango/pango.h>
+
+#include <e-util/e-util.h>
+
+#include "highlighter.h"
+
+/* How many 'highlight' processes can run at once */
+#define HIGHLIGHTER_MAX_JOBS 2
+
+/* Limits of the cache of the highlighted parts */
+#define HIGHLIGHTER_CACHE_MAX_ENTRIES 64
+#define HIGHLIGHTER_CACHE_MAX_BYTES (8 * 1024 * 1024)
+
+#define HIGHLIGHTER_STYLE "<style>body{margin:0; padding:8px;}</style>"
+
+typedef struct _CacheEntry {
+	gchar *key;
+	GBytes *bytes;
+} CacheEntry;
+
+/* Everything below is guarded by the 'highlighter' lock */
+static struct {
+	/* The options are read from the settings on demand and
+	   forgotten whenever any of the settings changes */
+	GSettings *mail_settings;
+	GSettings *interface_settings;
+	GSettings *highlight_settings;
+	gchar *font_family;
+	gint font_size;
+	gchar *theme;
+
+	GQueue cache; /* CacheEntry *, the most recently used first */
+	gsize cache_size;
+
+	/* Keys of the parts being highlighted right now, to not
+	   run the same request twice at the same time */
+	GHashTable *running;
+	guint n_running;
+} highlighter;
+
+G_LOCK_DEFINE_STATIC (highlighter);
+static GCond highlighter_cond;
+
+static void
+cache_entry_free (gpointer ptr)
+{
+	CacheEntry *entry = ptr;
+
+	if (entry) {
+		g_free (entry->key);
+		g_bytes_unref (entry->bytes);
+		g_free (entry);
+	}
+}
+
+static void
+highlighter_settings_changed_cb (GSettings *settings,
+				 const gchar *key,
+				 gpointer user_data)
+{
+	G_LOCK (highlighter);
+
+	g_clear_pointer (&highlighter.font_family, g_free);
+	g_clear_pointer (&highlighter.theme, g_free);
+
+	/* Cached parts of the previous theme or font are not needed anymore */
+	g_queue_clear_full (&highlighter.cache, cache_entry_free);
+	highlighter.cache_size = 0;
+
+	G_UNLOCK (highlighter);
+}
+
+/* Call with the 'highlighter' lock held */
+static void
+highlighter_ensure_options_locked (void)
+{
+	PangoFontDescription *fd;
+	gchar *font = NULL;
+
+	if (!highlighter.mail_settings) {
+		highlighter.mail_settings = e_util_ref_settings ("org.gnome.evolution.mail");
+		highlighter.interface_settings = e_util_ref_settings ("org.gnome.desktop.interface");
+		highlighter.highlight_settings = e_util_ref_settings ("org.gnome.evolution.text-highlight");
+		highlighter.running = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+		g_signal_connect (highlighter.mail_settings, "changed::use-custom-font",
+			G_CALLBACK (highlighter_settings_changed_cb), NULL);
+		g_signal_connect (highlighter.mail_settings, "changed::monospace-font",
+			G_CALLBACK (highlighter_settings_changed_cb), NULL);
+		g_signal_connect (highlighter.interface_settings, "changed::monospace-font-name",
+			G_CALLBACK (highlighter_settings_changed_cb), NULL);
+		g_signal_connect (highlighter.highlight_settings, "changed::theme",
+			G_CALLBACK (highlighter_settings_changed_cb), NULL);
+	}
+
+	if (highlighter.font_family && highlighter.theme)
+		return;
+
+	if (g_settings_get_boolean (highlighter.mail_settings, "use-custom-font"))
+		font = g_settings_get_string (highlighter.mail_settings, "monospace-font");
+
+	if (!font || !*font) {
+		g_free (font);
+		font = g_settings_get_string (highlighter.interface_settings, "monospace-font-name");
+	}
+
+	if (!font || !*font) {
+		g_free (font);
+		font = g_strdup ("monospace 10");
+	}
+
+	fd = pango_font_description_from_string (font);
+
+	g_free (highlighter.font_family);
+	highlighter.font_family = g_strdup (pango_font_description_get_family (fd));
+	highlighter.font_size = pango_font_description_get_size (fd) / PANGO_SCALE;
+
+	pango_font_description_free (fd);
+	g_free (font);
+
+	g_free (highlighter.theme);
+	highlighter.theme = g_settings_get_string (highlighter.highlight_settings, "theme");
+
+	if (!highlighter.theme || !*highlighter.theme) {
+		g_free (highlighter.theme);
+		highlighter.theme = g_strdup ("bclear");
+	}
+}
+
+/* Call with the 'highlighter' lock held */
+static GBytes *
+highlighter_cache_lookup_locked (const gchar *key)
+{
+	GList *link;
+
+	for (link = highlighter.cache.head; link; link = g_list_next (link)) {
+		CacheEntry *entry = link->data;
+
+		if (g_strcmp0 (entry->key, key) == 0) {
+			/* Move it to the front, as the most recently used */
+			g_queue_unlink (&highlighter.cache, link);
+			g_queue_push_head_link (&highlighter.cache, link);
+
+			return g_bytes_ref (entry->bytes);
+		}
+	}
+
+	return NULL;
+}
+
+/* Call with the 'highlighter' lock held */
+static void
+highlighter_cache_add_locked (const gchar *key,
+			      GBytes *bytes)
+{
+	CacheEntry *entry;
+	gsize size;
+
+	size = g_bytes_get_size (bytes);
+
+	/* Do not let one large part evict everything else */
+	if (size > HIGHLIGHTER_CACHE_MAX_BYTES / 4)
+		return;
+
+	entry = g_new0 (CacheEntry, 1);
+	entry->key = g_strdup (key);
+	entry->bytes = g_bytes_ref (bytes);
+
+	g_queue_push_head (&highlighter.cache, entry);
+	highlighter.cache_size += size;
+
+	while (highlighter.cache.length > HIGHLIGHTER_CACHE_MAX_ENTRIES ||
+	       highlighter.cache_size > HIGHLIGHTER_CACHE_MAX_BYTES) {
+		entry = g_queue_pop_tail (&highlighter.cache);
+		highlighter.cache_size -= g_bytes_get_size (entry->bytes);
+		cache_entry_free (entry);
+	}
+}
+
+static void
+highlighter_cancelled_cb (GCancellable *cancellable,
+			  gpointer user_data)
+{
+	/* Wake up the waiting requests, thus they can give up */
+	G_LOCK (highlighter);
+	g_cond_broadcast (&highlighter_cond);
+	G_UNLOCK (highlighter);
+}
+
+/* Decodes the content into UTF-8, which the 'highlight' expects;
+   it can cope with non-UTF-8 letters, thus no need for a content
+   UTF-8-validation */
+static GBytes *
+highlighter_decode_content (CamelDataWrapper *data_wrapper,
+			    GCancellable *cancellable,
+			    GError **error)
+{
+	CamelContentType *content_type;
+	CamelStream *mem_stream, *write_stream;
+	GByteArray *byte_array;
+	GBytes *bytes = NULL;
+
+	byte_array = g_byte_array_new ();
+	mem_stream = camel_stream_mem_new ();
+	camel_stream_mem_set_byte_array (CAMEL_STREAM_MEM (mem_stream), byte_array);
+
+	write_stream = g_object_ref (mem_stream);
+
+	content_type = camel_data_wrapper_get_mime_type_field (data_wrapper);
+	if (content_type) {
+		const gchar *charset = camel_content_type_param (content_type, "charset");
+
+		if (charset && g_ascii_strcasecmp (charset, "utf-8") != 0) {
+			CamelMimeFilter *filter;
+
+			filter = camel_mime_filter_charset_new (charset, "UTF-8");
+			if (filter != NULL) {
+				CamelStream *filtered = camel_stream_filter_new (write_stream);
+
+				if (filtered) {
+					camel_stream_filter_add (CAMEL_STREAM_FILTER (filtered), filter);
+					g_object_unref (write_stream);
+					write_stream = filtered;
+				}
+
+				g_object_unref (filter);
+			}
+		}
+	}
+
+	if (camel_data_wrapper_decode_to_stream_sync (data_wrapper, write_stream, cancellable, error) >= 0 &&
+	    camel_stream_flush (write_stream, cancellable, error) == 0) {
+		bytes = g_bytes_new (byte_array->data, byte_array->len);
+	}
+
+	g_object_unref (write_stream);
+	/* The stream does not own the byte array */
+	g_object_unref (mem_stream);
+	g_byte_array_free (byte_array, TRUE);
+
+	return bytes;
+}
+
+static GBytes *
+highlighter_run (GBytes *content,
+		 const gchar *syntax,
+		 const gchar *font_family,
+		 gint font_size,
+		 const gchar *theme,
+		 GCancellable *cancellable,
+		 GError **error)
+{
+	GSubprocess *subprocess;
+	GBytes *stdout_bytes = NULL;
+	gchar *font_family_arg, *font_size_arg, *syntax_arg, *theme_arg;
+
+	font_family_arg = g_strdup_printf ("--font='%s'", font_family);
+	font_size_arg = g_strdup_printf ("--font-size=%d", font_size);
+	syntax_arg = g_strdup_printf ("--syntax=%s", syntax);
+	theme_arg = g_strdup_printf ("--style=%s", theme);
+
+	subprocess = g_subprocess_new (
+		G_SUBPROCESS_FLAGS_STDIN_PIPE |
+		G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+		G_SUBPROCESS_FLAGS_STDERR_SILENCE,
+		error,
+		HIGHLIGHT_COMMAND,
+		font_family_arg,
+		font_size_arg,
+		syntax_arg,
+		theme_arg,
+		"--out-format=html",
+		"--include-style",
+		"--inline-css",
+		"--encoding=none",
+		"--failsafe",
+		NULL);
+
+	if (subprocess) {
+		if (!g_subprocess_communicate (subprocess, content, cancellable, &stdout_bytes, NULL, error)) {
+			g_subprocess_force_exit (subprocess);
+			g_clear_pointer (&stdout_bytes, g_bytes_unref);
+		}
+
+		g_object_unref (subprocess);
+	}
+
+	g_free (font_family_arg);
+	g_free (font_size_arg);
+	g_free (syntax_arg);
+	g_free (theme_arg);
+
+	return stdout_bytes;
+}
+
+/* Highlights the content of the data_wrapper as the syntax and writes
+   the result into the output_stream. The results are cached, keyed by
+   the content, the syntax and the current theme and font, thus showing
+   the same part again does not need to run the 'highlight' again. */
+gboolean
+highlighter_format (CamelDataWrapper *data_wrapper,
+		    const gchar *syntax,
+		    GOutputStream *output_stream,
+		    GCancellable *cancellable,
+		    GError **error)
+{
+	GBytes *content, *result;
+	gchar *content_hash, *key, *font_family, *theme;
+	gint font_size;
+	gulong cancelled_id = 0;
+	gboolean success;
+
+	g_return_val_if_fail (CAMEL_IS_DATA_WRAPPER (data_wrapper), FALSE);
+	g_return_val_if_fail (syntax != NULL, FALSE);
+	g_return_val_if_fail (G_IS_OUTPUT_STREAM (output_stream), FALSE);
+
+	content = highlighter_decode_content (data_wrapper, cancellable, error);
+	if (!content)
+		return FALSE;
+
+	content_hash = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, content);
+
+	if (cancellable)
+		cancelled_id = g_cancellable_connect (cancellable, G_CALLBACK (highlighter_cancelled_cb), NULL, NULL);
+
+	G_LOCK (highlighter);
+
+	highlighter_ensure_options_locked ();
+
+	font_family = g_strdup (highlighter.font_family);
+	font_size = highlighter.font_size;
+	theme = g_strdup (highlighter.theme);
+
+	key = g_strdup_printf ("%s\n%s\n%s\n%s\n%d", content_hash, syntax, theme, font_family, font_size);
+
+	/* Wait for a free slot, or for the same request run by another thread */
+	while (result = highlighter_cache_lookup_locked (key), !result &&
+	       (highlighter.n_running >= HIGHLIGHTER_MAX_JOBS ||
+	        g_hash_table_contains (highlighter.running, key)) &&
+	       !g_cancellable_is_cancelled (cancellable)) {
+		g_cond_wait (&highlighter_cond, &G_LOCK_NAME (highlighter));
+	}
+
+	if (!result && !g_cancellable_is_cancelled (cancellable)) {
+		g_hash_table_add (highlighter.running, g_strdup (key));
+		highlighter.n_running++;
+
+		G_UNLOCK (highlighter);
+
+		result = highlighter_run (content, syntax, font_family, font_size, theme, cancellable, error);
+
+		G_LOCK (highlighter);
+
+		g_hash_table_remove (highlighter.running, key);
+		highlighter.n_running--;
+
+		/* Do not cache when the settings changed meanwhile */
+		if (result && g_bytes_get_size (result) > 0 &&
+		    g_strcmp0 (theme, highlighter.theme) == 0 &&
+		    g_strcmp0 (font_family, highlighter.font_family) == 0 &&
+		    font_size == highlighter.font_size)
+			highlighter_cache_add_locked (key, result);
+
+		g_cond_broadcast (&highlighter_cond);
+	}
+
+	G_UNLOCK (highlighter);
+
+	if (cancelled_id)
+		g_cancellable_disconnect (cancellable, cancelled_id);
+
+	if (!result && (!error || !*error))
+		g_cancellable_set_error_if_cancelled (cancellable, error);
+
+	success = result && g_bytes_get_size (result) > 0 &&
+		g_output_stream_write_all (output_stream, HIGHLIGHTER_STYLE, strlen (HIGHLIGHTER_STYLE), NULL, cancellable, error) &&
+		g_output_stream_write_all (output_stream, g_bytes_get_data (result, NULL), g_bytes_get_size (result), NULL, cancellable, error);
+
+	if (result)
+		g_bytes_unref (result);
+	g_bytes_unref (content);
+	g_free (content_hash);
+	g_free (font_family);
+	g_free (theme);
+	g_free (key);
+
+	return success;
+}
@@ -0,0 +1,30 @@
+/*
+ * highlighter.h
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HIGHLIGHTER_H
+#define HIGHLIGHTER_H
+
+#include <gio/gio.h>
+#include <camel/camel.h>
+
+gboolean	highlighter_format		(CamelDataWrapper *data_wrapper,
+						 const gchar *syntax,
+						 GOutputStream *output_stream,
+						 GCancellable *cancellable,
+						 GError **error);
+
+#endif /* HIGHLIGHTER_H */
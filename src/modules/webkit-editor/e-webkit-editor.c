@@ -178,6 +178,10 @@ struct _EWebKitEditorPrivate {
 
 	GError *last_error;
 
+	/* Editor commands waiting to be sent to the web process in one script */
+	GString *pending_scripts;
+	guint flush_scripts_id;
+
 	gint minimum_font_size;
 	EHTMLLinkToText link_to_text;
 };
@@ -264,6 +268,114 @@ webkit_editor_call_jsc_sync (EWebKitEditor *wk_editor,
 			     const gchar *script_format,
 			     ...) G_GNUC_PRINTF (2, 3);
 
+/* Sends all the queued commands to the web process as one script,
+   which coalesces also the formatting state changes into one reply. */
+static void
+webkit_editor_flush_scripts (EWebKitEditor *wk_editor)
+{
+	GString *script;
+
+	if (wk_editor->priv->flush_scripts_id) {
+		g_source_remove (wk_editor->priv->flush_scripts_id);
+		wk_editor->priv->flush_scripts_id = 0;
+	}
+
+	if (!wk_editor->priv->pending_scripts)
+		return;
+
+	script = wk_editor->priv->pending_scripts;
+	wk_editor->priv->pending_scripts = NULL;
+
+	g_string_append (script, "]);");
+
+	e_web_view_jsc_run_script_take (WEBKIT_WEB_VIEW (wk_editor),
+		g_string_free (script, FALSE),
+		wk_editor->priv->cancellable);
+}
+
+static gboolean
+webkit_editor_flush_scripts_idle_cb (gpointer user_data)
+{
+	EWebKitEditor *wk_editor = user_data;
+
+	wk_editor->priv->flush_scripts_id = 0;
+
+	webkit_editor_flush_scripts (wk_editor);
+
+	return FALSE;
+}
+
+/* Assumes ownership of the 'script' */
+static void
+webkit_editor_queue_script_take (EWebKitEditor *wk_editor,
+				 gchar *script)
+{
+	g_return_if_fail (E_IS_WEBKIT_EDITOR (wk_editor));
+	g_return_if_fail (script != NULL);
+
+	if (!wk_editor->priv->pending_scripts)
+		wk_editor->priv->pending_scripts = g_string_new ("EvoEditor.RunBatch([");
+	else
+		g_string_append_c (wk_editor->priv->pending_scripts, ',');
+
+	g_string_append (wk_editor->priv->pending_scripts, "function() {\n");
+	g_string_append (wk_editor->priv->pending_scripts, script);
+	g_string_append (wk_editor->priv->pending_scripts, "\n}");
+
+	g_free (script);
+
+	/* Run before the next redraw, thus all the commands issued
+	   by one user action end in the same batch. */
+	if (!wk_editor->priv->flush_scripts_id) {
+		wk_editor->priv->flush_scripts_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+			webkit_editor_flush_scripts_idle_cb, wk_editor, NULL);
+	}
+}
+
+static void
+webkit_editor_queue_script (EWebKitEditor *wk_editor,
+			    const gchar *script_format,
+			    ...) G_GNUC_PRINTF (2, 3);
+
+static void
+webkit_editor_queue_script (EWebKitEditor *wk_editor,
+			    const gchar *script_format,
+			    ...)
+{
+	gchar *script;
+	va_list va;
+
+	g_return_if_fail (E_IS_WEBKIT_EDITOR (wk_editor));
+	g_return_if_fail (script_format != NULL);
+
+	va_start (va, script_format);
+	script = e_web_view_jsc_vprintf_script (script_format, va);
+	va_end (va);
+
+	webkit_editor_queue_script_take (wk_editor, script);
+}
+
+/* Editing commands bypass the scripts, thus the queued
+   commands need to be sent first to keep their order. */
+static void
+webkit_editor_execute_editing_command (EWebKitEditor *wk_editor,
+				       const gchar *command)
+{
+	webkit_editor_flush_scripts (wk_editor);
+
+	webkit_web_view_execute_editing_command (WEBKIT_WEB_VIEW (wk_editor), command);
+}
+
+static void
+webkit_editor_execute_editing_command_with_argument (EWebKitEditor *wk_editor,
+						     const gchar *command,
+						     const gchar *argument)
+{
+	webkit_editor_flush_scripts (wk_editor);
+
+	webkit_web_view_execute_editing_command_with_argument (WEBKIT_WEB_VIEW (wk_editor), command, argument);
+}
+
 typedef struct _JSCCallData {
 	EWebKitEditorFlag *flag;
 	gchar *script;
@@ -328,6 +440,9 @@ webkit_editor_call_jsc_sync (EWebKitEditor *wk_editor,
 	jcd.flag = g_object_new (e_webkit_editor_flag_get_type (), NULL);
 	jcd.result = NULL;
 
+	/* The queued commands are not waited for, they only go first */
+	webkit_editor_flush_scripts (wk_editor);
+
 	webkit_web_view_run_javascript (WEBKIT_WEB_VIEW (wk_editor), jcd.script, wk_editor->priv->cancellable,
 		webkit_editor_jsc_call_done_cb, &jcd);
 
@@ -448,11 +563,11 @@ webkit_editor_dialog_utils_set_attribute (EWebKitEditor *wk_editor,
 	g_return_if_fail (name != NULL);
 
 	if (value) {
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.DialogUtilsSetAttribute(%s, %s, %s);",
 			selector, name, value);
 	} else {
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.DialogUtilsSetAttribute(%s, %s, null);",
 			selector, name);
 	}
@@ -505,11 +620,11 @@ webkit_editor_dialog_utils_set_table_attribute (EWebKitEditor *wk_editor,
 	g_return_if_fail (name != NULL);
 
 	if (value) {
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.DialogUtilsTableSetAttribute(%d, %s, %s);",
 			scope, name, value);
 	} else {
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.DialogUtilsTableSetAttribute(%d, %s, null);",
 			scope, name);
 	}
@@ -1672,7 +1787,7 @@ webkit_editor_set_page_color_attribute (EContentEditor *editor,
 				attr_name,
 				color);
 		} else {
-			e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+			webkit_editor_queue_script (wk_editor,
 				"EvoEditor.SetBodyAttribute(%s, %s);",
 				attr_name,
 				color);
@@ -1682,7 +1797,7 @@ webkit_editor_set_page_color_attribute (EContentEditor *editor,
 			"document.documentElement.removeAttribute(%s);\n",
 			attr_name);
 	} else {
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.SetBodyAttribute(%s, null);",
 			attr_name);
 	}
@@ -1784,7 +1899,7 @@ webkit_editor_page_set_font_name (EContentEditor *editor,
 {
 	EWebKitEditor *wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.SetBodyFontName(%s);",
 		value ? value : "");
 }
@@ -1915,9 +2030,7 @@ webkit_editor_style_updated (EWebKitEditor *wk_editor,
 		"EvoEditor.UpdateThemeStyleSheet(%s);",
 		css->str);
 
-	e_web_view_jsc_run_script_take (WEBKIT_WEB_VIEW (wk_editor),
-		g_string_free (script, FALSE),
-		wk_editor->priv->cancellable);
+	webkit_editor_queue_script_take (wk_editor, g_string_free (script, FALSE));
 
 	g_string_free (css, TRUE);
 }
@@ -1972,10 +2085,10 @@ webkit_editor_set_mode (EWebKitEditor *wk_editor,
 	wk_editor->priv->mode = mode;
 
 	if (mode == E_CONTENT_EDITOR_MODE_HTML) {
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.SetMode(EvoEditor.MODE_HTML);");
 	} else {
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.SetMode(EvoEditor.MODE_PLAIN_TEXT);");
 	}
 
@@ -2015,17 +2128,17 @@ webkit_editor_insert_content (EContentEditor *editor,
 
 	if ((flags & E_CONTENT_EDITOR_INSERT_CONVERT) &&
 	    !(flags & E_CONTENT_EDITOR_INSERT_REPLACE_ALL)) {
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.InsertContent(%s, %x, %x, %x);",
 			content, (flags & E_CONTENT_EDITOR_INSERT_TEXT_HTML) != 0, FALSE, prefer_pre);
 	} else if ((flags & E_CONTENT_EDITOR_INSERT_REPLACE_ALL) &&
 		   (flags & E_CONTENT_EDITOR_INSERT_TEXT_HTML)) {
 		if ((strstr (content, "data-evo-draft") ||
 		     strstr (content, "data-evo-signature-plain-text-mode"))) {
-			e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+			webkit_editor_queue_script (wk_editor,
 				"EvoEditor.LoadHTML(%s);", content);
 			if (cleanup_sig_id)
-				e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable, "EvoEditor.CleanupSignatureID();");
+				webkit_editor_queue_script (wk_editor, "EvoEditor.CleanupSignatureID();");
 			return;
 		}
 
@@ -2035,16 +2148,16 @@ webkit_editor_insert_content (EContentEditor *editor,
 			    !strstr (content, "<!-- disable-format-prompt -->")) {
 				if (!show_lose_formatting_dialog (wk_editor)) {
 					webkit_editor_set_mode (wk_editor, E_CONTENT_EDITOR_MODE_HTML);
-					e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+					webkit_editor_queue_script (wk_editor,
 						"EvoEditor.LoadHTML(%s);", content);
 					if (cleanup_sig_id)
-						e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable, "EvoEditor.CleanupSignatureID();");
+						webkit_editor_queue_script (wk_editor, "EvoEditor.CleanupSignatureID();");
 					return;
 				}
 			}
 		}
 
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.LoadHTML(%s);", content);
 	} else if ((flags & E_CONTENT_EDITOR_INSERT_REPLACE_ALL) &&
 		   (flags & E_CONTENT_EDITOR_INSERT_TEXT_PLAIN)) {
@@ -2072,19 +2185,19 @@ webkit_editor_insert_content (EContentEditor *editor,
 
 		html = g_strjoinv ("", lines);
 
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.LoadHTML(%s);", html);
 
 		g_strfreev (lines);
 		g_free (html);
 	} else if ((flags & E_CONTENT_EDITOR_INSERT_QUOTE_CONTENT) &&
 		   !(flags & E_CONTENT_EDITOR_INSERT_REPLACE_ALL)) {
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.InsertContent(%s, %x, %x, %x);",
 			content, (flags & E_CONTENT_EDITOR_INSERT_TEXT_HTML) != 0, TRUE, prefer_pre);
 	} else if (!(flags & E_CONTENT_EDITOR_INSERT_CONVERT) &&
 		   !(flags & E_CONTENT_EDITOR_INSERT_REPLACE_ALL)) {
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.InsertContent(%s, %x, %x, %x);",
 			content, (flags & E_CONTENT_EDITOR_INSERT_TEXT_HTML) != 0, FALSE, prefer_pre);
 	} else {
@@ -2092,7 +2205,7 @@ webkit_editor_insert_content (EContentEditor *editor,
 	}
 
 	if (cleanup_sig_id)
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable, "EvoEditor.CleanupSignatureID();");
+		webkit_editor_queue_script (wk_editor, "EvoEditor.CleanupSignatureID();");
 
 	if (flags & E_CONTENT_EDITOR_INSERT_REPLACE_ALL)
 		webkit_editor_style_updated (wk_editor, TRUE);
@@ -2113,6 +2226,8 @@ webkit_editor_get_content (EContentEditor *editor,
 	cid_uid_prefix = camel_header_msgid_generate (inline_images_from_domain ? inline_images_from_domain : "");
 	script = e_web_view_jsc_printf_script ("EvoEditor.GetContent(%d, %s, %s)", flags, cid_uid_prefix, DEFAULT_CSS_STYLE);
 
+	webkit_editor_flush_scripts (E_WEBKIT_EDITOR (editor));
+
 	webkit_web_view_run_javascript (WEBKIT_WEB_VIEW (editor), script, cancellable, callback, user_data);
 
 	g_free (cid_uid_prefix);
@@ -2268,7 +2383,7 @@ webkit_editor_undo (EContentEditor *editor)
 
 	wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoUndoRedo.Undo();");
 }
 
@@ -2289,7 +2404,7 @@ webkit_editor_redo (EContentEditor *editor)
 
 	wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoUndoRedo.Redo();");
 }
 
@@ -2305,7 +2420,7 @@ webkit_editor_move_caret_on_coordinates (EContentEditor *editor,
 
 	wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.MoveSelectionToPoint(%d, %d, %x);",
 		xx, yy, cancel_if_not_collapsed);
 }
@@ -2339,7 +2454,7 @@ webkit_editor_insert_emoticon (EContentEditor *editor,
 
 	wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.InsertEmoticon(%s, %s, %d, %d);",
 		text, image_uri, width, height);
 
@@ -2356,8 +2471,7 @@ webkit_editor_select_all (EContentEditor *editor)
 
 	wk_editor = E_WEBKIT_EDITOR (editor);
 
-	webkit_web_view_execute_editing_command (
-		WEBKIT_WEB_VIEW (wk_editor), WEBKIT_EDITING_COMMAND_SELECT_ALL);
+	webkit_editor_execute_editing_command (wk_editor, WEBKIT_EDITING_COMMAND_SELECT_ALL);
 }
 
 static void
@@ -2369,7 +2483,7 @@ webkit_editor_selection_wrap (EContentEditor *editor)
 
 	wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.WrapSelection();");
 }
 
@@ -2388,7 +2502,7 @@ webkit_editor_selection_indent (EContentEditor *editor)
 
 	wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.Indent(true);");
 }
 
@@ -2399,20 +2513,20 @@ webkit_editor_selection_unindent (EContentEditor *editor)
 
 	wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.Indent(false);");
 }
 
 static void
 webkit_editor_cut (EContentEditor *editor)
 {
-	webkit_web_view_execute_editing_command (WEBKIT_WEB_VIEW (editor), WEBKIT_EDITING_COMMAND_CUT);
+	webkit_editor_execute_editing_command (E_WEBKIT_EDITOR (editor), WEBKIT_EDITING_COMMAND_CUT);
 }
 
 static void
 webkit_editor_copy (EContentEditor *editor)
 {
-	webkit_web_view_execute_editing_command (WEBKIT_WEB_VIEW (editor), WEBKIT_EDITING_COMMAND_COPY);
+	webkit_editor_execute_editing_command (E_WEBKIT_EDITOR (editor), WEBKIT_EDITING_COMMAND_COPY);
 }
 
 static ESpellChecker *
@@ -2454,7 +2568,7 @@ webkit_editor_set_start_bottom (EWebKitEditor *wk_editor,
 
 	wk_editor->priv->start_bottom = value;
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.START_BOTTOM = %x;",
 		e_content_editor_util_three_state_to_bool (value, "composer-reply-start-bottom"));
 
@@ -2643,7 +2757,7 @@ webkit_editor_clear_undo_redo_history (EContentEditor *editor)
 
 	wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoUndoRedo.Clear();");
 }
 
@@ -2657,7 +2771,7 @@ webkit_editor_replace_caret_word (EContentEditor *editor,
 
 	wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.ReplaceCaretWord(%s);", replacement);
 }
 
@@ -2716,7 +2830,7 @@ webkit_editor_replace (EContentEditor *editor,
 
 	wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.ReplaceSelection(%s);", replacement);
 }
 
@@ -2742,7 +2856,7 @@ webkit_find_controller_found_text_cb (WebKitFindController *find_controller,
 		/* Repeatedly search for 'word', then replace selection by
 		 * 'replacement'. Repeat until there's at least one occurrence of
 		 * 'word' in the document */
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.ReplaceSelection(%s);", wk_editor->priv->replace_with);
 
 		g_idle_add ((GSourceFunc) search_next_on_idle, wk_editor);
@@ -2760,7 +2874,7 @@ webkit_find_controller_failed_to_find_text_cb (WebKitFindController *find_contro
 	if (wk_editor->priv->performing_replace_all) {
 		guint replaced_count = wk_editor->priv->replaced_count;
 
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoUndoRedo.StopRecord(EvoUndoRedo.RECORD_KIND_GROUP, %s);", "ReplaceAll");
 
 		webkit_editor_finish_search (wk_editor);
@@ -2856,10 +2970,10 @@ webkit_editor_replace_all (EContentEditor *editor,
 	wk_editor->priv->performing_replace_all = TRUE;
 	wk_editor->priv->replaced_count = 0;
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoUndoRedo.StartRecord(EvoUndoRedo.RECORD_KIND_GROUP, %s);", "ReplaceAll");
 
-	webkit_web_view_execute_editing_command (WEBKIT_WEB_VIEW (wk_editor), "MoveToBeginningOfDocumentAndModifySelection");
+	webkit_editor_execute_editing_command (wk_editor, "MoveToBeginningOfDocumentAndModifySelection");
 
 	webkit_find_controller_search (wk_editor->priv->find_controller, find_text, wk_options, G_MAXUINT);
 }
@@ -2873,7 +2987,7 @@ webkit_editor_selection_save (EContentEditor *editor)
 
 	wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.StoreSelection();");
 }
 
@@ -2886,7 +3000,7 @@ webkit_editor_selection_restore (EContentEditor *editor)
 
 	wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.RestoreSelection();");
 }
 
@@ -2896,7 +3010,7 @@ webkit_editor_on_dialog_open (EContentEditor *editor,
 {
 	EWebKitEditor *wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.OnDialogOpen(%s);", name);
 
 	if (g_strcmp0 (name, E_CONTENT_EDITOR_DIALOG_SPELLCHECK) == 0) {
@@ -2928,7 +3042,7 @@ webkit_editor_on_dialog_open (EContentEditor *editor,
 
 			*ptr = '\0';
 
-			e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+			webkit_editor_queue_script (wk_editor,
 				"EvoEditor.SetSpellCheckLanguages(%s);", langs);
 
 			g_slice_free1 (len, langs);
@@ -2943,7 +3057,7 @@ webkit_editor_on_dialog_close (EContentEditor *editor,
 {
 	EWebKitEditor *wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.OnDialogClose(%s);", name);
 
 	if (g_strcmp0 (name, E_CONTENT_EDITOR_DIALOG_SPELLCHECK) == 0 ||
@@ -2957,7 +3071,7 @@ webkit_editor_delete_cell_contents (EContentEditor *editor)
 {
 	EWebKitEditor *wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"var arr = EvoEditor.RemoveCurrentElementAttr();"
 		"EvoEditor.DialogUtilsCurrentElementFromFocus(\"TABLE*\");"
 		"EvoEditor.DialogUtilsTableDeleteCellContent();"
@@ -2970,7 +3084,7 @@ webkit_editor_delete_column (EContentEditor *editor)
 {
 	EWebKitEditor *wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"var arr = EvoEditor.RemoveCurrentElementAttr();"
 		"EvoEditor.DialogUtilsCurrentElementFromFocus(\"TABLE*\");"
 		"EvoEditor.DialogUtilsTableDeleteColumn();"
@@ -2983,7 +3097,7 @@ webkit_editor_delete_row (EContentEditor *editor)
 {
 	EWebKitEditor *wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"var arr = EvoEditor.RemoveCurrentElementAttr();"
 		"EvoEditor.DialogUtilsCurrentElementFromFocus(\"TABLE*\");"
 		"EvoEditor.DialogUtilsTableDeleteRow();"
@@ -2996,7 +3110,7 @@ webkit_editor_delete_table (EContentEditor *editor)
 {
 	EWebKitEditor *wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"var arr = EvoEditor.RemoveCurrentElementAttr();"
 		"EvoEditor.DialogUtilsCurrentElementFromFocus(\"TABLE*\");"
 		"EvoEditor.DialogUtilsTableDelete();"
@@ -3011,7 +3125,7 @@ webikt_editor_call_table_insert (EContentEditor *editor,
 {
 	EWebKitEditor *wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"var arr = EvoEditor.RemoveCurrentElementAttr();"
 		"EvoEditor.DialogUtilsCurrentElementFromFocus(\"TABLE*\");"
 		"EvoEditor.DialogUtilsTableInsert(%s, %d);"
@@ -3025,7 +3139,7 @@ webkit_editor_delete_h_rule (EContentEditor *editor)
 {
 	EWebKitEditor *wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.DialogUtilsContextElementDelete();");
 }
 
@@ -3034,7 +3148,7 @@ webkit_editor_delete_image (EContentEditor *editor)
 {
 	EWebKitEditor *wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.DialogUtilsContextElementDelete();");
 }
 
@@ -3165,7 +3279,7 @@ webkit_editor_insert_image (EContentEditor *editor,
 		}
 	}
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.InsertImage(%s, %d, %d);",
 		image_uri, width, height);
 }
@@ -3175,7 +3289,7 @@ webkit_editor_replace_image_src (EWebKitEditor *wk_editor,
                                  const gchar *selector,
                                  const gchar *image_uri)
 {
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.ReplaceImageSrc(%s, %s);",
 		selector,
 		image_uri);
@@ -3213,7 +3327,7 @@ webkit_editor_image_set_url (EContentEditor *editor,
 {
 	EWebKitEditor *wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.DialogUtilsSetImageUrl(%s);",
 		value);
 }
@@ -3343,7 +3457,7 @@ webkit_editor_selection_unlink (EContentEditor *editor)
 {
 	EWebKitEditor *wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.Unlink();");
 }
 
@@ -3355,7 +3469,7 @@ webkit_editor_link_set_properties (EContentEditor *editor,
 {
 	EWebKitEditor *wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.LinkSetProperties(%s, %s, %s);",
 		href, text, name);
 }
@@ -3390,7 +3504,7 @@ webkit_editor_set_alignment (EWebKitEditor *wk_editor,
 {
 	g_return_if_fail (E_IS_WEBKIT_EDITOR (wk_editor));
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.SetAlignment(%d);",
 		value);
 }
@@ -3409,7 +3523,7 @@ webkit_editor_set_block_format (EWebKitEditor *wk_editor,
 {
 	g_return_if_fail (E_IS_WEBKIT_EDITOR (wk_editor));
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.SetBlockFormat(%d);",
 		value);
 }
@@ -3444,7 +3558,7 @@ webkit_editor_set_background_color (EWebKitEditor *wk_editor,
 		wk_editor->priv->background_color = NULL;
 	}
 
-	webkit_web_view_execute_editing_command_with_argument (WEBKIT_WEB_VIEW (wk_editor), "BackColor", color);
+	webkit_editor_execute_editing_command_with_argument (wk_editor, "BackColor", color);
 }
 
 static const GdkRGBA *
@@ -3464,7 +3578,7 @@ webkit_editor_set_font_name (EWebKitEditor *wk_editor,
 {
 	g_return_if_fail (E_IS_WEBKIT_EDITOR (wk_editor));
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.SetFontName(%s);",
 		value ? value : "");
 }
@@ -3494,7 +3608,7 @@ webkit_editor_set_font_color (EWebKitEditor *wk_editor,
 
 	webkit_editor_utils_color_to_string (color, sizeof (color), value);
 
-	webkit_web_view_execute_editing_command_with_argument (WEBKIT_WEB_VIEW (wk_editor), "ForeColor",
+	webkit_editor_execute_editing_command_with_argument (wk_editor, "ForeColor",
 		webkit_editor_utils_color_to_string (color, sizeof (color), value));
 }
 
@@ -3527,7 +3641,7 @@ webkit_editor_set_font_size (EWebKitEditor *wk_editor,
 		return;
 	}
 
-	webkit_web_view_execute_editing_command_with_argument (WEBKIT_WEB_VIEW (wk_editor), "FontSize", sz);
+	webkit_editor_execute_editing_command_with_argument (wk_editor, "FontSize", sz);
 }
 
 static gint
@@ -3552,22 +3666,22 @@ webkit_editor_set_style_flag (EWebKitEditor *wk_editor,
 	case E_WEBKIT_EDITOR_STYLE_NONE:
 		break;
 	case E_WEBKIT_EDITOR_STYLE_IS_BOLD:
-		webkit_web_view_execute_editing_command (WEBKIT_WEB_VIEW (wk_editor), "Bold");
+		webkit_editor_execute_editing_command (wk_editor, "Bold");
 		break;
 	case E_WEBKIT_EDITOR_STYLE_IS_ITALIC:
-		webkit_web_view_execute_editing_command (WEBKIT_WEB_VIEW (wk_editor), "Italic");
+		webkit_editor_execute_editing_command (wk_editor, "Italic");
 		break;
 	case E_WEBKIT_EDITOR_STYLE_IS_UNDERLINE:
-		webkit_web_view_execute_editing_command (WEBKIT_WEB_VIEW (wk_editor), "Underline");
+		webkit_editor_execute_editing_command (wk_editor, "Underline");
 		break;
 	case E_WEBKIT_EDITOR_STYLE_IS_STRIKETHROUGH:
-		webkit_web_view_execute_editing_command (WEBKIT_WEB_VIEW (wk_editor), "Strikethrough");
+		webkit_editor_execute_editing_command (wk_editor, "Strikethrough");
 		break;
 	case E_WEBKIT_EDITOR_STYLE_IS_SUBSCRIPT:
-		webkit_web_view_execute_editing_command (WEBKIT_WEB_VIEW (wk_editor), "Subscript");
+		webkit_editor_execute_editing_command (wk_editor, "Subscript");
 		break;
 	case E_WEBKIT_EDITOR_STYLE_IS_SUPERSCRIPT:
-		webkit_web_view_execute_editing_command (WEBKIT_WEB_VIEW (wk_editor), "Superscript");
+		webkit_editor_execute_editing_command (wk_editor, "Superscript");
 		break;
 	}
 
@@ -3657,7 +3771,7 @@ webkit_editor_cell_set_header_style (EContentEditor *editor,
 
 	wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.DialogUtilsTableSetHeader(%d, %x);",
 		scope, value);
 }
@@ -3761,7 +3875,7 @@ webkit_editor_table_set_row_count (EContentEditor *editor,
 {
 	EWebKitEditor *wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.DialogUtilsTableSetRowCount(%d);",
 		value);
 }
@@ -3780,7 +3894,7 @@ webkit_editor_table_set_column_count (EContentEditor *editor,
 {
 	EWebKitEditor *wk_editor = E_WEBKIT_EDITOR (editor);
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.DialogUtilsTableSetColumnCount(%d);",
 		value);
 }
@@ -3997,7 +4111,7 @@ webkit_editor_set_normal_paragraph_width (EWebKitEditor *wk_editor,
 	if (wk_editor->priv->normal_paragraph_width != value) {
 		wk_editor->priv->normal_paragraph_width = value;
 
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.SetNormalParagraphWidth(%d);",
 			value);
 
@@ -4022,7 +4136,7 @@ webkit_editor_set_magic_links (EWebKitEditor *wk_editor,
 	if ((wk_editor->priv->magic_links ? 1 : 0) != (value ? 1 : 0)) {
 		wk_editor->priv->magic_links = value;
 
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.MAGIC_LINKS = %x;",
 			value);
 
@@ -4047,7 +4161,7 @@ webkit_editor_set_magic_smileys (EWebKitEditor *wk_editor,
 	if ((wk_editor->priv->magic_smileys ? 1 : 0) != (value ? 1 : 0)) {
 		wk_editor->priv->magic_smileys = value;
 
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.MAGIC_SMILEYS = %x;",
 			value);
 
@@ -4072,7 +4186,7 @@ webkit_editor_set_unicode_smileys (EWebKitEditor *wk_editor,
 	if ((wk_editor->priv->unicode_smileys ? 1 : 0) != (value ? 1 : 0)) {
 		wk_editor->priv->unicode_smileys = value;
 
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.UNICODE_SMILEYS = %x;",
 			value);
 
@@ -4097,7 +4211,7 @@ webkit_editor_set_wrap_quoted_text_in_replies (EWebKitEditor *wk_editor,
 	if ((wk_editor->priv->wrap_quoted_text_in_replies ? 1 : 0) != (value ? 1 : 0)) {
 		wk_editor->priv->wrap_quoted_text_in_replies = value;
 
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.WRAP_QUOTED_TEXT_IN_REPLIES = %x;",
 			value);
 
@@ -4169,7 +4283,7 @@ webkit_editor_set_link_to_text (EWebKitEditor *wk_editor,
 	if (wk_editor->priv->link_to_text != value) {
 		wk_editor->priv->link_to_text = value;
 
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.LINK_TO_TEXT = %d;",
 			value);
 
@@ -4365,6 +4479,7 @@ webkit_editor_constructed (GObject *object)
 
 	g_clear_object (&settings);
 
+	webkit_editor_flush_scripts (wk_editor);
 	webkit_web_view_load_html (WEBKIT_WEB_VIEW (wk_editor), "", "evo-file:///");
 }
 
@@ -4464,6 +4579,16 @@ webkit_editor_dispose (GObject *object)
 	if (self->priv->cancellable)
 		g_cancellable_cancel (self->priv->cancellable);
 
+	if (self->priv->flush_scripts_id) {
+		g_source_remove (self->priv->flush_scripts_id);
+		self->priv->flush_scripts_id = 0;
+	}
+
+	if (self->priv->pending_scripts) {
+		g_string_free (self->priv->pending_scripts, TRUE);
+		self->priv->pending_scripts = NULL;
+	}
+
 	g_clear_pointer (&self->priv->current_user_stylesheet, g_free);
 
 	if (self->priv->font_settings != NULL) {
@@ -5040,7 +5165,7 @@ webkit_editor_load_changed_cb (EWebKitEditor *wk_editor,
 	    !webkit_editor_is_ready (E_CONTENT_EDITOR (wk_editor)))
 		return;
 
-	e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+	webkit_editor_queue_script (wk_editor,
 		"EvoEditor.NORMAL_PARAGRAPH_WIDTH = %d;"
 		"EvoEditor.START_BOTTOM = %x;"
 		"EvoEditor.MAGIC_LINKS = %x;"
@@ -5637,7 +5762,7 @@ webkit_editor_move_to_anchor_idle_cb (gpointer user_data)
 
 	wk_editor = g_weak_ref_get (&data->weakref);
 	if (wk_editor) {
-		e_web_view_jsc_run_script (WEBKIT_WEB_VIEW (wk_editor), wk_editor->priv->cancellable,
+		webkit_editor_queue_script (wk_editor,
 			"EvoEditor.MoveToAnchor(%s);",
 			data->anchor_name);
 